@@ -0,0 +1,164 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_BAMSORTFIXMATESINFO_HPP)
+#define BIOBAMBAM_BAMSORTFIXMATESINFO_HPP
+
+#include <libmaus/bambam/BamAlignment.hpp>
+#include <libmaus/bambam/BamAuxFilterVector.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/util/ArgInfo.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <cctype>
+#include <iostream>
+
+/**
+ * settings for fixing mate information of name collated input before sorting
+ **/
+struct BamSortFixMatesInfo
+{
+	typedef BamSortFixMatesInfo this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	enum tag_type_enum
+	{
+		tag_type_none,
+		tag_type_string,
+		tag_type_nucleotide
+	};
+
+	bool fixmates;
+	bool addMSMC;
+	tag_type_enum tag_type;
+	std::string tag;
+	std::string nucltag;
+
+	libmaus::bambam::BamAuxFilterVector MQfilter;
+	libmaus::bambam::BamAuxFilterVector MSfilter;
+	libmaus::bambam::BamAuxFilterVector MCfilter;
+	libmaus::bambam::BamAuxFilterVector MTfilter;
+
+	BamSortFixMatesInfo(
+		bool const rfixmates, bool const raddMSMC, tag_type_enum const rtag_type, 
+		std::string const & rtag, std::string const & rnucltag
+	)
+	: fixmates(rfixmates), addMSMC(raddMSMC), tag_type(rtag_type), tag(rtag), nucltag(rnucltag)
+	{
+		MQfilter.set("MQ");
+		MSfilter.set("MS");
+		MCfilter.set("MC");
+		MTfilter.set("MT");
+	}
+
+	/**
+	 * construct from the fixmates, adddupmarksupport, tag and nucltag arguments
+	 *
+	 * @param arginfo argument info
+	 * @param markduplicates true if duplicate marking follows the sorting (forces adddupmarksupport=1)
+	 **/
+	static unique_ptr_type construct(libmaus::util::ArgInfo const & arginfo, bool const markduplicates)
+	{
+		bool const havetag = arginfo.hasArg("tag");
+		std::string const tag = arginfo.getUnparsedValue("tag","no tag");
+
+		if ( havetag && (tag.size() != 2 || (!isalpha(tag[0])) || (!isalnum(tag[1])) ) )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << "tag " << tag << " is invalid" << std::endl;
+			se.finish();
+			throw se;			
+		}
+
+		// nucl tag field
+		bool const havenucltag = arginfo.hasArg("nucltag");
+		std::string const nucltag = arginfo.getUnparsedValue("nucltag","no tag");
+
+		if ( havenucltag && (nucltag.size() != 2 || (!isalpha(nucltag[0])) || (!isalnum(nucltag[1])) ) )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << "nucltag " << nucltag << " is invalid" << std::endl;
+			se.finish();
+			throw se;			
+		}
+		
+		if ( havetag && havenucltag )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << "tag and nucltag are mutually exclusive" << std::endl;
+			se.finish();
+			throw se;					
+		}
+		
+		tag_type_enum tag_type;
+		
+		if ( havetag )
+			tag_type = tag_type_string;
+		else if ( havenucltag )
+			tag_type = tag_type_nucleotide;
+		else
+			tag_type = tag_type_none;
+
+		bool addMSMC = arginfo.getValue<int>("adddupmarksupport",0);
+		bool fixmates = arginfo.getValue<int>("fixmates",0);
+		
+		if ( (havetag || havenucltag) && (!addMSMC) )
+		{
+			std::cerr << "[W] tag or nucltag is enabled, forcing adddupmarksupport=1" << std::endl;
+			addMSMC = true;
+		}
+		
+		if ( markduplicates && (!addMSMC) )
+		{
+			std::cerr << "[W] markduplicates is enabled, forcing adddupmarksupport=1" << std::endl;
+			addMSMC = true;		
+		}
+		
+		if ( addMSMC && ! fixmates )
+		{
+			std::cerr << "[W] adddupmarksupport is enabled, forcing fixmates=1" << std::endl;
+			fixmates = true;
+		}
+		
+		unique_ptr_type tptr(new this_type(fixmates,addMSMC,tag_type,tag,nucltag));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+
+	void fixPair(libmaus::bambam::BamAlignment & prevalgn, libmaus::bambam::BamAlignment & curalgn) const
+	{
+		libmaus::bambam::BamAlignment::fixMateInformation(prevalgn,curalgn,MQfilter);
+
+		if ( addMSMC )
+		{
+			libmaus::bambam::BamAlignment::addMateBaseScore(prevalgn,curalgn,MSfilter);
+			libmaus::bambam::BamAlignment::addMateCoordinate(prevalgn,curalgn,MCfilter);
+
+			switch ( tag_type )
+			{
+				case tag_type_string:
+					libmaus::bambam::BamAlignment::addMateTag(prevalgn,curalgn,MTfilter,tag);
+					break;
+				case tag_type_nucleotide:
+					libmaus::bambam::BamAlignment::addMateTag(prevalgn,curalgn,MTfilter,nucltag);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+};
+#endif
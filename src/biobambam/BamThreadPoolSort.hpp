@@ -0,0 +1,45 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_BAMTHREADPOOLSORT_HPP)
+#define BIOBAMBAM_BAMTHREADPOOLSORT_HPP
+
+#include <libmaus/util/ArgInfo.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * sort alignments using the thread pool based sorting engine (decode, parse, sort and write blocks
+ * in a thread pool, then merge). Input and output are selected by the usual arguments
+ * (I, inputformat, O, outputformat, md5, index, ...)
+ *
+ * @param arginfo argument info
+ * @param progname program name used for the PG header line
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ **/
+int bamThreadPoolSort(libmaus::util::ArgInfo const & arginfo, std::string const & progname);
+
+/**
+ * append help for the options specific to the thread pool sorting engine to V
+ *
+ * @param V help text vector
+ * @param note text appended to each description
+ **/
+void bamThreadPoolSortHelp(std::vector< std::pair<std::string,std::string> > & V, std::string const & note);
+#endif
@@ -0,0 +1,350 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/BamWriterPool.hpp>
+#include <biobambam/BgzfBlockCopy.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/lz/BgzfOutputStream.hpp>
+#include <libmaus/util/TempFileRemovalContainer.hpp>
+#include <algorithm>
+#include <sstream>
+#include <zlib.h>
+
+BamWriterPoolFile::BamWriterPoolFile(
+	uint64_t const rid,
+	std::string const & rfilename,
+	bool const md5,
+	bool const index,
+	std::string const & tmpfileindex
+)
+: id(rid), filename(rfilename), md5filename(rfilename + ".md5"), indexfilename(rfilename + ".bai"),
+  COS(new libmaus::aio::CheckedOutputStream(filename)), Pmd5cb(), Pindex(), cbs(),
+  completed(), nextseq(0), writing(false), failed(false)
+{
+	if ( md5 )
+	{
+		::libmaus::lz::BgzfDeflateOutputCallbackMD5::unique_ptr_type Tmd5cb(new ::libmaus::lz::BgzfDeflateOutputCallbackMD5);
+		Pmd5cb = UNIQUE_PTR_MOVE(Tmd5cb);
+		cbs.push_back(Pmd5cb.get());
+	}
+	if ( index )
+	{
+		libmaus::bambam::BgzfDeflateOutputCallbackBamIndex::unique_ptr_type Tindex(new libmaus::bambam::BgzfDeflateOutputCallbackBamIndex(tmpfileindex));
+		Pindex = UNIQUE_PTR_MOVE(Tindex);
+		cbs.push_back(Pindex.get());
+	}
+}
+
+void BamWriterPoolFile::write(BamWriterPoolChunk const & chunk)
+{
+	uint8_t const * data = chunk.data.size() ? &(chunk.data[0]) : 0;
+	uint8_t const * block = reinterpret_cast<uint8_t const *>(chunk.compressed.c_str());
+
+	for ( uint64_t i = 0; i < chunk.blocks.size(); ++i )
+	{
+		for ( uint64_t j = 0; j < cbs.size(); ++j )
+			(*(cbs[j]))(data,chunk.blocks[i].first,block,chunk.blocks[i].second);
+
+		data += chunk.blocks[i].first;
+		block += chunk.blocks[i].second;
+	}
+
+	COS->write(chunk.compressed.c_str(),chunk.compressed.size());
+
+	if ( ! *COS )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "BamWriterPool: failed to write " << filename << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+void BamWriterPoolFile::finish()
+{
+	// write bam footer
+	{
+		std::ostringstream footerostr;
+		libmaus::lz::BgzfOutputStream writer(footerostr);
+		writer.flush();
+		writer.addEOFBlock();
+		std::istringstream footeristr(footerostr.str());
+		bgzfBlockCopy(footeristr,*COS,cbs.size() ? &cbs : 0);
+	}
+
+	COS->flush();
+	COS->close();
+	COS.reset();
+
+	if ( Pmd5cb )
+	{
+		Pmd5cb->saveDigestAsFile(md5filename);
+	}
+	if ( Pindex )
+	{
+		Pindex->flush(std::string(indexfilename));
+	}
+}
+
+BamWriterPool::BamWriterPool(
+	uint64_t const numthreads,
+	int const rlevel,
+	uint64_t const rchunksize,
+	uint64_t const numchunks,
+	bool const rmd5,
+	bool const rindex,
+	std::string const & rtmpfileprefix
+)
+: level(checkCompressionLevel(rlevel)), chunksize(std::max(rchunksize/getBgzfBlockMaxPayload(),static_cast<uint64_t>(1))*getBgzfBlockMaxPayload()), md5(rmd5), index(rindex), tmpfileprefix(rtmpfileprefix),
+  chunks(std::max(numchunks,static_cast<uint64_t>(2))), workers(std::max(numthreads,static_cast<uint64_t>(1))),
+  files(), nextfileid(0), curfile(0), curchunk(0), curseq(0), finished(false)
+{
+	for ( uint64_t i = 0; i < chunks.size(); ++i )
+	{
+		BamWriterPoolChunk::unique_ptr_type tptr(new BamWriterPoolChunk);
+		chunks[i] = UNIQUE_PTR_MOVE(tptr);
+		chunks[i]->data.reserve(chunksize);
+		freeChunks.enque(chunks[i].get());
+	}
+
+	for ( uint64_t i = 0; i < workers.size(); ++i )
+	{
+		BamWriterPoolWorker::unique_ptr_type tptr(new BamWriterPoolWorker(*this));
+		workers[i] = UNIQUE_PTR_MOVE(tptr);
+		workers[i]->start();
+	}
+}
+
+int BamWriterPool::checkCompressionLevel(int const level)
+{
+	if ( level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "Compression level " << level << " is not supported for BAM output files of this program (valid levels are "
+			<< Z_DEFAULT_COMPRESSION << " to " << Z_BEST_COMPRESSION << ")" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	return level;
+}
+
+BamWriterPool::~BamWriterPool()
+{
+	if ( ! finished )
+	{
+		for ( uint64_t i = 0; i < workers.size(); ++i )
+			todoChunks.enque(0);
+		for ( uint64_t i = 0; i < workers.size(); ++i )
+			workers[i]->join();
+	}
+
+	// files which have not been completed due to a failure
+	for ( std::map<uint64_t,BamWriterPoolFile *>::iterator ita = files.begin(); ita != files.end(); ++ita )
+		delete ita->second;
+}
+
+void BamWriterPool::setFailure(std::string const & message)
+{
+	libmaus::parallel::ScopePosixSpinLock lfailedlock(failedlock);
+	if ( ! failmessage.size() )
+		failmessage = message;
+}
+
+void BamWriterPool::checkFailure()
+{
+	std::string message;
+
+	{
+		libmaus::parallel::ScopePosixSpinLock lfailedlock(failedlock);
+		message = failmessage;
+	}
+
+	if ( message.size() )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << message << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+BamWriterPoolChunk * BamWriterPool::getFreeChunk()
+{
+	checkFailure();
+	BamWriterPoolChunk * chunk = freeChunks.deque();
+	chunk->file = curfile;
+	return chunk;
+}
+
+void BamWriterPool::submit(bool const last)
+{
+	curchunk->seq = curseq++;
+	curchunk->last = last;
+	todoChunks.enque(curchunk);
+	curchunk = last ? 0 : getFreeChunk();
+}
+
+void BamWriterPool::open(std::string const & filename, libmaus::bambam::BamHeader const & header)
+{
+	close();
+
+	uint64_t const id = nextfileid++;
+	std::ostringstream tmpostr;
+	tmpostr << tmpfileprefix << "_" << id << "_index";
+	std::string const tmpfileindex = tmpostr.str();
+	if ( index )
+		::libmaus::util::TempFileRemovalContainer::addTempFile(tmpfileindex);
+
+	BamWriterPoolFile::unique_ptr_type tfile(new BamWriterPoolFile(id,filename,md5,index,tmpfileindex));
+
+	{
+		libmaus::parallel::ScopePosixSpinLock lfileslock(fileslock);
+		files[id] = tfile.get();
+	}
+	curfile = tfile.release();
+	curseq = 0;
+	curchunk = getFreeChunk();
+
+	std::ostringstream headerostr;
+	header.serialise(headerostr);
+	std::string const headerdata = headerostr.str();
+	put(reinterpret_cast<uint8_t const *>(headerdata.c_str()),headerdata.size());
+}
+
+void BamWriterPool::put(uint8_t const * D, uint64_t n)
+{
+	while ( n )
+	{
+		if ( curchunk->data.size() == chunksize )
+			submit(false);
+
+		uint64_t const towrite = std::min(n,static_cast<uint64_t>(chunksize - curchunk->data.size()));
+		curchunk->data.insert(curchunk->data.end(),D,D+towrite);
+		D += towrite;
+		n -= towrite;
+	}
+}
+
+void BamWriterPool::close()
+{
+	if ( curfile )
+	{
+		submit(true);
+		curfile = 0;
+	}
+}
+
+void BamWriterPool::finish()
+{
+	close();
+
+	for ( uint64_t i = 0; i < workers.size(); ++i )
+		todoChunks.enque(0);
+	for ( uint64_t i = 0; i < workers.size(); ++i )
+		workers[i]->join();
+	finished = true;
+
+	checkFailure();
+}
+
+void BamWriterPool::workerLoop(BgzfBlockDeflateEngine & engine)
+{
+	BamWriterPoolChunk * chunk = 0;
+	libmaus::autoarray::AutoArray<uint8_t> block;
+	uint64_t const payload = getBgzfBlockMaxPayload();
+
+	while ( (chunk = todoChunks.deque()) )
+	{
+		BamWriterPoolFile & file = *(chunk->file);
+
+		try
+		{
+			// cut chunk into full BGZF blocks, only the last chunk of a file can end in a short block
+			for ( uint64_t low = 0; low < chunk->data.size(); low += payload )
+			{
+				uint64_t const n = std::min(payload,static_cast<uint64_t>(chunk->data.size()-low));
+				uint64_t const blocksize = engine.deflateBlock(&(chunk->data[low]),n,block);
+				chunk->compressed.append(reinterpret_cast<char const *>(block.begin()),blocksize);
+				chunk->blocks.push_back(std::pair<uint64_t,uint64_t>(n,blocksize));
+			}
+		}
+		catch(std::exception const & ex)
+		{
+			setFailure(ex.what());
+		}
+
+		{
+			libmaus::parallel::ScopePosixSpinLock lfilelock(file.lock);
+			file.completed[chunk->seq] = chunk;
+			// another thread is writing chunks of this file and will pick up this one
+			if ( file.writing )
+				continue;
+			file.writing = true;
+		}
+
+		// write chunks of this file as long as they are available in order
+		bool complete = false;
+		while ( true )
+		{
+			BamWriterPoolChunk * next = 0;
+
+			{
+				libmaus::parallel::ScopePosixSpinLock lfilelock(file.lock);
+				std::map<uint64_t,BamWriterPoolChunk *>::iterator ita = file.completed.find(file.nextseq);
+				if ( ita == file.completed.end() )
+				{
+					file.writing = false;
+					break;
+				}
+				next = ita->second;
+				file.completed.erase(ita);
+				file.nextseq += 1;
+			}
+
+			try
+			{
+				if ( ! file.failed )
+				{
+					file.write(*next);
+					if ( next->last )
+						file.finish();
+				}
+			}
+			catch(std::exception const & ex)
+			{
+				file.failed = true;
+				setFailure(ex.what());
+			}
+
+			if ( next->last )
+				complete = true;
+
+			next->reset();
+			freeChunks.enque(next);
+		}
+
+		// all chunks of the file have been written
+		if ( complete )
+		{
+			libmaus::parallel::ScopePosixSpinLock lfileslock(fileslock);
+			files.erase(file.id);
+			delete &file;
+		}
+	}
+}
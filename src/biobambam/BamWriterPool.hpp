@@ -0,0 +1,245 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_BAMWRITERPOOL_HPP)
+#define BIOBAMBAM_BAMWRITERPOOL_HPP
+
+#include <biobambam/BgzfBlockDeflate.hpp>
+#include <libmaus/aio/CheckedOutputStream.hpp>
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/bambam/BamAlignment.hpp>
+#include <libmaus/bambam/BamHeader.hpp>
+#include <libmaus/bambam/BgzfDeflateOutputCallbackBamIndex.hpp>
+#include <libmaus/lz/BgzfDeflateOutputCallbackMD5.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BamWriterPoolFile;
+
+/**
+ * piece of uncompressed BAM data of an output file
+ **/
+struct BamWriterPoolChunk
+{
+	typedef BamWriterPoolChunk this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	BamWriterPoolFile * file;
+	// rank of chunk in file
+	uint64_t seq;
+	// chunk is the last one of the file
+	bool last;
+	std::vector<uint8_t> data;
+	// sequence of BGZF blocks
+	std::string compressed;
+	// (uncompressed size,compressed size) for each block in compressed
+	std::vector< std::pair<uint64_t,uint64_t> > blocks;
+
+	BamWriterPoolChunk() : file(0), seq(0), last(false), data(), compressed(), blocks() {}
+
+	void reset()
+	{
+		file = 0;
+		seq = 0;
+		last = false;
+		data.resize(0);
+		compressed.resize(0);
+		blocks.resize(0);
+	}
+};
+
+/**
+ * output file of a writer pool
+ **/
+struct BamWriterPoolFile
+{
+	typedef BamWriterPoolFile this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	uint64_t const id;
+	std::string const filename;
+	std::string const md5filename;
+	std::string const indexfilename;
+	libmaus::aio::CheckedOutputStream::unique_ptr_type COS;
+	::libmaus::lz::BgzfDeflateOutputCallbackMD5::unique_ptr_type Pmd5cb;
+	libmaus::bambam::BgzfDeflateOutputCallbackBamIndex::unique_ptr_type Pindex;
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > cbs;
+
+	libmaus::parallel::PosixSpinLock lock;
+	// compressed chunks waiting for their predecessors
+	std::map<uint64_t,BamWriterPoolChunk *> completed;
+	// next chunk to be written
+	uint64_t nextseq;
+	// a thread is currently writing chunks of this file
+	bool writing;
+	bool failed;
+
+	BamWriterPoolFile(
+		uint64_t const rid,
+		std::string const & rfilename,
+		bool const md5,
+		bool const index,
+		std::string const & tmpfileindex
+	);
+
+	/**
+	 * write compressed chunk to the file, the callbacks are fed from the uncompressed data kept in the chunk
+	 **/
+	void write(BamWriterPoolChunk const & chunk);
+
+	/**
+	 * write the EOF block, close the file and write md5 and index files if requested
+	 **/
+	void finish();
+};
+
+/**
+ * pool of threads compressing BAM output files. The caller produces the files one after another
+ * (open, put, close), the uncompressed data is cut into chunks which are compressed by the
+ * worker threads and written to their files in order. The amount of data in flight is bounded
+ * by the number of chunks, put blocks if all chunks are in use. An output file is completed
+ * (EOF block, md5 and index files written) asynchronously after close.
+ **/
+struct BamWriterPool
+{
+	typedef BamWriterPool this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	struct BamWriterPoolWorker : public libmaus::parallel::PosixThread
+	{
+		typedef BamWriterPoolWorker this_type;
+		typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+		BamWriterPool & pool;
+		BgzfBlockDeflateEngine::unique_ptr_type engine;
+
+		BamWriterPoolWorker(BamWriterPool & rpool)
+		: pool(rpool), engine(constructBgzfBlockDeflateEngine("zlib",pool.level)) {}
+
+		void * run()
+		{
+			pool.workerLoop(*engine);
+			return 0;
+		}
+	};
+
+	int const level;
+	uint64_t const chunksize;
+	bool const md5;
+	bool const index;
+	std::string const tmpfileprefix;
+
+	libmaus::autoarray::AutoArray<BamWriterPoolChunk::unique_ptr_type> chunks;
+	libmaus::parallel::SynchronousQueue<BamWriterPoolChunk *> freeChunks;
+	libmaus::parallel::SynchronousQueue<BamWriterPoolChunk *> todoChunks;
+	libmaus::autoarray::AutoArray<BamWriterPoolWorker::unique_ptr_type> workers;
+
+	libmaus::parallel::PosixSpinLock fileslock;
+	std::map<uint64_t,BamWriterPoolFile *> files;
+	uint64_t nextfileid;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	std::string failmessage;
+
+	// file and chunk currently filled by the caller
+	BamWriterPoolFile * curfile;
+	BamWriterPoolChunk * curchunk;
+	uint64_t curseq;
+	bool finished;
+
+	/**
+	 * @param numthreads number of compression threads
+	 * @param rlevel compression level
+	 * @param rchunksize size of uncompressed chunks (rounded down to a multiple of the BGZF block payload,
+	 *        so only the last block of each file can be short)
+	 * @param numchunks number of chunks (bounds memory usage)
+	 * @param rmd5 write md5 checksum file filename.md5 for each output file
+	 * @param rindex write BAM index filename.bai for each output file
+	 * @param rtmpfileprefix prefix for temporary files of index computation
+	 **/
+	BamWriterPool(
+		uint64_t const numthreads,
+		int const rlevel,
+		uint64_t const rchunksize,
+		uint64_t const numchunks,
+		bool const rmd5,
+		bool const rindex,
+		std::string const & rtmpfileprefix
+	);
+	~BamWriterPool();
+
+	static uint64_t getDefaultChunkSize() { return 1024*1024; }
+
+	/**
+	 * check that level is supported by the pool, the workers compress using zlib (levels -1 to 9)
+	 *
+	 * @param level compression level
+	 * @return level
+	 **/
+	static int checkCompressionLevel(int const level);
+
+	/**
+	 * start next output file filename (previous file needs to be closed)
+	 **/
+	void open(std::string const & filename, libmaus::bambam::BamHeader const & header);
+
+	/**
+	 * append uncompressed data to current file
+	 **/
+	void put(uint8_t const * D, uint64_t n);
+
+	/**
+	 * append alignment to current file
+	 **/
+	void put(libmaus::bambam::BamAlignment const & algn)
+	{
+		uint8_t const B[4] = {
+			static_cast<uint8_t>(algn.blocksize >>  0), static_cast<uint8_t>(algn.blocksize >>  8),
+			static_cast<uint8_t>(algn.blocksize >> 16), static_cast<uint8_t>(algn.blocksize >> 24)
+		};
+		put(&B[0],sizeof(B));
+		put(algn.D.begin(),algn.blocksize);
+	}
+
+	/**
+	 * close current output file (it will be completed asynchronously)
+	 **/
+	void close();
+
+	/**
+	 * close current file, wait until all files are complete and terminate worker threads
+	 **/
+	void finish();
+
+	/**
+	 * compress and write chunks until a null pointer is dequeued (run by the worker threads)
+	 **/
+	void workerLoop(BgzfBlockDeflateEngine & engine);
+
+	private:
+	BamWriterPoolChunk * getFreeChunk();
+	void submit(bool const last);
+	void checkFailure();
+	void setFailure(std::string const & message);
+};
+#endif
@@ -0,0 +1,232 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/BgzfBlockCopy.hpp>
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/lz/BgzfConstants.hpp>
+#include <zlib.h>
+#include <cstring>
+
+static void bgzfBlockCopyInflate(uint8_t const * in, uint64_t const incnt, uint8_t * out, uint64_t const outcnt)
+{
+	z_stream strm;
+	memset(&strm,0,sizeof(z_stream));
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+
+	if ( inflateInit2(&strm,-15) != Z_OK )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: inflateInit2 failed" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	strm.avail_in = incnt;
+	strm.next_in = const_cast<Bytef *>(reinterpret_cast<Bytef const *>(in));
+	strm.avail_out = outcnt;
+	strm.next_out = reinterpret_cast<Bytef *>(out);
+
+	int const r = inflate(&strm,Z_FINISH);
+	bool const ok = (r == Z_STREAM_END) && (strm.avail_out == 0);
+	inflateEnd(&strm);
+
+	if ( ! ok )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: failed to decompress BGZF block" << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+// fixed part of BGZF block header (gzip header with BC extra field)
+static unsigned int const bgzfblockheadersize = 18;
+
+uint64_t bgzfBlockRead(std::istream & in, libmaus::autoarray::AutoArray<uint8_t> & block)
+{
+	if ( block.size() < libmaus::lz::BgzfConstants::getBgzfMaxBlockSize() )
+		block = libmaus::autoarray::AutoArray<uint8_t>(libmaus::lz::BgzfConstants::getBgzfMaxBlockSize(),false);
+
+	in.read(reinterpret_cast<char *>(block.begin()),bgzfblockheadersize);
+
+	if ( in.gcount() == 0 )
+		return 0;
+
+	if ( 
+		in.gcount() != static_cast<std::streamsize>(bgzfblockheadersize)
+		||
+		block[0] != 31 || block[1] != 139 || block[2] != 8 || block[3] != 4
+		||
+		block[10] != 6 || block[11] != 0 || block[12] != 'B' || block[13] != 'C'
+	)
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: malformed BGZF block header" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	uint64_t const blocksize = (static_cast<uint64_t>(block[16]) | (static_cast<uint64_t>(block[17]) << 8)) + 1;
+
+	if ( blocksize < bgzfblockheadersize + 8 || blocksize > block.size() )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: invalid BGZF block size " << blocksize << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	in.read(reinterpret_cast<char *>(block.begin() + bgzfblockheadersize),blocksize-bgzfblockheadersize);
+
+	if ( in.gcount() != static_cast<std::streamsize>(blocksize-bgzfblockheadersize) )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: unexpected EOF in BGZF block" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	return blocksize;
+}
+
+// uncompressed size stored in the footer of a BGZF block
+static uint64_t bgzfBlockISize(uint8_t const * block, uint64_t const blocksize)
+{
+	uint8_t const * isizep = block + blocksize - 4;
+	return
+		(static_cast<uint64_t>(isizep[0]) <<  0) |
+		(static_cast<uint64_t>(isizep[1]) <<  8) |
+		(static_cast<uint64_t>(isizep[2]) << 16) |
+		(static_cast<uint64_t>(isizep[3]) << 24);
+}
+
+uint64_t bgzfBlockInflate(uint8_t const * block, uint64_t const blocksize, libmaus::autoarray::AutoArray<uint8_t> & data)
+{
+	if ( data.size() < libmaus::lz::BgzfConstants::getBgzfMaxBlockSize() )
+		data = libmaus::autoarray::AutoArray<uint8_t>(libmaus::lz::BgzfConstants::getBgzfMaxBlockSize(),false);
+
+	uint64_t const isize = bgzfBlockISize(block,blocksize);
+
+	if ( isize > data.size() )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: invalid uncompressed BGZF block size " << isize << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	bgzfBlockCopyInflate(block + bgzfblockheadersize, blocksize - (bgzfblockheadersize + 8), data.begin(), isize);
+
+	return isize;
+}
+
+/*
+ * copy blocks from in to out. The uncompressed data passed to the callbacks is taken from the un
+ * bytes at udata if useudata is set, obtained by decompressing the block if inflate is set, or
+ * null otherwise.
+ */
+static uint64_t bgzfBlockCopyBlocks(
+	std::istream & in,
+	std::ostream & out,
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * cbs,
+	bool const inflate,
+	bool const useudata,
+	uint8_t const * udata,
+	uint64_t const un
+)
+{
+	libmaus::autoarray::AutoArray<uint8_t> block(libmaus::lz::BgzfConstants::getBgzfMaxBlockSize(),false);
+	libmaus::autoarray::AutoArray<uint8_t> data;
+	uint64_t numblocks = 0;
+	uint64_t blocksize = 0;
+	uint64_t uoffset = 0;
+
+	while ( (blocksize = bgzfBlockRead(in,block)) )
+	{
+		if ( cbs && cbs->size() )
+		{
+			uint8_t const * D = 0;
+			uint64_t isize = 0;
+
+			if ( useudata )
+			{
+				isize = bgzfBlockISize(block.begin(),blocksize);
+
+				if ( isize > un - uoffset )
+				{
+					libmaus::exception::LibMausException se;
+					se.getStream() << "bgzfBlockCopy: BGZF blocks contain more data than given" << std::endl;
+					se.finish();
+					throw se;
+				}
+
+				D = udata + uoffset;
+				uoffset += isize;
+			}
+			else if ( inflate )
+			{
+				isize = bgzfBlockInflate(block.begin(),blocksize,data);
+				D = data.begin();
+			}
+			else
+			{
+				isize = bgzfBlockISize(block.begin(),blocksize);
+			}
+
+			for ( uint64_t i = 0; i < cbs->size(); ++i )
+				(*((*cbs)[i]))(D,isize,block.begin(),blocksize);
+		}
+
+		out.write(reinterpret_cast<char const *>(block.begin()),blocksize);
+		numblocks += 1;
+	}
+
+	if ( useudata && cbs && cbs->size() && uoffset != un )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: BGZF blocks contain less data than given" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	if ( ! out )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bgzfBlockCopy: failed to write output" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	return numblocks;
+}
+
+uint64_t bgzfBlockCopy(std::istream & in, std::ostream & out, std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * cbs, bool const inflate)
+{
+	return bgzfBlockCopyBlocks(in,out,cbs,inflate,false,0,0);
+}
+
+uint64_t bgzfBlockCopy(
+	std::istream & in, std::ostream & out, std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * cbs,
+	uint8_t const * data, uint64_t const n
+)
+{
+	return bgzfBlockCopyBlocks(in,out,cbs,false,true,data,n);
+}
@@ -0,0 +1,79 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_BGZFBLOCKCOPY_HPP)
+#define BIOBAMBAM_BGZFBLOCKCOPY_HPP
+
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/lz/BgzfDeflateOutputCallback.hpp>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/**
+ * copy the BGZF blocks in stream in to out without recompressing them. If cbs is not null, then
+ * each block is passed to the callbacks as if it had just been produced by a BGZF deflater
+ * (used for md5 and index computation on concatenated BGZF streams). The blocks are
+ * decompressed for the callbacks only if inflate is set, otherwise the callbacks receive a null
+ * pointer for the uncompressed data. This is sufficient for callbacks using only the compressed
+ * block like the md5 callback, the index callback needs the uncompressed data.
+ *
+ * @param in input stream containing a sequence of BGZF blocks
+ * @param out output stream
+ * @param cbs callbacks (may be null)
+ * @param inflate decompress blocks for the callbacks
+ * @return number of blocks copied
+ **/
+uint64_t bgzfBlockCopy(std::istream & in, std::ostream & out, std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * cbs, bool const inflate = true);
+
+/**
+ * copy the BGZF blocks in stream in to out without recompressing them. The blocks contain the n
+ * bytes of uncompressed data at data, which is passed to the callbacks in cbs (if not null)
+ * together with the blocks. No block is decompressed.
+ *
+ * @param in input stream containing a sequence of BGZF blocks
+ * @param out output stream
+ * @param cbs callbacks (may be null)
+ * @param data uncompressed content of the blocks
+ * @param n number of uncompressed bytes
+ * @return number of blocks copied
+ **/
+uint64_t bgzfBlockCopy(
+	std::istream & in, std::ostream & out, std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * cbs,
+	uint8_t const * data, uint64_t const n
+);
+
+/**
+ * read the next BGZF block from in
+ *
+ * @param in input stream containing a sequence of BGZF blocks
+ * @param block buffer for block, resized to the maximum BGZF block size if it is too small
+ * @return size of the block in bytes, 0 on EOF
+ **/
+uint64_t bgzfBlockRead(std::istream & in, libmaus::autoarray::AutoArray<uint8_t> & block);
+
+/**
+ * decompress the BGZF block of blocksize bytes stored at block
+ *
+ * @param block BGZF block as returned by bgzfBlockRead
+ * @param blocksize size of block in bytes
+ * @param data buffer for decompressed data, resized to the maximum BGZF block size if it is too small
+ * @return number of decompressed bytes
+ **/
+uint64_t bgzfBlockInflate(uint8_t const * block, uint64_t const blocksize, libmaus::autoarray::AutoArray<uint8_t> & data);
+#endif
@@ -0,0 +1,223 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/BgzfBlockDeflate.hpp>
+#include <biobambam/BamBamConfig.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/lz/BgzfConstants.hpp>
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(BIOBAMBAM_HAVE_LIBDEFLATE)
+#include <libdeflate.h>
+#endif
+
+// fixed part of BGZF block header (gzip header with BC extra field) and footer (crc32 and isize)
+static unsigned int const bgzfblockheadersize = 18;
+static unsigned int const bgzfblockfootersize = 8;
+
+uint64_t getBgzfBlockMaxPayload()
+{
+	return 0xff00;
+}
+
+static void bgzfBlockDeflatePutLE32(uint8_t * D, uint32_t const v)
+{
+	D[0] = (v >>  0) & 0xFF;
+	D[1] = (v >>  8) & 0xFF;
+	D[2] = (v >> 16) & 0xFF;
+	D[3] = (v >> 24) & 0xFF;
+}
+
+static void bgzfBlockDeflateCheckBlock(libmaus::autoarray::AutoArray<uint8_t> & block)
+{
+	if ( block.size() < libmaus::lz::BgzfConstants::getBgzfMaxBlockSize() )
+		block = libmaus::autoarray::AutoArray<uint8_t>(libmaus::lz::BgzfConstants::getBgzfMaxBlockSize(),false);
+}
+
+/*
+ * fill in header and footer of BGZF block around csize bytes of deflate data
+ * stored at offset bgzfblockheadersize
+ */
+static uint64_t bgzfBlockDeflateFinish(uint8_t const * data, uint64_t const n, uint64_t const csize, libmaus::autoarray::AutoArray<uint8_t> & block)
+{
+	uint64_t const blocksize = bgzfblockheadersize + csize + bgzfblockfootersize;
+	uint8_t * B = block.begin();
+
+	static uint8_t const header[bgzfblockheadersize-2] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0 };
+	std::copy(&header[0],&header[0]+sizeof(header),B);
+	B[16] = ((blocksize-1) >> 0) & 0xFF;
+	B[17] = ((blocksize-1) >> 8) & 0xFF;
+
+	uint32_t const crc = crc32(crc32(0L,Z_NULL,0),data,n);
+	bgzfBlockDeflatePutLE32(B + bgzfblockheadersize + csize,crc);
+	bgzfBlockDeflatePutLE32(B + bgzfblockheadersize + csize + 4,n);
+
+	return blocksize;
+}
+
+static void bgzfBlockDeflateCheckPayload(uint64_t const n)
+{
+	if ( n > getBgzfBlockMaxPayload() )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "BgzfBlockDeflateEngine: payload of " << n << " bytes exceeds maximum of " << getBgzfBlockMaxPayload() << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+static void bgzfBlockDeflateFailure(char const * engine)
+{
+	libmaus::exception::LibMausException se;
+	se.getStream() << "BgzfBlockDeflateEngine: " << engine << " failed to compress block" << std::endl;
+	se.finish();
+	throw se;
+}
+
+struct BgzfBlockDeflateZlib : public BgzfBlockDeflateEngine
+{
+	z_stream strm;
+
+	BgzfBlockDeflateZlib(int const level)
+	{
+		memset(&strm,0,sizeof(z_stream));
+		strm.zalloc = Z_NULL;
+		strm.zfree = Z_NULL;
+		strm.opaque = Z_NULL;
+
+		if ( deflateInit2(&strm,level,Z_DEFLATED,-15,8,Z_DEFAULT_STRATEGY) != Z_OK )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << "BgzfBlockDeflateZlib: deflateInit2 failed for level " << level << std::endl;
+			se.finish();
+			throw se;
+		}
+	}
+
+	~BgzfBlockDeflateZlib()
+	{
+		deflateEnd(&strm);
+	}
+
+	uint64_t deflateBlock(uint8_t const * data, uint64_t const n, libmaus::autoarray::AutoArray<uint8_t> & block)
+	{
+		bgzfBlockDeflateCheckPayload(n);
+		bgzfBlockDeflateCheckBlock(block);
+
+		if ( deflateReset(&strm) != Z_OK )
+			bgzfBlockDeflateFailure("zlib");
+
+		uint64_t const avail = block.size() - (bgzfblockheadersize + bgzfblockfootersize);
+		strm.avail_in = n;
+		strm.next_in = const_cast<Bytef *>(reinterpret_cast<Bytef const *>(data));
+		strm.avail_out = avail;
+		strm.next_out = reinterpret_cast<Bytef *>(block.begin() + bgzfblockheadersize);
+
+		if ( deflate(&strm,Z_FINISH) != Z_STREAM_END )
+			bgzfBlockDeflateFailure("zlib");
+
+		return bgzfBlockDeflateFinish(data,n,avail - strm.avail_out,block);
+	}
+};
+
+#if defined(BIOBAMBAM_HAVE_LIBDEFLATE)
+struct BgzfBlockDeflateLibDeflate : public BgzfBlockDeflateEngine
+{
+	struct libdeflate_compressor * comp;
+
+	BgzfBlockDeflateLibDeflate(int const level) : comp(libdeflate_alloc_compressor(level < 0 ? 6 : level))
+	{
+		if ( ! comp )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << "BgzfBlockDeflateLibDeflate: failed to allocate compressor for level " << level << std::endl;
+			se.finish();
+			throw se;
+		}
+	}
+
+	~BgzfBlockDeflateLibDeflate()
+	{
+		libdeflate_free_compressor(comp);
+	}
+
+	uint64_t deflateBlock(uint8_t const * data, uint64_t const n, libmaus::autoarray::AutoArray<uint8_t> & block)
+	{
+		bgzfBlockDeflateCheckPayload(n);
+		bgzfBlockDeflateCheckBlock(block);
+
+		uint64_t const avail = block.size() - (bgzfblockheadersize + bgzfblockfootersize);
+		size_t const csize = libdeflate_deflate_compress(comp,data,n,block.begin() + bgzfblockheadersize,avail);
+
+		if ( ! csize )
+			bgzfBlockDeflateFailure("libdeflate");
+
+		return bgzfBlockDeflateFinish(data,n,csize,block);
+	}
+};
+#endif
+
+BgzfBlockDeflateEngine::unique_ptr_type constructBgzfBlockDeflateEngine(std::string const & engine, int const level)
+{
+	if ( engine == "zlib" )
+	{
+		if ( level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << "constructBgzfBlockDeflateEngine: level " << level << " is not supported by engine zlib (valid levels are -1 to 9)" << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		BgzfBlockDeflateEngine::unique_ptr_type tptr(new BgzfBlockDeflateZlib(level));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+	#if defined(BIOBAMBAM_HAVE_LIBDEFLATE)
+	else if ( engine == "libdeflate" )
+	{
+		if ( level < -1 || level > 12 )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << "constructBgzfBlockDeflateEngine: level " << level << " is not supported by engine libdeflate (valid levels are -1 to 12)" << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		BgzfBlockDeflateEngine::unique_ptr_type tptr(new BgzfBlockDeflateLibDeflate(level));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+	#endif
+	else
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "constructBgzfBlockDeflateEngine: unsupported engine " << engine << " (supported: " << getBgzfBlockDeflateEngines() << ")" << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+std::string getBgzfBlockDeflateEngines()
+{
+	std::string engines = "zlib";
+	#if defined(BIOBAMBAM_HAVE_LIBDEFLATE)
+	engines += ",libdeflate";
+	#endif
+	return engines;
+}
@@ -0,0 +1,67 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_BGZFBLOCKDEFLATE_HPP)
+#define BIOBAMBAM_BGZFBLOCKDEFLATE_HPP
+
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <string>
+
+/**
+ * deflate engine producing single BGZF blocks. Engine objects are not thread safe, each
+ * thread needs to use its own object.
+ **/
+struct BgzfBlockDeflateEngine
+{
+	typedef BgzfBlockDeflateEngine this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	virtual ~BgzfBlockDeflateEngine() {}
+
+	/**
+	 * compress n bytes at data into a complete BGZF block
+	 *
+	 * @param data uncompressed data
+	 * @param n number of bytes, at most getBgzfBlockMaxPayload()
+	 * @param block buffer for BGZF block, resized to the maximum BGZF block size if it is too small
+	 * @return size of the BGZF block in bytes
+	 **/
+	virtual uint64_t deflateBlock(uint8_t const * data, uint64_t const n, libmaus::autoarray::AutoArray<uint8_t> & block) = 0;
+};
+
+/**
+ * @return maximum number of uncompressed bytes stored in a BGZF block by this module
+ **/
+uint64_t getBgzfBlockMaxPayload();
+
+/**
+ * construct deflate engine. Supported engines are zlib (levels -1 to 9) and libdeflate (levels -1 to 12,
+ * if compiled in, levels 10 to 12 trade much more time for a better compression ratio).
+ *
+ * @param engine name of engine
+ * @param level compression level
+ * @return engine object
+ **/
+BgzfBlockDeflateEngine::unique_ptr_type constructBgzfBlockDeflateEngine(std::string const & engine, int const level);
+
+/**
+ * @return description of supported deflate engines for help texts
+ **/
+std::string getBgzfBlockDeflateEngines();
+#endif
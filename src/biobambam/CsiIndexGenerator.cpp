@@ -0,0 +1,474 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/CsiIndexGenerator.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/lz/BgzfOutputStream.hpp>
+#include <zlib.h>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+// chunks spanning less compressed data are moved to the parent bin
+static uint64_t const csiminmarkerdist = 0x10000;
+
+static uint32_t csiGetLE32(uint8_t const * D)
+{
+	return
+		(static_cast<uint32_t>(D[0]) <<  0) |
+		(static_cast<uint32_t>(D[1]) <<  8) |
+		(static_cast<uint32_t>(D[2]) << 16) |
+		(static_cast<uint32_t>(D[3]) << 24);
+}
+
+static uint16_t csiGetLE16(uint8_t const * D)
+{
+	return
+		(static_cast<uint16_t>(D[0]) << 0) |
+		(static_cast<uint16_t>(D[1]) << 8);
+}
+
+static void csiPutLE32(std::ostream & out, uint32_t const v)
+{
+	uint8_t const D[4] = {
+		static_cast<uint8_t>(v >>  0), static_cast<uint8_t>(v >>  8),
+		static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 24)
+	};
+	out.write(reinterpret_cast<char const *>(&D[0]),sizeof(D));
+}
+
+static void csiPutLE64(std::ostream & out, uint64_t const v)
+{
+	csiPutLE32(out,static_cast<uint32_t>(v & 0xFFFFFFFFull));
+	csiPutLE32(out,static_cast<uint32_t>(v >> 32));
+}
+
+// index of the first bin on level l
+static uint64_t csiBinFirst(unsigned int const l)
+{
+	return ((1ull << (3*l)) - 1) / 7;
+}
+
+static unsigned int csiBinLevel(uint64_t bin)
+{
+	unsigned int l = 0;
+	for ( ; bin; bin = (bin-1) >> 3 )
+		++l;
+	return l;
+}
+
+// number of bins in the binning scheme
+static uint64_t csiNumBins(unsigned int const depth)
+{
+	return csiBinFirst(depth+1);
+}
+
+CsiIndexGenerator::CsiIndexGenerator(unsigned int const rminshift, bool const rverbose)
+: minshift(rminshift), depth(0), verbose(rverbose), pending(), pendingp(0), blocks(), blockp(0), coffset(0),
+  headercomplete(false), refnames(), reflengths(), refs(), nnocoor(0),
+  chunkrefid(-1), chunkbin(0), chunkbeg(0), chunkend(0), prevpos(-1), numalgn(0)
+{
+	if ( minshift < 1 || minshift > 30 )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: invalid minimal interval shift " << minshift << " (valid range is 1 to 30)" << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+uint32_t CsiIndexGenerator::reg2bin(int64_t const beg, int64_t end, unsigned int const minshift, unsigned int const depth)
+{
+	unsigned int s = minshift;
+	uint64_t t = csiBinFirst(depth);
+
+	--end;
+	for ( unsigned int l = depth; l > 0; --l, s += 3, t -= 1ull << (3*l) )
+		if ( (beg >> s) == (end >> s) )
+			return static_cast<uint32_t>(t + (beg >> s));
+
+	return 0;
+}
+
+uint64_t CsiIndexGenerator::getVirtualOffset(uint64_t const p)
+{
+	// skip blocks ending at or before p (this includes empty blocks)
+	while ( blockp < blocks.size() && p >= blocks[blockp].first + blocks[blockp].second.second )
+		++blockp;
+
+	if ( blockp == blocks.size() )
+		return coffset << 16;
+	else
+		return (blocks[blockp].second.first << 16) | (p - blocks[blockp].first);
+}
+
+bool CsiIndexGenerator::parseHeader()
+{
+	uint64_t const n = pending.size();
+	uint64_t p = 0;
+
+	if ( n < 8 )
+		return false;
+
+	if ( pending[0] != 'B' || pending[1] != 'A' || pending[2] != 'M' || pending[3] != 1 )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: input is not a BAM file (wrong magic)" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	p = 8 + csiGetLE32(&pending[4]);
+	if ( n < p + 4 )
+		return false;
+
+	uint64_t const nref = csiGetLE32(&pending[p]);
+	p += 4;
+
+	std::vector<std::string> names;
+	std::vector<uint64_t> lengths;
+	for ( uint64_t i = 0; i < nref; ++i )
+	{
+		if ( n < p + 4 )
+			return false;
+		uint64_t const lname = csiGetLE32(&pending[p]);
+		p += 4;
+		if ( n < p + lname + 4 )
+			return false;
+		names.push_back(std::string(reinterpret_cast<char const *>(&pending[p]),lname ? lname-1 : 0));
+		p += lname;
+		lengths.push_back(csiGetLE32(&pending[p]));
+		p += 4;
+	}
+
+	refnames.swap(names);
+	reflengths.swap(lengths);
+	refs.resize(nref);
+
+	// choose number of levels such that the longest sequence fits
+	uint64_t maxlen = 0;
+	for ( uint64_t i = 0; i < reflengths.size(); ++i )
+		maxlen = std::max(maxlen,reflengths[i]);
+	maxlen += 256;
+	depth = 0;
+	for ( uint64_t s = 1ull << minshift; maxlen > s; s <<= 3 )
+		++depth;
+
+	if ( minshift + 3*depth > 62 )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: reference sequences are too long for minimal interval shift " << minshift << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	pendingp = p;
+	headercomplete = true;
+
+	return true;
+}
+
+void CsiIndexGenerator::saveChunk()
+{
+	if ( chunkrefid >= 0 )
+	{
+		refs[chunkrefid].bins[chunkbin].push_back(std::pair<uint64_t,uint64_t>(chunkbeg,chunkend));
+		chunkrefid = -1;
+	}
+}
+
+void CsiIndexGenerator::addAlignment(uint8_t const * D, uint64_t const blocksize, uint64_t const voffbeg, uint64_t const voffend)
+{
+	int64_t const refid = static_cast<int32_t>(csiGetLE32(D+0));
+	int64_t const pos = static_cast<int32_t>(csiGetLE32(D+4));
+	uint64_t const lreadname = D[8];
+	uint64_t const ncigar = csiGetLE16(D+12);
+	uint16_t const flags = csiGetLE16(D+14);
+	bool const mapped = !(flags & 4);
+
+	numalgn += 1;
+
+	// alignments without coordinates are at the end of the file
+	if ( refid < 0 )
+	{
+		saveChunk();
+		nnocoor += 1;
+		return;
+	}
+
+	if ( refid >= static_cast<int64_t>(refs.size()) )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: invalid reference id " << refid << " for alignment " << numalgn << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	if ( nnocoor || (chunkrefid >= 0 && (refid < chunkrefid || (refid == chunkrefid && pos < prevpos))) )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: input is not coordinate sorted (alignment " << numalgn << ")" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	if ( 32 + lreadname + 4*ncigar > blocksize )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: malformed alignment " << numalgn << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	int64_t const beg = std::max(pos,static_cast<int64_t>(0));
+	int64_t reflen = 0;
+	if ( mapped )
+	{
+		uint8_t const * C = D + 32 + lreadname;
+		for ( uint64_t i = 0; i < ncigar; ++i, C += 4 )
+		{
+			uint32_t const op = csiGetLE32(C);
+			switch ( op & 0xF )
+			{
+				// M, D, N, =, X
+				case 0: case 2: case 3: case 7: case 8:
+					reflen += op >> 4;
+					break;
+			}
+		}
+	}
+	int64_t const end = beg + std::max(reflen,static_cast<int64_t>(1));
+	uint32_t const bin = reg2bin(beg,end,minshift,depth);
+
+	if ( refid != chunkrefid || bin != chunkbin )
+	{
+		saveChunk();
+		chunkrefid = refid;
+		chunkbin = bin;
+		chunkbeg = voffbeg;
+	}
+	chunkend = voffend;
+	prevpos = pos;
+
+	CsiReferenceIndex & ref = refs[refid];
+
+	if ( !(ref.nmapped + ref.nunmapped) )
+		ref.offbeg = voffbeg;
+	ref.offend = voffend;
+	if ( mapped )
+		ref.nmapped += 1;
+	else
+		ref.nunmapped += 1;
+
+	uint64_t const wbeg = beg >> minshift;
+	uint64_t const wend = (end-1) >> minshift;
+	if ( ref.linear.size() <= wend )
+		ref.linear.resize(wend+1,std::numeric_limits<uint64_t>::max());
+	for ( uint64_t w = wbeg; w <= wend; ++w )
+		if ( ref.linear[w] == std::numeric_limits<uint64_t>::max() )
+			ref.linear[w] = voffbeg;
+}
+
+void CsiIndexGenerator::addBlock(uint8_t const * data, uint64_t const compressed, uint64_t const uncompressed)
+{
+	// drop data already parsed
+	uint64_t const cut = (blockp < blocks.size()) ? std::min(pendingp,blocks[blockp].first) : pendingp;
+	if ( cut )
+	{
+		pending.erase(pending.begin(),pending.begin()+cut);
+		pendingp -= cut;
+	}
+	blocks.erase(blocks.begin(),blocks.begin()+blockp);
+	blockp = 0;
+	for ( uint64_t i = 0; i < blocks.size(); ++i )
+		blocks[i].first -= cut;
+
+	blocks.push_back(
+		std::pair<uint64_t, std::pair<uint64_t,uint64_t> >(
+			pending.size(),std::pair<uint64_t,uint64_t>(coffset,uncompressed)
+		)
+	);
+	pending.insert(pending.end(),data,data+uncompressed);
+	coffset += compressed;
+
+	if ( ! headercomplete && ! parseHeader() )
+		return;
+
+	while ( pending.size() - pendingp >= 4 )
+	{
+		uint64_t const blocksize = csiGetLE32(&pending[pendingp]);
+
+		if ( pending.size() - pendingp < 4 + blocksize )
+			break;
+
+		if ( blocksize < 32 )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << "CsiIndexGenerator: invalid alignment block size " << blocksize << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		uint64_t const voffbeg = getVirtualOffset(pendingp);
+		uint64_t const voffend = getVirtualOffset(pendingp + 4 + blocksize);
+		addAlignment(&pending[pendingp+4],blocksize,voffbeg,voffend);
+		pendingp += 4 + blocksize;
+
+		if ( verbose && (numalgn & (1024*1024-1)) == 0 )
+			std::cerr << "[V] " << numalgn << std::endl;
+	}
+}
+
+void CsiIndexGenerator::finishReference(CsiReferenceIndex & ref) const
+{
+	typedef std::map< uint32_t, std::vector< std::pair<uint64_t,uint64_t> > > bin_map_type;
+	bin_map_type & bins = ref.bins;
+
+	// move chunks of small bins to their parent bins
+	for ( unsigned int l = depth; l > 0; --l )
+	{
+		bin_map_type::iterator ita = bins.lower_bound(csiBinFirst(l));
+
+		while ( ita != bins.end() )
+		{
+			std::vector< std::pair<uint64_t,uint64_t> > & p = ita->second;
+
+			if ( l < depth && p.size() > 1 )
+				std::sort(p.begin(),p.end());
+
+			if ( (p.back().second >> 16) - (p.front().first >> 16) < csiminmarkerdist )
+			{
+				bin_map_type::iterator itp = bins.find((ita->first-1) >> 3);
+
+				if ( itp != bins.end() )
+				{
+					itp->second.insert(itp->second.end(),p.begin(),p.end());
+					bins.erase(ita++);
+					continue;
+				}
+			}
+
+			++ita;
+		}
+	}
+
+	if ( bins.find(0) != bins.end() )
+		std::sort(bins[0].begin(),bins[0].end());
+
+	// merge chunks starting in the same BGZF block as the previous chunk ends
+	for ( bin_map_type::iterator ita = bins.begin(); ita != bins.end(); ++ita )
+	{
+		std::vector< std::pair<uint64_t,uint64_t> > & p = ita->second;
+		uint64_t m = 0;
+
+		for ( uint64_t i = 1; i < p.size(); ++i )
+			if ( (p[m].second >> 16) >= (p[i].first >> 16) )
+				p[m].second = std::max(p[m].second,p[i].second);
+			else
+				p[++m] = p[i];
+
+		p.resize(m+1);
+	}
+
+	// fill gaps in linear index
+	uint64_t l = 0;
+	for ( ; l < ref.linear.size() && ref.linear[l] == std::numeric_limits<uint64_t>::max(); ++l )
+		ref.linear[l] = ref.offbeg;
+	for ( ; l < ref.linear.size(); ++l )
+		if ( ref.linear[l] == std::numeric_limits<uint64_t>::max() )
+			ref.linear[l] = ref.linear[l-1];
+}
+
+void CsiIndexGenerator::flush(std::ostream & out)
+{
+	if ( ! headercomplete || pendingp != pending.size() )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: unexpected EOF in BAM input" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	saveChunk();
+
+	libmaus::lz::BgzfOutputStream bgzf(out,Z_DEFAULT_COMPRESSION);
+	uint64_t const metabin = csiNumBins(depth) + 1;
+
+	bgzf.write("CSI\1",4);
+	csiPutLE32(bgzf,minshift);
+	csiPutLE32(bgzf,depth);
+	// no auxiliary data
+	csiPutLE32(bgzf,0);
+	csiPutLE32(bgzf,refs.size());
+
+	for ( uint64_t r = 0; r < refs.size(); ++r )
+	{
+		CsiReferenceIndex & ref = refs[r];
+		finishReference(ref);
+
+		bool const haveref = (ref.nmapped + ref.nunmapped) != 0;
+		csiPutLE32(bgzf,ref.bins.size() + (haveref ? 1 : 0));
+
+		for ( std::map< uint32_t, std::vector< std::pair<uint64_t,uint64_t> > >::const_iterator ita = ref.bins.begin();
+			ita != ref.bins.end(); ++ita )
+		{
+			// first window covered by the bin
+			unsigned int const l = csiBinLevel(ita->first);
+			uint64_t const botbin = (ita->first - csiBinFirst(l)) << (3*(depth - l));
+			uint64_t const loff = (botbin < ref.linear.size()) ? ref.linear[botbin] : 0;
+			std::vector< std::pair<uint64_t,uint64_t> > const & p = ita->second;
+
+			csiPutLE32(bgzf,ita->first);
+			csiPutLE64(bgzf,loff);
+			csiPutLE32(bgzf,p.size());
+			for ( uint64_t i = 0; i < p.size(); ++i )
+			{
+				csiPutLE64(bgzf,p[i].first);
+				csiPutLE64(bgzf,p[i].second);
+			}
+		}
+
+		// pseudo bin holding the offset range and the number of mapped and unmapped alignments
+		if ( haveref )
+		{
+			csiPutLE32(bgzf,metabin);
+			csiPutLE64(bgzf,0);
+			csiPutLE32(bgzf,2);
+			csiPutLE64(bgzf,ref.offbeg);
+			csiPutLE64(bgzf,ref.offend);
+			csiPutLE64(bgzf,ref.nmapped);
+			csiPutLE64(bgzf,ref.nunmapped);
+		}
+
+		if ( verbose )
+			std::cerr << "[V] " << refnames[r] << "\t" << ref.nmapped << "\t" << ref.nunmapped << std::endl;
+	}
+
+	csiPutLE64(bgzf,nnocoor);
+
+	bgzf.flush();
+	bgzf.addEOFBlock();
+
+	if ( ! out )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CsiIndexGenerator: failed to write index" << std::endl;
+		se.finish();
+		throw se;
+	}
+}
@@ -0,0 +1,118 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_CSIINDEXGENERATOR_HPP)
+#define BIOBAMBAM_CSIINDEXGENERATOR_HPP
+
+#include <libmaus/util/unique_ptr.hpp>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * index information for a single reference sequence
+ **/
+struct CsiReferenceIndex
+{
+	// chunk lists indexed by bin
+	std::map< uint32_t, std::vector< std::pair<uint64_t,uint64_t> > > bins;
+	// linear index (smallest virtual offset of an alignment overlapping each window)
+	std::vector<uint64_t> linear;
+	// virtual offsets of the first and behind the last alignment on the sequence
+	uint64_t offbeg;
+	uint64_t offend;
+	uint64_t nmapped;
+	uint64_t nunmapped;
+
+	CsiReferenceIndex() : bins(), linear(), offbeg(0), offend(0), nmapped(0), nunmapped(0) {}
+};
+
+/**
+ * CSI index generator for coordinate sorted BAM files. The uncompressed data of the BGZF blocks
+ * is passed to addBlock in file order, the binning scheme (minimal interval size 2^minshift,
+ * number of levels chosen such that the longest reference sequence fits) and the chunk merging
+ * follow the CSI specification and the samtools implementation. Unlike BAI indices this
+ * supports reference sequences longer than 2^29 bases.
+ **/
+struct CsiIndexGenerator
+{
+	typedef CsiIndexGenerator this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	unsigned int const minshift;
+	unsigned int depth;
+	bool const verbose;
+
+	// uncompressed data not yet parsed
+	std::vector<uint8_t> pending;
+	// pending offset of next item to be parsed
+	uint64_t pendingp;
+	// blocks covering pending as (pending offset,compressed file offset,uncompressed size)
+	std::vector< std::pair<uint64_t, std::pair<uint64_t,uint64_t> > > blocks;
+	// index of block containing pendingp
+	uint64_t blockp;
+	// compressed file offset of next block
+	uint64_t coffset;
+
+	bool headercomplete;
+	std::vector<std::string> refnames;
+	std::vector<uint64_t> reflengths;
+	std::vector<CsiReferenceIndex> refs;
+	uint64_t nnocoor;
+
+	// state of the chunk currently being extended
+	int64_t chunkrefid;
+	uint32_t chunkbin;
+	uint64_t chunkbeg;
+	uint64_t chunkend;
+	int64_t prevpos;
+	uint64_t numalgn;
+
+	static unsigned int getDefaultMinShift() { return 14; }
+
+	CsiIndexGenerator(unsigned int const rminshift = getDefaultMinShift(), bool const rverbose = false);
+
+	/**
+	 * process next BGZF block
+	 *
+	 * @param data uncompressed block data
+	 * @param compressed size of the compressed block in the file
+	 * @param uncompressed size of the uncompressed data
+	 **/
+	void addBlock(uint8_t const * data, uint64_t const compressed, uint64_t const uncompressed);
+
+	/**
+	 * write the index (BGZF compressed) to out
+	 **/
+	void flush(std::ostream & out);
+
+	/**
+	 * CSI bin for the zero based interval [beg,end)
+	 **/
+	static uint32_t reg2bin(int64_t const beg, int64_t end, unsigned int const minshift, unsigned int const depth);
+
+	private:
+	uint64_t getVirtualOffset(uint64_t const p);
+	bool parseHeader();
+	void addAlignment(uint8_t const * D, uint64_t const blocksize, uint64_t const voffbeg, uint64_t const voffend);
+	void saveChunk();
+	void finishReference(CsiReferenceIndex & ref) const;
+};
+#endif
@@ -0,0 +1,100 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/DepthRunAccumulator.hpp>
+#include <libmaus/bambam/BamFlagBase.hpp>
+
+static uint64_t depthRunNextPowerOfTwo(uint64_t const v)
+{
+	uint64_t s = 1;
+	while ( s < v )
+		s <<= 1;
+	return s;
+}
+
+DepthRunAccumulator::DepthRunAccumulator(uint64_t const initialsize)
+: ring(depthRunNextPowerOfTwo(std::max(initialsize,static_cast<uint64_t>(2)))), mask(ring.size()-1), base(0), pendingend(0), depth(0), runstart(0), cigop()
+{
+
+}
+
+void DepthRunAccumulator::reset()
+{
+	base = 0;
+	pendingend = 0;
+	depth = 0;
+	runstart = 0;
+}
+
+void DepthRunAccumulator::grow(uint64_t const minsize)
+{
+	libmaus::autoarray::AutoArray<int64_t> nring(depthRunNextPowerOfTwo(minsize));
+	uint64_t const nmask = nring.size()-1;
+
+	for ( uint64_t i = 0; i < ring.size(); ++i )
+		nring[(base+i) & nmask] = ring[(base+i) & mask];
+
+	ring = nring;
+	mask = nmask;
+}
+
+void DepthRunAccumulator::addAlignment(libmaus::bambam::BamAlignment const & algn)
+{
+	uint32_t const numcigop = algn.getCigarOperations(cigop);
+	uint64_t pos = algn.getPos();
+	uint64_t blockstart = pos;
+	// ref skips and deletions before the first match/mismatch do not advance on the reference
+	bool frontskip = true;
+
+	for ( uint32_t cidx = 0; cidx < numcigop; ++cidx )
+		switch ( cigop[cidx].first )
+		{
+			// ref skip, deletion (advance on reference)
+			case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CREF_SKIP:
+			case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDEL:
+				if ( frontskip )
+					break;
+				if ( pos != blockstart )
+					addBlock(blockstart,pos);
+				pos += cigop[cidx].second;
+				blockstart = pos;
+				break;
+			// match/mismatch
+			case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CMATCH:
+			case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CEQUAL:
+			case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDIFF:
+				pos += cigop[cidx].second;
+				frontskip = false;
+				break;
+			// padding, clipping, insertion (no change on reference)
+			default:
+				break;
+		}
+
+	if ( pos != blockstart )
+		addBlock(blockstart,pos);
+}
+
+void DepthRunWriter::operator()(uint64_t const from, uint64_t const to, int64_t const depth)
+{
+	if ( bedgraph )
+		out << refname << '\t' << from << '\t' << to << '\t' << depth << '\n';
+	else
+		for ( uint64_t i = from; i < to; ++i )
+			out << refname << '\t' << i << '\t' << depth << '\n';
+}
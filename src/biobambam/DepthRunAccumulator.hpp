@@ -0,0 +1,161 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_DEPTHRUNACCUMULATOR_HPP)
+#define BIOBAMBAM_DEPTHRUNACCUMULATOR_HPP
+
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/bambam/BamAlignment.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+/**
+ * depth of coverage accumulator for coordinate sorted alignments on a single reference sequence.
+ * Each aligned block adds +1 at its start and -1 at its end to a difference array stored in a
+ * ring buffer. Positions left of the start of the next alignment are final and are passed to a
+ * consumer as runs [from,to) of constant non zero depth.
+ **/
+struct DepthRunAccumulator
+{
+	typedef DepthRunAccumulator this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	// difference array
+	libmaus::autoarray::AutoArray<int64_t> ring;
+	uint64_t mask;
+	// next position to be processed
+	uint64_t base;
+	// one past the largest position holding a non zero difference
+	uint64_t pendingend;
+	// depth at base-1
+	int64_t depth;
+	// start of current run
+	uint64_t runstart;
+	// cigar operation buffer for addAlignment
+	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> cigop;
+
+	DepthRunAccumulator(uint64_t const initialsize = 64*1024);
+
+	/**
+	 * reset for next reference sequence, all data needs to be flushed beforehand
+	 **/
+	void reset();
+
+	/**
+	 * add aligned block [from,to). from needs to be at least base
+	 **/
+	void addBlock(uint64_t const from, uint64_t const to)
+	{
+		if ( to - base >= ring.size() )
+			grow(to - base + 1);
+		ring[from & mask] += 1;
+		ring[to & mask] -= 1;
+		pendingend = std::max(pendingend,to+1);
+	}
+
+	/**
+	 * add the match/mismatch blocks of a mapped alignment. Blocks only separated by
+	 * insertions, clipping or padding are merged. Ref skips and deletions before the
+	 * first match/mismatch are ignored, the first block starts at the alignment position.
+	 **/
+	void addAlignment(libmaus::bambam::BamAlignment const & algn);
+
+	/**
+	 * pass all runs ending at or before to to consumer C
+	 **/
+	template<typename consumer_type>
+	void flush(uint64_t const to, consumer_type & C)
+	{
+		uint64_t const lim = std::min(to,pendingend);
+
+		for ( ; base < lim; ++base )
+		{
+			int64_t & d = ring[base & mask];
+
+			if ( d )
+			{
+				if ( depth )
+					C(runstart,base,depth);
+				depth += d;
+				runstart = base;
+				d = 0;
+			}
+		}
+
+		// no pending differences left, skip uncovered gap
+		if ( base < to )
+			base = to;
+	}
+
+	/**
+	 * flush all runs
+	 **/
+	template<typename consumer_type>
+	void finish(consumer_type & C)
+	{
+		flush(pendingend,C);
+	}
+
+	void grow(uint64_t const minsize);
+};
+
+/**
+ * depth run consumer writing text output. For bedgraph=false a line refname\tpos\tdepth
+ * is written for every covered position (0 based). For bedgraph=true a line
+ * refname\tfrom\tto\tdepth is written for every run.
+ **/
+struct DepthRunWriter
+{
+	std::ostream & out;
+	bool const bedgraph;
+	std::string refname;
+
+	DepthRunWriter(std::ostream & rout, bool const rbedgraph) : out(rout), bedgraph(rbedgraph), refname() {}
+
+	void setRefName(std::string const & rrefname)
+	{
+		refname = rrefname;
+	}
+
+	void operator()(uint64_t const from, uint64_t const to, int64_t const depth);
+};
+
+/**
+ * depth run consumer passing the parts of runs inside [from,to) to another consumer
+ **/
+template<typename consumer_type>
+struct DepthRunClipper
+{
+	consumer_type & C;
+	uint64_t const from;
+	uint64_t const to;
+
+	DepthRunClipper(consumer_type & rC, uint64_t const rfrom, uint64_t const rto) : C(rC), from(rfrom), to(rto) {}
+
+	void operator()(uint64_t const rfrom, uint64_t const rto, int64_t const depth)
+	{
+		uint64_t const lfrom = std::max(from,rfrom);
+		uint64_t const lto = std::min(to,rto);
+
+		if ( lfrom < lto )
+			C(lfrom,lto,depth);
+	}
+};
+#endif
@@ -0,0 +1,616 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/BgzfBlockCopy.hpp>
+#include <biobambam/DupMarkRewrite.hpp>
+#include <libmaus/aio/CheckedInputStream.hpp>
+#include <libmaus/aio/CheckedOutputStream.hpp>
+#include <libmaus/bambam/BamFlagBase.hpp>
+#include <libmaus/bambam/BgzfDeflateOutputCallbackBamIndex.hpp>
+#include <libmaus/bambam/ProgramHeaderLineSet.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/lz/BgzfDeflateOutputCallbackMD5.hpp>
+#include <libmaus/lz/BgzfOutputStream.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
+#include <libmaus/timing/RealTimeClock.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <iostream>
+#include <sstream>
+
+static uint64_t dupMarkRewriteGetLE32(uint8_t const * p)
+{
+	return
+		(static_cast<uint64_t>(p[0]) <<  0) |
+		(static_cast<uint64_t>(p[1]) <<  8) |
+		(static_cast<uint64_t>(p[2]) << 16) |
+		(static_cast<uint64_t>(p[3]) << 24);
+}
+
+/**
+ * compute length of the BAM header stored at the start of D[0,n)
+ *
+ * @return length of header in bytes or 0 if D does not contain the complete header
+ **/
+static uint64_t dupMarkRewriteHeaderLength(uint8_t const * D, uint64_t const n)
+{
+	if ( n < 8 )
+		return 0;
+
+	if ( D[0] != 'B' || D[1] != 'A' || D[2] != 'M' || D[3] != 1 )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "markDuplicatesInBamParallel: input is not a BAM file" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	uint64_t o = 8 + dupMarkRewriteGetLE32(D+4);
+	if ( n < o + 4 )
+		return 0;
+	uint64_t const nref = dupMarkRewriteGetLE32(D+o);
+	o += 4;
+
+	for ( uint64_t i = 0; i < nref; ++i )
+	{
+		// name length and name
+		if ( n < o + 4 )
+			return 0;
+		o += 4 + dupMarkRewriteGetLE32(D+o);
+		// sequence length
+		o += 4;
+		if ( n < o )
+			return 0;
+	}
+
+	return o;
+}
+
+static void dupMarkRewriteCheckFailure(std::string const & failmessage)
+{
+	if ( failmessage.size() )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "markDuplicatesInBamParallel: " << failmessage << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+/**
+ * batch of BGZF blocks read from the input file
+ **/
+struct DupMarkRewriteInputBatch
+{
+	typedef DupMarkRewriteInputBatch this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> > cblocks;
+	std::vector<uint64_t> csizes;
+	uint64_t numblocks;
+
+	DupMarkRewriteInputBatch(uint64_t const batchblocks) : cblocks(batchblocks), csizes(batchblocks), numblocks(0) {}
+};
+
+/**
+ * input thread reading batches of BGZF blocks ahead of decompression. A batch with less than
+ * batchblocks blocks marks the end of the input
+ **/
+struct DupMarkRewriteReader : public libmaus::parallel::PosixThread
+{
+	std::istream & in;
+	uint64_t const batchblocks;
+
+	libmaus::autoarray::AutoArray<DupMarkRewriteInputBatch::unique_ptr_type> batches;
+	libmaus::parallel::SynchronousQueue<DupMarkRewriteInputBatch *> freeBatches;
+	libmaus::parallel::SynchronousQueue<DupMarkRewriteInputBatch *> fullBatches;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	std::string failmessage;
+
+	DupMarkRewriteReader(std::istream & rin, uint64_t const rbatchblocks, uint64_t const numbatches)
+	: in(rin), batchblocks(rbatchblocks), batches(numbatches)
+	{
+		for ( uint64_t i = 0; i < batches.size(); ++i )
+		{
+			DupMarkRewriteInputBatch::unique_ptr_type tptr(new DupMarkRewriteInputBatch(batchblocks));
+			batches[i] = UNIQUE_PTR_MOVE(tptr);
+			freeBatches.enque(batches[i].get());
+		}
+	}
+
+	void produce()
+	{
+		DupMarkRewriteInputBatch * batch = 0;
+
+		// a null pointer in the free list stops the reader
+		while ( (batch = freeBatches.deque()) )
+		{
+			batch->numblocks = 0;
+			while ( batch->numblocks < batchblocks && (batch->csizes[batch->numblocks] = bgzfBlockRead(in,batch->cblocks[batch->numblocks])) )
+				batch->numblocks++;
+
+			bool const eof = batch->numblocks < batchblocks;
+			fullBatches.enque(batch);
+
+			if ( eof )
+				break;
+		}
+	}
+
+	void * run()
+	{
+		try
+		{
+			produce();
+		}
+		catch(std::exception const & ex)
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+			failmessage = ex.what();
+		}
+
+		// end of stream marker
+		fullBatches.enque(0);
+
+		return 0;
+	}
+
+	/**
+	 * get next batch, throws if reading failed
+	 **/
+	DupMarkRewriteInputBatch * getBatch()
+	{
+		DupMarkRewriteInputBatch * batch = fullBatches.deque();
+
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+		if ( (! batch) || failmessage.size() )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << "markDuplicatesInBamParallel: failed to read input: " << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		return batch;
+	}
+
+	void returnBatch(DupMarkRewriteInputBatch * batch)
+	{
+		freeBatches.enque(batch);
+	}
+
+	void abort()
+	{
+		freeBatches.enque(0);
+	}
+};
+
+/**
+ * batch of uncompressed output data and its BGZF compressed form, one string per chunk
+ **/
+struct DupMarkRewriteOutputBatch
+{
+	typedef DupMarkRewriteOutputBatch this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	std::vector<uint8_t> data;
+	std::vector<std::string> compressed;
+};
+
+/**
+ * output thread writing compressed batches and passing them to the md5/index callbacks
+ * while the next batches are processed
+ **/
+struct DupMarkRewriteWriter : public libmaus::parallel::PosixThread
+{
+	std::ostream & out;
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * Pcbs;
+	uint64_t const chunksize;
+
+	libmaus::autoarray::AutoArray<DupMarkRewriteOutputBatch::unique_ptr_type> batches;
+	libmaus::parallel::SynchronousQueue<DupMarkRewriteOutputBatch *> freeBatches;
+	libmaus::parallel::SynchronousQueue<DupMarkRewriteOutputBatch *> fullBatches;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	std::string failmessage;
+
+	DupMarkRewriteWriter(
+		std::ostream & rout,
+		std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * rPcbs,
+		uint64_t const rchunksize,
+		uint64_t const numbatches
+	)
+	: out(rout), Pcbs(rPcbs), chunksize(rchunksize), batches(numbatches)
+	{
+		for ( uint64_t i = 0; i < batches.size(); ++i )
+		{
+			DupMarkRewriteOutputBatch::unique_ptr_type tptr(new DupMarkRewriteOutputBatch);
+			batches[i] = UNIQUE_PTR_MOVE(tptr);
+			freeBatches.enque(batches[i].get());
+		}
+	}
+
+	bool hasFailed()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+		return failmessage.size() != 0;
+	}
+
+	void * run()
+	{
+		DupMarkRewriteOutputBatch * batch = 0;
+
+		// batches are consumed until the null pointer even after a failure, so putBatch does not block
+		while ( (batch = fullBatches.deque()) )
+		{
+			try
+			{
+				// the callbacks get the uncompressed data, the blocks are not decompressed again
+				for ( uint64_t i = 0; (! hasFailed()) && i < batch->compressed.size(); ++i )
+				{
+					uint64_t const low = i * chunksize;
+					uint64_t const high = std::min(low + chunksize,static_cast<uint64_t>(batch->data.size()));
+					std::istringstream istr(batch->compressed[i]);
+					bgzfBlockCopy(istr,out,Pcbs,&(batch->data[low]),high-low);
+				}
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+				failmessage = ex.what();
+			}
+
+			freeBatches.enque(batch);
+		}
+
+		return 0;
+	}
+
+	DupMarkRewriteOutputBatch * getFreeBatch()
+	{
+		return freeBatches.deque();
+	}
+
+	void putBatch(DupMarkRewriteOutputBatch * batch)
+	{
+		fullBatches.enque(batch);
+	}
+
+	/**
+	 * wait for all batches to be written, throws if writing failed
+	 **/
+	void finish()
+	{
+		putBatch(0);
+		join();
+		dupMarkRewriteCheckFailure(failmessage);
+	}
+};
+
+uint64_t markDuplicatesInBamParallel(
+	libmaus::util::ArgInfo const & arginfo,
+	bool const verbose,
+	libmaus::bambam::BamHeader const & bamheader,
+	uint64_t const mod,
+	int const level,
+	libmaus::bambam::DupSetCallback const & DSC,
+	std::string const & inputfilename,
+	std::string const & tmpfileindex,
+	std::string const & progid,
+	std::string const & packageversion,
+	bool const rmdup,
+	bool const md5,
+	bool const index,
+	uint64_t const numthreads
+)
+{
+	libmaus::timing::RealTimeClock rtc; rtc.start();
+
+	std::string const headertext(bamheader.text);
+
+	// add PG line to header
+	std::string const upheadtext = ::libmaus::bambam::ProgramHeaderLineSet::addProgramLine(
+		headertext,
+		progid, // ID
+		progid, // PN
+		arginfo.commandline, // CL
+		::libmaus::bambam::ProgramHeaderLineSet(headertext).getLastIdInChain(), // PP
+		packageversion // VN			
+	);
+	// construct new header
+	::libmaus::bambam::BamHeader uphead(upheadtext);
+
+	/*
+	 * start index/md5 callbacks
+	 */
+	std::string const outputfilename = arginfo.getUnparsedValue("O","");
+	std::string md5filename;
+	std::string indexfilename;
+
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > cbs;
+	::libmaus::lz::BgzfDeflateOutputCallbackMD5::unique_ptr_type Pmd5cb;
+	if ( md5 )
+	{
+		if ( arginfo.hasArg("md5filename") &&  arginfo.getUnparsedValue("md5filename","") != "" )
+			md5filename = arginfo.getUnparsedValue("md5filename","");
+		else if ( outputfilename.size() )
+			md5filename = outputfilename + ".md5";
+		else
+			std::cerr << "[V] no filename for md5 given, not creating hash" << std::endl;
+
+		if ( md5filename.size() )
+		{
+			::libmaus::lz::BgzfDeflateOutputCallbackMD5::unique_ptr_type Tmd5cb(new ::libmaus::lz::BgzfDeflateOutputCallbackMD5);
+			Pmd5cb = UNIQUE_PTR_MOVE(Tmd5cb);
+			cbs.push_back(Pmd5cb.get());
+		}
+	}
+	libmaus::bambam::BgzfDeflateOutputCallbackBamIndex::unique_ptr_type Pindex;
+	if ( index )
+	{
+		if ( arginfo.hasArg("indexfilename") &&  arginfo.getUnparsedValue("indexfilename","") != "" )
+			indexfilename = arginfo.getUnparsedValue("indexfilename","");
+		else if ( outputfilename.size() )
+			indexfilename = outputfilename + ".bai";
+		else
+			std::cerr << "[V] no filename for index given, not creating index" << std::endl;
+
+		if ( indexfilename.size() )
+		{
+			libmaus::bambam::BgzfDeflateOutputCallbackBamIndex::unique_ptr_type Tindex(new libmaus::bambam::BgzfDeflateOutputCallbackBamIndex(tmpfileindex));
+			Pindex = UNIQUE_PTR_MOVE(Tindex);
+			cbs.push_back(Pindex.get());
+		}
+	}
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > * Pcbs = 0;
+	if ( cbs.size() )
+		Pcbs = &cbs;
+	/*
+	 * end md5/index callbacks
+	 */
+
+	libmaus::aio::CheckedOutputStream::unique_ptr_type COS;
+	if ( outputfilename.size() )
+	{
+		libmaus::aio::CheckedOutputStream::unique_ptr_type tCOS(new libmaus::aio::CheckedOutputStream(outputfilename));
+		COS = UNIQUE_PTR_MOVE(tCOS);
+	}
+	std::ostream & out = COS ? static_cast<std::ostream &>(*COS) : static_cast<std::ostream &>(std::cout);
+
+	// write bam header
+	{
+		std::ostringstream headerostr;
+		libmaus::lz::BgzfOutputStream writer(headerostr,level);
+		uphead.serialise(writer);
+		writer.flush();
+		std::istringstream headeristr(headerostr.str());
+		bgzfBlockCopy(headeristr,out,Pcbs);
+	}
+
+	libmaus::aio::CheckedInputStream CIS(inputfilename);
+
+	// number of input blocks processed per batch
+	uint64_t const batchblocks = 16 * numthreads;
+	// size of uncompressed data compressed by one thread in a batch
+	uint64_t const chunksize = 256*1024;
+	uint8_t const dupmask = libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FDUP >> 8;
+
+	/*
+	 * reading the input and writing the output (including the md5/index callbacks) run in their
+	 * own threads, overlapping with decompression, flag patching and compression of other batches
+	 */
+	DupMarkRewriteReader reader(CIS,batchblocks,3);
+	DupMarkRewriteWriter writer(out,Pcbs,chunksize,3);
+
+	libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> > ublocks(batchblocks);
+	std::vector<uint64_t> usizes(batchblocks);
+	// decompressed data not yet parsed
+	std::vector<uint8_t> pending;
+	// patched data not yet compressed
+	std::vector<uint8_t> outdata;
+	libmaus::parallel::PosixSpinLock faillock;
+	std::string failmessage;
+
+	bool headerskipped = false;
+	bool eof = false;
+	uint64_t rank = 0;
+	uint64_t removed = 0;
+
+	reader.start();
+	writer.start();
+
+	try
+	{
+		while ( ! eof )
+		{
+			DupMarkRewriteInputBatch * inbatch = reader.getBatch();
+			uint64_t const numblocks = inbatch->numblocks;
+			eof = (numblocks < batchblocks);
+
+			#if defined(_OPENMP)
+			#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+			#endif
+			for ( int64_t i = 0; i < static_cast<int64_t>(numblocks); ++i )
+			{
+				try
+				{
+					usizes[i] = bgzfBlockInflate(inbatch->cblocks[i].begin(),inbatch->csizes[i],ublocks[i]);
+				}
+				catch(std::exception const & ex)
+				{
+					libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+					failmessage = ex.what();
+				}
+			}
+			reader.returnBatch(inbatch);
+			dupMarkRewriteCheckFailure(failmessage);
+
+			for ( uint64_t i = 0; i < numblocks; ++i )
+				pending.insert(pending.end(),ublocks[i].begin(),ublocks[i].begin()+usizes[i]);
+
+			uint64_t p = 0;
+
+			// skip the input header, it has been replaced by the updated one
+			if ( ! headerskipped )
+			{
+				uint64_t const headerlength = pending.size() ? dupMarkRewriteHeaderLength(&pending[0],pending.size()) : 0;
+
+				if ( headerlength )
+				{
+					p = headerlength;
+					headerskipped = true;
+				}
+				else if ( eof )
+				{
+					libmaus::exception::LibMausException se;
+					se.getStream() << "markDuplicatesInBamParallel: unexpected EOF in BAM header" << std::endl;
+					se.finish();
+					throw se;
+				}
+			}
+
+			// patch flags of complete alignments
+			while ( headerskipped && pending.size() - p >= 4 )
+			{
+				uint64_t const blocksize = dupMarkRewriteGetLE32(&pending[p]);
+
+				if ( pending.size() - p < 4 + blocksize )
+					break;
+
+				if ( blocksize < 32 )
+				{
+					libmaus::exception::LibMausException se;
+					se.getStream() << "markDuplicatesInBamParallel: invalid alignment block size " << blocksize << std::endl;
+					se.finish();
+					throw se;
+				}
+
+				uint8_t * const D = &pending[p];
+				bool const isdup = DSC.isMarked(rank);
+
+				// upper byte of the flag field
+				if ( isdup )
+					D[19] |= dupmask;
+				else
+					D[19] &= ~dupmask;
+
+				if ( rmdup && isdup )
+					removed++;
+				else
+					outdata.insert(outdata.end(),D,D+4+blocksize);
+
+				p += 4 + blocksize;
+				rank++;
+
+				if ( verbose && mod && (rank % mod == 0) )
+					std::cerr << "[V] Marked " << rank << " " << rtc.getElapsedSeconds() << " (" << rtc.formatTime(rtc.getElapsedSeconds()) << ")" << std::endl;
+			}
+
+			pending.erase(pending.begin(),pending.begin()+p);
+
+			if ( eof && pending.size() )
+			{
+				libmaus::exception::LibMausException se;
+				se.getStream() << "markDuplicatesInBamParallel: unexpected EOF in alignment data" << std::endl;
+				se.finish();
+				throw se;
+			}
+
+			// compress full chunks (and the rest on EOF)
+			uint64_t const numchunks = eof ? ((outdata.size() + chunksize - 1) / chunksize) : (outdata.size() / chunksize);
+			uint64_t const numbytes = std::min(numchunks * chunksize,static_cast<uint64_t>(outdata.size()));
+
+			if ( ! numchunks )
+				continue;
+
+			DupMarkRewriteOutputBatch * outbatch = writer.getFreeBatch();
+			outbatch->data.swap(outdata);
+			outdata.assign(outbatch->data.begin()+numbytes,outbatch->data.end());
+			outbatch->data.resize(numbytes);
+			outbatch->compressed.resize(numchunks);
+
+			#if defined(_OPENMP)
+			#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+			#endif
+			for ( int64_t i = 0; i < static_cast<int64_t>(numchunks); ++i )
+			{
+				try
+				{
+					uint64_t const low = i * chunksize;
+					uint64_t const high = std::min(low + chunksize,numbytes);
+					std::ostringstream ostr;
+					libmaus::lz::BgzfOutputStream bgzfwriter(ostr,level);
+					bgzfwriter.write(reinterpret_cast<char const *>(&(outbatch->data[low])),high-low);
+					bgzfwriter.flush();
+					outbatch->compressed[i] = ostr.str();
+				}
+				catch(std::exception const & ex)
+				{
+					libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+					failmessage = ex.what();
+				}
+			}
+			dupMarkRewriteCheckFailure(failmessage);
+			writer.putBatch(outbatch);
+		}
+	}
+	catch(...)
+	{
+		reader.abort();
+		reader.join();
+		writer.putBatch(0);
+		writer.join();
+		throw;
+	}
+
+	reader.join();
+	writer.finish();
+
+	// write bam footer
+	{
+		std::ostringstream footerostr;
+		libmaus::lz::BgzfOutputStream writer(footerostr);
+		writer.flush();
+		writer.addEOFBlock();
+		std::istringstream footeristr(footerostr.str());
+		bgzfBlockCopy(footeristr,out,Pcbs);
+	}
+
+	out.flush();
+
+	if ( Pmd5cb )
+	{
+		Pmd5cb->saveDigestAsFile(md5filename);
+	}
+	if ( Pindex )
+	{
+		Pindex->flush(std::string(indexfilename));
+	}
+
+	if ( verbose )
+	{
+		std::cerr << "[V] Marked " << rank << " alignments";
+		if ( rmdup )
+			std::cerr << ", removed " << removed << " duplicates";
+		std::cerr << " in " << rtc.getElapsedSeconds() << " (" << rtc.formatTime(rtc.getElapsedSeconds()) << ")" << std::endl;
+	}
+
+	return rank;
+}
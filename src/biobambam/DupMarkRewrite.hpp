@@ -0,0 +1,53 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_DUPMARKREWRITE_HPP)
+#define BIOBAMBAM_DUPMARKREWRITE_HPP
+
+#include <libmaus/bambam/BamHeader.hpp>
+#include <libmaus/bambam/DupSetCallback.hpp>
+#include <libmaus/util/ArgInfo.hpp>
+#include <string>
+
+/**
+ * rewrite the BAM file inputfilename to the output file given by the O key (stdout if unset)
+ * while setting the duplicate flag of the alignments marked in DSC (the rank of an alignment is
+ * its index in the input file). The BGZF blocks are decompressed and the output is compressed
+ * by numthreads threads, the flag field is patched in place in the raw alignment data. The
+ * md5, md5filename, index and indexfilename keys in arginfo are handled like by
+ * libmaus::bambam::DupMarkBase::markDuplicatesInFile. Duplicates are dropped if rmdup is set.
+ *
+ * @return number of alignments processed
+ **/
+uint64_t markDuplicatesInBamParallel(
+	libmaus::util::ArgInfo const & arginfo,
+	bool const verbose,
+	libmaus::bambam::BamHeader const & bamheader,
+	uint64_t const mod,
+	int const level,
+	libmaus::bambam::DupSetCallback const & DSC,
+	std::string const & inputfilename,
+	std::string const & tmpfileindex,
+	std::string const & progid,
+	std::string const & packageversion,
+	bool const rmdup,
+	bool const md5,
+	bool const index,
+	uint64_t const numthreads
+);
+#endif
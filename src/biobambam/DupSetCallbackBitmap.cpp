@@ -0,0 +1,347 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/DupSetCallbackBitmap.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/util/TempFileRemovalContainer.hpp>
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+DupSetRunReader::DupSetRunReader(std::string const & filename, uint64_t const offset, uint64_t const length, uint64_t const bufsize)
+: CIS(new libmaus::aio::CheckedInputStream(filename)), B(bufsize,false), bpos(0), bfill(0), left(length)
+{
+	CIS->seekg(offset * sizeof(uint64_t));
+}
+
+bool DupSetRunReader::getNext(uint64_t & v)
+{
+	if ( bpos == bfill )
+	{
+		if ( ! left )
+			return false;
+
+		uint64_t const toread = std::min(left,static_cast<uint64_t>(B.size()));
+		CIS->read(reinterpret_cast<char *>(B.begin()),toread * sizeof(uint64_t));
+
+		if ( CIS->gcount() != static_cast<int64_t>(toread * sizeof(uint64_t)) )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << "DupSetRunReader: failed to read from temporary file" << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		bpos = 0;
+		bfill = toread;
+		left -= toread;
+	}
+
+	v = B[bpos++];
+	return true;
+}
+
+bool DupSetCallbackBitmap::Chunk::contains(uint16_t const v) const
+{
+	if ( isDense() )
+		return (dense[v >> 6] >> (v & 63)) & 1;
+	else
+		return std::binary_search(sparse.begin(),sparse.end(),v);
+}
+
+int64_t DupSetCallbackBitmap::Chunk::insert(uint16_t const v, bool & isnew)
+{
+	if ( isDense() )
+	{
+		uint64_t const mask = static_cast<uint64_t>(1) << (v & 63);
+		isnew = !(dense[v >> 6] & mask);
+		dense[v >> 6] |= mask;
+		return 0;
+	}
+
+	std::vector<uint16_t>::iterator const it = std::lower_bound(sparse.begin(),sparse.end(),v);
+
+	if ( it != sparse.end() && *it == v )
+	{
+		isnew = false;
+		return 0;
+	}
+
+	isnew = true;
+	int64_t const oldbytes = sparse.capacity() * sizeof(uint16_t);
+	sparse.insert(it,v);
+
+	// switch to bit vector representation
+	if ( sparse.size() > sparsemax )
+	{
+		dense = libmaus::autoarray::AutoArray<uint64_t>(densewords);
+		for ( uint64_t i = 0; i < sparse.size(); ++i )
+			dense[sparse[i] >> 6] |= static_cast<uint64_t>(1) << (sparse[i] & 63);
+		std::vector<uint16_t>().swap(sparse);
+		return static_cast<int64_t>(densewords * sizeof(uint64_t)) - oldbytes;
+	}
+	else
+	{
+		return static_cast<int64_t>(sparse.capacity() * sizeof(uint16_t)) - oldbytes;
+	}
+}
+
+void DupSetCallbackBitmap::Chunk::getRanks(uint64_t const base, std::vector<uint64_t> & V) const
+{
+	if ( isDense() )
+	{
+		for ( uint64_t i = 0; i < dense.size(); ++i )
+			for ( uint64_t w = dense[i]; w; w &= w-1 )
+				V.push_back(base + (i << 6) + __builtin_ctzll(w));
+	}
+	else
+	{
+		for ( uint64_t i = 0; i < sparse.size(); ++i )
+			V.push_back(base + sparse[i]);
+	}
+}
+
+DupSetCallbackBitmap::DupSetCallbackBitmap(
+	std::string const & rtmpfilename,
+	std::map<uint64_t,::libmaus::bambam::DuplicationMetrics> & rmetrics,
+	uint64_t const rmemlimit
+)
+: metrics(rmetrics), tmpfilename(rtmpfilename), mergedfilename(rtmpfilename + "_merged"), memlimit(rmemlimit),
+  spillbuffersize(std::max(rmemlimit / sizeof(uint64_t),static_cast<uint64_t>(64*1024))),
+  chunks(), memused(0), numdups(0), spilled(false), flushed(false), spillbuffer(), spillout(), spilloffset(0), runstart(0),
+  runs(), mergedlength(0), querylock(), queryreader(), queryhavenext(false), querynext(0), querylast(0)
+{
+	libmaus::util::TempFileRemovalContainer::addTempFile(tmpfilename);
+	libmaus::util::TempFileRemovalContainer::addTempFile(mergedfilename);
+}
+
+void DupSetCallbackBitmap::mark(uint64_t const rank)
+{
+	if ( spilled )
+	{
+		spillbuffer.push_back(rank);
+
+		if ( spillbuffer.size() >= spillbuffersize )
+		{
+			std::sort(spillbuffer.begin(),spillbuffer.end());
+			spillbuffer.resize(std::unique(spillbuffer.begin(),spillbuffer.end()) - spillbuffer.begin());
+			// ranks may repeat between runs, flush computes the exact count
+			numdups += spillbuffer.size();
+			writeSpillBuffer();
+			finishRun();
+		}
+	}
+	else
+	{
+		uint64_t const c = rank >> chunkshift;
+
+		if ( c >= chunks.size() )
+		{
+			memused += (c + 1 - chunks.size()) * sizeof(Chunk);
+			chunks.resize(c+1);
+		}
+
+		bool isnew = false;
+		memused = static_cast<uint64_t>(static_cast<int64_t>(memused) + chunks[c].insert(rank & chunkmask,isnew));
+		if ( isnew )
+			numdups++;
+
+		if ( memused > memlimit )
+			spill();
+	}
+}
+
+void DupSetCallbackBitmap::writeSpillBuffer()
+{
+	spillout->write(reinterpret_cast<char const *>(spillbuffer.size() ? &spillbuffer[0] : 0),spillbuffer.size() * sizeof(uint64_t));
+
+	if ( ! *spillout )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "DupSetCallbackBitmap: failed to write to " << tmpfilename << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	spilloffset += spillbuffer.size();
+	spillbuffer.resize(0);
+}
+
+void DupSetCallbackBitmap::finishRun()
+{
+	if ( spilloffset != runstart )
+		runs.push_back(std::pair<uint64_t,uint64_t>(runstart,spilloffset-runstart));
+	runstart = spilloffset;
+}
+
+void DupSetCallbackBitmap::spill()
+{
+	libmaus::aio::CheckedOutputStream::unique_ptr_type tptr(new libmaus::aio::CheckedOutputStream(tmpfilename));
+	spillout = UNIQUE_PTR_MOVE(tptr);
+	spilled = true;
+
+	// the bitmap is already sorted, write it as the first run
+	for ( uint64_t c = 0; c < chunks.size(); ++c )
+	{
+		chunks[c].getRanks(c << chunkshift,spillbuffer);
+		if ( spillbuffer.size() >= spillbuffersize )
+			writeSpillBuffer();
+	}
+	writeSpillBuffer();
+	finishRun();
+
+	std::deque<Chunk>().swap(chunks);
+	memused = 0;
+	spillbuffer.reserve(spillbuffersize);
+}
+
+void DupSetCallbackBitmap::operator()(::libmaus::bambam::ReadEndsBase const & A)
+{
+	mark(A.getRead1IndexInFile());
+
+	if ( A.isPaired() )
+	{
+		mark(A.getRead2IndexInFile());
+		metrics[A.getLibraryId()].readpairduplicates++;
+	}
+	else
+	{
+		metrics[A.getLibraryId()].unpairedreadduplicates++;
+	}
+}
+
+void DupSetCallbackBitmap::addOpticalDuplicates(uint64_t const libid, uint64_t const count)
+{
+	metrics[libid].opticalduplicates += count;
+}
+
+uint64_t DupSetCallbackBitmap::getNumDups() const
+{
+	return numdups;
+}
+
+void DupSetCallbackBitmap::resetQuery() const
+{
+	DupSetRunReader::unique_ptr_type tptr(new DupSetRunReader(mergedfilename,0,mergedlength));
+	queryreader = UNIQUE_PTR_MOVE(tptr);
+	queryhavenext = queryreader->getNext(querynext);
+	querylast = 0;
+}
+
+bool DupSetCallbackBitmap::isMarked(uint64_t const i) const
+{
+	if ( ! spilled )
+	{
+		uint64_t const c = i >> chunkshift;
+		return c < chunks.size() && chunks[c].contains(i & chunkmask);
+	}
+
+	libmaus::parallel::ScopePosixSpinLock lquerylock(querylock);
+
+	if ( i < querylast )
+		resetQuery();
+	querylast = i;
+
+	while ( queryhavenext && querynext < i )
+		queryhavenext = queryreader->getNext(querynext);
+
+	return queryhavenext && querynext == i;
+}
+
+void DupSetCallbackBitmap::flush(uint64_t const /* n */)
+{
+	if ( flushed || ! spilled )
+	{
+		flushed = true;
+		return;
+	}
+
+	std::sort(spillbuffer.begin(),spillbuffer.end());
+	spillbuffer.resize(std::unique(spillbuffer.begin(),spillbuffer.end()) - spillbuffer.begin());
+	writeSpillBuffer();
+	finishRun();
+	spillout->flush();
+	spillout.reset();
+	std::vector<uint64_t>().swap(spillbuffer);
+
+	// merge runs into a single sorted file without duplicates
+	libmaus::autoarray::AutoArray<DupSetRunReader::unique_ptr_type> readers(runs.size());
+	std::priority_queue<
+		std::pair<uint64_t,uint64_t>,
+		std::vector< std::pair<uint64_t,uint64_t> >,
+		std::greater< std::pair<uint64_t,uint64_t> >
+	> Q;
+
+	for ( uint64_t i = 0; i < runs.size(); ++i )
+	{
+		DupSetRunReader::unique_ptr_type treader(new DupSetRunReader(tmpfilename,runs[i].first,runs[i].second));
+		readers[i] = UNIQUE_PTR_MOVE(treader);
+		uint64_t v;
+		if ( readers[i]->getNext(v) )
+			Q.push(std::pair<uint64_t,uint64_t>(v,i));
+	}
+
+	libmaus::aio::CheckedOutputStream mergedout(mergedfilename);
+	libmaus::autoarray::AutoArray<uint64_t> B(4096,false);
+	uint64_t bfill = 0;
+	bool havelast = false;
+	uint64_t last = 0;
+	mergedlength = 0;
+
+	while ( Q.size() )
+	{
+		std::pair<uint64_t,uint64_t> const P = Q.top();
+		Q.pop();
+
+		if ( !havelast || P.first != last )
+		{
+			B[bfill++] = P.first;
+			last = P.first;
+			havelast = true;
+
+			if ( bfill == B.size() )
+			{
+				mergedout.write(reinterpret_cast<char const *>(B.begin()),bfill * sizeof(uint64_t));
+				mergedlength += bfill;
+				bfill = 0;
+			}
+		}
+
+		uint64_t v;
+		if ( readers[P.second]->getNext(v) )
+			Q.push(std::pair<uint64_t,uint64_t>(v,P.second));
+	}
+
+	mergedout.write(reinterpret_cast<char const *>(B.begin()),bfill * sizeof(uint64_t));
+	mergedlength += bfill;
+	mergedout.flush();
+
+	if ( ! mergedout )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "DupSetCallbackBitmap: failed to write to " << mergedfilename << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	mergedout.close();
+
+	numdups = mergedlength;
+	flushed = true;
+	resetQuery();
+}
@@ -0,0 +1,134 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_DUPSETCALLBACKBITMAP_HPP)
+#define BIOBAMBAM_DUPSETCALLBACKBITMAP_HPP
+
+#include <libmaus/aio/CheckedInputStream.hpp>
+#include <libmaus/aio/CheckedOutputStream.hpp>
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/bambam/DupSetCallback.hpp>
+#include <libmaus/bambam/DuplicationMetrics.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * sequential reader for a run of sorted ranks in a temporary file
+ **/
+struct DupSetRunReader
+{
+	typedef DupSetRunReader this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	libmaus::aio::CheckedInputStream::unique_ptr_type CIS;
+	libmaus::autoarray::AutoArray<uint64_t> B;
+	uint64_t bpos;
+	uint64_t bfill;
+	uint64_t left;
+
+	DupSetRunReader(std::string const & filename, uint64_t const offset, uint64_t const length, uint64_t const bufsize = 4096);
+	bool getNext(uint64_t & v);
+};
+
+/**
+ * duplicate set callback storing the ranks of duplicate alignments in a chunked in memory bitmap.
+ * The rank space is split into chunks of 2^16 ranks. A chunk is stored as a sorted array of 16 bit
+ * offsets as long as it contains at most 4096 ranks and as a plain bit vector otherwise. If the
+ * memory used by the bitmap exceeds memlimit bytes, then the ranks are spilled to tmpfilename as
+ * sorted runs which are merged when flush is called. In this case marks are queried using a
+ * sequential cursor, which is efficient for queries in increasing rank order. After spilling
+ * getNumDups may count a rank marked in several runs more than once until flush is called.
+ **/
+struct DupSetCallbackBitmap : public ::libmaus::bambam::DupSetCallback
+{
+	typedef DupSetCallbackBitmap this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	static unsigned int const chunkshift = 16;
+	static uint64_t const chunkmask = (1ull << chunkshift)-1;
+	static uint64_t const densewords = (1ull << chunkshift)/64;
+	static uint64_t const sparsemax = 4096;
+
+	struct Chunk
+	{
+		std::vector<uint16_t> sparse;
+		libmaus::autoarray::AutoArray<uint64_t> dense;
+
+		Chunk() : sparse(), dense() {}
+
+		bool isDense() const { return dense.size() != 0; }
+		bool contains(uint16_t const v) const;
+		// returns change of memory used in bytes, sets isnew if v was not present before
+		int64_t insert(uint16_t const v, bool & isnew);
+		void getRanks(uint64_t const base, std::vector<uint64_t> & V) const;
+	};
+
+	std::map<uint64_t,::libmaus::bambam::DuplicationMetrics> & metrics;
+	std::string const tmpfilename;
+	std::string const mergedfilename;
+	uint64_t const memlimit;
+	uint64_t const spillbuffersize;
+
+	std::deque<Chunk> chunks;
+	uint64_t memused;
+	uint64_t numdups;
+
+	bool spilled;
+	bool flushed;
+	std::vector<uint64_t> spillbuffer;
+	libmaus::aio::CheckedOutputStream::unique_ptr_type spillout;
+	uint64_t spilloffset;
+	uint64_t runstart;
+	std::vector< std::pair<uint64_t,uint64_t> > runs;
+	uint64_t mergedlength;
+
+	mutable libmaus::parallel::PosixSpinLock querylock;
+	mutable DupSetRunReader::unique_ptr_type queryreader;
+	mutable bool queryhavenext;
+	mutable uint64_t querynext;
+	mutable uint64_t querylast;
+
+	static uint64_t getDefaultMemLimit() { return 256*1024*1024; }
+
+	DupSetCallbackBitmap(
+		std::string const & rtmpfilename,
+		std::map<uint64_t,::libmaus::bambam::DuplicationMetrics> & rmetrics,
+		uint64_t const rmemlimit = getDefaultMemLimit()
+	);
+	virtual ~DupSetCallbackBitmap() {}
+
+	void operator()(::libmaus::bambam::ReadEndsBase const & A);
+	void addOpticalDuplicates(uint64_t const libid, uint64_t const count);
+	uint64_t getNumDups() const;
+	bool isMarked(uint64_t const i) const;
+	void flush(uint64_t const n);
+
+	bool isSpilled() const { return spilled; }
+
+	private:
+	void mark(uint64_t const rank);
+	void spill();
+	void writeSpillBuffer();
+	void finishRun();
+	void resetQuery() const;
+};
+#endif
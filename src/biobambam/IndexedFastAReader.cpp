@@ -0,0 +1,164 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/IndexedFastAReader.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/util/GetFileSize.hpp>
+#include <algorithm>
+
+IndexedFastAReader::IndexedFastAReader(std::string const & filename)
+: Pindex(), Pstream(), B()
+{
+	std::string const indexfilename = filename + ".fai";
+
+	if ( ! libmaus::util::GetFileSize::fileExists(indexfilename) )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "IndexedFastAReader: index file " << indexfilename << " does not exist (it can be created using samtools faidx)" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	libmaus::fastx::FastAIndex::unique_ptr_type Tindex(libmaus::fastx::FastAIndex::load(indexfilename));
+	Pindex = UNIQUE_PTR_MOVE(Tindex);
+
+	libmaus::aio::CheckedInputStream::unique_ptr_type Tstream(new libmaus::aio::CheckedInputStream(filename));
+	Pstream = UNIQUE_PTR_MOVE(Tstream);
+}
+
+void IndexedFastAReader::readSequence(uint64_t const id, std::string & out)
+{
+	Pstream->clear();
+	libmaus::autoarray::AutoArray<char> const A = Pindex->readSequence(*Pstream,id);
+	out.assign(A.begin(),A.end());
+}
+
+void IndexedFastAReader::readRange(uint64_t const id, uint64_t const from, uint64_t const rlen, std::string & out)
+{
+	libmaus::fastx::FastAIndexEntry const & entry = (*Pindex)[id];
+
+	out.resize(0);
+
+	if ( from >= entry.length )
+		return;
+
+	uint64_t const len = std::min(rlen,entry.length-from);
+
+	if ( ! len )
+		return;
+
+	if ( ! entry.basesperline )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "IndexedFastAReader: index entry for " << entry.name << " has no line length" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	uint64_t const last = from + len - 1;
+	uint64_t const bytefrom = entry.offset + (from / entry.basesperline) * entry.bytesperline + (from % entry.basesperline);
+	uint64_t const byteto = entry.offset + (last / entry.basesperline) * entry.bytesperline + (last % entry.basesperline) + 1;
+	uint64_t const numbytes = byteto - bytefrom;
+
+	if ( numbytes > B.size() )
+		B = libmaus::autoarray::AutoArray<char>(numbytes,false);
+
+	Pstream->clear();
+	Pstream->seekg(bytefrom);
+	Pstream->read(B.begin(),numbytes);
+
+	if ( Pstream->gcount() != static_cast<int64_t>(numbytes) )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "IndexedFastAReader: failed to read " << entry.name << ":" << from << "-" << from+len << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	// drop line breaks
+	out.reserve(len);
+	for ( uint64_t i = 0; i < numbytes; ++i )
+		if ( B[i] != '\n' && B[i] != '\r' )
+			out.push_back(B[i]);
+
+	if ( out.size() != len )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "IndexedFastAReader: sequence data for " << entry.name << " does not match the index" << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+FastAWindowCache::FastAWindowCache(IndexedFastAReader & rreader, uint64_t const rwindowsize, uint64_t const rmaxwindows)
+: reader(rreader), windowsize(std::max(rwindowsize,static_cast<uint64_t>(1))), maxwindows(std::max(rmaxwindows,static_cast<uint64_t>(1))),
+  windows(), windowmap(), hits(0), misses(0)
+{
+}
+
+std::string const & FastAWindowCache::getWindow(uint64_t const id, uint64_t const w)
+{
+	key_type const key(id,w);
+	std::map<key_type,list_type::iterator>::iterator ita = windowmap.find(key);
+
+	if ( ita != windowmap.end() )
+	{
+		hits++;
+		// move to front
+		windows.splice(windows.begin(),windows,ita->second);
+		return ita->second->second;
+	}
+
+	misses++;
+
+	std::string data;
+	reader.readRange(id,w*windowsize,windowsize,data);
+
+	if ( windows.size() >= maxwindows )
+	{
+		windowmap.erase(windows.back().first);
+		windows.pop_back();
+	}
+
+	windows.push_front(std::pair<key_type,std::string>(key,std::string()));
+	windows.front().second.swap(data);
+	windowmap[key] = windows.begin();
+
+	return windows.front().second;
+}
+
+void FastAWindowCache::getRange(uint64_t const id, uint64_t const from, uint64_t const rlen, std::string & out)
+{
+	uint64_t const length = reader[id].length;
+
+	out.resize(0);
+
+	if ( from >= length )
+		return;
+
+	uint64_t const to = from + std::min(rlen,length-from);
+
+	for ( uint64_t w = from / windowsize; w * windowsize < to; ++w )
+	{
+		std::string const & W = getWindow(id,w);
+		uint64_t const wfrom = w * windowsize;
+		uint64_t const low = std::max(from,wfrom) - wfrom;
+		uint64_t const high = std::min(to,wfrom+W.size()) - wfrom;
+		out.append(W,low,high-low);
+	}
+}
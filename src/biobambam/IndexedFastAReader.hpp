@@ -0,0 +1,109 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_INDEXEDFASTAREADER_HPP)
+#define BIOBAMBAM_INDEXEDFASTAREADER_HPP
+
+#include <libmaus/aio/CheckedInputStream.hpp>
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/fastx/FastAIndex.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+/**
+ * random access to the sequences of an uncompressed FastA file via its .fai index
+ * (as produced by samtools faidx), which is loaded using libmaus::fastx::FastAIndex.
+ **/
+struct IndexedFastAReader
+{
+	typedef IndexedFastAReader this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	libmaus::fastx::FastAIndex::unique_ptr_type Pindex;
+	libmaus::aio::CheckedInputStream::unique_ptr_type Pstream;
+	libmaus::autoarray::AutoArray<char> B;
+
+	/**
+	 * open filename and load the index filename.fai
+	 **/
+	IndexedFastAReader(std::string const & filename);
+
+	uint64_t size() const
+	{
+		return Pindex->size();
+	}
+
+	libmaus::fastx::FastAIndexEntry const & operator[](uint64_t const i) const
+	{
+		return (*Pindex)[i];
+	}
+
+	/**
+	 * @return id of sequence name or -1 if there is no such sequence
+	 **/
+	int64_t getSequenceId(std::string const & name) const
+	{
+		return Pindex->getSequenceIdByName(name);
+	}
+
+	/**
+	 * read bases [from,from+len) of sequence id to out. The range is clipped to the
+	 * length of the sequence.
+	 **/
+	void readRange(uint64_t const id, uint64_t const from, uint64_t const len, std::string & out);
+
+	/**
+	 * read complete sequence id to out
+	 **/
+	void readSequence(uint64_t const id, std::string & out);
+};
+
+/**
+ * cache of fixed size windows of the sequences of an IndexedFastAReader. If the cache
+ * is full, then the least recently used window is dropped.
+ **/
+struct FastAWindowCache
+{
+	typedef std::pair<uint64_t,uint64_t> key_type;
+	typedef std::list< std::pair<key_type,std::string> > list_type;
+
+	IndexedFastAReader & reader;
+	uint64_t const windowsize;
+	uint64_t const maxwindows;
+	// windows, most recently used first
+	list_type windows;
+	std::map<key_type,list_type::iterator> windowmap;
+	uint64_t hits;
+	uint64_t misses;
+
+	FastAWindowCache(IndexedFastAReader & rreader, uint64_t const rwindowsize, uint64_t const rmaxwindows);
+
+	/**
+	 * @return window w (bases [w*windowsize,(w+1)*windowsize)) of sequence id
+	 **/
+	std::string const & getWindow(uint64_t const id, uint64_t const w);
+
+	/**
+	 * get bases [from,from+len) of sequence id in out. The range is clipped to the
+	 * length of the sequence.
+	 **/
+	void getRange(uint64_t const id, uint64_t const from, uint64_t const len, std::string & out);
+};
+#endif
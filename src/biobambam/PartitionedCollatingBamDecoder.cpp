@@ -0,0 +1,909 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/PartitionedCollatingBamDecoder.hpp>
+#include <libmaus/bambam/BamAlignmentDecoderBase.hpp>
+#include <libmaus/bambam/BamFlagBase.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/util/TempFileRemovalContainer.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <sstream>
+
+uint64_t const CollationPartition::emptyslot;
+uint64_t const CollationPartition::deletedslot;
+uint64_t const CollationPartition::headersize;
+
+uint64_t CollationBatch::push(uint8_t const * D, uint64_t const blocksize)
+{
+	data.push_back((blocksize >> 0) & 0xFF);
+	data.push_back((blocksize >> 8) & 0xFF);
+	data.push_back((blocksize >> 16) & 0xFF);
+	data.push_back((blocksize >> 24) & 0xFF);
+	uint64_t const off = data.size();
+	data.insert(data.end(),D,D+blocksize);
+	return off;
+}
+
+void CollationBatch::push(entry_type const type, uint8_t const * Da, uint64_t const blocksizea, uint8_t const * Db, uint64_t const blocksizeb)
+{
+	Entry entry;
+	entry.type = type;
+	entry.blocksizea = blocksizea;
+	entry.offa = push(Da,blocksizea);
+	entry.blocksizeb = Db ? blocksizeb : 0;
+	entry.offb = Db ? push(Db,blocksizeb) : 0;
+	entries.push_back(entry);
+}
+
+CollationRunReader::CollationRunReader(std::string const & filename, uint64_t const offset, uint64_t const numrecords)
+: CIS(new libmaus::aio::CheckedInputStream(filename)), left(numrecords), B(), blocksize(0)
+{
+	CIS->seekg(offset);
+}
+
+bool CollationRunReader::getNext()
+{
+	if ( ! left )
+		return false;
+
+	uint8_t lenbuf[4];
+	CIS->read(reinterpret_cast<char *>(&lenbuf[0]),sizeof(lenbuf));
+
+	if ( CIS->gcount() != static_cast<int64_t>(sizeof(lenbuf)) )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CollationRunReader: failed to read from temporary file" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	blocksize =
+		(static_cast<uint64_t>(lenbuf[0]) << 0) |
+		(static_cast<uint64_t>(lenbuf[1]) << 8) |
+		(static_cast<uint64_t>(lenbuf[2]) << 16) |
+		(static_cast<uint64_t>(lenbuf[3]) << 24);
+
+	if ( blocksize > B.size() )
+		B = libmaus::autoarray::AutoArray<uint8_t>(blocksize,false);
+
+	CIS->read(reinterpret_cast<char *>(B.begin()),blocksize);
+
+	if ( CIS->gcount() != static_cast<int64_t>(blocksize) )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "CollationRunReader: failed to read from temporary file" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	left -= 1;
+	return true;
+}
+
+char const * CollationRunReader::getName() const
+{
+	return libmaus::bambam::BamAlignmentDecoderBase::getReadName(B.begin());
+}
+
+/**
+ * comparator for the run merge heap, yields the smallest name (and lowest run id for equal names) on top
+ **/
+struct CollationRunHeapComparator
+{
+	libmaus::autoarray::AutoArray<CollationRunReader::unique_ptr_type> const & readers;
+
+	CollationRunHeapComparator(libmaus::autoarray::AutoArray<CollationRunReader::unique_ptr_type> const & rreaders)
+	: readers(rreaders) {}
+
+	bool operator()(uint64_t const a, uint64_t const b) const
+	{
+		int const r = strcmp(readers[a]->getName(),readers[b]->getName());
+
+		if ( r != 0 )
+			return r > 0;
+		else
+			return a > b;
+	}
+};
+
+/**
+ * comparator ordering arena records by read name
+ **/
+struct CollationArenaNameComparator
+{
+	std::vector<uint8_t> const & arena;
+
+	CollationArenaNameComparator(std::vector<uint8_t> const & rarena) : arena(rarena) {}
+
+	bool operator()(uint64_t const a, uint64_t const b) const
+	{
+		return strcmp(
+			libmaus::bambam::BamAlignmentDecoderBase::getReadName(&arena[a] + CollationPartition::headersize),
+			libmaus::bambam::BamAlignmentDecoderBase::getReadName(&arena[b] + CollationPartition::headersize)
+		) < 0;
+	}
+};
+
+CollationPartition::CollationPartition(
+	uint64_t const rid,
+	std::string const & rtmpfilename,
+	uint64_t const rmemlimit,
+	uint64_t const rbatchsize,
+	CollationAbortFlag & rabortflag,
+	libmaus::parallel::SynchronousQueue<CollationBatch *> & routputqueue,
+	uint64_t const rfardistance,
+	std::vector<uint64_t> const & rrefoffsets,
+	uint64_t const rnumbuckets,
+	uint64_t const numbatches
+)
+: id(rid), tmpfilename(rtmpfilename), memlimit(rmemlimit), batchsize(rbatchsize), abortflag(rabortflag),
+  // assume 256 bytes per pending read, keep the load factor below 1/2
+  tablefloor(2 * (rmemlimit / (headersize + 256))),
+  fardistance(rfardistance), refoffsets(rrefoffsets), numbuckets(rfardistance ? std::max(rnumbuckets,static_cast<uint64_t>(1)) : 0),
+  bucketfilenames(), bucketout(numbuckets), bucketrecords(numbuckets), farrecords(0),
+  inputbatches(std::max(numbatches,static_cast<uint64_t>(2))), outputbatches(std::max(numbatches,static_cast<uint64_t>(2))),
+  outputqueue(routputqueue), outbatch(0), arena(), table(), tableused(0), live(0), livebytes(0),
+  runs(), spillout(), spilloffset(0), failed(false)
+{
+	for ( uint64_t i = 0; i < inputbatches.size(); ++i )
+	{
+		CollationBatch::unique_ptr_type tptr(new CollationBatch(id));
+		inputbatches[i] = UNIQUE_PTR_MOVE(tptr);
+		freeInput.enque(inputbatches[i].get());
+	}
+	for ( uint64_t i = 1; i < outputbatches.size(); ++i )
+	{
+		CollationBatch::unique_ptr_type tptr(new CollationBatch(id));
+		outputbatches[i] = UNIQUE_PTR_MOVE(tptr);
+		freeOutput.enque(outputbatches[i].get());
+	}
+
+	CollationBatch::unique_ptr_type tptr(new CollationBatch(id));
+	outputbatches[0] = UNIQUE_PTR_MOVE(tptr);
+	outbatch = outputbatches[0].get();
+
+	for ( uint64_t i = 0; i < numbuckets; ++i )
+	{
+		std::ostringstream fnostr;
+		fnostr << tmpfilename << "_far_" << i;
+		bucketfilenames.push_back(fnostr.str());
+		libmaus::util::TempFileRemovalContainer::addTempFile(bucketfilenames.back());
+	}
+
+	rebuildTable(0);
+}
+
+uint64_t CollationPartition::hashName(char const * name)
+{
+	// FNV-1a followed by the murmur3 finaliser
+	uint64_t h = 14695981039346656037ull;
+
+	for ( ; *name; ++name )
+	{
+		h ^= static_cast<uint8_t>(*name);
+		h *= 1099511628211ull;
+	}
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+
+	return h;
+}
+
+uint64_t CollationPartition::getRecordSize(uint64_t const off) const
+{
+	uint32_t v;
+	memcpy(&v,&arena[off],sizeof(uint32_t));
+	return v;
+}
+
+void CollationPartition::setRecordLive(uint64_t const off, bool const islive)
+{
+	uint32_t const v = islive;
+	memcpy(&arena[off + sizeof(uint32_t)],&v,sizeof(uint32_t));
+}
+
+bool CollationPartition::isRecordLive(uint64_t const off) const
+{
+	uint32_t v;
+	memcpy(&v,&arena[off + sizeof(uint32_t)],sizeof(uint32_t));
+	return v != 0;
+}
+
+void CollationPartition::emit(
+	CollationBatch::entry_type const type, uint8_t const * Da, uint64_t const blocksizea, uint8_t const * Db, uint64_t const blocksizeb
+)
+{
+	outbatch->push(type,Da,blocksizea,Db,blocksizeb);
+
+	if ( outbatch->data.size() >= batchsize )
+		flushOutput();
+}
+
+void CollationPartition::emitPair(uint8_t const * Da, uint64_t const blocksizea, uint8_t const * Db, uint64_t const blocksizeb)
+{
+	uint32_t const flagsa = libmaus::bambam::BamAlignmentDecoderBase::getFlags(Da);
+	uint32_t const flagsb = libmaus::bambam::BamAlignmentDecoderBase::getFlags(Db);
+
+	// put first mate in front
+	if (
+		!(flagsa & libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1)
+		&&
+		(flagsb & libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1)
+	)
+		emit(CollationBatch::entry_pair,Db,blocksizeb,Da,blocksizea);
+	else
+		emit(CollationBatch::entry_pair,Da,blocksizea,Db,blocksizeb);
+}
+
+void CollationPartition::emitOrphan(uint8_t const * D, uint64_t const blocksize)
+{
+	uint32_t const flags = libmaus::bambam::BamAlignmentDecoderBase::getFlags(D);
+
+	if ( flags & libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD2 )
+		emit(CollationBatch::entry_orphan2,D,blocksize);
+	else
+		emit(CollationBatch::entry_orphan1,D,blocksize);
+}
+
+void CollationPartition::flushOutput()
+{
+	if ( outbatch->entries.size() )
+	{
+		outputqueue.enque(outbatch);
+		outbatch = freeOutput.deque();
+		outbatch->reset();
+	}
+}
+
+/*
+ * rebuild hash table from the live entries of the current table, the new table has at least
+ * four times as many slots as there are live entries and at least tablefloor slots
+ */
+void CollationPartition::rebuildTable(uint64_t const minsize)
+{
+	std::vector<uint64_t> offsets;
+	for ( uint64_t i = 0; i < table.size(); ++i )
+		if ( table[i] != emptyslot && table[i] != deletedslot )
+			offsets.push_back(table[i]-1);
+
+	uint64_t tablesize = 1024;
+	while ( tablesize < std::max(std::max(minsize,tablefloor),static_cast<uint64_t>(4*offsets.size())) )
+		tablesize <<= 1;
+
+	table.assign(tablesize,emptyslot);
+	tableused = 0;
+
+	for ( uint64_t i = 0; i < offsets.size(); ++i )
+		insertTable(offsets[i]);
+}
+
+void CollationPartition::insertTable(uint64_t const off)
+{
+	if ( 2*(tableused+1) > table.size() )
+		rebuildTable(0);
+
+	uint64_t const mask = table.size()-1;
+	uint64_t i = hashName(libmaus::bambam::BamAlignmentDecoderBase::getReadName(getRecord(off))) & mask;
+
+	while ( table[i] != emptyslot && table[i] != deletedslot )
+		i = (i+1) & mask;
+
+	if ( table[i] == emptyslot )
+		tableused += 1;
+
+	table[i] = off+1;
+}
+
+int64_t CollationPartition::findSlot(char const * name) const
+{
+	uint64_t const mask = table.size()-1;
+
+	for ( uint64_t i = hashName(name) & mask; table[i] != emptyslot; i = (i+1) & mask )
+		if (
+			table[i] != deletedslot
+			&&
+			strcmp(libmaus::bambam::BamAlignmentDecoderBase::getReadName(getRecord(table[i]-1)),name) == 0
+		)
+			return i;
+
+	return -1;
+}
+
+/*
+ * compute far mate bucket for alignment, returns -1 if the mate is near or not mapped
+ */
+int64_t CollationPartition::getFarBucket(uint8_t const * D) const
+{
+	uint32_t const flags = libmaus::bambam::BamAlignmentDecoderBase::getFlags(D);
+
+	if (
+		!(flags & libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED)
+		||
+		(flags & libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP)
+		||
+		(flags & libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FMUNMAP)
+	)
+		return -1;
+
+	int64_t const numref = static_cast<int64_t>(refoffsets.size()) - 1;
+	int64_t const refid = libmaus::bambam::BamAlignmentDecoderBase::getRefID(D);
+	int64_t const pos = libmaus::bambam::BamAlignmentDecoderBase::getPos(D);
+	int64_t const nextrefid = libmaus::bambam::BamAlignmentDecoderBase::getNextRefID(D);
+	int64_t const nextpos = libmaus::bambam::BamAlignmentDecoderBase::getNextPos(D);
+
+	if ( refid < 0 || refid >= numref || nextrefid < 0 || nextrefid >= numref || pos < 0 || nextpos < 0 )
+		return -1;
+
+	if ( refid == nextrefid && static_cast<uint64_t>(std::max(pos,nextpos) - std::min(pos,nextpos)) <= fardistance )
+		return -1;
+
+	// leftmost coordinate of the pair, this is the same for both mates
+	bool const selfleft = (refid < nextrefid) || (refid == nextrefid && pos <= nextpos);
+	uint64_t const lin = selfleft ? (refoffsets[refid] + pos) : (refoffsets[nextrefid] + nextpos);
+	uint64_t const total = std::max(refoffsets.back(),static_cast<uint64_t>(1));
+
+	return std::min(numbuckets-1,(lin * numbuckets) / total);
+}
+
+void CollationPartition::addAlignment(uint8_t const * D, uint64_t const blocksize)
+{
+	int64_t const bucket = fardistance ? getFarBucket(D) : -1;
+
+	if ( bucket < 0 )
+	{
+		collate(D,blocksize);
+		return;
+	}
+
+	if ( ! bucketout[bucket] )
+	{
+		libmaus::aio::CheckedOutputStream::unique_ptr_type tptr(new libmaus::aio::CheckedOutputStream(bucketfilenames[bucket]));
+		bucketout[bucket] = UNIQUE_PTR_MOVE(tptr);
+	}
+
+	uint8_t const lenbuf[4] = {
+		static_cast<uint8_t>((blocksize >> 0) & 0xFF),
+		static_cast<uint8_t>((blocksize >> 8) & 0xFF),
+		static_cast<uint8_t>((blocksize >> 16) & 0xFF),
+		static_cast<uint8_t>((blocksize >> 24) & 0xFF)
+	};
+	bucketout[bucket]->write(reinterpret_cast<char const *>(&lenbuf[0]),sizeof(lenbuf));
+	bucketout[bucket]->write(reinterpret_cast<char const *>(D),blocksize);
+	bucketrecords[bucket] += 1;
+	farrecords += 1;
+}
+
+/*
+ * collate the far mate buckets in order of their coordinates. Reads left unpaired stay in the
+ * pending set (and may be spilled) like reads from the main input
+ */
+void CollationPartition::collateBuckets()
+{
+	uint64_t processed = 0;
+
+	for ( uint64_t i = 0; i < numbuckets; ++i )
+		if ( bucketout[i] )
+		{
+			bucketout[i]->flush();
+			bucketout[i].reset();
+
+			CollationRunReader reader(bucketfilenames[i],0,bucketrecords[i]);
+
+			while ( reader.getNext() )
+			{
+				collate(reader.B.begin(),reader.blocksize);
+
+				if ( ((++processed) & 0xFFFFull) == 0 && abortflag.get() )
+					return;
+			}
+
+			// free disk space early
+			remove(bucketfilenames[i].c_str());
+		}
+}
+
+void CollationPartition::collate(uint8_t const * D, uint64_t const blocksize)
+{
+	uint32_t const flags = libmaus::bambam::BamAlignmentDecoderBase::getFlags(D);
+
+	if ( ! (flags & libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED) )
+	{
+		emit(CollationBatch::entry_single,D,blocksize);
+		return;
+	}
+
+	int64_t const slot = findSlot(libmaus::bambam::BamAlignmentDecoderBase::getReadName(D));
+
+	if ( slot >= 0 )
+	{
+		uint64_t const off = table[slot]-1;
+		uint64_t const recsize = getRecordSize(off);
+		emitPair(getRecord(off),recsize,D,blocksize);
+
+		setRecordLive(off,false);
+		table[slot] = deletedslot;
+		live -= 1;
+		livebytes -= headersize + recsize;
+	}
+	else
+	{
+		uint64_t const off = arena.size();
+		arena.resize(off + headersize + blocksize);
+		uint32_t const recsize = blocksize;
+		memcpy(&arena[off],&recsize,sizeof(uint32_t));
+		setRecordLive(off,true);
+		std::copy(D,D+blocksize,arena.begin() + off + headersize);
+
+		live += 1;
+		livebytes += headersize + blocksize;
+		insertTable(off);
+
+		if ( arena.size() > memlimit )
+			reorganise(false);
+	}
+}
+
+/*
+ * remove deleted records from the arena. If the live records occupy more than half of the
+ * memory limit (or if spillall is set), then the oldest records are written to the temporary
+ * file as a run sorted by name until at most half of the live data remains in memory.
+ */
+void CollationPartition::reorganise(bool const spillall)
+{
+	std::vector<uint64_t> liveoff;
+	for ( uint64_t off = 0; off < arena.size(); off += headersize + getRecordSize(off) )
+		if ( isRecordLive(off) )
+			liveoff.push_back(off);
+
+	uint64_t nspill = 0;
+
+	if ( spillall )
+	{
+		nspill = liveoff.size();
+	}
+	else if ( 2*livebytes > memlimit )
+	{
+		uint64_t spillbytes = 0;
+		while ( nspill < liveoff.size() && 2*spillbytes < livebytes )
+			spillbytes += headersize + getRecordSize(liveoff[nspill++]);
+	}
+
+	if ( nspill )
+	{
+		std::vector<uint64_t> spill(liveoff.begin(),liveoff.begin()+nspill);
+		std::sort(spill.begin(),spill.end(),CollationArenaNameComparator(arena));
+
+		if ( ! spillout )
+		{
+			libmaus::aio::CheckedOutputStream::unique_ptr_type tptr(new libmaus::aio::CheckedOutputStream(tmpfilename));
+			spillout = UNIQUE_PTR_MOVE(tptr);
+		}
+
+		runs.push_back(std::pair<uint64_t,uint64_t>(spilloffset,spill.size()));
+
+		for ( uint64_t i = 0; i < spill.size(); ++i )
+		{
+			uint64_t const recsize = getRecordSize(spill[i]);
+			uint8_t const lenbuf[4] = {
+				static_cast<uint8_t>((recsize >> 0) & 0xFF),
+				static_cast<uint8_t>((recsize >> 8) & 0xFF),
+				static_cast<uint8_t>((recsize >> 16) & 0xFF),
+				static_cast<uint8_t>((recsize >> 24) & 0xFF)
+			};
+			spillout->write(reinterpret_cast<char const *>(&lenbuf[0]),sizeof(lenbuf));
+			spillout->write(reinterpret_cast<char const *>(getRecord(spill[i])),recsize);
+			spilloffset += sizeof(lenbuf) + recsize;
+		}
+	}
+
+	// compact remaining records
+	std::vector<uint8_t> narena;
+	for ( uint64_t i = nspill; i < liveoff.size(); ++i )
+		narena.insert(
+			narena.end(),
+			arena.begin() + liveoff[i],
+			arena.begin() + liveoff[i] + headersize + getRecordSize(liveoff[i])
+		);
+	arena.swap(narena);
+
+	live = liveoff.size() - nspill;
+	livebytes = arena.size();
+
+	table.assign(0,emptyslot);
+	rebuildTable(4*live);
+	for ( uint64_t off = 0; off < arena.size(); off += headersize + getRecordSize(off) )
+		insertTable(off);
+}
+
+void CollationPartition::finish()
+{
+	collateBuckets();
+
+	if ( abortflag.get() )
+		return;
+
+	if ( ! runs.size() )
+	{
+		for ( uint64_t off = 0; off < arena.size(); off += headersize + getRecordSize(off) )
+			if ( isRecordLive(off) )
+				emitOrphan(getRecord(off),getRecordSize(off));
+
+		arena.resize(0);
+		table.assign(0,emptyslot);
+		return;
+	}
+
+	reorganise(true);
+	spillout->flush();
+	spillout.reset();
+	std::vector<uint8_t>().swap(arena);
+	std::vector<uint64_t>().swap(table);
+
+	libmaus::autoarray::AutoArray<CollationRunReader::unique_ptr_type> readers(runs.size());
+	CollationRunHeapComparator comp(readers);
+	std::priority_queue<uint64_t,std::vector<uint64_t>,CollationRunHeapComparator> Q(comp);
+
+	for ( uint64_t i = 0; i < runs.size(); ++i )
+	{
+		CollationRunReader::unique_ptr_type treader(new CollationRunReader(tmpfilename,runs[i].first,runs[i].second));
+		readers[i] = UNIQUE_PTR_MOVE(treader);
+
+		if ( readers[i]->getNext() )
+			Q.push(i);
+	}
+
+	// previous record if it has not been paired yet
+	std::vector<uint8_t> prev;
+	bool haveprev = false;
+	uint64_t merged = 0;
+
+	while ( Q.size() )
+	{
+		uint64_t const i = Q.top();
+		Q.pop();
+
+		CollationRunReader & reader = *(readers[i]);
+
+		if (
+			haveprev
+			&&
+			strcmp(libmaus::bambam::BamAlignmentDecoderBase::getReadName(&prev[0]),reader.getName()) == 0
+		)
+		{
+			emitPair(&prev[0],prev.size(),reader.B.begin(),reader.blocksize);
+			haveprev = false;
+		}
+		else
+		{
+			if ( haveprev )
+				emitOrphan(&prev[0],prev.size());
+
+			prev.assign(reader.B.begin(),reader.B.begin()+reader.blocksize);
+			haveprev = true;
+		}
+
+		if ( reader.getNext() )
+			Q.push(i);
+
+		if ( ((++merged) & 0xFFFFull) == 0 && abortflag.get() )
+			return;
+	}
+
+	if ( haveprev )
+		emitOrphan(&prev[0],prev.size());
+}
+
+bool CollationPartition::checkFailedNoThrow()
+{
+	libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+	return failed;
+}
+
+void CollationPartition::checkFailed()
+{
+	libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+
+	if ( failed )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "collation thread " << id << " failed: " << failmessage << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+void * CollationPartition::run()
+{
+	CollationBatch * batch = 0;
+
+	while ( (batch = fullInput.deque()) )
+	{
+		if ( ! checkFailedNoThrow() && ! abortflag.get() )
+		{
+			try
+			{
+				for ( uint64_t i = 0; i < batch->entries.size(); ++i )
+					addAlignment(&(batch->data[batch->entries[i].offa]),batch->entries[i].blocksizea);
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+				failed = true;
+				failmessage = ex.what();
+			}
+		}
+
+		freeInput.enque(batch);
+	}
+
+	if ( ! checkFailedNoThrow() && ! abortflag.get() )
+	{
+		try
+		{
+			finish();
+			flushOutput();
+		}
+		catch(std::exception const & ex)
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+			failed = true;
+			failmessage = ex.what();
+		}
+	}
+
+	// end of stream marker for this partition
+	outputqueue.enque(0);
+
+	return 0;
+}
+
+PartitionedCollatingBamDecoder::Reader::Reader(
+	libmaus::bambam::BamAlignmentDecoder & rdecoder,
+	uint32_t const rexcludeflags,
+	libmaus::autoarray::AutoArray<CollationPartition::unique_ptr_type> & rpartitions,
+	uint64_t const rbatchsize,
+	CollationAbortFlag & rabortflag
+)
+: decoder(rdecoder), excludeflags(rexcludeflags), partitions(rpartitions), batchsize(rbatchsize), abortflag(rabortflag), rank(0), failed(false)
+{
+
+}
+
+void * PartitionedCollatingBamDecoder::Reader::run()
+{
+	uint64_t const numpartitions = partitions.size();
+
+	try
+	{
+		libmaus::autoarray::AutoArray<CollationBatch *> batches(numpartitions);
+		for ( uint64_t i = 0; i < numpartitions; ++i )
+			batches[i] = partitions[i]->getFreeInputBatch();
+
+		libmaus::bambam::BamAlignment const & algn = decoder.getAlignment();
+
+		while ( decoder.readAlignment() )
+		{
+			if ( ((++rank) & 0xFFFFull) == 0 && abortflag.get() )
+				break;
+
+			if ( algn.getFlags() & excludeflags )
+				continue;
+
+			uint64_t const p = (CollationPartition::hashName(algn.getName()) >> 40) % numpartitions;
+			CollationBatch * batch = batches[p];
+			uint64_t const off = batch->push(algn.D.begin(),algn.blocksize);
+
+			CollationBatch::Entry entry;
+			entry.type = CollationBatch::entry_single;
+			entry.offa = off;
+			entry.blocksizea = algn.blocksize;
+			entry.offb = 0;
+			entry.blocksizeb = 0;
+			batch->entries.push_back(entry);
+
+			if ( batch->data.size() >= batchsize )
+			{
+				partitions[p]->fullInput.enque(batch);
+				batches[p] = partitions[p]->getFreeInputBatch();
+			}
+		}
+
+		for ( uint64_t i = 0; i < numpartitions; ++i )
+			if ( batches[i]->entries.size() )
+				partitions[i]->fullInput.enque(batches[i]);
+			else
+				partitions[i]->freeInput.enque(batches[i]);
+	}
+	catch(std::exception const & ex)
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+		failed = true;
+		failmessage = ex.what();
+	}
+
+	// end of input marker for the partitions
+	for ( uint64_t i = 0; i < numpartitions; ++i )
+		partitions[i]->fullInput.enque(0);
+
+	return 0;
+}
+
+void PartitionedCollatingBamDecoder::Reader::checkFailed()
+{
+	libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+
+	if ( failed )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "collation input thread failed: " << failmessage << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+PartitionedCollatingBamDecoder::PartitionedCollatingBamDecoder(
+	libmaus::bambam::BamAlignmentDecoder & rdecoder,
+	std::string const & tmpfilenamebase,
+	uint32_t const excludeflags,
+	uint64_t const numpartitions,
+	uint64_t const memlimit,
+	uint64_t const fardistance,
+	uint64_t const numbuckets,
+	uint64_t const batchsize
+)
+: decoder(rdecoder), header(rdecoder.getHeader()), refoffsets(), abortflag(), outputqueue(),
+  partitions(std::max(numpartitions,static_cast<uint64_t>(1))),
+  reader(rdecoder,excludeflags,partitions,std::max(batchsize,static_cast<uint64_t>(1)),abortflag),
+  outbatch(0), outindex(0), finished(0), joined(false), OBE()
+{
+	// small limits are allowed, they only lead to more runs in the temporary files
+	uint64_t const partmemlimit = std::max(memlimit / partitions.size(), static_cast<uint64_t>(4096));
+
+	uint64_t refoffset = 0;
+	for ( uint64_t i = 0; i < header.getNumRef(); ++i )
+	{
+		refoffsets.push_back(refoffset);
+		refoffset += header.getRefIDLength(i);
+	}
+	refoffsets.push_back(refoffset);
+
+	for ( uint64_t i = 0; i < partitions.size(); ++i )
+	{
+		std::ostringstream fnostr;
+		fnostr << tmpfilenamebase << "_" << i;
+		std::string const fn = fnostr.str();
+		libmaus::util::TempFileRemovalContainer::addTempFile(fn);
+
+		CollationPartition::unique_ptr_type tptr(
+			new CollationPartition(
+				i,fn,partmemlimit,std::max(batchsize,static_cast<uint64_t>(1)),abortflag,outputqueue,
+				fardistance,refoffsets,numbuckets
+			)
+		);
+		partitions[i] = UNIQUE_PTR_MOVE(tptr);
+	}
+
+	for ( uint64_t i = 0; i < partitions.size(); ++i )
+		partitions[i]->start();
+	reader.start();
+}
+
+PartitionedCollatingBamDecoder::~PartitionedCollatingBamDecoder()
+{
+	if ( ! joined )
+	{
+		// stop the threads and drain the pipeline
+		abortflag.set();
+
+		try
+		{
+			while ( process() )
+			{
+			}
+		}
+		catch(...)
+		{
+		}
+	}
+}
+
+void PartitionedCollatingBamDecoder::join()
+{
+	reader.join();
+	for ( uint64_t i = 0; i < partitions.size(); ++i )
+		partitions[i]->join();
+	joined = true;
+}
+
+PartitionedCollatingBamDecoder::OutputBufferEntry * PartitionedCollatingBamDecoder::process()
+{
+	while ( true )
+	{
+		if ( outbatch && outindex < outbatch->entries.size() )
+		{
+			CollationBatch::Entry const & entry = outbatch->entries[outindex++];
+
+			OBE.Da = &(outbatch->data[entry.offa]);
+			OBE.blocksizea = entry.blocksizea;
+			OBE.Db = (entry.type == CollationBatch::entry_pair) ? &(outbatch->data[entry.offb]) : 0;
+			OBE.blocksizeb = entry.blocksizeb;
+			OBE.fpair = (entry.type == CollationBatch::entry_pair);
+			OBE.fsingle = (entry.type == CollationBatch::entry_single);
+			OBE.forphan1 = (entry.type == CollationBatch::entry_orphan1);
+			OBE.forphan2 = (entry.type == CollationBatch::entry_orphan2);
+
+			return &OBE;
+		}
+
+		if ( outbatch )
+		{
+			partitions[outbatch->partition]->returnOutputBatch(outbatch);
+			outbatch = 0;
+		}
+
+		if ( finished == partitions.size() )
+		{
+			if ( ! joined )
+			{
+				join();
+
+				reader.checkFailed();
+				for ( uint64_t i = 0; i < partitions.size(); ++i )
+					partitions[i]->checkFailed();
+			}
+
+			return 0;
+		}
+
+		CollationBatch * batch = outputqueue.deque();
+
+		if ( batch )
+		{
+			outbatch = batch;
+			outindex = 0;
+		}
+		else
+		{
+			finished += 1;
+		}
+	}
+}
+
+uint64_t PartitionedCollatingBamDecoder::getNumSpilled() const
+{
+	uint64_t numspilled = 0;
+	for ( uint64_t i = 0; i < partitions.size(); ++i )
+		if ( partitions[i]->isSpilled() )
+			numspilled += 1;
+	return numspilled;
+}
+
+uint64_t PartitionedCollatingBamDecoder::getNumFar() const
+{
+	uint64_t numfar = 0;
+	for ( uint64_t i = 0; i < partitions.size(); ++i )
+		numfar += partitions[i]->farrecords;
+	return numfar;
+}
@@ -0,0 +1,379 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_PARTITIONEDCOLLATINGBAMDECODER_HPP)
+#define BIOBAMBAM_PARTITIONEDCOLLATINGBAMDECODER_HPP
+
+#include <libmaus/aio/CheckedInputStream.hpp>
+#include <libmaus/aio/CheckedOutputStream.hpp>
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/bambam/BamAlignmentDecoder.hpp>
+#include <libmaus/bambam/BamHeader.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * batch of alignments passed between the threads of the partitioned collator. Each alignment
+ * is stored as a 32 bit little endian block size followed by the alignment block. For output
+ * batches an entry refers to one or two (for pairs) alignments.
+ **/
+struct CollationBatch
+{
+	typedef CollationBatch this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	enum entry_type { entry_pair, entry_single, entry_orphan1, entry_orphan2 };
+
+	struct Entry
+	{
+		entry_type type;
+		uint64_t offa;
+		uint64_t blocksizea;
+		uint64_t offb;
+		uint64_t blocksizeb;
+	};
+
+	// id of the partition owning the batch
+	uint64_t const partition;
+	std::vector<uint8_t> data;
+	std::vector<Entry> entries;
+
+	CollationBatch(uint64_t const rpartition) : partition(rpartition) {}
+
+	void reset()
+	{
+		data.resize(0);
+		entries.resize(0);
+	}
+
+	uint64_t push(uint8_t const * D, uint64_t const blocksize);
+	void push(entry_type const type, uint8_t const * Da, uint64_t const blocksizea, uint8_t const * Db = 0, uint64_t const blocksizeb = 0);
+};
+
+/**
+ * sequential reader for a run of alignments sorted by name in a temporary file
+ **/
+struct CollationRunReader
+{
+	typedef CollationRunReader this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	libmaus::aio::CheckedInputStream::unique_ptr_type CIS;
+	uint64_t left;
+	libmaus::autoarray::AutoArray<uint8_t> B;
+	uint64_t blocksize;
+
+	CollationRunReader(std::string const & filename, uint64_t const offset, uint64_t const numrecords);
+	bool getNext();
+	char const * getName() const;
+};
+
+/**
+ * flag used to stop the threads of the partitioned collator early
+ **/
+struct CollationAbortFlag
+{
+	libmaus::parallel::PosixSpinLock lock;
+	bool aborted;
+
+	CollationAbortFlag() : aborted(false) {}
+
+	void set()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(lock);
+		aborted = true;
+	}
+
+	bool get()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(lock);
+		return aborted;
+	}
+};
+
+/**
+ * collation thread for one partition of the read name space. Reads are kept in an insertion
+ * ordered arena indexed by an open addressing hash table until their mate arrives. If the arena
+ * exceeds memlimit bytes, then the older half of the pending reads is written to the partition's
+ * temporary file as a run sorted by name. At the end of the input the runs are merged and
+ * reads with equal names are paired.
+ *
+ * If fardistance is not zero, then mapped reads whose mate is mapped to a different reference
+ * sequence or more than fardistance positions away are not kept in memory. Such reads are
+ * written to one of numbuckets bucket files chosen by the leftmost coordinate of the pair, so
+ * both mates end up in the same bucket. The buckets are collated one after the other after the
+ * end of the input.
+ **/
+struct CollationPartition : public libmaus::parallel::PosixThread
+{
+	typedef CollationPartition this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	static uint64_t const emptyslot = 0;
+	static uint64_t const deletedslot = ~static_cast<uint64_t>(0);
+	// arena record header: 32 bit block size, 32 bit live flag
+	static uint64_t const headersize = 2*sizeof(uint32_t);
+
+	uint64_t const id;
+	std::string const tmpfilename;
+	uint64_t const memlimit;
+	uint64_t const batchsize;
+	CollationAbortFlag & abortflag;
+	// minimum hash table size derived from memlimit
+	uint64_t const tablefloor;
+
+	// far mate buckets
+	uint64_t const fardistance;
+	std::vector<uint64_t> const & refoffsets;
+	uint64_t const numbuckets;
+	std::vector<std::string> bucketfilenames;
+	libmaus::autoarray::AutoArray<libmaus::aio::CheckedOutputStream::unique_ptr_type> bucketout;
+	std::vector<uint64_t> bucketrecords;
+	uint64_t farrecords;
+
+	libmaus::autoarray::AutoArray<CollationBatch::unique_ptr_type> inputbatches;
+	libmaus::parallel::SynchronousQueue<CollationBatch *> freeInput;
+	libmaus::parallel::SynchronousQueue<CollationBatch *> fullInput;
+
+	libmaus::autoarray::AutoArray<CollationBatch::unique_ptr_type> outputbatches;
+	libmaus::parallel::SynchronousQueue<CollationBatch *> freeOutput;
+	libmaus::parallel::SynchronousQueue<CollationBatch *> & outputqueue;
+	CollationBatch * outbatch;
+
+	// pending reads
+	std::vector<uint8_t> arena;
+	std::vector<uint64_t> table;
+	uint64_t tableused;
+	uint64_t live;
+	uint64_t livebytes;
+
+	// spilled runs (file offset, number of records)
+	std::vector< std::pair<uint64_t,uint64_t> > runs;
+	libmaus::aio::CheckedOutputStream::unique_ptr_type spillout;
+	uint64_t spilloffset;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	bool failed;
+	std::string failmessage;
+
+	CollationPartition(
+		uint64_t const rid,
+		std::string const & rtmpfilename,
+		uint64_t const rmemlimit,
+		uint64_t const rbatchsize,
+		CollationAbortFlag & rabortflag,
+		libmaus::parallel::SynchronousQueue<CollationBatch *> & routputqueue,
+		uint64_t const rfardistance,
+		std::vector<uint64_t> const & rrefoffsets,
+		uint64_t const rnumbuckets,
+		uint64_t const numbatches = 4
+	);
+
+	static uint64_t hashName(char const * name);
+
+	CollationBatch * getFreeInputBatch()
+	{
+		CollationBatch * batch = freeInput.deque();
+		batch->reset();
+		return batch;
+	}
+
+	void returnOutputBatch(CollationBatch * batch)
+	{
+		freeOutput.enque(batch);
+	}
+
+	bool isSpilled() const
+	{
+		return runs.size() != 0;
+	}
+
+	bool checkFailedNoThrow();
+	void checkFailed();
+
+	void * run();
+
+	private:
+	uint8_t const * getRecord(uint64_t const off) const { return &arena[off] + headersize; }
+	uint64_t getRecordSize(uint64_t const off) const;
+	void setRecordLive(uint64_t const off, bool const islive);
+	bool isRecordLive(uint64_t const off) const;
+
+	void emit(CollationBatch::entry_type const type, uint8_t const * Da, uint64_t const blocksizea, uint8_t const * Db = 0, uint64_t const blocksizeb = 0);
+	void emitPair(uint8_t const * Da, uint64_t const blocksizea, uint8_t const * Db, uint64_t const blocksizeb);
+	void emitOrphan(uint8_t const * D, uint64_t const blocksize);
+	void flushOutput();
+
+	void rebuildTable(uint64_t const minsize);
+	void insertTable(uint64_t const off);
+	int64_t findSlot(char const * name) const;
+	int64_t getFarBucket(uint8_t const * D) const;
+	void addAlignment(uint8_t const * D, uint64_t const blocksize);
+	void collate(uint8_t const * D, uint64_t const blocksize);
+	void collateBuckets();
+	void reorganise(bool const spillall);
+	void finish();
+};
+
+/**
+ * collating decoder processing partitions of the read name space in parallel. A reader thread
+ * decodes the input and distributes the alignments to numpartitions collation threads by a hash
+ * value of the read name. Each collation thread uses its own overflow file tmpfilenamebase_<id>.
+ * The output of the partitions is merged into a single stream of entries with the same
+ * interface as the entries returned by CircularHashCollatingBamDecoder. The order of the
+ * entries depends on thread scheduling. The memory used for reads waiting for their mate is
+ * bounded by memlimit, see CollationPartition for the handling of far mates (fardistance > 0).
+ **/
+struct PartitionedCollatingBamDecoder
+{
+	typedef PartitionedCollatingBamDecoder this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	struct OutputBufferEntry
+	{
+		uint8_t const * Da;
+		uint64_t blocksizea;
+		uint8_t const * Db;
+		uint64_t blocksizeb;
+		bool fpair;
+		bool fsingle;
+		bool forphan1;
+		bool forphan2;
+
+		OutputBufferEntry()
+		: Da(0), blocksizea(0), Db(0), blocksizeb(0), fpair(false), fsingle(false), forphan1(false), forphan2(false)
+		{}
+	};
+
+	/**
+	 * input thread
+	 **/
+	struct Reader : public libmaus::parallel::PosixThread
+	{
+		libmaus::bambam::BamAlignmentDecoder & decoder;
+		uint32_t const excludeflags;
+		libmaus::autoarray::AutoArray<CollationPartition::unique_ptr_type> & partitions;
+		uint64_t const batchsize;
+		CollationAbortFlag & abortflag;
+		uint64_t rank;
+
+		libmaus::parallel::PosixSpinLock failedlock;
+		bool failed;
+		std::string failmessage;
+
+		Reader(
+			libmaus::bambam::BamAlignmentDecoder & rdecoder,
+			uint32_t const rexcludeflags,
+			libmaus::autoarray::AutoArray<CollationPartition::unique_ptr_type> & rpartitions,
+			uint64_t const rbatchsize,
+			CollationAbortFlag & rabortflag
+		);
+
+		void * run();
+		void checkFailed();
+	};
+
+	libmaus::bambam::BamAlignmentDecoder & decoder;
+	libmaus::bambam::BamHeader const & header;
+	// start of each reference sequence on the concatenated coordinate axis (plus total length)
+	std::vector<uint64_t> refoffsets;
+	CollationAbortFlag abortflag;
+	libmaus::parallel::SynchronousQueue<CollationBatch *> outputqueue;
+	libmaus::autoarray::AutoArray<CollationPartition::unique_ptr_type> partitions;
+	Reader reader;
+
+	CollationBatch * outbatch;
+	uint64_t outindex;
+	uint64_t finished;
+	bool joined;
+	OutputBufferEntry OBE;
+
+	static uint64_t getDefaultMemLimit()
+	{
+		return 1024ull*1024ull*1024ull;
+	}
+
+	static uint64_t getDefaultBatchSize()
+	{
+		return 1024*1024;
+	}
+
+	static uint64_t getDefaultFarDistance()
+	{
+		return 0;
+	}
+
+	static uint64_t getDefaultNumBuckets()
+	{
+		return 32;
+	}
+
+	PartitionedCollatingBamDecoder(
+		libmaus::bambam::BamAlignmentDecoder & rdecoder,
+		std::string const & tmpfilenamebase,
+		uint32_t const excludeflags,
+		uint64_t const numpartitions,
+		uint64_t const memlimit = getDefaultMemLimit(),
+		uint64_t const fardistance = getDefaultFarDistance(),
+		uint64_t const numbuckets = getDefaultNumBuckets(),
+		uint64_t const batchsize = getDefaultBatchSize()
+	);
+	~PartitionedCollatingBamDecoder();
+
+	libmaus::bambam::BamHeader const & getHeader() const
+	{
+		return header;
+	}
+
+	void disableValidation()
+	{
+		decoder.disableValidation();
+	}
+
+	/**
+	 * @return next collated entry or null pointer at the end of the input. The returned entry
+	 *         is valid until the next call.
+	 **/
+	OutputBufferEntry * process();
+
+	/**
+	 * @return number of alignments read from the input
+	 **/
+	uint64_t getRank() const
+	{
+		return reader.rank;
+	}
+
+	/**
+	 * @return number of partitions which spilled pending reads to their overflow files
+	 **/
+	uint64_t getNumSpilled() const;
+
+	/**
+	 * @return number of reads processed via the far mate buckets
+	 **/
+	uint64_t getNumFar() const;
+
+	private:
+	void join();
+};
+#endif
@@ -0,0 +1,313 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/ReferenceRegions.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+std::vector<ReferenceRegion> computeReferenceRegions(libmaus::bambam::BamHeader const & header, uint64_t const chunksize)
+{
+	std::vector<ReferenceRegion> V;
+
+	for ( uint64_t i = 0; i < header.getNumRef(); ++i )
+	{
+		uint64_t const len = header.getRefIDLength(i);
+
+		if ( ! chunksize || len <= chunksize )
+			V.push_back(ReferenceRegion(i,0,len));
+		else
+			for ( uint64_t from = 0; from < len; from += chunksize )
+				V.push_back(ReferenceRegion(i,from,std::min(from+chunksize,len)));
+	}
+
+	return V;
+}
+
+bool checkReferenceRegionNames(libmaus::bambam::BamHeader const & header)
+{
+	for ( uint64_t i = 0; i < header.getNumRef(); ++i )
+		if ( header.getRefIDName(i).find(':') != std::string::npos )
+			return false;
+
+	return true;
+}
+
+libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type constructReferenceRegionDecoder(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	ReferenceRegion const & R
+)
+{
+	if ( header.getRefIDName(R.refid).find(':') != std::string::npos )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "Reference sequence name " << header.getRefIDName(R.refid) << " contains a colon and cannot be used in a region query" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	// query one base more on both sides (range coordinates are 1 based and inclusive)
+	std::ostringstream rangestr;
+	rangestr << header.getRefIDName(R.refid) << ":" << std::max(R.from,static_cast<uint64_t>(1)) << "-" << (R.to+1);
+	std::string const range = rangestr.str();
+
+	// replace any range given by the user, both keys are set so it does not matter which one the factory looks at
+	libmaus::util::ArgInfo rarginfo(arginfo);
+	rarginfo.replaceKey("range",range);
+	rarginfo.replaceKey("ranges",range);
+
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type tptr(
+		libmaus::bambam::BamMultiAlignmentDecoderFactory::construct(rarginfo));
+	return UNIQUE_PTR_MOVE(tptr);
+}
+
+void checkReferenceRegionInput(libmaus::util::ArgInfo const & arginfo, std::string const & defaultinputformat)
+{
+	std::string const inputformat = arginfo.getValue<std::string>("inputformat",defaultinputformat);
+
+	if ( ! (arginfo.hasArg("filename") || arginfo.hasArg("I")) || (inputformat != "bam" && inputformat != "cram") )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "Processing by region requires an indexed BAM or CRAM file given via the filename or I key" << std::endl;
+		se.finish();
+		throw se;
+	}
+}
+
+ReferenceRegionOutputSlot::ReferenceRegionOutputSlot(uint64_t const numpieces)
+: pieces(std::max(numpieces,static_cast<uint64_t>(1))), freepieces(), fullpieces()
+{
+	for ( uint64_t i = 0; i < pieces.size(); ++i )
+		freepieces.enque(&pieces[i]);
+}
+
+ReferenceRegionOutputStreamBuffer::ReferenceRegionOutputStreamBuffer(
+	ReferenceRegionScheduler & rscheduler, ReferenceRegionOutputSlot & rslot, uint64_t const rstream, uint64_t const piecesize
+)
+: scheduler(rscheduler), slot(rslot), stream(rstream), buffer(std::max(piecesize,static_cast<uint64_t>(1)),false)
+{
+	setp(buffer.begin(),buffer.end());
+}
+
+/*
+ * pass the buffered data to the writer. The data is dropped after a failure, the writer only
+ * writes the regions claimed before the failure and may not wait for this one.
+ */
+void ReferenceRegionOutputStreamBuffer::putPiece()
+{
+	uint64_t const n = pptr()-pbase();
+
+	if ( n && ! scheduler.getFailed() )
+	{
+		ReferenceRegionOutputPiece * piece = slot.freepieces.deque();
+		piece->stream = stream;
+		piece->data.assign(pbase(),n);
+		slot.fullpieces.enque(piece);
+	}
+
+	setp(buffer.begin(),buffer.end());
+}
+
+ReferenceRegionOutputStreamBuffer::int_type ReferenceRegionOutputStreamBuffer::overflow(int_type c)
+{
+	putPiece();
+
+	if ( ! traits_type::eq_int_type(c,traits_type::eof()) )
+	{
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+
+	return traits_type::not_eof(c);
+}
+
+int ReferenceRegionOutputStreamBuffer::sync()
+{
+	putPiece();
+	return 0;
+}
+
+ReferenceRegionScheduler::ReferenceRegionScheduler(
+	std::vector<ReferenceRegion> const & rregions,
+	ReferenceRegionProcessor & rprocessor,
+	uint64_t const numslots,
+	uint64_t const rnumstreams,
+	uint64_t const rpiecesize,
+	uint64_t const numpieces
+)
+: regions(rregions), processor(rprocessor), numstreams(rnumstreams), piecesize(rpiecesize),
+  slots(std::max(numslots,static_cast<uint64_t>(1))), tokens(), lock(), nextregion(0), failed(false), failmessage()
+{
+	for ( uint64_t i = 0; i < slots.size(); ++i )
+	{
+		ReferenceRegionOutputSlot::unique_ptr_type tptr(new ReferenceRegionOutputSlot(numpieces));
+		slots[i] = UNIQUE_PTR_MOVE(tptr);
+		tokens.enque(i);
+	}
+}
+
+uint64_t ReferenceRegionScheduler::claimRegion()
+{
+	libmaus::parallel::ScopePosixSpinLock slock(lock);
+
+	if ( failed || nextregion == regions.size() )
+		return regions.size();
+	else
+		return nextregion++;
+}
+
+uint64_t ReferenceRegionScheduler::getWriteLimit()
+{
+	libmaus::parallel::ScopePosixSpinLock slock(lock);
+	return failed ? nextregion : regions.size();
+}
+
+void ReferenceRegionScheduler::setFailed(std::string const & message)
+{
+	libmaus::parallel::ScopePosixSpinLock slock(lock);
+
+	if ( ! failed )
+	{
+		failed = true;
+		failmessage = message;
+	}
+}
+
+bool ReferenceRegionScheduler::getFailed()
+{
+	libmaus::parallel::ScopePosixSpinLock slock(lock);
+	return failed;
+}
+
+void ReferenceRegionScheduler::work()
+{
+	while ( true )
+	{
+		uint64_t const token = tokens.deque();
+		uint64_t const i = claimRegion();
+
+		if ( i == regions.size() )
+		{
+			// pass the token on to the next waiting thread
+			tokens.enque(token);
+			return;
+		}
+
+		ReferenceRegionOutputSlot & slot = *(slots[i % slots.size()]);
+
+		try
+		{
+			libmaus::autoarray::AutoArray<ReferenceRegionOutputStream::unique_ptr_type> streams(numstreams);
+			std::vector<std::ostream *> out(numstreams);
+
+			for ( uint64_t j = 0; j < numstreams; ++j )
+			{
+				ReferenceRegionOutputStream::unique_ptr_type tptr(new ReferenceRegionOutputStream(*this,slot,j,piecesize));
+				streams[j] = UNIQUE_PTR_MOVE(tptr);
+				out[j] = streams[j].get();
+			}
+
+			processor.processRegion(i,regions[i],out);
+
+			for ( uint64_t j = 0; j < numstreams; ++j )
+				streams[j]->flush();
+		}
+		catch(std::exception const & ex)
+		{
+			setFailed(ex.what());
+		}
+
+		// end of region
+		slot.fullpieces.enque(0);
+	}
+}
+
+void ReferenceRegionScheduler::write(int const verbose)
+{
+	for ( uint64_t i = 0; i < getWriteLimit(); ++i )
+	{
+		ReferenceRegionOutputSlot & slot = *(slots[i % slots.size()]);
+		ReferenceRegionOutputPiece * piece = 0;
+
+		while ( (piece = slot.fullpieces.deque()) )
+		{
+			try
+			{
+				if ( ! getFailed() )
+					processor.writePiece(i,piece->stream,piece->data.c_str(),piece->data.size());
+			}
+			catch(std::exception const & ex)
+			{
+				setFailed(ex.what());
+			}
+
+			slot.freepieces.enque(piece);
+		}
+
+		try
+		{
+			if ( ! getFailed() )
+				processor.finishRegion(i);
+		}
+		catch(std::exception const & ex)
+		{
+			setFailed(ex.what());
+		}
+
+		// the slot is free for the next region
+		tokens.enque(i % slots.size());
+
+		if ( verbose && ! getFailed() )
+			std::cerr << "[V] " << (i+1) << "/" << regions.size() << " regions" << std::endl;
+	}
+}
+
+void processReferenceRegions(
+	std::vector<ReferenceRegion> const & regions,
+	ReferenceRegionProcessor & processor,
+	uint64_t const numthreads,
+	uint64_t const numstreams,
+	int const verbose
+)
+{
+	uint64_t const nthreads = std::max(numthreads,static_cast<uint64_t>(1));
+	ReferenceRegionScheduler scheduler(regions,processor,2*nthreads,numstreams,64*1024,4);
+	libmaus::autoarray::AutoArray<ReferenceRegionWorker::unique_ptr_type> workers(nthreads);
+
+	for ( uint64_t i = 0; i < workers.size(); ++i )
+	{
+		ReferenceRegionWorker::unique_ptr_type tptr(new ReferenceRegionWorker(scheduler));
+		workers[i] = UNIQUE_PTR_MOVE(tptr);
+		workers[i]->start();
+	}
+
+	scheduler.write(verbose);
+
+	for ( uint64_t i = 0; i < workers.size(); ++i )
+		workers[i]->join();
+
+	if ( scheduler.getFailed() )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << scheduler.failmessage << std::endl;
+		se.finish();
+		throw se;
+	}
+}
@@ -0,0 +1,244 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_REFERENCEREGIONS_HPP)
+#define BIOBAMBAM_REFERENCEREGIONS_HPP
+
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/bambam/BamHeader.hpp>
+#include <libmaus/bambam/BamMultiAlignmentDecoderFactory.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
+#include <libmaus/util/ArgInfo.hpp>
+#include <libmaus/util/unique_ptr.hpp>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * half open interval [from,to) on reference sequence refid
+ **/
+struct ReferenceRegion
+{
+	uint64_t refid;
+	uint64_t from;
+	uint64_t to;
+
+	ReferenceRegion() : refid(0), from(0), to(0) {}
+	ReferenceRegion(uint64_t const rrefid, uint64_t const rfrom, uint64_t const rto) : refid(rrefid), from(rfrom), to(rto) {}
+};
+
+/**
+ * split the reference sequences in header into regions in header order. Each reference sequence
+ * is split into pieces of chunksize bases, chunksize=0 means one region per reference sequence.
+ **/
+std::vector<ReferenceRegion> computeReferenceRegions(libmaus::bambam::BamHeader const & header, uint64_t const chunksize);
+
+/**
+ * return true if all reference sequences of header can be used in region queries. Region queries
+ * are given as name:from-to, which is ambiguous for names containing a colon.
+ **/
+bool checkReferenceRegionNames(libmaus::bambam::BamHeader const & header);
+
+/**
+ * construct a decoder for the alignments overlapping region R using the index of the input
+ * file given by the filename or I key of arginfo. Any ranges given in arginfo are replaced.
+ * The decoder may return additional alignments close to the region borders.
+ **/
+libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type constructReferenceRegionDecoder(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	ReferenceRegion const & R
+);
+
+/**
+ * throw an exception if the input described by arginfo cannot be used for region queries
+ **/
+void checkReferenceRegionInput(libmaus::util::ArgInfo const & arginfo, std::string const & defaultinputformat);
+
+/**
+ * piece of the output of a region, stream is the index of the output stream the data belongs to
+ **/
+struct ReferenceRegionOutputPiece
+{
+	uint64_t stream;
+	std::string data;
+
+	ReferenceRegionOutputPiece() : stream(0), data() {}
+};
+
+/**
+ * output channel for the region processed in a slot. The thread processing the region blocks
+ * if all pieces of the slot are waiting for the writer. A null pointer in fullpieces marks the
+ * end of the region.
+ **/
+struct ReferenceRegionOutputSlot
+{
+	typedef ReferenceRegionOutputSlot this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	libmaus::autoarray::AutoArray<ReferenceRegionOutputPiece> pieces;
+	libmaus::parallel::SynchronousQueue<ReferenceRegionOutputPiece *> freepieces;
+	libmaus::parallel::SynchronousQueue<ReferenceRegionOutputPiece *> fullpieces;
+
+	ReferenceRegionOutputSlot(uint64_t const numpieces);
+};
+
+struct ReferenceRegionScheduler;
+
+/**
+ * stream buffer passing the data written to it to the output slot of a region in pieces of
+ * at most piecesize bytes
+ **/
+struct ReferenceRegionOutputStreamBuffer : public std::streambuf
+{
+	ReferenceRegionScheduler & scheduler;
+	ReferenceRegionOutputSlot & slot;
+	uint64_t const stream;
+	libmaus::autoarray::AutoArray<char> buffer;
+
+	ReferenceRegionOutputStreamBuffer(ReferenceRegionScheduler & rscheduler, ReferenceRegionOutputSlot & rslot, uint64_t const rstream, uint64_t const piecesize);
+
+	void putPiece();
+	int_type overflow(int_type c = traits_type::eof());
+	int sync();
+};
+
+/**
+ * output stream of a region
+ **/
+struct ReferenceRegionOutputStream : public ReferenceRegionOutputStreamBuffer, public std::ostream
+{
+	typedef ReferenceRegionOutputStream this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	ReferenceRegionOutputStream(ReferenceRegionScheduler & rscheduler, ReferenceRegionOutputSlot & rslot, uint64_t const rstream, uint64_t const piecesize)
+	: ReferenceRegionOutputStreamBuffer(rscheduler,rslot,rstream,piecesize), std::ostream(this)
+	{
+	}
+};
+
+/**
+ * computation and output of regions used by processReferenceRegions
+ **/
+struct ReferenceRegionProcessor
+{
+	virtual ~ReferenceRegionProcessor() {}
+
+	/**
+	 * compute region R with index i and write its output to the streams in out. Called by the
+	 * worker threads, each region is processed once.
+	 **/
+	virtual void processRegion(uint64_t const i, ReferenceRegion const & R, std::vector<std::ostream *> const & out) = 0;
+
+	/**
+	 * write a piece of the output of region i to output stream stream. Called by the writer in region order.
+	 **/
+	virtual void writePiece(uint64_t const i, uint64_t const stream, char const * data, uint64_t const n) = 0;
+
+	/**
+	 * called by the writer after the last piece of region i
+	 **/
+	virtual void finishRegion(uint64_t const i) = 0;
+};
+
+/**
+ * state shared by the worker threads and the writer of processReferenceRegions
+ **/
+struct ReferenceRegionScheduler
+{
+	std::vector<ReferenceRegion> const & regions;
+	ReferenceRegionProcessor & processor;
+	uint64_t const numstreams;
+	uint64_t const piecesize;
+
+	// output slots, region i uses slot i % slots.size()
+	libmaus::autoarray::AutoArray<ReferenceRegionOutputSlot::unique_ptr_type> slots;
+	// one token per slot, a worker needs a token to claim a region, the writer returns it after the region is written
+	libmaus::parallel::SynchronousQueue<uint64_t> tokens;
+
+	libmaus::parallel::PosixSpinLock lock;
+	uint64_t nextregion;
+	bool failed;
+	std::string failmessage;
+
+	ReferenceRegionScheduler(
+		std::vector<ReferenceRegion> const & rregions,
+		ReferenceRegionProcessor & rprocessor,
+		uint64_t const numslots,
+		uint64_t const numstreams,
+		uint64_t const piecesize,
+		uint64_t const numpieces
+	);
+
+	/**
+	 * return the next region to be processed or regions.size() if there is none. No regions are claimed after a failure.
+	 **/
+	uint64_t claimRegion();
+	/**
+	 * number of regions the writer has to write, this is the number of claimed regions after a failure
+	 **/
+	uint64_t getWriteLimit();
+	void setFailed(std::string const & message);
+	bool getFailed();
+	/**
+	 * claim and process regions until there are no more
+	 **/
+	void work();
+	/**
+	 * write the output of all regions in order
+	 **/
+	void write(int const verbose);
+};
+
+/**
+ * worker thread of processReferenceRegions
+ **/
+struct ReferenceRegionWorker : public libmaus::parallel::PosixThread
+{
+	typedef ReferenceRegionWorker this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	ReferenceRegionScheduler & scheduler;
+
+	ReferenceRegionWorker(ReferenceRegionScheduler & rscheduler) : scheduler(rscheduler) {}
+
+	void * run()
+	{
+		scheduler.work();
+		return 0;
+	}
+};
+
+/**
+ * process regions on numthreads threads. The regions are claimed in order by the threads and
+ * their output is passed to processor.writePiece by the calling thread in region order while
+ * they are processed. At most 2*numthreads regions are in progress at any time and the output
+ * of each is buffered in at most four pieces of 64KiB, so the memory used for output does not
+ * depend on the size of the regions.
+ **/
+void processReferenceRegions(
+	std::vector<ReferenceRegion> const & regions,
+	ReferenceRegionProcessor & processor,
+	uint64_t const numthreads,
+	uint64_t const numstreams,
+	int const verbose
+);
+#endif
@@ -0,0 +1,764 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#include <biobambam/TempFileCompression.hpp>
+#include <biobambam/BamBamConfig.hpp>
+#include <libmaus/autoarray/AutoArray.hpp>
+#include <libmaus/bambam/BamBlockWriterBaseFactory.hpp>
+#include <libmaus/exception/LibMausException.hpp>
+#include <libmaus/lz/SnappyCompressorObjectFactory.hpp>
+#include <libmaus/lz/SnappyDecompressorObjectFactory.hpp>
+#include <libmaus/lz/ZlibCompressorObjectFactory.hpp>
+#include <libmaus/lz/ZlibDecompressorObjectFactory.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/timing/RealTimeClock.hpp>
+#include <libmaus/util/TempFileRemovalContainer.hpp>
+
+#if defined(BIOBAMBAM_HAVE_LZ4)
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#if defined(BIOBAMBAM_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+static bool tempFileCompressionStartsWith(std::string const & a, std::string const & b)
+{
+	return	a.size() >= b.size() && a.substr(0,b.size()) == b;
+}
+
+/**
+ * parse optional level suffix of a compression setting (e.g. zstd:3), returns deflevel if there is none
+ **/
+static int64_t parseTempFileCompressionLevel(std::string const & tempcomp, std::string const & name, int64_t const deflevel)
+{
+	if ( tempcomp == name )
+		return deflevel;
+
+	std::string const levelstr = tempcomp.substr(name.size()+1);
+	std::istringstream levelistr(levelstr);
+	int64_t level = deflevel;
+	levelistr >> level;
+
+	if ( ! levelistr )
+	{
+		libmaus::exception::LibMausException lme;
+		lme.getStream() << "Cannot parse compression setting in " << tempcomp << std::endl;
+		lme.finish();
+		throw lme;
+	}
+
+	return level;
+}
+
+static void ensureTempFileCompressionOutputSize(libmaus::autoarray::AutoArray<char> & output, uint64_t const size)
+{
+	if ( output.size() < size )
+		output = libmaus::autoarray::AutoArray<char>(size,false);
+}
+
+#if defined(BIOBAMBAM_HAVE_LZ4)
+struct Lz4CompressorObject : public libmaus::lz::CompressorObject
+{
+	// 0 for LZ4 default compression, > 0 for LZ4HC using the given level
+	int const level;
+
+	Lz4CompressorObject(int const rlevel) : level(rlevel) {}
+	virtual ~Lz4CompressorObject() {}
+
+	virtual size_t compress(char const * input, size_t inputLength, libmaus::autoarray::AutoArray<char> & output)
+	{
+		int const bound = LZ4_compressBound(inputLength);
+		ensureTempFileCompressionOutputSize(output,bound);
+
+		int const r =
+			level ?
+			LZ4_compress_HC(input,output.begin(),inputLength,bound,level)
+			:
+			LZ4_compress_default(input,output.begin(),inputLength,bound);
+
+		if ( r <= 0 )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "Lz4CompressorObject::compress: compression failed" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		return r;
+	}
+
+	virtual std::string getDescription() const
+	{
+		std::ostringstream ostr;
+		ostr << "Lz4CompressorObject(" << level << ")";
+		return ostr.str();
+	}
+};
+
+struct Lz4CompressorObjectFactory : public libmaus::lz::CompressorObjectFactory
+{
+	int const level;
+
+	Lz4CompressorObjectFactory(int const rlevel) : level(rlevel) {}
+	virtual ~Lz4CompressorObjectFactory() {}
+
+	virtual libmaus::lz::CompressorObject::unique_ptr_type operator()()
+	{
+		libmaus::lz::CompressorObject::unique_ptr_type tptr(new Lz4CompressorObject(level));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+
+	virtual std::string getDescription() const
+	{
+		std::ostringstream ostr;
+		ostr << "Lz4CompressorObjectFactory(" << level << ")";
+		return ostr.str();
+	}
+};
+
+struct Lz4DecompressorObject : public libmaus::lz::DecompressorObject
+{
+	Lz4DecompressorObject() {}
+	virtual ~Lz4DecompressorObject() {}
+
+	virtual bool rawuncompress(char const * compressed, size_t compressed_length, char * uncompressed, size_t uncompressed_length)
+	{
+		int const r = LZ4_decompress_safe(compressed,uncompressed,compressed_length,uncompressed_length);
+		return r >= 0 && static_cast<size_t>(r) == uncompressed_length;
+	}
+
+	virtual std::string getDescription() const
+	{
+		return "Lz4DecompressorObject";
+	}
+};
+
+struct Lz4DecompressorObjectFactory : public libmaus::lz::DecompressorObjectFactory
+{
+	Lz4DecompressorObjectFactory() {}
+	virtual ~Lz4DecompressorObjectFactory() {}
+
+	virtual libmaus::lz::DecompressorObject::unique_ptr_type operator()()
+	{
+		libmaus::lz::DecompressorObject::unique_ptr_type tptr(new Lz4DecompressorObject);
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+
+	virtual std::string getDescription() const
+	{
+		return "Lz4DecompressorObjectFactory";
+	}
+};
+#endif
+
+#if defined(BIOBAMBAM_HAVE_ZSTD)
+struct ZstdCompressorObject : public libmaus::lz::CompressorObject
+{
+	int const level;
+	ZSTD_CCtx * context;
+
+	ZstdCompressorObject(int const rlevel) : level(rlevel), context(ZSTD_createCCtx())
+	{
+		if ( ! context )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "ZstdCompressorObject: failed to create compression context" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+	virtual ~ZstdCompressorObject()
+	{
+		ZSTD_freeCCtx(context);
+	}
+
+	virtual size_t compress(char const * input, size_t inputLength, libmaus::autoarray::AutoArray<char> & output)
+	{
+		size_t const bound = ZSTD_compressBound(inputLength);
+		ensureTempFileCompressionOutputSize(output,bound);
+
+		size_t const r = ZSTD_compressCCtx(context,output.begin(),bound,input,inputLength,level);
+
+		if ( ZSTD_isError(r) )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "ZstdCompressorObject::compress: " << ZSTD_getErrorName(r) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		return r;
+	}
+
+	virtual std::string getDescription() const
+	{
+		std::ostringstream ostr;
+		ostr << "ZstdCompressorObject(" << level << ")";
+		return ostr.str();
+	}
+};
+
+struct ZstdCompressorObjectFactory : public libmaus::lz::CompressorObjectFactory
+{
+	int const level;
+
+	ZstdCompressorObjectFactory(int const rlevel) : level(rlevel) {}
+	virtual ~ZstdCompressorObjectFactory() {}
+
+	virtual libmaus::lz::CompressorObject::unique_ptr_type operator()()
+	{
+		libmaus::lz::CompressorObject::unique_ptr_type tptr(new ZstdCompressorObject(level));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+
+	virtual std::string getDescription() const
+	{
+		std::ostringstream ostr;
+		ostr << "ZstdCompressorObjectFactory(" << level << ")";
+		return ostr.str();
+	}
+};
+
+struct ZstdDecompressorObject : public libmaus::lz::DecompressorObject
+{
+	ZSTD_DCtx * context;
+
+	ZstdDecompressorObject() : context(ZSTD_createDCtx())
+	{
+		if ( ! context )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "ZstdDecompressorObject: failed to create decompression context" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+	virtual ~ZstdDecompressorObject()
+	{
+		ZSTD_freeDCtx(context);
+	}
+
+	virtual bool rawuncompress(char const * compressed, size_t compressed_length, char * uncompressed, size_t uncompressed_length)
+	{
+		size_t const r = ZSTD_decompressDCtx(context,uncompressed,uncompressed_length,compressed,compressed_length);
+		return (! ZSTD_isError(r)) && r == uncompressed_length;
+	}
+
+	virtual std::string getDescription() const
+	{
+		return "ZstdDecompressorObject";
+	}
+};
+
+struct ZstdDecompressorObjectFactory : public libmaus::lz::DecompressorObjectFactory
+{
+	ZstdDecompressorObjectFactory() {}
+	virtual ~ZstdDecompressorObjectFactory() {}
+
+	virtual libmaus::lz::DecompressorObject::unique_ptr_type operator()()
+	{
+		libmaus::lz::DecompressorObject::unique_ptr_type tptr(new ZstdDecompressorObject);
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+
+	virtual std::string getDescription() const
+	{
+		return "ZstdDecompressorObjectFactory";
+	}
+};
+#endif
+
+/**
+ * construct factories for a single codec
+ **/
+static void constructTempFileCompressionCodec(
+	std::string const & tempcomp,
+	libmaus::lz::CompressorObjectFactory::unique_ptr_type & compfact,
+	libmaus::lz::DecompressorObjectFactory::unique_ptr_type & decompfact
+)
+{
+	if ( tempFileCompressionStartsWith(tempcomp,"snappy") )
+	{
+		libmaus::lz::CompressorObjectFactory::unique_ptr_type TcompressorFactory(new libmaus::lz::SnappyCompressorObjectFactory());
+		compfact = UNIQUE_PTR_MOVE(TcompressorFactory);
+		libmaus::lz::DecompressorObjectFactory::unique_ptr_type TdecompressorFactory(new libmaus::lz::SnappyDecompressorObjectFactory);
+		decompfact = UNIQUE_PTR_MOVE(TdecompressorFactory);
+	}
+	else if ( tempFileCompressionStartsWith(tempcomp,"zlib:") )
+	{
+		int64_t const templevel = libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(
+			parseTempFileCompressionLevel(tempcomp,"zlib",-1)
+		);
+
+		libmaus::lz::CompressorObjectFactory::unique_ptr_type TcompressorFactory(new libmaus::lz::ZlibCompressorObjectFactory(templevel));
+		compfact = UNIQUE_PTR_MOVE(TcompressorFactory);
+		libmaus::lz::DecompressorObjectFactory::unique_ptr_type TdecompressorFactory(new libmaus::lz::ZlibDecompressorObjectFactory);
+		decompfact = UNIQUE_PTR_MOVE(TdecompressorFactory);
+	}
+	else if ( tempcomp == "lz4" || tempFileCompressionStartsWith(tempcomp,"lz4:") )
+	{
+		#if defined(BIOBAMBAM_HAVE_LZ4)
+		int64_t const templevel = parseTempFileCompressionLevel(tempcomp,"lz4",0);
+
+		if ( templevel < 0 || templevel > 12 )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "Unsupported lz4 compression level in " << tempcomp << " (0 for default, 1 to 12 for high compression mode)" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		libmaus::lz::CompressorObjectFactory::unique_ptr_type TcompressorFactory(new Lz4CompressorObjectFactory(templevel));
+		compfact = UNIQUE_PTR_MOVE(TcompressorFactory);
+		libmaus::lz::DecompressorObjectFactory::unique_ptr_type TdecompressorFactory(new Lz4DecompressorObjectFactory);
+		decompfact = UNIQUE_PTR_MOVE(TdecompressorFactory);
+		#else
+		libmaus::exception::LibMausException lme;
+		lme.getStream() << "Temp file compression scheme " << tempcomp << " requires lz4 support, which is not present (configure using --with-lz4)" << std::endl;
+		lme.finish();
+		throw lme;
+		#endif
+	}
+	else if ( tempcomp == "zstd" || tempFileCompressionStartsWith(tempcomp,"zstd:") )
+	{
+		#if defined(BIOBAMBAM_HAVE_ZSTD)
+		int64_t const templevel = parseTempFileCompressionLevel(tempcomp,"zstd",3);
+
+		if ( templevel < 1 || templevel > ZSTD_maxCLevel() )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "Unsupported zstd compression level in " << tempcomp << " (1 to " << ZSTD_maxCLevel() << ")" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		libmaus::lz::CompressorObjectFactory::unique_ptr_type TcompressorFactory(new ZstdCompressorObjectFactory(templevel));
+		compfact = UNIQUE_PTR_MOVE(TcompressorFactory);
+		libmaus::lz::DecompressorObjectFactory::unique_ptr_type TdecompressorFactory(new ZstdDecompressorObjectFactory);
+		decompfact = UNIQUE_PTR_MOVE(TdecompressorFactory);
+		#else
+		libmaus::exception::LibMausException lme;
+		lme.getStream() << "Temp file compression scheme " << tempcomp << " requires zstd support, which is not present (configure using --with-zstd)" << std::endl;
+		lme.finish();
+		throw lme;
+		#endif
+	}
+	else
+	{
+		libmaus::exception::LibMausException lme;
+		lme.getStream() << "Unsupported temp file compression scheme in " << tempcomp << std::endl;
+		lme.finish();
+		throw lme;
+	}
+}
+
+/**
+ * codecs tried for tempcomp=auto; the index in this list is stored as the first byte of each compressed block
+ **/
+static std::vector<std::string> getAutoTempFileCompressionCandidates()
+{
+	std::vector<std::string> V;
+	V.push_back("snappy");
+	V.push_back("zlib:1");
+	#if defined(BIOBAMBAM_HAVE_LZ4)
+	V.push_back("lz4");
+	#endif
+	#if defined(BIOBAMBAM_HAVE_ZSTD)
+	V.push_back("zstd:1");
+	V.push_back("zstd:3");
+	#endif
+	return V;
+}
+
+/**
+ * measure bandwidth for writing a file (in bytes per second, including fsync)
+ **/
+static double measureTempFileWriteBandwidth(std::string const & fn)
+{
+	uint64_t const blocksize = 1024*1024;
+	uint64_t const numblocks = 32;
+
+	// data is not compressed, so we do not care about content besides avoiding zero pages
+	libmaus::autoarray::AutoArray<char> B(blocksize,false);
+	uint64_t x = 0x9E3779B97F4A7C15ull;
+	for ( uint64_t i = 0; i < B.size(); ++i )
+	{
+		x = x * 6364136223846793005ull + 1442695040888963407ull;
+		B[i] = static_cast<char>(x >> 56);
+	}
+
+	libmaus::util::TempFileRemovalContainer::addTempFile(fn);
+	int const fd = ::open(fn.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0600);
+
+	if ( fd < 0 )
+	{
+		int const error = errno;
+		libmaus::exception::LibMausException lme;
+		lme.getStream() << "measureTempFileWriteBandwidth: failed to open " << fn << ": " << strerror(error) << std::endl;
+		lme.finish();
+		throw lme;
+	}
+
+	libmaus::timing::RealTimeClock rtc; rtc.start();
+
+	for ( uint64_t i = 0; i < numblocks; ++i )
+	{
+		char const * p = B.begin();
+		uint64_t n = B.size();
+
+		while ( n )
+		{
+			ssize_t const w = ::write(fd,p,n);
+
+			if ( w < 0 )
+			{
+				int const error = errno;
+
+				if ( error == EINTR || error == EAGAIN )
+					continue;
+
+				::close(fd);
+				::unlink(fn.c_str());
+				libmaus::exception::LibMausException lme;
+				lme.getStream() << "measureTempFileWriteBandwidth: failed to write " << fn << ": " << strerror(error) << std::endl;
+				lme.finish();
+				throw lme;
+			}
+
+			p += w;
+			n -= w;
+		}
+	}
+
+	::fsync(fd);
+	::close(fd);
+
+	double const t = rtc.getElapsedSeconds();
+	::unlink(fn.c_str());
+
+	return (blocksize * numblocks) / std::max(t,1e-6);
+}
+
+/**
+ * codec selection state shared by all compressor objects of an auto compressor factory
+ **/
+struct AutoTempFileCompressionSelection
+{
+	// number of blocks compressed using all candidates before the codec is fixed
+	static uint64_t const trialblocks = 16;
+
+	std::vector<std::string> const names;
+	double const writebandwidth;
+	// number of threads compressing blocks concurrently
+	uint64_t const numthreads;
+	bool const verbose;
+
+	libmaus::parallel::PosixSpinLock lock;
+	uint64_t trials;
+	std::vector<double> seconds;
+	std::vector<uint64_t> outbytes;
+	int64_t selected;
+
+	AutoTempFileCompressionSelection(std::vector<std::string> const & rnames, double const rwritebandwidth, uint64_t const rnumthreads, bool const rverbose)
+	: names(rnames), writebandwidth(rwritebandwidth), numthreads(std::max(rnumthreads,static_cast<uint64_t>(1))), verbose(rverbose), lock(), trials(0), seconds(names.size(),0), outbytes(names.size(),0), selected(-1)
+	{
+
+	}
+
+	int64_t getSelected()
+	{
+		libmaus::parallel::ScopePosixSpinLock llock(lock);
+		return selected;
+	}
+
+	/*
+	 * compression runs on numthreads threads concurrently while all threads share
+	 * the bandwidth of the temporary file system
+	 */
+	double getCost(double const s, uint64_t const bytes) const
+	{
+		return s / numthreads + bytes / writebandwidth;
+	}
+
+	void report(std::vector<double> const & s, std::vector<uint64_t> const & o)
+	{
+		libmaus::parallel::ScopePosixSpinLock llock(lock);
+
+		if ( selected >= 0 )
+			return;
+
+		for ( uint64_t i = 0; i < names.size(); ++i )
+		{
+			seconds[i] += s[i];
+			outbytes[i] += o[i];
+		}
+
+		if ( ++trials >= trialblocks )
+		{
+			uint64_t best = 0;
+			for ( uint64_t i = 1; i < names.size(); ++i )
+				if ( getCost(seconds[i],outbytes[i]) < getCost(seconds[best],outbytes[best]) )
+					best = i;
+
+			selected = best;
+
+			if ( verbose )
+			{
+				for ( uint64_t i = 0; i < names.size(); ++i )
+					std::cerr << "[V] tempcomp=auto " << names[i]
+						<< " compress " << seconds[i] << "s"
+						<< " output " << outbytes[i] << " bytes"
+						<< " estimated spill time " << getCost(seconds[i],outbytes[i]) << "s"
+						<< std::endl;
+				std::cerr << "[V] tempcomp=auto selected " << names[selected] << std::endl;
+			}
+		}
+	}
+};
+
+struct AutoTempFileCompressionCompressorObject : public libmaus::lz::CompressorObject
+{
+	AutoTempFileCompressionSelection & selection;
+	libmaus::autoarray::AutoArray<libmaus::lz::CompressorObject::unique_ptr_type> compressors;
+	libmaus::autoarray::AutoArray<char> T;
+	libmaus::timing::RealTimeClock rtc;
+
+	AutoTempFileCompressionCompressorObject(
+		AutoTempFileCompressionSelection & rselection,
+		libmaus::autoarray::AutoArray<libmaus::lz::CompressorObjectFactory::unique_ptr_type> & factories
+	) : selection(rselection), compressors(factories.size()), T(), rtc()
+	{
+		for ( uint64_t i = 0; i < factories.size(); ++i )
+		{
+			libmaus::lz::CompressorObject::unique_ptr_type tptr((*(factories[i]))());
+			compressors[i] = UNIQUE_PTR_MOVE(tptr);
+		}
+	}
+	virtual ~AutoTempFileCompressionCompressorObject() {}
+
+	size_t putBlock(uint64_t const id, uint64_t const n, libmaus::autoarray::AutoArray<char> & output)
+	{
+		ensureTempFileCompressionOutputSize(output,n+1);
+		output[0] = static_cast<char>(id);
+		std::copy(T.begin(),T.begin()+n,output.begin()+1);
+		return n+1;
+	}
+
+	virtual size_t compress(char const * input, size_t inputLength, libmaus::autoarray::AutoArray<char> & output)
+	{
+		int64_t const selected = selection.getSelected();
+
+		if ( selected >= 0 )
+		{
+			size_t const n = compressors[selected]->compress(input,inputLength,T);
+			return putBlock(selected,n,output);
+		}
+		else
+		{
+			std::vector<double> s(compressors.size());
+			std::vector<uint64_t> o(compressors.size());
+			size_t outsize = 0;
+			double bestcost = 0;
+
+			for ( uint64_t i = 0; i < compressors.size(); ++i )
+			{
+				rtc.start();
+				size_t const n = compressors[i]->compress(input,inputLength,T);
+				s[i] = rtc.getElapsedSeconds();
+				o[i] = n;
+
+				double const cost = selection.getCost(s[i],o[i]);
+				if ( i == 0 || cost < bestcost )
+				{
+					bestcost = cost;
+					outsize = putBlock(i,n,output);
+				}
+			}
+
+			selection.report(s,o);
+
+			return outsize;
+		}
+	}
+
+	virtual std::string getDescription() const
+	{
+		return "AutoTempFileCompressionCompressorObject";
+	}
+};
+
+struct AutoTempFileCompressionCompressorObjectFactory : public libmaus::lz::CompressorObjectFactory
+{
+	libmaus::autoarray::AutoArray<libmaus::lz::CompressorObjectFactory::unique_ptr_type> factories;
+	AutoTempFileCompressionSelection selection;
+
+	AutoTempFileCompressionCompressorObjectFactory(
+		std::vector<std::string> const & names,
+		double const writebandwidth,
+		uint64_t const numthreads,
+		bool const verbose
+	) : factories(names.size()), selection(names,writebandwidth,numthreads,verbose)
+	{
+		for ( uint64_t i = 0; i < names.size(); ++i )
+		{
+			libmaus::lz::DecompressorObjectFactory::unique_ptr_type decompfact;
+			constructTempFileCompressionCodec(names[i],factories[i],decompfact);
+		}
+	}
+	virtual ~AutoTempFileCompressionCompressorObjectFactory() {}
+
+	virtual libmaus::lz::CompressorObject::unique_ptr_type operator()()
+	{
+		libmaus::lz::CompressorObject::unique_ptr_type tptr(new AutoTempFileCompressionCompressorObject(selection,factories));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+
+	virtual std::string getDescription() const
+	{
+		std::ostringstream ostr;
+		ostr << "AutoTempFileCompressionCompressorObjectFactory(";
+		for ( uint64_t i = 0; i < selection.names.size(); ++i )
+			ostr << ((i > 0) ? "," : "") << selection.names[i];
+		ostr << ")";
+		return ostr.str();
+	}
+};
+
+struct AutoTempFileCompressionDecompressorObject : public libmaus::lz::DecompressorObject
+{
+	libmaus::autoarray::AutoArray<libmaus::lz::DecompressorObject::unique_ptr_type> decompressors;
+
+	AutoTempFileCompressionDecompressorObject(
+		libmaus::autoarray::AutoArray<libmaus::lz::DecompressorObjectFactory::unique_ptr_type> & factories
+	) : decompressors(factories.size())
+	{
+		for ( uint64_t i = 0; i < factories.size(); ++i )
+		{
+			libmaus::lz::DecompressorObject::unique_ptr_type tptr((*(factories[i]))());
+			decompressors[i] = UNIQUE_PTR_MOVE(tptr);
+		}
+	}
+	virtual ~AutoTempFileCompressionDecompressorObject() {}
+
+	virtual bool rawuncompress(char const * compressed, size_t compressed_length, char * uncompressed, size_t uncompressed_length)
+	{
+		if ( ! compressed_length )
+			return false;
+
+		uint64_t const id = static_cast<uint8_t>(compressed[0]);
+
+		if ( id >= decompressors.size() )
+			return false;
+
+		return decompressors[id]->rawuncompress(compressed+1,compressed_length-1,uncompressed,uncompressed_length);
+	}
+
+	virtual std::string getDescription() const
+	{
+		return "AutoTempFileCompressionDecompressorObject";
+	}
+};
+
+struct AutoTempFileCompressionDecompressorObjectFactory : public libmaus::lz::DecompressorObjectFactory
+{
+	libmaus::autoarray::AutoArray<libmaus::lz::DecompressorObjectFactory::unique_ptr_type> factories;
+
+	AutoTempFileCompressionDecompressorObjectFactory(std::vector<std::string> const & names)
+	: factories(names.size())
+	{
+		for ( uint64_t i = 0; i < names.size(); ++i )
+		{
+			libmaus::lz::CompressorObjectFactory::unique_ptr_type compfact;
+			constructTempFileCompressionCodec(names[i],compfact,factories[i]);
+		}
+	}
+	virtual ~AutoTempFileCompressionDecompressorObjectFactory() {}
+
+	virtual libmaus::lz::DecompressorObject::unique_ptr_type operator()()
+	{
+		libmaus::lz::DecompressorObject::unique_ptr_type tptr(new AutoTempFileCompressionDecompressorObject(factories));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+
+	virtual std::string getDescription() const
+	{
+		return "AutoTempFileCompressionDecompressorObjectFactory";
+	}
+};
+
+void constructTempFileCompression(
+	std::string const & tempcomp,
+	std::string const & tmpfilenamebase,
+	uint64_t const numthreads,
+	bool const verbose,
+	libmaus::lz::CompressorObjectFactory::unique_ptr_type & compfact,
+	libmaus::lz::DecompressorObjectFactory::unique_ptr_type & decompfact
+)
+{
+	if ( tempcomp == "auto" )
+	{
+		std::vector<std::string> const names = getAutoTempFileCompressionCandidates();
+		double const writebandwidth = measureTempFileWriteBandwidth(tmpfilenamebase + "_tempcompbandwidth");
+
+		if ( verbose )
+			std::cerr << "[V] tempcomp=auto measured write bandwidth of "
+				<< std::setprecision(4) << (writebandwidth / (1024.0*1024.0)) << std::setprecision(6)
+				<< " MiB/s for temporary files" << std::endl;
+
+		libmaus::lz::CompressorObjectFactory::unique_ptr_type TcompressorFactory(
+			new AutoTempFileCompressionCompressorObjectFactory(names,writebandwidth,numthreads,verbose)
+		);
+		compfact = UNIQUE_PTR_MOVE(TcompressorFactory);
+		libmaus::lz::DecompressorObjectFactory::unique_ptr_type TdecompressorFactory(
+			new AutoTempFileCompressionDecompressorObjectFactory(names)
+		);
+		decompfact = UNIQUE_PTR_MOVE(TdecompressorFactory);
+	}
+	else
+	{
+		constructTempFileCompressionCodec(tempcomp,compfact,decompfact);
+	}
+}
+
+std::string getTempFileCompressionSettings()
+{
+	std::ostringstream ostr;
+	ostr << "zlib:{-1,0,...,9,11},snappy";
+	#if defined(BIOBAMBAM_HAVE_LZ4)
+	ostr << ",lz4[:{1,...,12}]";
+	#endif
+	#if defined(BIOBAMBAM_HAVE_ZSTD)
+	ostr << ",zstd[:{1,...," << ZSTD_maxCLevel() << "}]";
+	#endif
+	ostr << ",auto";
+	return ostr.str();
+}
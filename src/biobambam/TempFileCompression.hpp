@@ -0,0 +1,54 @@
+/**
+    biobambam
+    Copyright (C) 2009-2014 German Tischler
+    Copyright (C) 2011-2014 Genome Research Limited
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+**/
+#if ! defined(BIOBAMBAM_TEMPFILECOMPRESSION_HPP)
+#define BIOBAMBAM_TEMPFILECOMPRESSION_HPP
+
+#include <libmaus/lz/CompressorObjectFactory.hpp>
+#include <libmaus/lz/DecompressorObjectFactory.hpp>
+#include <string>
+
+/**
+ * construct compressor and decompressor factories for temporary files. Supported settings are
+ * snappy, zlib:<level>, lz4[:<level>] and zstd[:<level>] (if compiled in) and auto. For auto
+ * the first blocks are compressed using each available codec and the codec minimising the sum of
+ * compression time (divided by the number of compressing threads) and the time for writing the
+ * compressed data (at the bandwidth measured for a test file created using tmpfilenamebase as
+ * prefix) is used for the remaining blocks.
+ *
+ * @param tempcomp compression setting
+ * @param tmpfilenamebase prefix for temporary files
+ * @param numthreads number of threads compressing blocks concurrently
+ * @param verbose print codec selection information on std::cerr
+ * @param compfact compressor factory (output)
+ * @param decompfact decompressor factory (output)
+ **/
+void constructTempFileCompression(
+	std::string const & tempcomp,
+	std::string const & tmpfilenamebase,
+	uint64_t const numthreads,
+	bool const verbose,
+	libmaus::lz::CompressorObjectFactory::unique_ptr_type & compfact,
+	libmaus::lz::DecompressorObjectFactory::unique_ptr_type & decompfact
+);
+
+/**
+ * @return description of supported temporary file compression settings for help texts
+ **/
+std::string getTempFileCompressionSettings();
+#endif
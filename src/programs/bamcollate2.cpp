@@ -20,6 +20,7 @@
 #include <biobambam/BamBamConfig.hpp>
 #include <biobambam/Licensing.hpp>
 #include <biobambam/AttachRank.hpp>
+#include <biobambam/PartitionedCollatingBamDecoder.hpp>
 #include <biobambam/ResetAlignment.hpp>
 
 #include <iomanip>
@@ -50,6 +51,7 @@ static int getDefaultIndex() { return 0; }
 static int getDefaultMapQThreshold() { return -1; }
 static std::string getDefaultClassFilter() { return "F,F2,O,O2,S"; }
 static bool getDefaultResetAux() { return true; }
+static uint64_t getDefaultColThreads() { return 1; }
 
 static uint32_t const classmask_F  = (1ull << 0);
 static uint32_t const classmask_F2 = (1ull << 1);
@@ -403,15 +405,16 @@ void bamcollate2NonCollating(libmaus::util::ArgInfo const & arginfo)
 	std::cout.flush();
 }
 
+template<typename collator_type>
 void bamcollate2Collating(
 	libmaus::util::ArgInfo const & arginfo,
-	libmaus::bambam::CircularHashCollatingBamDecoder & CHCBD
+	collator_type & CHCBD
 )
 {
 	if ( arginfo.getValue<unsigned int>("disablevalidation",0) )
 		CHCBD.disableValidation();
 
-	libmaus::bambam::CircularHashCollatingBamDecoder::OutputBufferEntry * ob = 0;
+	typename collator_type::OutputBufferEntry * ob = 0;
 	bool const verbose = arginfo.getValue<unsigned int>("verbose",getDefaultVerbose());
 	
 	// number of alignments written to files
@@ -795,8 +798,24 @@ void bamcollate2Collating(libmaus::util::ArgInfo const & arginfo)
 			arginfo,false /* put rank */, 0 /* copy stream */, PFIS
 		)
 	);
-	libmaus::bambam::CircularHashCollatingBamDecoder CHCBD(decwrapper->getDecoder(),tmpfilename,excludeflags,hlog,sbs);
-	bamcollate2Collating(arginfo,CHCBD);
+	uint64_t const colthreads = arginfo.getValueUnsignedNumeric<uint64_t>("colthreads",getDefaultColThreads());
+	uint64_t const colfar = arginfo.getValueUnsignedNumeric<uint64_t>("colfar",PartitionedCollatingBamDecoder::getDefaultFarDistance());
+
+	if ( colthreads > 1 || colfar )
+	{
+		uint64_t const colmem = arginfo.getValueUnsignedNumeric<uint64_t>("colmem",PartitionedCollatingBamDecoder::getDefaultMemLimit());
+		uint64_t const colbuckets = arginfo.getValueUnsignedNumeric<uint64_t>("colbuckets",PartitionedCollatingBamDecoder::getDefaultNumBuckets());
+		PartitionedCollatingBamDecoder PCBD(decwrapper->getDecoder(),tmpfilename,excludeflags,colthreads,colmem,colfar,colbuckets);
+		bamcollate2Collating(arginfo,PCBD);
+
+		if ( arginfo.getValue<unsigned int>("verbose",getDefaultVerbose()) )
+			std::cerr << "[V] collation spilled for " << PCBD.getNumSpilled() << " partitions, " << PCBD.getNumFar() << " reads with far mates" << std::endl;
+	}
+	else
+	{
+		libmaus::bambam::CircularHashCollatingBamDecoder CHCBD(decwrapper->getDecoder(),tmpfilename,excludeflags,hlog,sbs);
+		bamcollate2Collating(arginfo,CHCBD);
+	}
 	
 	std::cout.flush();
 }
@@ -1460,6 +1479,10 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "disablevalidation=<[0]>", "disable validation of input data" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "colhlog=<[18]>", "base 2 logarithm of hash table size used for collation" ) );
 				V.push_back ( std::pair<std::string,std::string> ( std::string("colsbs=<[")+libmaus::util::NumberSerialisation::formatNumber(128ull*1024*1024,0)+"]>", "size of hash table overflow list in bytes" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "colthreads=<["+::biobambam::Licensing::formatNumber(getDefaultColThreads())+"]>", "number of partitioned collation threads for collate=1 (1: use single threaded collation unless colfar>0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("colmem=<[")+libmaus::util::NumberSerialisation::formatNumber(PartitionedCollatingBamDecoder::getDefaultMemLimit(),0)+"]>", "memory for reads waiting for their mate in the partitioned collation (colthreads>1 or colfar>0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("colfar=<[")+libmaus::util::NumberSerialisation::formatNumber(PartitionedCollatingBamDecoder::getDefaultFarDistance(),0)+"]>", "collate mates mapped further apart than this in coordinate buckets after reading the input (0: off, uses partitioned collation)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("colbuckets=<[")+libmaus::util::NumberSerialisation::formatNumber(PartitionedCollatingBamDecoder::getDefaultNumBuckets(),0)+"]>", "number of coordinate buckets per collation thread if colfar>0" ) );
 				V.push_back ( std::pair<std::string,std::string> ( std::string("T=<[") + arginfo.getDefaultTmpFileName() + "]>" , "temporary file name" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "md5=<["+::biobambam::Licensing::formatNumber(getDefaultMD5())+"]>", "create md5 check sum (default: 0)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "md5filename=<filename>", "file name for md5 check sum (default: extend output file name)" ) );
@@ -18,8 +18,10 @@
 */
 #include <libmaus/bambam/BamMultiAlignmentDecoderFactory.hpp>
 #include <libmaus/bambam/BamBlockWriterBaseFactory.hpp>
+#include <libmaus/util/TempFileRemovalContainer.hpp>
 
 #include <biobambam/BamBamConfig.hpp>
+#include <biobambam/BamWriterPool.hpp>
 #include <biobambam/Licensing.hpp>
 
 int getDefaultLevel() { return Z_DEFAULT_COMPRESSION; }
@@ -27,9 +29,14 @@ int getDefaultVerbose() { return 0; }
 std::string getDefaultInputFormat() { return "bam"; }
 uint64_t getDefaultSizeThres() { return 32*1024*1024; }
 std::string getDefaultPrefix() { return "split_"; }
+uint64_t getDefaultOutputThreads() { return 1; }
+int getDefaultMD5() { return 0; }
+int getDefaultIndex() { return 0; }
 
 int bamexplode(libmaus::util::ArgInfo const & arginfo)
 {
+	::libmaus::util::TempFileRemovalContainer::setup();
+
 	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type Preader(libmaus::bambam::BamMultiAlignmentDecoderFactory::construct(arginfo));
 
 	libmaus::bambam::BamBlockWriterBase::unique_ptr_type Pwriter;
@@ -43,6 +50,28 @@ int bamexplode(libmaus::util::ArgInfo const & arginfo)
 	std::string const outputformat = arginfo.getUnparsedValue("outputformat",libmaus::bambam::BamBlockWriterBaseFactory::getDefaultOutputFormat());
 	std::string const prefix = arginfo.getUnparsedValue("prefix",getDefaultPrefix());
 	uint64_t const thres = arginfo.getValueUnsignedNumeric("sizethres",getDefaultSizeThres());
+
+	/*
+	 * BAM output files are compressed by a pool of threads shared by all files, so decoding
+	 * continues while previous files are being compressed and written
+	 */
+	BamWriterPool::unique_ptr_type Ppool;
+	if ( outputformat == "bam" )
+	{
+		// the output files are compressed by the pool using zlib
+		int const level = BamWriterPool::checkCompressionLevel(
+			libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",getDefaultLevel()))
+		);
+		uint64_t const outputthreads = std::max(arginfo.getValueUnsignedNumeric<uint64_t>("outputthreads",getDefaultOutputThreads()),static_cast<uint64_t>(1));
+		bool const md5 = arginfo.getValue<unsigned int>("md5",getDefaultMD5());
+		bool const index = arginfo.getValue<unsigned int>("index",getDefaultIndex());
+		std::string const tmpfileprefix = arginfo.getUnparsedValue("tmpfile",arginfo.getDefaultTmpFileName());
+
+		BamWriterPool::unique_ptr_type Tpool(
+			new BamWriterPool(outputthreads,level,BamWriterPool::getDefaultChunkSize(),4*outputthreads,md5,index,tmpfileprefix)
+		);
+		Ppool = UNIQUE_PTR_MOVE(Tpool);
+	}
 	
 	while ( decoder.readAlignment() )
 	{
@@ -50,22 +79,35 @@ int bamexplode(libmaus::util::ArgInfo const & arginfo)
 
 		if ( refid != prevrefid && written > thres )
 		{
-			Pwriter.reset();
-			libmaus::util::ArgInfo argcopy(arginfo);
 			std::ostringstream fnostr;
 			fnostr << prefix << std::setw(6) << std::setfill('0') << nextfn++ << std::setw(0) << "." << outputformat;
-			argcopy.replaceKey("O",fnostr.str());
-			libmaus::bambam::BamBlockWriterBase::unique_ptr_type Twriter(libmaus::bambam::BamBlockWriterBaseFactory::construct(header,argcopy));
-			Pwriter = UNIQUE_PTR_MOVE(Twriter);
+
+			if ( Ppool )
+			{
+				Ppool->open(fnostr.str(),header);
+			}
+			else
+			{
+				Pwriter.reset();
+				libmaus::util::ArgInfo argcopy(arginfo);
+				argcopy.replaceKey("O",fnostr.str());
+				libmaus::bambam::BamBlockWriterBase::unique_ptr_type Twriter(libmaus::bambam::BamBlockWriterBaseFactory::construct(header,argcopy));
+				Pwriter = UNIQUE_PTR_MOVE(Twriter);
+			}
 			written = 0;
 		}
 		
-		Pwriter->writeAlignment(algn);
+		if ( Ppool )
+			Ppool->put(algn);
+		else
+			Pwriter->writeAlignment(algn);
 		
 		prevrefid = refid;
 		written ++;
 	}
 	
+	if ( Ppool )
+		Ppool->finish();
 	Pwriter.reset();
 
 	return EXIT_SUCCESS;
@@ -108,7 +150,10 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "inputthreads=<[1]>", "input helper threads (for inputformat=bam only, default: 1)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "reference=<>", "reference FastA (.fai file required, for cram i/o only)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "range=<>", "coordinate range to be processed (for coordinate sorted indexed BAM input only)" ) );
-				V.push_back ( std::pair<std::string,std::string> ( "outputthreads=<[1]>", "output helper threads (for outputformat=bam only, default: 1)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "outputthreads=<["+::biobambam::Licensing::formatNumber(getDefaultOutputThreads())+"]>", "output compression threads shared by all output files (for outputformat=bam only, default: 1)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "md5=<["+::biobambam::Licensing::formatNumber(getDefaultMD5())+"]>", "create md5 check sum file <file>.md5 for each output file (for outputformat=bam only, default: 0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "index=<["+::biobambam::Licensing::formatNumber(getDefaultIndex())+"]>", "create BAM index <file>.bai for each output file (for outputformat=bam only, default: 0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "tmpfile=<["+arginfo.getDefaultTmpFileName()+"]>", "prefix for temporary files of index=1 (default: create in current directory)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "O=<[stdout]>", "output filename (standard output if unset)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( std::string("prefix=<[")+getDefaultPrefix()+"]>", "prefix of output file names" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "thres=<["+::biobambam::Licensing::formatNumber(getDefaultSizeThres())+"]>", "size threshold for the creation of next file" ) );
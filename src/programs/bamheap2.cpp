@@ -19,9 +19,18 @@
 #include <libmaus/bambam/BamMultiAlignmentDecoderFactory.hpp>
 #include <libmaus/fastx/FastAIndex.hpp>
 #include <libmaus/aio/PosixFdOutputStream.hpp>
+#include <libmaus/exception/LibMausException.hpp>
 #include <libmaus/util/Histogram.hpp>
+#include <libmaus/parallel/PosixMutex.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
 #include <biobambam/BamBamConfig.hpp>
 #include <biobambam/Licensing.hpp>
+#include <biobambam/ReferenceRegions.hpp>
+#include <limits>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 static int getDefaultVerbose()
 {
@@ -38,6 +47,26 @@ static std::string getDefaultInputFormat()
 	return "bam";
 }
 
+static unsigned int getDefaultThreads()
+{
+	return 1;
+}
+
+static uint64_t getDefaultWindowSize()
+{
+	return 64*1024;
+}
+
+static int getDefaultByRef()
+{
+	return 0;
+}
+
+static uint64_t getDefaultChunkSize()
+{
+	return 0;
+}
+
 static char const padsym = '*';
 
 struct ConsensusAccuracy;
@@ -105,24 +134,68 @@ struct ConsensusAux
 {
 	libmaus::autoarray::AutoArray<uint64_t> M;
 	libmaus::autoarray::AutoArray<uint64_t> C;
+	// scratch space for insertion columns
+	std::vector<uint64_t> active;
+	std::vector< std::pair<char,uint8_t> > sortvec;
 
-	ConsensusAux() : M(256), C(256)
+	ConsensusAux() : M(256), C(256), active(), sortvec()
 	{
 		std::fill(M.begin(),M.end(),1);
 		std::fill(C.begin(),C.end(),0);
 	}
+
+	void copyMultipliers(ConsensusAux const & O)
+	{
+		std::copy(O.M.begin(),O.M.end(),M.begin());
+	}
 };
 
-struct HeapEntry
+/*
+ * pileup column. The vectors keep their capacity when the column is recycled, so no allocations
+ * are needed once the ring buffer holding the columns has warmed up.
+ */
+struct PileupColumn
 {
-	// bases inserted before reference base
-	std::vector< std::vector< std::pair<char,uint8_t> > > I;
+	// bases inserted before reference base, insertion i is stored in I[IO[i]..IO[i+1]) (up to I.size() for the last one)
+	std::vector< std::pair<char,uint8_t> > I;
+	std::vector<uint64_t> IO;
 	// bases aligned to reference base
 	std::vector< std::pair<char,uint8_t> > V;
 	uint64_t iadd;
+	bool used;
 	
-	HeapEntry() : I(), V(), iadd(0)
+	PileupColumn() : I(), IO(), V(), iadd(0), used(false)
+	{
+	}
+
+	void reset()
+	{
+		I.resize(0);
+		IO.resize(0);
+		V.resize(0);
+		iadd = 0;
+		used = false;
+	}
+
+	void swap(PileupColumn & O)
+	{
+		I.swap(O.I);
+		IO.swap(O.IO);
+		V.swap(O.V);
+		std::swap(iadd,O.iadd);
+		std::swap(used,O.used);
+	}
+
+	template<typename iterator>
+	void addInsertion(iterator ita, iterator ite)
+	{
+		IO.push_back(I.size());
+		I.insert(I.end(),ita,ite);
+	}
+
+	uint64_t getInsertionLength(uint64_t const i) const
 	{
+		return ((i+1 < IO.size()) ? IO[i+1] : I.size()) - IO[i];
 	}
 	
 	static uint8_t getConsensusBase(ConsensusAux const & caux) 
@@ -160,21 +233,22 @@ struct HeapEntry
 	)
 	{
 		// insertions
-		if ( I.size() )
+		if ( IO.size() )
 		{
 			uint64_t const cov = V.size() + iadd;
 			
 			uint64_t maxi = 0;
-			for ( uint64_t i = 0; i < I.size(); ++i )
-				maxi = std::max(maxi,static_cast<uint64_t>(I[i].size()));
+			for ( uint64_t i = 0; i < IO.size(); ++i )
+				maxi = std::max(maxi,getInsertionLength(i));
 			
 			// vector of active indices	
-			std::vector<uint64_t> active(I.size());
+			std::vector<uint64_t> & active = caux.active;
+			active.resize(IO.size());
 			for ( uint64_t i = 0; i < active.size(); ++i )
 				active[i] = i;
 			
 			// vector for symbol sorting	
-			std::vector< std::pair<char,uint8_t> > sortvec(active.size());
+			std::vector< std::pair<char,uint8_t> > & sortvec = caux.sortvec;
 			for ( uint64_t j = 0; active.size(); ++j )
 			{
 				// number still active in next round
@@ -182,9 +256,9 @@ struct HeapEntry
 				sortvec.resize(active.size());
 				for ( uint64_t i = 0; i < active.size(); ++i )
 				{
-					sortvec[i] = I[active[i]][j];
+					sortvec[i] = I[IO[active[i]]+j];
 					
-					if ( j+1 < I[active[i]].size() )
+					if ( j+1 < getInsertionLength(active[i]) )
 						active[o++] = active[i];
 				}
 				active.resize(o);
@@ -288,309 +362,698 @@ struct HeapEntry
 	}
 };
 
-int bamheap2(libmaus::util::ArgInfo const & arginfo)
+/*
+ * ring buffer of pileup columns indexed by reference position. Columns left of the start of the
+ * next alignment are final and are passed to a consumer and recycled.
+ */
+struct PileupRing
 {
-	bool const verbose = arginfo.getValue("verbose",getDefaultVerbose());
-	std::string const reference = arginfo.getUnparsedValue("reference",std::string());
-	std::string const outputprefix = arginfo.getUnparsedValue("outputprefix",std::string());
-	
-	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type decwrapper(
-		libmaus::bambam::BamMultiAlignmentDecoderFactory::construct(arginfo));
-	::libmaus::bambam::BamAlignmentDecoder * ppdec = &(decwrapper->getDecoder());
-	::libmaus::bambam::BamAlignmentDecoder & dec = *ppdec;
-	::libmaus::bambam::BamHeader const & header = dec.getHeader();	
-	::libmaus::bambam::BamAlignment const & algn = dec.getAlignment();
-	
-	double const damult = arginfo.getValue<double>("amult",1);
-	double const dcmult = arginfo.getValue<double>("cmult",1);
-	double const dgmult = arginfo.getValue<double>("gmult",1);
-	double const dtmult = arginfo.getValue<double>("tmult",1);
-	double const dpadmult = arginfo.getValue<double>("padmult",1);
-	
-	double maxmult = 0;
-	maxmult = std::max(damult,maxmult);
-	maxmult = std::max(dcmult,maxmult);
-	maxmult = std::max(dgmult,maxmult);
-	maxmult = std::max(dtmult,maxmult);
-	maxmult = std::max(dpadmult,maxmult);
-	
-	uint64_t const amult = std::floor((damult / maxmult) * (1ull<<16) + 0.5);
-	uint64_t const cmult = std::floor((dcmult / maxmult) * (1ull<<16) + 0.5);
-	uint64_t const gmult = std::floor((dgmult / maxmult) * (1ull<<16) + 0.5);
-	uint64_t const tmult = std::floor((dtmult / maxmult) * (1ull<<16) + 0.5);
-	uint64_t const padmult = std::floor((dpadmult / maxmult) * (1ull<<16) + 0.5);
-	
-	libmaus::fastx::FastAIndex::unique_ptr_type Pindex;
-	libmaus::aio::CheckedInputStream::unique_ptr_type PCIS;
-	if ( reference.size() )
+	std::vector<PileupColumn> ring;
+	uint64_t mask;
+	// first position not yet flushed
+	uint64_t base;
+	// one past the largest position used
+	uint64_t end;
+
+	PileupRing(uint64_t const initialsize = 1024) : ring(initialsize), mask(initialsize-1), base(0), end(0)
 	{
-		libmaus::fastx::FastAIndex::unique_ptr_type Tindex(
-			libmaus::fastx::FastAIndex::load(reference+".fai")
-		);
-		Pindex = UNIQUE_PTR_MOVE(Tindex);
-		
-		libmaus::aio::CheckedInputStream::unique_ptr_type TCIS(new libmaus::aio::CheckedInputStream(reference));
-		PCIS = UNIQUE_PTR_MOVE(TCIS);
+		assert ( (initialsize & (initialsize-1)) == 0 );
 	}
 
+	PileupColumn & operator[](uint64_t const pos)
+	{
+		assert ( pos >= base );
+
+		if ( pos - base >= ring.size() )
+			grow(pos - base + 1);
+
+		PileupColumn & C = ring[pos & mask];
+		C.used = true;
+		end = std::max(end,pos+1);
+		return C;
+	}
+
+	void grow(uint64_t const minsize)
+	{
+		uint64_t newsize = ring.size();
+		while ( newsize < minsize )
+			newsize *= 2;
+
+		std::vector<PileupColumn> nring(newsize);
+		for ( uint64_t pos = base; pos < end; ++pos )
+			nring[pos & (newsize-1)].swap(ring[pos & mask]);
+
+		ring.swap(nring);
+		mask = newsize-1;
+	}
+
+	/*
+	 * pass used columns left of to to the consumer C and recycle them
+	 */
+	template<typename consumer_type>
+	void flush(uint64_t const to, consumer_type & C)
+	{
+		for ( uint64_t const lim = std::min(to,end); base < lim; ++base )
+		{
+			PileupColumn & P = ring[base & mask];
+
+			if ( P.used )
+			{
+				C(base,P);
+				P.reset();
+			}
+		}
+
+		if ( base < to )
+			base = to;
+	}
+
+	/*
+	 * flush all columns and restart at position pos
+	 */
+	template<typename consumer_type>
+	void finish(uint64_t const pos, consumer_type & C)
+	{
+		flush(end,C);
+		base = end = pos;
+	}
+};
+
+/*
+ * adds the bases of alignments to a pileup ring. Columns left of the start of the next alignment
+ * are passed to the consumer.
+ */
+struct PileupBuilder
+{
 	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> cigop;
 	libmaus::autoarray::AutoArray<char> bases;
-	
-	int64_t prevrefid = -1;
-	std::string refidname = "*";
-	
-	std::map< uint64_t, HeapEntry > M;
-	uint64_t alcnt = 0;
 	std::vector< std::pair<char,uint8_t> > pendinginserts;
-	int64_t loadedRefId = -1;
-	int64_t streamRefId = -1;
-	libmaus::autoarray::AutoArray<char> refseqbases;
-	ConsensusAccuracy * consacc = 0;
-	std::map<uint64_t,ConsensusAccuracy> Mconsacc;
-	typedef libmaus::util::shared_ptr<std::ostringstream>::type stream_ptr_type;
-	stream_ptr_type Pstream;
-	ConsensusAux Caux;
-	
-	Caux.M['a'] = Caux.M['A'] = amult;
-	Caux.M['c'] = Caux.M['C'] = cmult;
-	Caux.M['g'] = Caux.M['G'] = gmult;
-	Caux.M['t'] = Caux.M['T'] = tmult;
-	Caux.M[padsym] = padmult;
-	
-	while ( dec.readAlignment() )
+	int64_t prevrefid;
+
+	PileupBuilder() : cigop(), bases(), pendinginserts(), prevrefid(-1)
 	{
-		if ( algn.isMapped() && (!algn.isQCFail()) )
+	}
+
+	template<typename consumer_type>
+	void operator()(libmaus::bambam::BamAlignment const & algn, PileupRing & M, consumer_type & C)
+	{
+		assert ( ! pendinginserts.size() );
+	
+		uint32_t const numcigop = algn.getCigarOperations(cigop);
+		uint64_t readpos = 0;
+		uint64_t refpos = algn.getPos();
+		uint64_t const seqlen = algn.decodeRead(bases);
+		uint8_t const * qual = libmaus::bambam::BamAlignmentDecoderBase::getQual(algn.D.begin());
+		
+		// handle finished columns
+		if ( algn.getRefID() != prevrefid )
+		{
+			M.finish(refpos,C);
+		
+			prevrefid = algn.getRefID();
+			C.setRefId(prevrefid);
+		}
+		else if ( refpos < M.base )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "bamheap2: input is not coordinate sorted" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+		else
 		{
-			assert ( ! pendinginserts.size() );
+			M.flush(refpos,C);
+		}
 		
-			uint32_t const numcigop = algn.getCigarOperations(cigop);
-			uint64_t readpos = 0;
-			uint64_t refpos = algn.getPos();
-			uint64_t const seqlen = algn.decodeRead(bases);
-			uint8_t const * qual = libmaus::bambam::BamAlignmentDecoderBase::getQual(algn.D.begin());
+		for ( uint64_t ci = 0; ci < numcigop; ++ci )
+		{
+			uint64_t const ciglen = cigop[ci].second;
 			
-			// handle finished columns
-			if ( algn.getRefID() != prevrefid )
+			switch ( cigop[ci].first )
 			{
-				while ( M.size() )
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CMATCH:
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CEQUAL:
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDIFF:
 				{
-					HeapEntry & H = M.begin()->second;
-					
-					if ( outputprefix.size() && (streamRefId != prevrefid) )
+					if ( pendinginserts.size() )
 					{
-						if ( Pstream )
-						{
-							std::ostringstream fnostr;
-							fnostr << outputprefix << "_" << header.getRefIDName(streamRefId);
-							libmaus::aio::PosixFdOutputStream PFOS(fnostr.str());
-							PFOS << ">" << header.getRefIDName(streamRefId) << '\n';
-							PFOS << Pstream->str() << '\n';
-							
-							Pstream.reset();
-						}
-						
-						stream_ptr_type Tstream(new std::ostringstream);
-						Pstream = Tstream;
-						streamRefId = prevrefid;
+						M[refpos].addInsertion(pendinginserts.begin(),pendinginserts.end());
+						pendinginserts.resize(0);
 					}
-					
-					if ( Pindex && (loadedRefId != prevrefid) )
+				
+					for ( uint64_t i = 0; i < ciglen; ++i )
 					{
-						refseqbases = Pindex->readSequence(*PCIS, Pindex->getSequenceIdByName(refidname));
-						loadedRefId = prevrefid;
-						
-						if ( Mconsacc.find(loadedRefId) == Mconsacc.end() )
-							Mconsacc[loadedRefId] = ConsensusAccuracy(refseqbases.size());
-						
-						consacc = &(Mconsacc[loadedRefId]);
+						M[refpos].V.push_back(std::make_pair(bases[readpos],qual[readpos]));
+						readpos++;
+						refpos++;
 					}
-					
-					H.toStream(std::cout,M.begin()->first,refidname,(M.begin()->first < refseqbases.size()) ? static_cast<int>(refseqbases[M.begin()->first]) : -1,Caux,consacc,Pstream.get());
-					
-					M.erase(M.begin());
+					break;
 				}
-			
-				prevrefid = algn.getRefID();
-				refidname = header.getRefIDName(prevrefid);
-			}
-			else
-			{
-				while ( M.size() && M.begin()->first < refpos )
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CINS:
 				{
-					HeapEntry & H = M.begin()->second;
-
-					if ( outputprefix.size() && (streamRefId != prevrefid) )
-					{
-						if ( Pstream )
-						{
-							std::ostringstream fnostr;
-							fnostr << outputprefix << "_" << header.getRefIDName(streamRefId);
-							libmaus::aio::PosixFdOutputStream PFOS(fnostr.str());
-							PFOS << ">" << header.getRefIDName(streamRefId) << '\n';
-							PFOS << Pstream->str() << '\n';
-
-							Pstream.reset();
-						}
-						
-						stream_ptr_type Tstream(new std::ostringstream);
-						Pstream = Tstream;
-						streamRefId = prevrefid;
-					}
-
-					if ( Pindex && (loadedRefId != prevrefid) )
+					for ( uint64_t i = 0; i < ciglen; ++i, ++readpos )
+						pendinginserts.push_back(std::make_pair(bases[readpos],qual[readpos]));
+					break;
+				}
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDEL:
+					// handle pending inserts
+					if ( pendinginserts.size() )
 					{
-						refseqbases = Pindex->readSequence(*PCIS, Pindex->getSequenceIdByName(refidname));
-						loadedRefId = prevrefid;
-
-						if ( Mconsacc.find(loadedRefId) == Mconsacc.end() )
-							Mconsacc[loadedRefId] = ConsensusAccuracy(refseqbases.size());
-
-						consacc = &(Mconsacc[loadedRefId]);
+						M[refpos].addInsertion(pendinginserts.begin(),pendinginserts.end());
+						pendinginserts.resize(0);
 					}
 					
-					H.toStream(std::cout,M.begin()->first,refidname,(M.begin()->first < refseqbases.size()) ? static_cast<int>(refseqbases[M.begin()->first]) : -1,Caux,consacc,Pstream.get());
-					
-					M.erase(M.begin());				
-				}
-			}
-			
-			for ( uint64_t ci = 0; ci < numcigop; ++ci )
-			{
-				uint64_t const ciglen = cigop[ci].second;
-				
-				switch ( cigop[ci].first )
-				{
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CMATCH:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CEQUAL:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDIFF:
+					// deleting bases from the reference
+					for ( uint64_t i = 0; i < ciglen; ++i, ++refpos )
+						M[refpos].V.push_back(std::make_pair(padsym,0));
+					break;
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CREF_SKIP:
+					// handle pending inserts
+					if ( pendinginserts.size() )
 					{
-						if ( pendinginserts.size() )
-						{
-							M[refpos].I.push_back(pendinginserts);
-							pendinginserts.resize(0);
-						}
-					
-						for ( uint64_t i = 0; i < ciglen; ++i )
-						{
-							M[refpos].V.push_back(std::make_pair(bases[readpos],qual[readpos]));
-							readpos++;
-							refpos++;
-						}
-						break;
+						M[refpos].addInsertion(pendinginserts.begin(),pendinginserts.end());
+						pendinginserts.resize(0);
 					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CINS:
+
+					// skip bases on reference
+					for ( uint64_t i = 0; i < ciglen; ++i )
 					{
-						for ( uint64_t i = 0; i < ciglen; ++i, ++readpos )
-							pendinginserts.push_back(std::make_pair(bases[readpos],qual[readpos]));
-						break;
+						refpos++;
 					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDEL:
-						// handle pending inserts
-						if ( pendinginserts.size() )
-						{
-							M[refpos].I.push_back(pendinginserts);
-							pendinginserts.resize(0);
-						}
-						
-						// deleting bases from the reference
-						for ( uint64_t i = 0; i < ciglen; ++i, ++refpos )
-							M[refpos].V.push_back(std::make_pair(padsym,0));
-						break;
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CREF_SKIP:
-						// handle pending inserts
-						if ( pendinginserts.size() )
-						{
-							M[refpos].I.push_back(pendinginserts);
-							pendinginserts.resize(0);
-						}
-
-						// skip bases on reference
-						for ( uint64_t i = 0; i < ciglen; ++i )
-						{
-							refpos++;
-						}
-						break;
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP:
-						// skip bases on read
-						for ( uint64_t i = 0; i < ciglen; ++i )
-						{
-							readpos++;
-						}
-						break;
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP:
-						break;
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CPAD:
+					break;
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP:
+					// skip bases on read
+					for ( uint64_t i = 0; i < ciglen; ++i )
 					{
-						for ( uint64_t i = 0; i < ciglen; ++i, ++readpos )
-							pendinginserts.push_back(std::make_pair(padsym,0));
-						break;
+						readpos++;
 					}
+					break;
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP:
+					break;
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CPAD:
+				{
+					for ( uint64_t i = 0; i < ciglen; ++i, ++readpos )
+						pendinginserts.push_back(std::make_pair(padsym,0));
+					break;
 				}
 			}
+		}
 
-			if ( pendinginserts.size() )
-			{
-				M[refpos].I.push_back(pendinginserts);
-				M[refpos].iadd++;
-				pendinginserts.resize(0);
-			}
-
-			assert ( readpos == seqlen );
+		if ( pendinginserts.size() )
+		{
+			PileupColumn & P = M[refpos];
+			P.addInsertion(pendinginserts.begin(),pendinginserts.end());
+			P.iadd++;
+			pendinginserts.resize(0);
 		}
-		
-		if ( verbose && ((++alcnt % (1024*1024)) == 0) )
-			std::cerr << "[V] " << alcnt << std::endl;
+
+		assert ( readpos == seqlen );
 	}
+};
+
+/*
+ * write consensus for reference sequence refidname to file outputprefix_refidname
+ */
+static void bamheap2WriteConsensus(std::string const & outputprefix, std::string const & refidname, std::string const & consensus)
+{
+	std::ostringstream fnostr;
+	fnostr << outputprefix << "_" << refidname;
+	libmaus::aio::PosixFdOutputStream PFOS(fnostr.str());
+	PFOS << ">" << refidname << '\n';
+	PFOS << consensus << '\n';
+}
 
-	while ( M.size() )
+/*
+ * pileup column consumer writing the pileup and consensus. For numthreads > 1 the columns are
+ * collected in a window and the window is processed by numthreads threads once it is full. Each
+ * thread writes to its own piece of output, the pieces are written in order.
+ */
+struct ConsensusOutput
+{
+	typedef libmaus::util::shared_ptr<std::ostringstream>::type stream_ptr_type;
+
+	libmaus::bambam::BamHeader const & header;
+	std::string const outputprefix;
+	libmaus::fastx::FastAIndex * index;
+	std::istream * refstream;
+	ConsensusAux & Caux;
+	std::ostream & out;
+	uint64_t const numthreads;
+
+	int64_t refid;
+	std::string refidname;
+	int64_t loadedRefId;
+	int64_t streamRefId;
+	libmaus::autoarray::AutoArray<char> refseqbases;
+	ConsensusAccuracy * consacc;
+	std::map<uint64_t,ConsensusAccuracy> Mconsacc;
+	stream_ptr_type Pstream;
+
+	// window of columns waiting for processing if numthreads > 1
+	std::vector<PileupColumn> window;
+	std::vector<uint64_t> windowpos;
+	uint64_t windowfill;
+	// per thread state
+	libmaus::autoarray::AutoArray<ConsensusAux> threadaux;
+	std::vector< std::map<uint64_t,ConsensusAccuracy> > threadconsacc;
+	// output pieces of window
+	std::vector<std::string> pieceout;
+	std::vector<std::string> piececons;
+
+	ConsensusOutput(
+		libmaus::bambam::BamHeader const & rheader,
+		std::string const & routputprefix,
+		libmaus::fastx::FastAIndex * rindex,
+		std::istream * rrefstream,
+		ConsensusAux & rCaux,
+		std::ostream & rout,
+		uint64_t const rnumthreads = 1,
+		uint64_t const windowsize = getDefaultWindowSize()
+	)
+	: header(rheader), outputprefix(routputprefix), index(rindex), refstream(rrefstream), Caux(rCaux), out(rout), numthreads(rnumthreads),
+	  refid(-1), refidname("*"), loadedRefId(-1), streamRefId(-1), refseqbases(), consacc(0), Mconsacc(), Pstream(),
+	  window((numthreads > 1) ? windowsize : 0), windowpos(window.size()), windowfill(0),
+	  threadaux((numthreads > 1) ? numthreads : 0), threadconsacc(threadaux.size()),
+	  pieceout((numthreads > 1) ? 4*numthreads : 0), piececons(pieceout.size())
 	{
-		HeapEntry & H = M.begin()->second;
+		for ( uint64_t i = 0; i < threadaux.size(); ++i )
+			threadaux[i].copyMultipliers(Caux);
+	}
 
-		if ( outputprefix.size() && (streamRefId != prevrefid) )
+	void setRefId(int64_t const rrefid)
+	{
+		// the window only holds columns of a single reference sequence
+		processWindow();
+
+		refid = rrefid;
+		refidname = header.getRefIDName(refid);
+	}
+
+	void writeStream()
+	{
+		bamheap2WriteConsensus(outputprefix,header.getRefIDName(streamRefId),Pstream->str());
+		Pstream.reset();
+	}
+
+	void processWindow()
+	{
+		if ( ! windowfill )
+			return;
+
+		uint64_t const numpieces = std::min(static_cast<uint64_t>(pieceout.size()),windowfill);
+		uint64_t const piecesize = (windowfill + numpieces - 1) / numpieces;
+		libmaus::parallel::PosixSpinLock faillock;
+		std::string failmessage;
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t p = 0; p < static_cast<int64_t>(numpieces); ++p )
 		{
-			if ( Pstream )
+			try
 			{
-				std::ostringstream fnostr;
-				fnostr << outputprefix << "_" << header.getRefIDName(streamRefId);
-				libmaus::aio::PosixFdOutputStream PFOS(fnostr.str());
-				PFOS << ">" << header.getRefIDName(streamRefId) << '\n';
-				PFOS << Pstream->str() << '\n';
+				#if defined(_OPENMP)
+				uint64_t const tid = omp_get_thread_num();
+				#else
+				uint64_t const tid = 0;
+				#endif
+				uint64_t const low = std::min(p * piecesize, windowfill);
+				uint64_t const high = std::min(low + piecesize, windowfill);
+				ConsensusAccuracy * tconsacc = consacc ? &(threadconsacc[tid][loadedRefId]) : 0;
+				std::ostringstream ostr;
+				std::ostringstream cstr;
+
+				for ( uint64_t i = low; i < high; ++i )
+				{
+					uint64_t const refpos = windowpos[i];
+					window[i].toStream(ostr,refpos,refidname,(refpos < refseqbases.size()) ? static_cast<int>(refseqbases[refpos]) : -1,threadaux[tid],tconsacc,Pstream ? &cstr : 0);
+				}
 
-				Pstream.reset();
+				pieceout[p] = ostr.str();
+				piececons[p] = cstr.str();
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+				failmessage = ex.what();
 			}
+		}
+
+		if ( failmessage.size() )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		for ( uint64_t p = 0; p < numpieces; ++p )
+		{
+			out.write(pieceout[p].c_str(),pieceout[p].size());
+			if ( Pstream )
+				Pstream->write(piececons[p].c_str(),piececons[p].size());
+			pieceout[p] = std::string();
+			piececons[p] = std::string();
+		}
+
+		for ( uint64_t i = 0; i < windowfill; ++i )
+			window[i].reset();
+		windowfill = 0;
+	}
+
+	void operator()(uint64_t const refpos, PileupColumn & H)
+	{
+		if ( outputprefix.size() && (streamRefId != refid) )
+		{
+			if ( Pstream )
+				writeStream();
 			
 			stream_ptr_type Tstream(new std::ostringstream);
 			Pstream = Tstream;
-			streamRefId = prevrefid;
+			streamRefId = refid;
 		}
-
-		if ( Pindex && (loadedRefId != prevrefid) )
+		
+		if ( index && (loadedRefId != refid) )
 		{
-			refseqbases = Pindex->readSequence(*PCIS, Pindex->getSequenceIdByName(refidname));
-			loadedRefId = prevrefid;
-
+			refseqbases = index->readSequence(*refstream, index->getSequenceIdByName(refidname));
+			loadedRefId = refid;
+			
 			if ( Mconsacc.find(loadedRefId) == Mconsacc.end() )
 				Mconsacc[loadedRefId] = ConsensusAccuracy(refseqbases.size());
-
+			
 			consacc = &(Mconsacc[loadedRefId]);
 		}
-			
-		H.toStream(std::cout,M.begin()->first,refidname,(M.begin()->first < refseqbases.size()) ? static_cast<int>(refseqbases[M.begin()->first]) : -1,Caux,consacc,Pstream.get());
-		
-		M.erase(M.begin());
+
+		if ( numthreads > 1 )
+		{
+			windowpos[windowfill] = refpos;
+			window[windowfill++].swap(H);
+
+			if ( windowfill == window.size() )
+				processWindow();
+		}
+		else
+		{
+			H.toStream(out,refpos,refidname,(refpos < refseqbases.size()) ? static_cast<int>(refseqbases[refpos]) : -1,Caux,consacc,Pstream.get());
+		}
 	}
-	
-	if ( Pstream )
+
+	void finish()
 	{
-		std::ostringstream fnostr;
-		fnostr << outputprefix << "_" << header.getRefIDName(streamRefId);
-		libmaus::aio::PosixFdOutputStream PFOS(fnostr.str());
-		PFOS << ">" << header.getRefIDName(streamRefId) << '\n';
-		PFOS << Pstream->str() << '\n';
+		processWindow();
 
-		Pstream.reset();
+		if ( Pstream )
+			writeStream();
+
+		// merge per thread accuracy data
+		for ( uint64_t i = 0; i < threadconsacc.size(); ++i )
+		{
+			for ( std::map<uint64_t,ConsensusAccuracy>::const_iterator ita = threadconsacc[i].begin(); ita != threadconsacc[i].end(); ++ita )
+				Mconsacc[ita->first] += ita->second;
+			threadconsacc[i].clear();
+		}
+	}
+};
+
+/*
+ * pileup column consumer for a region query. Columns outside of [from,to) are dropped.
+ */
+struct RegionConsensusOutput
+{
+	uint64_t const from;
+	uint64_t const to;
+	std::string const refidname;
+	libmaus::autoarray::AutoArray<char> const & refseqbases;
+	ConsensusAux & Caux;
+	std::ostream & out;
+	std::ostream * consout;
+	ConsensusAccuracy * consacc;
+	bool used;
+
+	RegionConsensusOutput(
+		uint64_t const rfrom,
+		uint64_t const rto,
+		std::string const & rrefidname,
+		libmaus::autoarray::AutoArray<char> const & rrefseqbases,
+		ConsensusAux & rCaux,
+		std::ostream & rout,
+		std::ostream * rconsout,
+		ConsensusAccuracy * rconsacc
+	)
+	: from(rfrom), to(rto), refidname(rrefidname), refseqbases(rrefseqbases), Caux(rCaux), out(rout), consout(rconsout), consacc(rconsacc), used(false)
+	{
+	}
+
+	void setRefId(int64_t const)
+	{
 	}
+
+	void operator()(uint64_t const refpos, PileupColumn & H)
+	{
+		if ( refpos >= from && refpos < to )
+		{
+			H.toStream(out,refpos,refidname,(refpos < refseqbases.size()) ? static_cast<int>(refseqbases[refpos]) : -1,Caux,consacc,consout);
+			used = true;
+		}
+	}
+};
+
+struct Bamheap2RegionResult
+{
+	typedef Bamheap2RegionResult this_type;
+	typedef libmaus::util::shared_ptr<this_type>::type shared_ptr_type;
+
+	ConsensusAccuracy consacc;
+	uint64_t refbasesexpected;
+	bool used;
 	
+	Bamheap2RegionResult() : consacc(), refbasesexpected(0), used(false)
+	{
+	}
+};
+
+/*
+ * compute pileup and consensus for region R using a region query. refseqbases is the reference
+ * sequence of R.refid (null if no reference is given), it is shared by all regions of the sequence.
+ * The pileup is written to out, the consensus to consout.
+ */
+static void bamheap2Region(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	ReferenceRegion const & R,
+	libmaus::autoarray::AutoArray<char> const * refseqbases,
+	ConsensusAux const & rCaux,
+	std::ostream & out,
+	std::ostream & consout,
+	Bamheap2RegionResult & result
+)
+{
+	std::string const refidname = header.getRefIDName(R.refid);
+	// alignments may extend over the end of the reference sequence
+	uint64_t const to = (R.to == header.getRefIDLength(R.refid)) ? std::numeric_limits<uint64_t>::max() : R.to;
+
+	libmaus::autoarray::AutoArray<char> const norefseqbases;
+	if ( refseqbases )
+		result.refbasesexpected = refseqbases->size();
+
+	ConsensusAux Caux;
+	Caux.copyMultipliers(rCaux);
+
+	RegionConsensusOutput CO(R.from,to,refidname,refseqbases ? *refseqbases : norefseqbases,Caux,out,&consout,refseqbases ? &(result.consacc) : 0);
+	PileupRing M;
+	PileupBuilder B;
+
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type pdec(constructReferenceRegionDecoder(arginfo,header,R));
+	libmaus::bambam::BamAlignmentDecoder & dec = pdec->getDecoder();
+	libmaus::bambam::BamAlignment const & algn = dec.getAlignment();
+
+	while ( dec.readAlignment() )
+		if ( algn.isMapped() && (!algn.isQCFail()) && algn.getRefID() == static_cast<int64_t>(R.refid) )
+			B(algn,M,CO);
+
+	M.finish(0,CO);
+
+	result.used = CO.used;
+}
+
+/*
+ * region processor for bamheap2Parallel. Output stream 0 is the pileup, stream 1 the consensus.
+ * The consensus file of a reference sequence is written by the writer while the regions of the
+ * sequence arrive, the accuracy data of a region is merged once the region is written.
+ */
+struct Bamheap2RegionProcessor : public ReferenceRegionProcessor
+{
+	typedef libmaus::autoarray::AutoArray<char>::shared_ptr_type refseq_ptr_type;
+
+	libmaus::util::ArgInfo const & arginfo;
+	libmaus::bambam::BamHeader const & header;
+	std::vector<ReferenceRegion> const & regions;
+	libmaus::fastx::FastAIndex * index;
+	std::istream * refstream;
+	std::string const outputprefix;
+	ConsensusAux const & Caux;
+	std::map<uint64_t,ConsensusAccuracy> & Mconsacc;
+
+	// reference sequences loaded for the regions in progress
+	libmaus::parallel::PosixMutex refseqlock;
+	std::map<uint64_t,refseq_ptr_type> refseqs;
+
+	// results of regions processed but not yet written
+	libmaus::parallel::PosixSpinLock resultlock;
+	std::map<uint64_t,Bamheap2RegionResult::shared_ptr_type> results;
+
+	// consensus file currently written
+	int64_t consrefid;
+	libmaus::aio::PosixFdOutputStream::unique_ptr_type Pconsout;
+
+	Bamheap2RegionProcessor(
+		libmaus::util::ArgInfo const & rarginfo,
+		libmaus::bambam::BamHeader const & rheader,
+		std::vector<ReferenceRegion> const & rregions,
+		libmaus::fastx::FastAIndex * rindex,
+		std::istream * rrefstream,
+		std::string const & routputprefix,
+		ConsensusAux const & rCaux,
+		std::map<uint64_t,ConsensusAccuracy> & rMconsacc
+	)
+	: arginfo(rarginfo), header(rheader), regions(rregions), index(rindex), refstream(rrefstream), outputprefix(routputprefix),
+	  Caux(rCaux), Mconsacc(rMconsacc), refseqlock(), refseqs(), resultlock(), results(), consrefid(-1), Pconsout()
+	{
+	}
+
+	/*
+	 * get reference sequence refid. Regions are claimed in order, so sequences before refid are
+	 * dropped from the cache, threads still processing them hold their own pointer.
+	 */
+	refseq_ptr_type getRefSeq(uint64_t const refid)
+	{
+		libmaus::parallel::ScopePosixMutex slock(refseqlock);
+
+		while ( refseqs.size() && refseqs.begin()->first < refid )
+			refseqs.erase(refseqs.begin());
+
+		if ( refseqs.find(refid) == refseqs.end() )
+		{
+			refseq_ptr_type tptr(new libmaus::autoarray::AutoArray<char>);
+			*tptr = index->readSequence(*refstream, index->getSequenceIdByName(header.getRefIDName(refid)));
+			refseqs[refid] = tptr;
+		}
+
+		return refseqs.find(refid)->second;
+	}
+
+	void processRegion(uint64_t const i, ReferenceRegion const & R, std::vector<std::ostream *> const & out)
+	{
+		refseq_ptr_type refseq;
+		if ( index )
+			refseq = getRefSeq(R.refid);
+
+		Bamheap2RegionResult::shared_ptr_type result(new Bamheap2RegionResult);
+		bamheap2Region(arginfo,header,R,refseq.get(),Caux,*out[0],*out[1],*result);
+
+		libmaus::parallel::ScopePosixSpinLock slock(resultlock);
+		results[i] = result;
+	}
+
+	void closeConsensus()
+	{
+		if ( Pconsout )
+		{
+			(*Pconsout) << '\n';
+			Pconsout->flush();
+			Pconsout.reset();
+		}
+	}
+
+	void openConsensus(uint64_t const refid)
+	{
+		if ( consrefid != static_cast<int64_t>(refid) )
+		{
+			closeConsensus();
+
+			std::ostringstream fnostr;
+			fnostr << outputprefix << "_" << header.getRefIDName(refid);
+			libmaus::aio::PosixFdOutputStream::unique_ptr_type tptr(new libmaus::aio::PosixFdOutputStream(fnostr.str()));
+			Pconsout = UNIQUE_PTR_MOVE(tptr);
+			(*Pconsout) << ">" << header.getRefIDName(refid) << '\n';
+			consrefid = refid;
+		}
+	}
+
+	void writePiece(uint64_t const i, uint64_t const stream, char const * data, uint64_t const n)
+	{
+		if ( stream == 0 )
+		{
+			std::cout.write(data,n);
+		}
+		else if ( outputprefix.size() )
+		{
+			openConsensus(regions[i].refid);
+			Pconsout->write(data,n);
+		}
+	}
+
+	void finishRegion(uint64_t const i)
+	{
+		Bamheap2RegionResult::shared_ptr_type result;
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(resultlock);
+			result = results[i];
+			results.erase(i);
+		}
+		uint64_t const refid = regions[i].refid;
+
+		if ( ! result->used )
+			return;
+
+		// the consensus of a sequence may be empty
+		if ( outputprefix.size() )
+			openConsensus(refid);
+
+		if ( index )
+		{
+			if ( Mconsacc.find(refid) == Mconsacc.end() )
+				Mconsacc[refid] = ConsensusAccuracy(result->refbasesexpected);
+			Mconsacc[refid] += result->consacc;
+		}
+	}
+
+	void finish()
+	{
+		closeConsensus();
+	}
+};
+
+/*
+ * compute pileup and consensus for all reference sequences via region queries on numthreads threads.
+ * The output is written in header order while the regions are processed.
+ */
+static void bamheap2Parallel(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	libmaus::fastx::FastAIndex * index,
+	std::istream * refstream,
+	std::string const & outputprefix,
+	ConsensusAux const & Caux,
+	uint64_t const numthreads,
+	uint64_t const chunksize,
+	bool const verbose,
+	std::map<uint64_t,ConsensusAccuracy> & Mconsacc
+)
+{
+	std::vector<ReferenceRegion> const regions = computeReferenceRegions(header,chunksize);
+	Bamheap2RegionProcessor processor(arginfo,header,regions,index,refstream,outputprefix,Caux,Mconsacc);
+
+	processReferenceRegions(regions,processor,numthreads,2,verbose);
+
+	processor.finish();
+}
+
+/*
+ * print consensus accuracy and depth histograms per reference sequence and in total
+ */
+static void bamheap2PrintConsensusAccuracy(libmaus::bambam::BamHeader const & header, std::map<uint64_t,ConsensusAccuracy> const & Mconsacc)
+{
 	ConsensusAccuracy constotal;
 	for ( std::map<uint64_t,ConsensusAccuracy>::const_iterator ita = Mconsacc.begin(); ita != Mconsacc.end(); ++ita )
 	{
@@ -660,6 +1123,102 @@ int bamheap2(libmaus::util::ArgInfo const & arginfo)
 		std::cerr << "H[all,avg]\t" << static_cast<double>(preavg) / total << std::endl;
 		
 	}
+}
+
+int bamheap2(libmaus::util::ArgInfo const & arginfo)
+{
+	bool const verbose = arginfo.getValue("verbose",getDefaultVerbose());
+	std::string const reference = arginfo.getUnparsedValue("reference",std::string());
+	std::string const outputprefix = arginfo.getUnparsedValue("outputprefix",std::string());
+	unsigned int const threads = std::max(arginfo.getValue<unsigned int>("threads",getDefaultThreads()),1u);
+	uint64_t const windowsize = std::max(arginfo.getValueUnsignedNumeric<uint64_t>("windowsize",getDefaultWindowSize()),static_cast<uint64_t>(1));
+	bool const byref = arginfo.getValue<int>("byref",getDefaultByRef());
+	uint64_t const chunksize = arginfo.getValueUnsignedNumeric<uint64_t>("chunksize",getDefaultChunkSize());
+	
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type decwrapper(
+		libmaus::bambam::BamMultiAlignmentDecoderFactory::construct(arginfo));
+	::libmaus::bambam::BamAlignmentDecoder * ppdec = &(decwrapper->getDecoder());
+	::libmaus::bambam::BamAlignmentDecoder & dec = *ppdec;
+	::libmaus::bambam::BamHeader const & header = dec.getHeader();	
+	::libmaus::bambam::BamAlignment const & algn = dec.getAlignment();
+	
+	double const damult = arginfo.getValue<double>("amult",1);
+	double const dcmult = arginfo.getValue<double>("cmult",1);
+	double const dgmult = arginfo.getValue<double>("gmult",1);
+	double const dtmult = arginfo.getValue<double>("tmult",1);
+	double const dpadmult = arginfo.getValue<double>("padmult",1);
+	
+	double maxmult = 0;
+	maxmult = std::max(damult,maxmult);
+	maxmult = std::max(dcmult,maxmult);
+	maxmult = std::max(dgmult,maxmult);
+	maxmult = std::max(dtmult,maxmult);
+	maxmult = std::max(dpadmult,maxmult);
+	
+	uint64_t const amult = std::floor((damult / maxmult) * (1ull<<16) + 0.5);
+	uint64_t const cmult = std::floor((dcmult / maxmult) * (1ull<<16) + 0.5);
+	uint64_t const gmult = std::floor((dgmult / maxmult) * (1ull<<16) + 0.5);
+	uint64_t const tmult = std::floor((dtmult / maxmult) * (1ull<<16) + 0.5);
+	uint64_t const padmult = std::floor((dpadmult / maxmult) * (1ull<<16) + 0.5);
+	
+	libmaus::fastx::FastAIndex::unique_ptr_type Pindex;
+	libmaus::aio::CheckedInputStream::unique_ptr_type PCIS;
+	if ( reference.size() )
+	{
+		libmaus::fastx::FastAIndex::unique_ptr_type Tindex(
+			libmaus::fastx::FastAIndex::load(reference+".fai")
+		);
+		Pindex = UNIQUE_PTR_MOVE(Tindex);
+		
+		libmaus::aio::CheckedInputStream::unique_ptr_type TCIS(new libmaus::aio::CheckedInputStream(reference));
+		PCIS = UNIQUE_PTR_MOVE(TCIS);
+	}
+
+	ConsensusAux Caux;
+	
+	Caux.M['a'] = Caux.M['A'] = amult;
+	Caux.M['c'] = Caux.M['C'] = cmult;
+	Caux.M['g'] = Caux.M['G'] = gmult;
+	Caux.M['t'] = Caux.M['T'] = tmult;
+	Caux.M[padsym] = padmult;
+
+	std::map<uint64_t,ConsensusAccuracy> Mconsacc;
+
+	bool const regionnamesok = checkReferenceRegionNames(header);
+
+	if ( threads > 1 && byref && ! regionnamesok )
+		std::cerr << "[W] reference sequence names contain colons, region queries are not possible, using byref=0" << std::endl;
+
+	if ( threads > 1 && byref && regionnamesok )
+	{
+		checkReferenceRegionInput(arginfo,getDefaultInputFormat());
+		bamheap2Parallel(arginfo,header,Pindex.get(),PCIS.get(),outputprefix,Caux,threads,chunksize,verbose,Mconsacc);
+	}
+	else
+	{
+		PileupRing M;
+		PileupBuilder B;
+		uint64_t alcnt = 0;
+		ConsensusOutput CO(header,outputprefix,Pindex.get(),PCIS.get(),Caux,std::cout,threads,windowsize);
+	
+		while ( dec.readAlignment() )
+		{
+			if ( algn.isMapped() && (!algn.isQCFail()) )
+			{
+				B(algn,M,CO);
+			}
+			
+			if ( verbose && ((++alcnt % (1024*1024)) == 0) )
+				std::cerr << "[V] " << alcnt << std::endl;
+		}
+
+		M.finish(0,CO);
+		CO.finish();
+
+		Mconsacc.swap(CO.Mconsacc);
+	}
+
+	bamheap2PrintConsensusAccuracy(header,Mconsacc);
 
 	return EXIT_SUCCESS;
 }
@@ -700,6 +1259,10 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "inputthreads=<[1]>", "input helper threads (for inputformat=bam only, default: 1)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "reference=<>", "reference FastA (.fai file required, for cram i/o only)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "range=<>", "coordinate range to be processed (for coordinate sorted indexed BAM input only)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "threads=<["+::biobambam::Licensing::formatNumber(getDefaultThreads())+"]>", "number of threads used for computing the consensus" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "windowsize=<["+::biobambam::Licensing::formatNumber(getDefaultWindowSize())+"]>", "number of pileup columns processed in parallel if threads>1 and byref=0" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "byref=<["+::biobambam::Licensing::formatNumber(getDefaultByRef())+"]>", "process reference sequences in parallel via region queries if threads>1 (requires an indexed input file)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "chunksize=<["+::biobambam::Licensing::formatNumber(getDefaultChunkSize())+"]>", "size of reference sequence pieces processed by a thread if byref=1 (0 for whole reference sequences)" ) );
 
 				::biobambam::Licensing::printMap(std::cerr,V);
 
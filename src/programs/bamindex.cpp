@@ -19,14 +19,86 @@
 #include <config.h>
 
 #include <libmaus/bambam/BamIndexGenerator.hpp>
+#include <libmaus/exception/LibMausException.hpp>
 #include <libmaus/lz/BgzfInflate.hpp>
 #include <libmaus/util/ArgInfo.hpp>
 #include <libmaus/util/MemUsage.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
 
+#include <biobambam/BgzfBlockCopy.hpp>
+#include <biobambam/CsiIndexGenerator.hpp>
 #include <biobambam/Licensing.hpp>
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 bool getDefaultVerbose() { return true; }
 bool getDefaultDisableValidation() { return false; }
+uint64_t getDefaultThreads() { return 1; }
+bool getDefaultCsi() { return false; }
+
+/*
+ * pass the decompressed BGZF blocks of in to the index generator G in file order. For numthreads > 1 the
+ * compressed blocks are read in batches and decompressed in parallel.
+ */
+template<typename index_generator_type>
+static void bamindexFeed(std::istream & in, index_generator_type & G, uint64_t const numthreads)
+{
+	if ( numthreads <= 1 )
+	{
+		libmaus::lz::BgzfInflate<std::istream> rec(in);
+		libmaus::autoarray::AutoArray<uint8_t> B(libmaus::lz::BgzfConstants::getBgzfMaxBlockSize());
+		libmaus::lz::BgzfInflateInfo rinfo;
+		while ( ! (rinfo=rec.readAndInfo(reinterpret_cast<char *>(B.begin()),B.size())).streameof )
+			G.addBlock(B.begin(),rinfo.compressed,rinfo.uncompressed);
+		return;
+	}
+
+	uint64_t const batchblocks = 16*numthreads;
+	libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> > cblocks(batchblocks);
+	libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> > ublocks(batchblocks);
+	std::vector<uint64_t> csizes(batchblocks);
+	std::vector<uint64_t> usizes(batchblocks);
+	libmaus::parallel::PosixSpinLock faillock;
+	std::string failmessage;
+	bool eof = false;
+
+	while ( ! eof )
+	{
+		uint64_t numblocks = 0;
+		while ( numblocks < batchblocks && (csizes[numblocks] = bgzfBlockRead(in,cblocks[numblocks])) )
+			++numblocks;
+		eof = (numblocks < batchblocks);
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t i = 0; i < static_cast<int64_t>(numblocks); ++i )
+		{
+			try
+			{
+				usizes[i] = bgzfBlockInflate(cblocks[i].begin(),csizes[i],ublocks[i]);
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+				failmessage = ex.what();
+			}
+		}
+
+		if ( failmessage.size() )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		for ( uint64_t i = 0; i < numblocks; ++i )
+			G.addBlock(ublocks[i].begin(),csizes[i],usizes[i]);
+	}
+}
 
 int bamindex(libmaus::util::ArgInfo const & arginfo, std::istream & in, std::ostream & out)
 {
@@ -34,17 +106,22 @@ int bamindex(libmaus::util::ArgInfo const & arginfo, std::istream & in, std::ost
 	unsigned int const verbose = arginfo.getValue<unsigned int>("verbose",getDefaultVerbose());
 	bool const validate = !(arginfo.getValue<unsigned int>("disablevalidation",getDefaultDisableValidation()));
 	std::string const tmpfileprefix = arginfo.getValue<std::string>("tmpfile",arginfo.getDefaultTmpFileName());
+	uint64_t const numthreads = std::max(arginfo.getValueUnsignedNumeric<uint64_t>("threads",getDefaultThreads()),static_cast<uint64_t>(1));
+	bool const csi = arginfo.getValue<unsigned int>("csi",getDefaultCsi());
 
-	libmaus::lz::BgzfInflate<std::istream> rec(in);
-	
-	libmaus::bambam::BamIndexGenerator BIG(tmpfileprefix,verbose,validate,debug);
-
-	libmaus::autoarray::AutoArray<uint8_t> B(libmaus::lz::BgzfConstants::getBgzfMaxBlockSize());
-	libmaus::lz::BgzfInflateInfo rinfo;
-	while ( ! (rinfo=rec.readAndInfo(reinterpret_cast<char *>(B.begin()),B.size())).streameof )
-		BIG.addBlock(B.begin(),rinfo.compressed,rinfo.uncompressed);
-
-	BIG.flush(out);
+	if ( csi )
+	{
+		unsigned int const minshift = arginfo.getValue<unsigned int>("csiminshift",CsiIndexGenerator::getDefaultMinShift());
+		CsiIndexGenerator CIG(minshift,verbose);
+		bamindexFeed(in,CIG,numthreads);
+		CIG.flush(out);
+	}
+	else
+	{
+		libmaus::bambam::BamIndexGenerator BIG(tmpfileprefix,verbose,validate,debug);
+		bamindexFeed(in,BIG,numthreads);
+		BIG.flush(out);
+	}
 	
 	return EXIT_SUCCESS;
 }
@@ -81,6 +158,9 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "verbose=<["+::biobambam::Licensing::formatNumber(getDefaultVerbose())+"]>", "print progress report (default: 1)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "disablevalidation=<["+::biobambam::Licensing::formatNumber(getDefaultDisableValidation())+"]>", "disable alignment validation (default: 0)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "tmpfile=<["+arginfo.getDefaultTmpFileName()+"]>", "temporary file prefix (default: create in current directory)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "threads=<["+::biobambam::Licensing::formatNumber(getDefaultThreads())+"]>", "number of threads used for decompressing the input (default: 1)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "csi=<["+::biobambam::Licensing::formatNumber(getDefaultCsi())+"]>", "produce CSI index instead of BAI index (default: 0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "csiminshift=<["+::biobambam::Licensing::formatNumber(CsiIndexGenerator::getDefaultMinShift())+"]>", "base 2 logarithm of the minimal interval size for csi=1 (default: 14)" ) );
 
 				::biobambam::Licensing::printMap(std::cerr,V);
 
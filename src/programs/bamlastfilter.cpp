@@ -29,16 +29,23 @@
 #include <libmaus/bambam/BgzfDeflateOutputCallbackBamIndex.hpp>
 #include <libmaus/lz/BgzfDeflateOutputCallbackMD5.hpp>
 #include <libmaus/bambam/StrCmpNum.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
 
 #include <biobambam/BamBamConfig.hpp>
 #include <biobambam/Licensing.hpp>
 
 #include <config.h>
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 enum link_type_enum { link_type_chain, link_type_cluster };
 
 static int getDefaultMD5() { return 0; }
 static int getDefaultIndex() { return 0; }
+static unsigned int getDefaultThreads() { return 1; }
+static uint64_t getDefaultBatchSize() { return 4096; }
 
 static int getDefaultVerbose()
 {
@@ -79,17 +86,20 @@ struct MappingRegion
 	uint64_t refId;
 	uint64_t refFrom;
 	uint64_t refTo;
+	// value of the AS aux field
+	int64_t score;
 	libmaus::bambam::BamAlignment * algn;
 	
-	MappingRegion() : readFrom(0), readTo(0), refFrom(0), refTo(0), algn(0) {}
+	MappingRegion() : readFrom(0), readTo(0), refFrom(0), refTo(0), score(0), algn(0) {}
 	MappingRegion(
 		uint64_t const rreadFrom,
 		uint64_t const rreadTo,
 		uint64_t const rrefId,
 		uint64_t const rrefFrom,
 		uint64_t const rrefTo,
+		int64_t const rscore,
 		libmaus::bambam::BamAlignment * ralgn
-	) : readFrom(rreadFrom), readTo(rreadTo), refId(rrefId), refFrom(rrefFrom), refTo(rrefTo), algn(ralgn) {}
+	) : readFrom(rreadFrom), readTo(rreadTo), refId(rrefId), refFrom(rrefFrom), refTo(rrefTo), score(rscore), algn(ralgn) {}
 };
 
 std::ostream & operator<<(std::ostream & out, MappingRegion const & MR)
@@ -102,14 +112,14 @@ std::ostream & operator<<(std::ostream & out, MappingRegion const & MR)
 		<< MR.refTo << ")";
 }
 
-struct MappingRegionReadCoordComparator
+struct IntegerIntervalComparator
 {
-	bool operator()(MappingRegion const & A, MappingRegion const & B) const
+	bool operator()(libmaus::math::IntegerInterval<uint64_t> const & A, libmaus::math::IntegerInterval<uint64_t> const & B) const
 	{
-		if ( A.readFrom != B.readFrom )
-			return A.readFrom < B.readFrom;
+		if ( A.from != B.from )
+			return A.from < B.from;
 		else
-			return A.readTo < B.readTo;
+			return A.to < B.to;
 	}
 };
 
@@ -214,177 +224,188 @@ std::ostream & operator<<(std::ostream & out, ScoredAlignment const & S)
 			<< "," << S.getNormalisedScore() << ")";
 }
 
+/*
+ * per thread scratch space for handleVector
+ */
+struct LastFilterContext
+{
+	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> cigop;
+	std::vector<MappingRegion> M;
+	std::vector<ScoredAlignment> PQ;
+	std::vector<ScoredAlignment> scoredout;
+	std::vector < libmaus::math::IntegerInterval<uint64_t> > PIIV;
+	std::vector<ScoredInterval> alintervals;
+};
+
 void handleVector(
-	std::vector< ::libmaus::bambam::BamAlignment * > & samename,
-	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> & cigop,
+	::libmaus::bambam::BamAlignment ** const samename,
+	uint64_t const numsamename,
+	LastFilterContext & context,
 	libmaus::bambam::BamHeader const & header,
 	uint64_t & readbases,
 	uint64_t & mappedbases,
-	libmaus::bambam::BamBlockWriterBase & writer,
+	std::vector< ::libmaus::bambam::BamAlignment * > & outputvec,
 	link_type_enum const link_type,
 	double const erate = 0.3
 )
 {
-	std::sort(samename.begin(),samename.end());
+	// mapped alignments first, sorted by reference coordinates
+	std::stable_sort(samename,samename+numsamename,AlignmentComparator());
 
-	typedef std::pair<uint64_t,uint64_t> up;
-	std::vector<MappingRegion> M;
+	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> & cigop = context.cigop;
+	std::vector<MappingRegion> & M = context.M;
+	M.resize(0);
 	int64_t readlen = -1;
 	
-	typedef ScoredAlignment scored_alignment_type;
-	std::priority_queue < scored_alignment_type > PQ;
-	
-	for ( uint64_t i = 0; i < samename.size() && samename[i]->isMapped(); )
+	for ( uint64_t z = 0; z < numsamename && samename[z]->isMapped(); ++z )
 	{
-		uint64_t j = i;
-		while ( 
-			j < samename.size() && 
-			samename[j]->isMapped() && 
-			samename[j]->getRefID() == samename[i]->getRefID()
-		)
-			++j;
-		
-		for ( uint64_t z = i ; z < j; ++z )
-		{
-			::libmaus::bambam::BamAlignment * palgn = samename[z];
-			::libmaus::bambam::BamAlignment & algn = *palgn;
-
-			uint32_t const numcigop = algn.getCigarOperations(cigop);
-			uint64_t const seqlen = algn.getLseq();
-			uint64_t readpos = 0;
-			uint64_t refpos = algn.getPos();
-			uint64_t refid = algn.getRefID();
-
-			uint64_t hleft = 0;
-			uint64_t hright = 0;
-			uint64_t sleft = 0;
-			uint64_t sright = 0;
-			uint64_t cl = 0;
-			uint64_t cr = numcigop;
-				
-			while ( cl < cr && cigop[cl].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP )
-				hleft += cigop[cl++].second;
-			while ( cr > cl && cigop[cr-1].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP )
-				hright += cigop[--cr].second;
-
-			while ( cl < cr && cigop[cl].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP )
-				sleft += cigop[cl++].second;
-			while ( cr > cl && cigop[cr-1].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP )
-				sright += cigop[--cr].second;
-				
-			readpos += sleft;
-
-			for ( uint64_t ci = cl; ci < cr; ++ci )
-				if ( 
-					cigop[ci].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP
-					||
-					cigop[ci].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP
-				)
-				{
-					libmaus::exception::LibMausException lme;
-					lme.getStream() << "Malformed cigar string in read " << algn.getName() << "\n";
-					lme.getStream() << algn.formatAlignment(header) << "\n";
-					lme.finish();
-					throw lme;
-				}
-				
-			uint64_t const mpre = readpos;
-			uint64_t const rpre = refpos;
+		::libmaus::bambam::BamAlignment * palgn = samename[z];
+		::libmaus::bambam::BamAlignment & algn = *palgn;
+
+		uint32_t const numcigop = algn.getCigarOperations(cigop);
+		uint64_t const seqlen = algn.getLseq();
+		uint64_t readpos = 0;
+		uint64_t refpos = algn.getPos();
+		uint64_t refid = algn.getRefID();
+
+		uint64_t hleft = 0;
+		uint64_t hright = 0;
+		uint64_t sleft = 0;
+		uint64_t sright = 0;
+		uint64_t cl = 0;
+		uint64_t cr = numcigop;
 			
-			for ( uint64_t ci = cl; ci < cr; ++ci )
-			{
-				uint64_t const ciglen = cigop[ci].second;
-				
-				switch ( cigop[ci].first )
-				{
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CMATCH:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CEQUAL:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDIFF:
-					{
-						readpos += ciglen;
-						refpos += ciglen;
-						break;
-					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CINS:
-					{
-						readpos += ciglen;
-						break;
-					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDEL:
-					{
-						// deleting bases from the reference
-						refpos += ciglen;
-						break;
-					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CREF_SKIP:
-					{
-						// skip bases on reference
-						refpos += ciglen;
-						break;
-					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP:
-					{
-						// skip bases on read
-						readpos += ciglen;
-						break;
-					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP:
-					{
-						break;
-					}
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CPAD:
-					{
-						break;
-					}
-				}
-			}
+		while ( cl < cr && cigop[cl].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP )
+			hleft += cigop[cl++].second;
+		while ( cr > cl && cigop[cr-1].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP )
+			hright += cigop[--cr].second;
+
+		while ( cl < cr && cigop[cl].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP )
+			sleft += cigop[cl++].second;
+		while ( cr > cl && cigop[cr-1].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP )
+			sright += cigop[--cr].second;
 			
-			uint64_t const mpost = readpos;
-			uint64_t const rpost = refpos;
-
-			M.push_back(MappingRegion(hleft+mpre,hleft+mpost,refid,rpre,rpost,&algn));
+		readpos += sleft;
 
-			int64_t const score = palgn->getAuxAsNumber<int64_t>("AS");
-			PQ.push(scored_alignment_type(samename[i],score,hleft+mpre,hleft+mpost,rpre,rpost));
-			
-			readpos += sright;
-
-			if ( readpos != seqlen )
+		for ( uint64_t ci = cl; ci < cr; ++ci )
+			if ( 
+				cigop[ci].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP
+				||
+				cigop[ci].first == libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP
+			)
 			{
 				libmaus::exception::LibMausException lme;
 				lme.getStream() << "Malformed cigar string in read " << algn.getName() << "\n";
 				lme.getStream() << algn.formatAlignment(header) << "\n";
-				lme.getStream() << "cl=" << cl << " cr=" << cr << std::endl;
 				lme.finish();
 				throw lme;
 			}
-
-			assert ( readpos == seqlen );
 			
-			if ( readlen < 0 )
-				readlen = seqlen + hleft + hright;
-			else
-				assert ( static_cast<uint64_t>(readlen) == seqlen + hleft + hright );
+		uint64_t const mpre = readpos;
+		uint64_t const rpre = refpos;
+		
+		for ( uint64_t ci = cl; ci < cr; ++ci )
+		{
+			uint64_t const ciglen = cigop[ci].second;
+			
+			switch ( cigop[ci].first )
+			{
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CMATCH:
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CEQUAL:
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDIFF:
+				{
+					readpos += ciglen;
+					refpos += ciglen;
+					break;
+				}
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CINS:
+				{
+					readpos += ciglen;
+					break;
+				}
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDEL:
+				{
+					// deleting bases from the reference
+					refpos += ciglen;
+					break;
+				}
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CREF_SKIP:
+				{
+					// skip bases on reference
+					refpos += ciglen;
+					break;
+				}
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP:
+				{
+					// skip bases on read
+					readpos += ciglen;
+					break;
+				}
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP:
+				{
+					break;
+				}
+				case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CPAD:
+				{
+					break;
+				}
+			}
+		}
+		
+		uint64_t const mpost = readpos;
+		uint64_t const rpost = refpos;
+
+		M.push_back(MappingRegion(hleft+mpre,hleft+mpost,refid,rpre,rpost,algn.getAuxAsNumber<int64_t>("AS"),palgn));
+		
+		readpos += sright;
+
+		if ( readpos != seqlen )
+		{
+			libmaus::exception::LibMausException lme;
+			lme.getStream() << "Malformed cigar string in read " << algn.getName() << "\n";
+			lme.getStream() << algn.formatAlignment(header) << "\n";
+			lme.getStream() << "cl=" << cl << " cr=" << cr << std::endl;
+			lme.finish();
+			throw lme;
 		}
+
+		assert ( readpos == seqlen );
 		
-		i = j;
+		if ( readlen < 0 )
+			readlen = seqlen + hleft + hright;
+		else
+			assert ( static_cast<uint64_t>(readlen) == seqlen + hleft + hright );
 	}
 
-	std::vector<scored_alignment_type> scoredout;
-	while ( ! PQ.empty() )
+	std::vector<ScoredAlignment> & scoredout = context.scoredout;
+	scoredout.resize(0);
+	if ( link_type == link_type_cluster )
 	{
-		scored_alignment_type const SA = PQ.top(); PQ.pop();
-		
-		if ( ! SA.overlaps(scoredout) )
-			scoredout.push_back(SA);
+		// greedily pick alignments by descending normalised score, skipping overlaps on the read
+		std::vector<ScoredAlignment> & PQ = context.PQ;
+		PQ.resize(0);
+		for ( uint64_t i = 0; i < M.size(); ++i )
+		{
+			PQ.push_back(ScoredAlignment(M[i].algn,M[i].score,M[i].readFrom,M[i].readTo,M[i].refFrom,M[i].refTo));
+			std::push_heap(PQ.begin(),PQ.end());
+		}
+
+		while ( PQ.size() )
+		{
+			std::pop_heap(PQ.begin(),PQ.end());
+			ScoredAlignment const SA = PQ.back(); PQ.pop_back();
+			
+			if ( ! SA.overlaps(scoredout) )
+				scoredout.push_back(SA);
+		}
 	}
 	
-	std::sort(M.begin(),M.end(),MappingRegionReadCoordComparator());
-
-	std::vector < libmaus::math::IntegerInterval<uint64_t> > PIIV;
+	std::vector < libmaus::math::IntegerInterval<uint64_t> > & PIIV = context.PIIV;
+	PIIV.clear();
 	for ( uint64_t i = 0; i < M.size(); ++i )
 		if ( M[i].readFrom < M[i].readTo )
 			PIIV.push_back(libmaus::math::IntegerInterval<uint64_t>(M[i].readFrom,M[i].readTo-1));
+	std::sort(PIIV.begin(),PIIV.end(),IntegerIntervalComparator());
 	
 	std::vector < libmaus::math::IntegerInterval<uint64_t> > const IIV = libmaus::math::IntegerInterval<uint64_t>::mergeOverlapping(PIIV);
 
@@ -398,7 +419,8 @@ void handleVector(
 	std::sort(M.begin(),M.end(),MappingRegionRefCoordComparator());
 	// maximum error rate for linking fragments
 	// linked fragments
-	std::vector<ScoredInterval> alintervals;
+	std::vector<ScoredInterval> & alintervals = context.alintervals;
+	alintervals.resize(0);
 	
 	for ( uint64_t refidlow = 0; refidlow != M.size(); )
 	{
@@ -452,7 +474,7 @@ void handleVector(
 			#endif
 			double score = 0;
 			for ( uint64_t i = readlow; i < readhigh; ++i )
-				score += static_cast<double>(M[i].algn->getAuxAsNumber<int64_t>("AS"));
+				score += static_cast<double>(M[i].score);
 			
 			alintervals.push_back(ScoredInterval(readlow,readhigh,score));
 			
@@ -465,8 +487,6 @@ void handleVector(
 	// sort by descending score
 	std::sort(alintervals.begin(),alintervals.end(),ScoredIntervalComparator());
 	
-	std::vector< ::libmaus::bambam::BamAlignment * > outputvec;
-	
 	if ( link_type == link_type_chain )
 	{
 		if ( alintervals.size() )
@@ -490,11 +510,7 @@ void handleVector(
 			outputvec.push_back(scoredout[i].getAlignment());
 	}
 	
-	if ( outputvec.size() == 1 )
-	{
-		writer.writeAlignment(*(outputvec[0]));
-	}
-	else if ( outputvec.size() > 1 )
+	if ( outputvec.size() > 1 )
 	{
 		for ( uint64_t i = 1; i < outputvec.size(); ++i )
 		{
@@ -506,16 +522,121 @@ void handleVector(
 			outputvec[i]->putNextPos(outputvec[next]->getPos());
 			outputvec[i]->putNextRefId(outputvec[next]->getRefID());
 		}
-		for ( uint64_t i = 0; i < outputvec.size(); ++i )
-			writer.writeAlignment(*(outputvec[i]));
 	}
 }
 
+/*
+ * alignments of one read name in a LastFilterBatch
+ */
+struct LastFilterGroup
+{
+	uint64_t low;
+	uint64_t high;
+	uint64_t readbases;
+	uint64_t mappedbases;
+	std::vector< ::libmaus::bambam::BamAlignment * > outputvec;
+	
+	LastFilterGroup() : low(0), high(0), readbases(0), mappedbases(0), outputvec() {}
+};
+
+/*
+ * batch of name groups. The groups of a batch are processed in parallel, the output is written
+ * in input order. Alignments are taken from and returned to a free list, groups and scratch space
+ * are reused for the next batch.
+ */
+struct LastFilterBatch
+{
+	std::vector< ::libmaus::bambam::BamAlignment * > algns;
+	std::vector<LastFilterGroup> groups;
+	uint64_t numgroups;
+	uint64_t const numthreads;
+	libmaus::autoarray::AutoArray<LastFilterContext> contexts;
+	
+	LastFilterBatch(uint64_t const rnumthreads) : algns(), groups(), numgroups(0), numthreads(rnumthreads), contexts(numthreads) {}
+	
+	void closeGroup()
+	{
+		uint64_t const low = numgroups ? groups[numgroups-1].high : 0;
+		
+		if ( low == algns.size() )
+			return;
+		
+		if ( numgroups == groups.size() )
+			groups.push_back(LastFilterGroup());
+		
+		LastFilterGroup & G = groups[numgroups++];
+		G.low = low;
+		G.high = algns.size();
+	}
+	
+	void process(
+		libmaus::bambam::BamHeader const & header,
+		link_type_enum const link_type,
+		libmaus::bambam::BamBlockWriterBase & writer,
+		libmaus::util::GrowingFreeList< ::libmaus::bambam::BamAlignment > & alfl,
+		uint64_t & readbases,
+		uint64_t & mappedbases
+	)
+	{
+		libmaus::parallel::PosixSpinLock faillock;
+		std::string failmessage;
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t g = 0; g < static_cast<int64_t>(numgroups); ++g )
+		{
+			try
+			{
+				#if defined(_OPENMP)
+				uint64_t const tid = omp_get_thread_num();
+				#else
+				uint64_t const tid = 0;
+				#endif
+				LastFilterGroup & G = groups[g];
+				G.readbases = 0;
+				G.mappedbases = 0;
+				G.outputvec.resize(0);
+				handleVector(&algns[G.low],G.high-G.low,contexts[tid],header,G.readbases,G.mappedbases,G.outputvec,link_type);
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+				failmessage = ex.what();
+			}
+		}
+
+		if ( failmessage.size() )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		for ( uint64_t g = 0; g < numgroups; ++g )
+		{
+			LastFilterGroup const & G = groups[g];
+			for ( uint64_t i = 0; i < G.outputvec.size(); ++i )
+				writer.writeAlignment(*(G.outputvec[i]));
+			readbases += G.readbases;
+			mappedbases += G.mappedbases;
+		}
+
+		for ( uint64_t i = 0; i < algns.size(); ++i )
+			alfl.put(algns[i]);
+		algns.resize(0);
+		numgroups = 0;
+	}
+};
+
 int bamlastfilter(libmaus::util::ArgInfo const & arginfo)
 {
 	bool const verbose = arginfo.getValue("verbose",getDefaultVerbose());
 	std::string const reference = arginfo.getUnparsedValue("reference",std::string());
 	std::string const tmpfilenamebase = arginfo.getUnparsedValue("tmpfile",arginfo.getDefaultTmpFileName());	
+	unsigned int const threads = std::max(arginfo.getValue<unsigned int>("threads",getDefaultThreads()),1u);
+	uint64_t const batchsize = std::max(arginfo.getValueUnsignedNumeric<uint64_t>("batchsize",getDefaultBatchSize()),static_cast<uint64_t>(1));
 	link_type_enum link_type = link_type_chain;
 	
 	if ( arginfo.hasArg("linktype") )
@@ -545,7 +666,6 @@ int bamlastfilter(libmaus::util::ArgInfo const & arginfo)
 	::libmaus::bambam::BamAlignment prevalgn;
 	bool haveprevalgn = false;
 	uint64_t alcnt = 0;
-	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> cigop;
 
 	/*
 	 * start index/md5 callbacks
@@ -601,7 +721,7 @@ int bamlastfilter(libmaus::util::ArgInfo const & arginfo)
 	libmaus::bambam::BamBlockWriterBase & wr = *Pwriter;
 
 	libmaus::util::GrowingFreeList< ::libmaus::bambam::BamAlignment > alfl;
-	std::vector< ::libmaus::bambam::BamAlignment * > samename;
+	LastFilterBatch batch(threads);
 	uint64_t readbases = 0;
 	uint64_t mappedbases = 0;
 	
@@ -624,20 +744,17 @@ int bamlastfilter(libmaus::util::ArgInfo const & arginfo)
 		}
 	
 		// new name
-		if ( samename.size() && strcmp(samename.back()->getName(),algn.getName()) )
+		if ( batch.algns.size() && strcmp(batch.algns.back()->getName(),algn.getName()) )
 		{
-			handleVector(samename,cigop,header,readbases,mappedbases,wr,link_type);
-		
-			while ( samename.size() )
-			{
-				alfl.put(samename.back());
-				samename.pop_back();
-			}
+			batch.closeGroup();
+			
+			if ( batch.numgroups >= batchsize )
+				batch.process(header,link_type,wr,alfl,readbases,mappedbases);
 		}
 
 		::libmaus::bambam::BamAlignment * calgn = alfl.get();
 		calgn->copyFrom(algn);
-		samename.push_back(calgn);
+		batch.algns.push_back(calgn);
 		
 		algn.swap(prevalgn);
 		haveprevalgn = true;
@@ -646,16 +763,8 @@ int bamlastfilter(libmaus::util::ArgInfo const & arginfo)
 			std::cerr << "[V] " << alcnt << std::endl;
 	}
 
-	if ( samename.size() )
-	{
-		handleVector(samename,cigop,header,readbases,mappedbases,wr,link_type);
-
-		while ( samename.size() )
-		{
-			alfl.put(samename.back());
-			samename.pop_back();
-		}
-	}
+	batch.closeGroup();
+	batch.process(header,link_type,wr,alfl,readbases,mappedbases);
 	
 	std::cerr << "[V]\treadbases=" << readbases << "\tmappedbases=" << mappedbases << std::endl;
 
@@ -707,6 +816,8 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "inputthreads=<[1]>", "input helper threads (for inputformat=bam only, default: 1)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "reference=<>", "reference FastA (.fai file required, for cram i/o only)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "linktype=<>", "method used for selecting mapped fragments (chain or cluster)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "threads=<["+::biobambam::Licensing::formatNumber(getDefaultThreads())+"]>", "number of threads used for processing read name groups" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "batchsize=<["+::biobambam::Licensing::formatNumber(getDefaultBatchSize())+"]>", "number of read name groups processed per batch" ) );
 
 				::biobambam::Licensing::printMap(std::cerr,V);
 
@@ -60,6 +60,8 @@
 #include <libmaus/util/ArgInfo.hpp>
 #include <libmaus/util/ContainerGetObject.hpp>
 #include <libmaus/util/MemUsage.hpp>
+#include <biobambam/DupMarkRewrite.hpp>
+#include <biobambam/DupSetCallbackBitmap.hpp>
 #include <biobambam/Licensing.hpp>
 
 static int getDefaultLevel() { return Z_DEFAULT_COMPRESSION; }
@@ -71,6 +73,7 @@ static unsigned int getDefaultColHashBits() { return 20; }
 static uint64_t getDefaultColListSize() { return 32*1024*1024; }
 static uint64_t getDefaultFragBufSize() { return 48*1024*1024; }
 static uint64_t getDefaultMarkThreads() { return 1; }
+static uint64_t getDefaultDupSetMem() { return DupSetCallbackBitmap::getDefaultMemLimit(); }
 static uint64_t getDefaultMaxReadLength() { return 500; }
 static bool getDefaultRmDup() { return 0; }
 static std::string getProgId() { return "bammarkduplicates2"; }
@@ -177,6 +180,172 @@ std::ostream & operator<<(std::ostream & out, PairActiveCountTemplate<free_list_
 typedef PairActiveCountTemplate<libmaus::bambam::BamAlignmentPairFreeList> BamPairActiveCount;
 typedef PairActiveCountTemplate<libmaus::bambam::ReadEndsFreeList> ReadEndsActiveCount;
 
+/**
+ * duplicate set callback buffering marked read ends and optical duplicate counts
+ * so they can be replayed on another callback (parent) later. Mark queries are answered
+ * using the buffered read ends and the marks already present in parent.
+ **/
+struct DupSetCallbackBuffer : public ::libmaus::bambam::DupSetCallback
+{
+	::libmaus::bambam::DupSetCallback const * parent;
+	std::vector< ::libmaus::bambam::ReadEndsBase > marked;
+	std::vector< std::pair<uint64_t,uint64_t> > optical;
+
+	DupSetCallbackBuffer(::libmaus::bambam::DupSetCallback const * rparent = 0) : parent(rparent), marked(), optical() {}
+	virtual ~DupSetCallbackBuffer() {}
+
+	void operator()(::libmaus::bambam::ReadEndsBase const & A)
+	{
+		marked.push_back(A);
+	}
+
+	uint64_t getNumDups() const
+	{
+		return marked.size();
+	}
+
+	void addOpticalDuplicates(uint64_t const libid, uint64_t const count)
+	{
+		optical.push_back(std::pair<uint64_t,uint64_t>(libid,count));
+	}
+
+	bool isMarked(uint64_t const i) const
+	{
+		// linear scan, the duplicate marking functions do not query marks in the common case
+		for ( uint64_t j = 0; j < marked.size(); ++j )
+			if (
+				marked[j].getRead1IndexInFile() == i
+				||
+				(marked[j].isPaired() && marked[j].getRead2IndexInFile() == i)
+			)
+				return true;
+
+		return parent && parent->isMarked(i);
+	}
+
+	void flush(uint64_t const /* n */)
+	{
+	}
+
+	/**
+	 * pass buffered information on to DSC and clear buffer
+	 **/
+	void replay(::libmaus::bambam::DupSetCallback & DSC)
+	{
+		for ( uint64_t i = 0; i < marked.size(); ++i )
+			DSC(marked[i]);
+		for ( uint64_t i = 0; i < optical.size(); ++i )
+			DSC.addOpticalDuplicates(optical[i].first,optical[i].second);
+		marked.resize(0);
+		optical.resize(0);
+	}
+};
+
+/**
+ * mark duplicates in sorted read ends produced by dec. Runs of equal read ends (groups) are
+ * read in batches of about batchsize elements. The groups of a batch are split into packages
+ * of contiguous groups which are evaluated by numthreads threads, each package with its own
+ * buffering callback. The buffers are replayed on DSC in package order, so the result is the
+ * same as for sequential processing.
+ *
+ * @param dec sorted read ends decoder
+ * @param pairs true for pairs, false for single fragments
+ * @param DSC duplicate set callback
+ * @param numthreads number of threads
+ * @param batchsize number of read ends per batch
+ * @return number of duplicates found
+ **/
+static uint64_t markDuplicateGroups(
+	::libmaus::bambam::SortedFragDecoder & dec,
+	bool const pairs,
+	::libmaus::bambam::DupSetCallback & DSC,
+	uint64_t const numthreads,
+	uint64_t const batchsize = 1024*1024
+)
+{
+	std::vector< ::libmaus::bambam::ReadEnds > batch;
+	std::vector<uint64_t> groups;
+	std::vector<uint64_t> packages;
+	uint64_t const maxpackages = (numthreads > 1) ? 8*numthreads : 1;
+	std::vector<DupSetCallbackBuffer> buffers(maxpackages,DupSetCallbackBuffer(&DSC));
+	std::vector<uint64_t> packdups(maxpackages);
+	::libmaus::bambam::ReadEnds nextfrag;
+	bool running = dec.getNext(nextfrag);
+	uint64_t dupcnt = 0;
+
+	while ( running )
+	{
+		batch.resize(0);
+		groups.resize(0);
+
+		while ( running )
+		{
+			bool const newgroup =
+				(! batch.size())
+				||
+				(
+					pairs ?
+					(! libmaus::bambam::DupMarkBase::isDupPair(nextfrag,batch[groups.back()]))
+					:
+					(! libmaus::bambam::DupMarkBase::isDupFrag(nextfrag,batch[groups.back()]))
+				);
+
+			// only stop at a group boundary
+			if ( newgroup && batch.size() >= batchsize )
+				break;
+			if ( newgroup )
+				groups.push_back(batch.size());
+
+			batch.push_back(nextfrag);
+			running = dec.getNext(nextfrag);
+		}
+		groups.push_back(batch.size());
+
+		// split groups into packages of roughly equal number of read ends
+		uint64_t const numgroups = groups.size()-1;
+		uint64_t const packsize = (batch.size() + maxpackages - 1) / maxpackages;
+		packages.resize(0);
+		packages.push_back(0);
+		for ( uint64_t g = 1; g < numgroups; ++g )
+			if ( groups[g] - groups[packages.back()] >= packsize )
+				packages.push_back(g);
+		packages.push_back(numgroups);
+		int64_t const numpackages = packages.size()-1;
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t p = 0; p < numpackages; ++p )
+		{
+			::libmaus::bambam::DupSetCallback & PDSC = (numthreads > 1) ?
+				static_cast< ::libmaus::bambam::DupSetCallback & >(buffers[p]) : DSC;
+			std::vector< ::libmaus::bambam::ReadEnds > lfrags;
+			uint64_t ldupcnt = 0;
+
+			for ( uint64_t g = packages[p]; g < packages[p+1]; ++g )
+			{
+				lfrags.assign(batch.begin()+groups[g],batch.begin()+groups[g+1]);
+
+				if ( pairs )
+					ldupcnt += libmaus::bambam::DupMarkBase::markDuplicatePairsVector(lfrags,PDSC);
+				else
+					ldupcnt += libmaus::bambam::DupMarkBase::markDuplicateFrags(lfrags,PDSC);
+			}
+
+			packdups[p] = ldupcnt;
+		}
+
+		for ( int64_t p = 0; p < numpackages; ++p )
+		{
+			dupcnt += packdups[p];
+			if ( numthreads > 1 )
+				buffers[p].replay(DSC);
+		}
+	}
+
+	return dupcnt;
+}
+
 struct BamAlignmentInputPositionCallbackDupMark : public libmaus::bambam::BamAlignmentInputPositionUpdateCallback
 {
 	static unsigned int const defaultfreelistsize = 16*1024;
@@ -1149,6 +1318,8 @@ static int markDuplicates(::libmaus::util::ArgInfo const & arginfo)
 	uint64_t const collistsize = arginfo.getValueUnsignedNumeric<uint64_t>("collistsize",getDefaultColListSize());
 	// buffer size for fragment and pair data
 	uint64_t const fragbufsize = arginfo.getValueUnsignedNumeric<uint64_t>("fragbufsize",getDefaultFragBufSize());
+	// maximum memory used for the in memory duplicate bitmap
+	uint64_t const dupsetmem = arginfo.getValueUnsignedNumeric<uint64_t>("dupsetmem",getDefaultDupSetMem());
 	// print verbosity messages
 	bool const verbose = arginfo.getValue<unsigned int>("verbose",getDefaultVerbose());
 	// rewritten file should be in bam format, if input is given via stdin
@@ -1453,8 +1624,9 @@ static int markDuplicates(::libmaus::util::ArgInfo const & arginfo)
 	
 	libmaus::timing::RealTimeClock readinrtc; readinrtc.start();
 
-	::libmaus::bambam::DupSetCallbackStream DSCV(tmpfiledupset,metrics);
+	// ::libmaus::bambam::DupSetCallbackStream DSCV(tmpfiledupset,metrics);
 	// DupSetCallbackSet DSCV(metrics);
+	DupSetCallbackBitmap DSCV(tmpfiledupset,metrics,dupsetmem);
 	
 	PTI->setDupSetCallback(&DSCV);
 	PTI->setMaxReadLength(maxreadlength);
@@ -1738,8 +1910,6 @@ static int markDuplicates(::libmaus::util::ArgInfo const & arginfo)
 	/*
 	 * process fragment and pair data to determine which reads are to be marked as duplicates
 	 */		
-	::libmaus::bambam::ReadEnds nextfrag;
-	std::vector< ::libmaus::bambam::ReadEnds > lfrags;
 	uint64_t dupcnt = 0;
 
 	if ( verbose )
@@ -1747,22 +1917,7 @@ static int markDuplicates(::libmaus::util::ArgInfo const & arginfo)
 	rtc.start();
 	::libmaus::bambam::SortedFragDecoder::unique_ptr_type pairDec(pairREC->getDecoder());
 	pairREC.reset();
-	pairDec->getNext(lfrags);
-
-	while ( pairDec->getNext(nextfrag) )
-	{
-		if ( ! libmaus::bambam::DupMarkBase::isDupPair(nextfrag,lfrags.front()) )
-		{
-			// dupcnt += markDuplicatePairs(lfrags.begin(),lfrags.end(),DSCV);
-			dupcnt += libmaus::bambam::DupMarkBase::markDuplicatePairsVector(lfrags,DSCV);
-			lfrags.resize(0);
-		}
-
-		lfrags.push_back(nextfrag);
-	}
-	// dupcnt += markDuplicatePairs(lfrags.begin(),lfrags.end(),DSCV);
-	dupcnt += libmaus::bambam::DupMarkBase::markDuplicatePairsVector(lfrags,DSCV);
-	lfrags.resize(0);
+	dupcnt += markDuplicateGroups(*pairDec,true,DSCV,markthreads);
 	pairDec.reset();
 	if ( verbose )
 		std::cerr << "done, rate " << (diskpairs)/rtc.getElapsedSeconds() << std::endl;
@@ -1772,25 +1927,16 @@ static int markDuplicates(::libmaus::util::ArgInfo const & arginfo)
 	rtc.start();
 	::libmaus::bambam::SortedFragDecoder::unique_ptr_type fragDec(fragREC->getDecoder());
 	fragREC.reset();
-	fragDec->getNext(lfrags);
-	while ( fragDec->getNext(nextfrag) )
-	{
-		if ( !libmaus::bambam::DupMarkBase::isDupFrag(nextfrag,lfrags.front()) )
-		{
-			dupcnt += libmaus::bambam::DupMarkBase::markDuplicateFrags(lfrags,DSCV);
-			lfrags.resize(0);
-		}
-
-		lfrags.push_back(nextfrag);
-	}
-	dupcnt += libmaus::bambam::DupMarkBase::markDuplicateFrags(lfrags,DSCV);
-	lfrags.resize(0);
+	dupcnt += markDuplicateGroups(*fragDec,false,DSCV,markthreads);
 	fragDec.reset();
 	if ( verbose )
 		std::cerr << "done, rate " << (diskfrags)/rtc.getElapsedSeconds() << std::endl;		
 
 	DSCV.flush(numranks);
 
+	if ( verbose && DSCV.isSpilled() )
+		std::cerr << "[V] duplicate set exceeded dupsetmem=" << dupsetmem << ", using temporary file" << std::endl;
+
 	if ( verbose )
 		std::cerr << "[V] number of alignments marked as duplicates: " << DSCV.getNumDups() << " time " << fragrtc.getElapsedSeconds() << " (" << fragrtc.formatTime(fragrtc.getElapsedSeconds()) << ")" << std::endl;
 	/*
@@ -1839,15 +1985,46 @@ static int markDuplicates(::libmaus::util::ArgInfo const & arginfo)
 	/*
 	 * mark the duplicates
 	 */
-	libmaus::bambam::DupMarkBase::markDuplicatesInFile(
-		arginfo,verbose,bamheader,maxrank,mod,level,DSCV,tmpfilesnappyreads,rewritebam,tmpfileindex,
-		getProgId(),
-		std::string(PACKAGE_VERSION),
-		getDefaultRmDup(),
-		getDefaultMD5(),
-		getDefaultIndex(),
-		getDefaultMarkThreads()
-	);
+	// BAM file holding the alignments in rank order (empty if not available). For input via stdin
+	// the temporary file is a BAM file for rewritebam=1 (recompressed) and rewritebam=2 (copy)
+	std::string const rewriteinput =
+		(arginfo.getPairCount("I") == 1 && arginfo.getValue<std::string>("I","") != "")
+		?
+		arginfo.getUnparsedValue("I","")
+		:
+		(
+			((! arginfo.hasArg("I")) && rewritebam > 0) ? tmpfilesnappyreads : std::string()
+		);
+
+	// use the block level rewrite if we have a BAM file, more than one thread and no separate duplicates file
+	if ( 
+		markthreads > 1 && rewriteinput.size() && (! arginfo.hasArg("D")) 
+		&&
+		level >= Z_DEFAULT_COMPRESSION && level <= Z_BEST_COMPRESSION
+	)
+	{
+		markDuplicatesInBamParallel(
+			arginfo,verbose,bamheader,mod,level,DSCV,rewriteinput,tmpfileindex,
+			getProgId(),
+			std::string(PACKAGE_VERSION),
+			arginfo.getValue<unsigned int>("rmdup",getDefaultRmDup()),
+			arginfo.getValue<unsigned int>("md5",getDefaultMD5()),
+			arginfo.getValue<unsigned int>("index",getDefaultIndex()),
+			markthreads
+		);
+	}
+	else
+	{
+		libmaus::bambam::DupMarkBase::markDuplicatesInFile(
+			arginfo,verbose,bamheader,maxrank,mod,level,DSCV,tmpfilesnappyreads,rewritebam,tmpfileindex,
+			getProgId(),
+			std::string(PACKAGE_VERSION),
+			getDefaultRmDup(),
+			getDefaultMD5(),
+			getDefaultIndex(),
+			getDefaultMarkThreads()
+		);
+	}
 		
 	if ( verbose )
 		std::cerr << "[V] " << ::libmaus::util::MemUsage() << " " 
@@ -1894,7 +2071,7 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "M=<filename>", "metrics file, stderr if unset" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "tmpfile=<filename>", "prefix for temporary files, default: create files in current directory" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "level=<["+::biobambam::Licensing::formatNumber(getDefaultLevel())+"]>", libmaus::bambam::BamBlockWriterBaseFactory::getBamOutputLevelHelpText() ) );
-				V.push_back ( std::pair<std::string,std::string> ( "markthreads=<["+::biobambam::Licensing::formatNumber(getDefaultMarkThreads())+"]>", "number of helper threads" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "markthreads=<["+::biobambam::Licensing::formatNumber(getDefaultMarkThreads())+"]>", "number of helper threads (input decoding and duplicate set evaluation)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "verbose=<["+::biobambam::Licensing::formatNumber(getDefaultVerbose())+"]>", "print progress report (default: 1)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "mod=<["+::biobambam::Licensing::formatNumber(getDefaultMod())+"]>", "print progress for each mod'th record/alignment" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "rewritebam=<["+::biobambam::Licensing::formatNumber(getDefaultRewriteBam())+"]>", "compression of temporary alignment file when input is via stdin (0=snappy,1=gzip/bam,2=copy)" ) );
@@ -1903,6 +2080,7 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "colhashbits=<["+::biobambam::Licensing::formatNumber(getDefaultColHashBits())+"]>", "log_2 of size of hash table used for collation" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "collistsize=<["+::biobambam::Licensing::formatNumber(getDefaultColListSize())+"]>", "output list size for collation" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "fragbufsize=<["+::biobambam::Licensing::formatNumber(getDefaultFragBufSize())+"]>", "size of each fragment/pair file buffer in bytes" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "dupsetmem=<["+::biobambam::Licensing::formatNumber(getDefaultDupSetMem())+"]>", "maximum memory used for the duplicate bitmap before spilling to a temporary file in bytes" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "maxreadlength=<["+::biobambam::Licensing::formatNumber(getDefaultMaxReadLength())+"]>", "maximum allowed read length" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "md5=<["+::biobambam::Licensing::formatNumber(getDefaultMD5())+"]>", "create md5 check sum (default: 0)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "md5filename=<filename>", "file name for md5 check sum (default: extend output file name)" ) );
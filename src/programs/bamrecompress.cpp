@@ -21,21 +21,224 @@
 #include <libmaus/lz/BgzfInflateDeflateParallel.hpp>
 #include <libmaus/lz/BgzfInflateDeflateParallelThread.hpp>
 #include <libmaus/util/ArgInfo.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
 
+#include <biobambam/BgzfBlockCopy.hpp>
+#include <biobambam/BgzfBlockDeflate.hpp>
 #include <biobambam/Licensing.hpp>
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 static int getDefaultLevel() { return Z_DEFAULT_COMPRESSION; }
 static int getDefaultVerbose() { return 1; };
 static int getDefaultNumThreads() { return 1; };
+static int getDefaultBlockMode() { return 0; }
+static int getDefaultRepack() { return 0; }
+static std::string getDefaultEngine() { return "zlib"; }
 
 #include <libmaus/lz/BgzfDeflateOutputCallbackMD5.hpp>
 #include <libmaus/bambam/BgzfDeflateOutputCallbackBamIndex.hpp>
 static int getDefaultMD5() { return 0; }
 static int getDefaultIndex() { return 0; }
 
+static void bamrecompressPrintProgress(libmaus::timing::RealTimeClock & rtc, uint64_t const t, double const rate, bool const final)
+{
+	if ( isatty(STDERR_FILENO) )
+		std::cerr
+			<< "\r" << std::string(60,' ') << "\r";
+
+	std::cerr
+			<< rtc.formatTime(rtc.getElapsedSeconds()) << " " << t/(1024*1024) << "MB, " << rate/(1024.0*1024.0) << "MB/s";
+
+	if ( isatty(STDERR_FILENO) && ! final )
+		std::cerr << std::flush;
+	else
+		std::cerr << std::endl;
+}
+
+/*
+ * recompress the BGZF blocks on standard input without going through a byte stream. Batches of blocks
+ * are decompressed in parallel, the uncompressed blocks are either compressed 1:1 (repack=false) or
+ * cut into blocks of the maximum payload size (repack=true), compressed in parallel using the given
+ * deflate engine and written in order. The callbacks are called for each output block in order.
+ */
+static uint64_t bamrecompressBlocks(
+	std::string const & engine,
+	int const level,
+	int const verbose,
+	uint64_t const numthreads,
+	bool const repack,
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const & cbs
+)
+{
+	libmaus::autoarray::AutoArray<BgzfBlockDeflateEngine::unique_ptr_type> engines(numthreads);
+	for ( uint64_t i = 0; i < numthreads; ++i )
+	{
+		BgzfBlockDeflateEngine::unique_ptr_type tengine(constructBgzfBlockDeflateEngine(engine,level));
+		engines[i] = UNIQUE_PTR_MOVE(tengine);
+	}
+
+	uint64_t const payload = getBgzfBlockMaxPayload();
+	uint64_t const batchblocks = 16*numthreads;
+	libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> > cblocks(batchblocks);
+	libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> > ublocks(batchblocks);
+	std::vector<uint64_t> csizes(batchblocks);
+	std::vector<uint64_t> usizes(batchblocks);
+	// uncompressed data not yet compressed (repack=true)
+	std::vector<uint8_t> pending;
+	// pieces of uncompressed data forming the output blocks
+	std::vector< std::pair<uint8_t const *,uint64_t> > pieces;
+	libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> > oblocks;
+	std::vector<uint64_t> osizes;
+	libmaus::parallel::PosixSpinLock faillock;
+	std::string failmessage;
+
+	uint64_t t = 0;
+	uint64_t last = 0;
+	uint64_t const mod = 64*1024*1024;
+	libmaus::timing::RealTimeClock rtc; rtc.start();
+	libmaus::timing::RealTimeClock lrtc; lrtc.start();
+	bool eof = false;
+
+	while ( ! eof )
+	{
+		uint64_t numblocks = 0;
+		while ( numblocks < batchblocks && (csizes[numblocks] = bgzfBlockRead(std::cin,cblocks[numblocks])) )
+			++numblocks;
+		eof = (numblocks < batchblocks);
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t i = 0; i < static_cast<int64_t>(numblocks); ++i )
+		{
+			try
+			{
+				usizes[i] = bgzfBlockInflate(cblocks[i].begin(),csizes[i],ublocks[i]);
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+				failmessage = ex.what();
+			}
+		}
+
+		if ( failmessage.size() )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		// empty blocks (EOF markers) are dropped, a single EOF block is written at the end
+		pieces.resize(0);
+		if ( repack )
+		{
+			for ( uint64_t i = 0; i < numblocks; ++i )
+				pending.insert(pending.end(),ublocks[i].begin(),ublocks[i].begin()+usizes[i]);
+
+			uint64_t const numpieces = eof ? ((pending.size() + payload - 1) / payload) : (pending.size() / payload);
+			for ( uint64_t i = 0; i < numpieces; ++i )
+			{
+				uint64_t const low = i * payload;
+				uint64_t const high = std::min(low + payload,static_cast<uint64_t>(pending.size()));
+				pieces.push_back(std::pair<uint8_t const *,uint64_t>(&pending[low],high-low));
+			}
+		}
+		else
+		{
+			// input blocks may hold up to 64KiB of data, these are split in two
+			for ( uint64_t i = 0; i < numblocks; ++i )
+				for ( uint64_t low = 0; low < usizes[i]; low += payload )
+					pieces.push_back(std::pair<uint8_t const *,uint64_t>(ublocks[i].begin()+low,std::min(payload,usizes[i]-low)));
+		}
+
+		if ( oblocks.size() < pieces.size() )
+		{
+			oblocks = libmaus::autoarray::AutoArray< libmaus::autoarray::AutoArray<uint8_t> >(pieces.size());
+			osizes.resize(pieces.size());
+		}
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t i = 0; i < static_cast<int64_t>(pieces.size()); ++i )
+		{
+			try
+			{
+				#if defined(_OPENMP)
+				uint64_t const tid = omp_get_thread_num();
+				#else
+				uint64_t const tid = 0;
+				#endif
+
+				osizes[i] = engines[tid]->deflateBlock(pieces[i].first,pieces[i].second,oblocks[i]);
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+				failmessage = ex.what();
+			}
+		}
+
+		if ( failmessage.size() )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+
+		for ( uint64_t i = 0; i < pieces.size(); ++i )
+		{
+			std::cout.write(reinterpret_cast<char const *>(oblocks[i].begin()),osizes[i]);
+			for ( uint64_t j = 0; j < cbs.size(); ++j )
+				(*(cbs[j]))(pieces[i].first,pieces[i].second,oblocks[i].begin(),osizes[i]);
+			t += pieces[i].second;
+		}
+
+		if ( repack )
+			pending.erase(pending.begin(),pending.begin()+std::min(pieces.size() * payload,static_cast<uint64_t>(pending.size())));
+
+		if ( verbose && t/mod != last/mod )
+		{
+			bamrecompressPrintProgress(rtc,t,(t-last)/lrtc.getElapsedSeconds(),false);
+			lrtc.start();
+			last = t;
+		}
+	}
+
+	// EOF block
+	libmaus::autoarray::AutoArray<uint8_t> eofblock;
+	uint64_t const eofsize = engines[0]->deflateBlock(0,0,eofblock);
+	std::cout.write(reinterpret_cast<char const *>(eofblock.begin()),eofsize);
+	for ( uint64_t j = 0; j < cbs.size(); ++j )
+		(*(cbs[j]))(0,0,eofblock.begin(),eofsize);
+
+	std::cout.flush();
+
+	if ( ! std::cout )
+	{
+		libmaus::exception::LibMausException se;
+		se.getStream() << "bamrecompress: failed to write output" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	if ( verbose )
+		bamrecompressPrintProgress(rtc,t,t/rtc.getElapsedSeconds(),true);
+
+	return t;
+}
+
 uint64_t bamrecompress(libmaus::util::ArgInfo const & arginfo)
 {
-	int const level = libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",getDefaultLevel()));
+	bool const blockmode = arginfo.getValue<int>("blockmode",getDefaultBlockMode());
+	// levels are checked by the deflate engine in block mode
+	int const level = blockmode ? arginfo.getValue<int>("level",getDefaultLevel()) : libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",getDefaultLevel()));
 	int const verbose = arginfo.getValue<int>("verbose",getDefaultVerbose());
 	int const numthreads = std::max(1,arginfo.getValue<int>("numthreads",getDefaultNumThreads()));
 
@@ -84,6 +287,25 @@ uint64_t bamrecompress(libmaus::util::ArgInfo const & arginfo)
 	 * end md5/index callbacks
 	 */
 
+	if ( blockmode )
+	{
+		std::string const engine = arginfo.getUnparsedValue("engine",getDefaultEngine());
+		bool const repack = arginfo.getValue<int>("repack",getDefaultRepack());
+
+		bamrecompressBlocks(engine,level,verbose,numthreads,repack,cbs);
+
+		if ( Pmd5cb )
+		{
+			Pmd5cb->saveDigestAsFile(md5filename);
+		}
+		if ( Pindex )
+		{
+			Pindex->flush(std::string(indexfilename));
+		}
+
+		return 0;
+	}
+
 	libmaus::lz::BgzfInflateDeflateParallel::unique_ptr_type BIDP(new libmaus::lz::BgzfInflateDeflateParallel(std::cin,std::cout,level,numthreads,4*numthreads));
 
 	for ( uint64_t i = 0; i < cbs.size(); ++i )
@@ -108,19 +330,7 @@ uint64_t bamrecompress(libmaus::util::ArgInfo const & arginfo)
 		if ( t/mod != last/mod )
 		{
 			if ( verbose )
-			{
-				if ( isatty(STDERR_FILENO) )
-					std::cerr 
-						<< "\r" << std::string(60,' ') << "\r";
-
-				std::cerr
-						<< rtc.formatTime(rtc.getElapsedSeconds()) << " " << t/(1024*1024) << "MB, " << (lcnt/lrtc.getElapsedSeconds())/(1024.0*1024.0) << "MB/s";
-			
-				if ( isatty(STDERR_FILENO) )
-					std::cerr << std::flush;
-				else
-					std::cerr << std::endl;
-			}
+				bamrecompressPrintProgress(rtc,t,lcnt/lrtc.getElapsedSeconds(),false);
 			
 			lrtc.start();
 			last = t;
@@ -129,16 +339,7 @@ uint64_t bamrecompress(libmaus::util::ArgInfo const & arginfo)
 	}
 
 	if ( verbose )
-	{
-		if ( isatty(STDERR_FILENO) )
-			std::cerr 
-				<< "\r" << std::string(60,' ') << "\r";
-	
-		std::cerr
-				<< rtc.formatTime(rtc.getElapsedSeconds()) << " " << t/(1024*1024) << "MB, " << (t/rtc.getElapsedSeconds())/(1024.0*1024.0) << "MB/s";
-			
-		std::cerr << std::endl;
-	}
+		bamrecompressPrintProgress(rtc,t,t/rtc.getElapsedSeconds(),true);
 	
 	BIDP.reset();
 
@@ -186,6 +387,9 @@ int main(int argc, char *argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "level=<["+::biobambam::Licensing::formatNumber(getDefaultLevel())+"]>", libmaus::bambam::BamBlockWriterBaseFactory::getBamOutputLevelHelpText() ) );
 				V.push_back ( std::pair<std::string,std::string> ( "verbose=<["+::biobambam::Licensing::formatNumber(getDefaultVerbose())+"]>", "print progress report" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "numthreads=<["+::biobambam::Licensing::formatNumber(getDefaultNumThreads())+"]>", "number of recoding threads" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "blockmode=<["+::biobambam::Licensing::formatNumber(getDefaultBlockMode())+"]>", "recompress BGZF blocks directly (default: 0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "repack=<["+::biobambam::Licensing::formatNumber(getDefaultRepack())+"]>", "repack data into full blocks for blockmode=1 (default: 0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "engine=<["+getDefaultEngine()+"]>", "deflate engine for blockmode=1 ("+getBgzfBlockDeflateEngines()+")" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "md5=<["+::biobambam::Licensing::formatNumber(getDefaultMD5())+"]>", "create md5 check sum (default: 0)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "md5filename=<filename>", "file name for md5 check sum (default: extend output file name)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "index=<["+::biobambam::Licensing::formatNumber(getDefaultIndex())+"]>", "create BAM index (default: 0)" ) );
@@ -21,33 +21,190 @@
 #include <iostream>
 #include <queue>
 
+#include <libmaus/aio/PosixFdOutputStream.hpp>
+#include <libmaus/bambam/BamBlockWriterBaseFactory.hpp>
 #include <libmaus/util/ArgInfo.hpp>
 #include <libmaus/bambam/BamDecoder.hpp>
 #include <libmaus/bambam/BamMultiAlignmentDecoderFactory.hpp>
+#include <libmaus/lz/BgzfOutputStream.hpp>
 
 #include <biobambam/Licensing.hpp>
+#include <biobambam/DepthRunAccumulator.hpp>
+#include <biobambam/ReferenceRegions.hpp>
 
 static int getDefaultVerbose() { return 0; }
+static int getDefaultBedGraph() { return 0; }
+static int getDefaultGz() { return 0; }
+static int getDefaultLevel() { return -1; }
+static uint64_t getDefaultIOBlockSize() { return 1024*1024; }
+static unsigned int getDefaultThreads() { return 1; }
+static uint64_t getDefaultChunkSize() { return 1024*1024; }
+
+/**
+ * compute depth for region R using a region query and write it to out
+ **/
+static void bamrefdepthRegion(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	ReferenceRegion const & R,
+	std::ostream & out,
+	bool const bedgraph
+)
+{
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type pdec(constructReferenceRegionDecoder(arginfo,header,R));
+	libmaus::bambam::BamAlignmentDecoder & bamdec = pdec->getDecoder();
+	libmaus::bambam::BamAlignment const & algn = bamdec.getAlignment();
+
+	DepthRunAccumulator acc;
+	DepthRunWriter writer(out,bedgraph);
+	writer.setRefName(header.getRefIDName(R.refid));
+	DepthRunClipper<DepthRunWriter> clipper(writer,R.from,R.to);
+	uint64_t prevpos = 0;
+
+	while ( bamdec.readAlignment() )
+		if ( algn.isMapped() && algn.getRefID() == static_cast<int64_t>(R.refid) )
+		{
+			if ( static_cast<uint64_t>(algn.getPos()) < prevpos )
+			{
+				libmaus::exception::LibMausException se;
+				se.getStream() << "File is not ordered by coordinate:";
+				se.getStream() << algn.formatAlignment(header) << std::endl;
+				se.finish();
+				throw se;
+			}
+			prevpos = algn.getPos();
+
+			acc.flush(algn.getPos(),clipper);
+			acc.addAlignment(algn);
+		}
+
+	acc.finish(clipper);
+}
+
+/**
+ * region processor computing the depth of a region and writing it to out in region order
+ **/
+struct BamRefDepthRegionProcessor : public ReferenceRegionProcessor
+{
+	libmaus::util::ArgInfo const & arginfo;
+	libmaus::bambam::BamHeader const & header;
+	std::ostream & out;
+	bool const bedgraph;
+	bool const gz;
+	int const level;
+
+	BamRefDepthRegionProcessor(
+		libmaus::util::ArgInfo const & rarginfo,
+		libmaus::bambam::BamHeader const & rheader,
+		std::ostream & rout,
+		bool const rbedgraph,
+		bool const rgz,
+		int const rlevel
+	)
+	: arginfo(rarginfo), header(rheader), out(rout), bedgraph(rbedgraph), gz(rgz), level(rlevel)
+	{
+	}
+
+	void processRegion(uint64_t const, ReferenceRegion const & R, std::vector<std::ostream *> const & rout)
+	{
+		if ( gz )
+		{
+			// compress in this thread, BGZF blocks can be concatenated
+			libmaus::lz::BgzfOutputStream bgzf(*rout[0],level);
+			bamrefdepthRegion(arginfo,header,R,bgzf,bedgraph);
+			bgzf.flush();
+		}
+		else
+		{
+			bamrefdepthRegion(arginfo,header,R,*rout[0],bedgraph);
+		}
+	}
+
+	void writePiece(uint64_t const, uint64_t const, char const * data, uint64_t const n)
+	{
+		out.write(data,n);
+	}
+
+	void finishRegion(uint64_t const)
+	{
+	}
+};
+
+/**
+ * compute depth for all reference sequences via region queries on numthreads threads. The
+ * output is written in header order while the regions are processed.
+ **/
+static void bamrefdepthParallel(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	std::ostream & out,
+	bool const bedgraph,
+	bool const gz,
+	int const level,
+	uint64_t const numthreads,
+	uint64_t const chunksize,
+	int const verbose
+)
+{
+	std::vector<ReferenceRegion> const regions = computeReferenceRegions(header,chunksize);
+	BamRefDepthRegionProcessor processor(arginfo,header,out,bedgraph,gz,level);
+
+	processReferenceRegions(regions,processor,numthreads,1,verbose);
+
+	if ( gz )
+	{
+		libmaus::lz::BgzfOutputStream bgzf(out,level);
+		bgzf.flush();
+		bgzf.addEOFBlock();
+	}
+}
 
 int bamrefdepth(libmaus::util::ArgInfo const & arginfo)
 {
 	int const verbose = arginfo.getValue<int>("verbose",getDefaultVerbose());
+	bool const bedgraph = arginfo.getValue<int>("bedgraph",getDefaultBedGraph());
+	bool const gz = arginfo.getValue<int>("gz",getDefaultGz());
+	int const level = libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",getDefaultLevel()));
+	uint64_t const ioblocksize = std::max(arginfo.getValueUnsignedNumeric<uint64_t>("ioblocksize",getDefaultIOBlockSize()),static_cast<uint64_t>(1));
 
 	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type pdec(
 		libmaus::bambam::BamMultiAlignmentDecoderFactory::construct(arginfo));
 	libmaus::bambam::BamAlignmentDecoder & bamdec = pdec->getDecoder();
 	libmaus::bambam::BamAlignment & algn = bamdec.getAlignment();
 	libmaus::bambam::BamHeader const & header = bamdec.getHeader();
-	std::string const sortorder = libmaus::bambam::BamHeader::getSortOrderStatic(header.text);
+	unsigned int const threads = std::max(arginfo.getValue<unsigned int>("threads",getDefaultThreads()),1u);
+	
+	libmaus::aio::PosixFdOutputStream PFOS(STDOUT_FILENO,ioblocksize);
+
+	bool const regionnamesok = checkReferenceRegionNames(header);
+
+	if ( threads > 1 && ! regionnamesok )
+		std::cerr << "[W] reference sequence names contain colons, region queries are not possible, using a single thread" << std::endl;
+
+	if ( threads > 1 && regionnamesok )
+	{
+		checkReferenceRegionInput(arginfo,"bam");
+		// runs may cross piece boundaries, so bedGraph output is computed for whole reference sequences
+		uint64_t const chunksize = bedgraph ? 0 : arginfo.getValueUnsignedNumeric<uint64_t>("chunksize",getDefaultChunkSize());
+		bamrefdepthParallel(arginfo,header,PFOS,bedgraph,gz,level,threads,chunksize,verbose);
+		PFOS.flush();
+		return EXIT_SUCCESS;
+	}
+
+	libmaus::lz::BgzfOutputStream::unique_ptr_type Pbgzf;
+	if ( gz )
+	{
+		libmaus::lz::BgzfOutputStream::unique_ptr_type Tbgzf(new libmaus::lz::BgzfOutputStream(PFOS,level));
+		Pbgzf = UNIQUE_PTR_MOVE(Tbgzf);
+	}
+	std::ostream & out = gz ? static_cast<std::ostream &>(*Pbgzf) : static_cast<std::ostream &>(PFOS);
 	
 	libmaus::bambam::BamAlignment prevalgn;
 	bool hasprev = false;
 	uint64_t c = 0;
 	
-	std::deque<uint64_t> Q;
-	uint64_t leftpos = 0;
-	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> cigop;
-	libmaus::autoarray::AutoArray<char> decread;
+	DepthRunAccumulator acc;
+	DepthRunWriter writer(out,bedgraph);
 	
 	std::vector < std::string > refnames;
 	for ( uint64_t i = 0; i < header.getNumRef(); ++i )
@@ -85,111 +242,20 @@ int bamrefdepth(libmaus::util::ArgInfo const & arginfo)
 		}
 		
 		// next reference sequence
-		if ( hasprev && (algn.getRefID() != prevalgn.getRefID()) )
+		if ( (!hasprev) || (algn.getRefID() != prevalgn.getRefID()) )
 		{
-			while ( Q.size() )
-			{
-				if ( Q[0] )
-					std::cout << refnames[prevalgn.getRefID()] << "\t" << leftpos << "\t" << Q[0] << std::endl;
-				Q.pop_front();
-				leftpos++;				
-			}
-		
-			// Q.resize(0);
-			leftpos = 0;
+			acc.finish(writer);
+			acc.reset();
+			
+			if ( algn.getRefID() >= 0 )
+				writer.setRefName(refnames[algn.getRefID()]);
 		}
 		
 		if ( algn.isMapped() )
 		{
-			uint32_t const numcigop = algn.getCigarOperations(cigop);
-			uint64_t const readlen = algn.decodeRead(decread);
-			int64_t pos = algn.getPos();
-			uint64_t readpos = 0;
-			
-			// std::cerr << "Q.size()=" << Q.size() << std::endl;
-
-			while ( Q.size() && pos > static_cast<int64_t>(leftpos) )
-			{
-				if ( Q[0] )
-					std::cout << refnames[algn.getRefID()] << "\t" << leftpos << "\t" << Q[0] << std::endl;
-				Q.pop_front();
-				leftpos++;
-			}
-			
-			// skip soft clipping at front
-			uint64_t cidx = 0;
-			bool frontskip = true;
-			while ( cidx < numcigop && frontskip )
-				switch ( cigop[cidx].first )
-				{
-					// padding, ref skip, hard clip, deletion
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CPAD:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CREF_SKIP:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDEL:
-						cidx += 1;
-						break;
-					// insertion/soft clipping, advance on read
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CINS:
-						readpos += cigop[cidx++].second;
-						break;
-					// match/mismatch
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CMATCH:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CEQUAL:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDIFF:
-						frontskip = false;
-						break;
-				}
-
-			for ( ; cidx < numcigop ; ++cidx )
-				switch ( cigop[cidx].first )
-				{
-					// padding, hard clipping (ignore)
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CPAD:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CHARD_CLIP:
-						break;
-					// ref skip, deletion (advance on reference)
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CREF_SKIP:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDEL:
-						pos += cigop[cidx].second;
-						break;
-					// insertion/soft clipping (advance on read)
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CSOFT_CLIP:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CINS:
-						readpos += cigop[cidx].second;
-						break;
-					// match/mismatch
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CMATCH:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CEQUAL:
-					case libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_CDIFF:
-						for ( uint64_t i = 0; static_cast<int64_t>(i) < cigop[cidx].second; ++i, ++pos, ++readpos )
-						{
-							if ( ! Q.size() )
-							{
-								Q.push_back(1);
-								leftpos = pos;
-							}
-							else
-							{
-								while ( pos-leftpos >= Q.size() )
-									Q.push_back(0);
-							
-								assert ( pos-leftpos < Q.size() );		
-								Q[pos-leftpos] += 1;
-							}
-						}
-						break;
-				}
-			
-			#if 0
-			if ( readpos != readlen )
-			{
-				std::cerr << "readpos=" << readpos << " readlen=" << readlen << std::endl;			
-				std::cerr << algn.formatAlignment(header) << std::endl;
-			}	
-			#endif
-			assert (readpos == readlen);
+			// positions left of the alignment start are final
+			acc.flush(algn.getPos(),writer);
+			acc.addAlignment(algn);
 		}
 			
 		prevalgn.swap(algn);
@@ -199,13 +265,14 @@ int bamrefdepth(libmaus::util::ArgInfo const & arginfo)
 			std::cerr << "[V] " << c << std::endl;
 	}
 
-	while ( Q.size() )
+	acc.finish(writer);
+	
+	if ( gz )
 	{
-		if ( Q[0] )
-			std::cout << refnames[prevalgn.getRefID()] << "\t" << leftpos << "\t" << Q[0] << std::endl;
-		Q.pop_front();
-		leftpos++;				
+		Pbgzf->flush();
+		Pbgzf->addEOFBlock();
 	}
+	PFOS.flush();
 		
 	if ( verbose )
 		std::cerr << "[V] " << c << std::endl;
@@ -243,6 +310,12 @@ int main(int argc, char * argv[])
 				std::vector< std::pair<std::string,std::string> > V;
 			
 				V.push_back ( std::pair<std::string,std::string> ( "verbose=<["+::biobambam::Licensing::formatNumber(getDefaultVerbose())+"]>", "print progress report" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "bedgraph=<["+::biobambam::Licensing::formatNumber(getDefaultBedGraph())+"]>", "output runs of constant depth as bedGraph (refname, start, end, depth) instead of one line per position" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "gz=<["+::biobambam::Licensing::formatNumber(getDefaultGz())+"]>", "compress output using BGZF" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "level=<["+::biobambam::Licensing::formatNumber(getDefaultLevel())+"]>", libmaus::bambam::BamBlockWriterBaseFactory::getBamOutputLevelHelpText() ) );
+				V.push_back ( std::pair<std::string,std::string> ( "ioblocksize=<["+::biobambam::Licensing::formatNumber(getDefaultIOBlockSize())+"]>", "output buffer size in bytes" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "threads=<["+::biobambam::Licensing::formatNumber(getDefaultThreads())+"]>", "number of threads (threads>1 requires an indexed input file given by filename)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "chunksize=<["+::biobambam::Licensing::formatNumber(getDefaultChunkSize())+"]>", "size of reference sequence pieces processed by a thread if threads>1 and bedgraph=0 (0 for whole reference sequences)" ) );
 
 				::biobambam::Licensing::printMap(std::cerr,V);
 
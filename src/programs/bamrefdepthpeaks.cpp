@@ -24,12 +24,26 @@
 #include <libmaus/util/ArgInfo.hpp>
 #include <libmaus/bambam/BamDecoder.hpp>
 #include <libmaus/bambam/BamMultiAlignmentDecoderFactory.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
 
 #include <liftingwavelettransform/LiftingWaveletTransform.hpp>
 
 #include <biobambam/Licensing.hpp>
+#include <biobambam/DepthRunAccumulator.hpp>
+#include <biobambam/ReferenceRegions.hpp>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 static int getDefaultVerbose() { return 0; }
+static unsigned int getDefaultThreads() { return 1; }
 
 #include <algorithm>
 
@@ -74,6 +88,122 @@ uint64_t getSupportRadius(uint64_t const f, uint64_t const bs)
 	return f * bs;
 }
 
+/**
+ * compute interpolating convolution for the points [lo,hi) of A, which need to be far enough
+ * from the borders of A such that no mirroring is required. The operations for each point
+ * are the same as in interpolatingConvolveSingle, the vector versions compute several
+ * adjacent points at once.
+ **/
+static void interpolatingConvolveInterior(
+	float const * A, uint64_t const lo, uint64_t const hi,
+	float const * F, int64_t const f, int64_t const sub,
+	int64_t const bs, float const s, float * R
+)
+{
+	uint64_t i = lo;
+	
+	#if defined(__AVX__)
+	__m256 const half8 = _mm256_set1_ps(.5f);
+	__m256 const s8 = _mm256_set1_ps(s);
+	for ( ; i + 8 <= hi; i += 8 )
+	{
+		float const * p = A + static_cast<int64_t>(i) + sub*bs;
+		__m256 vj = _mm256_loadu_ps(p);
+		__m256 v = _mm256_setzero_ps();
+		
+		for ( int64_t j = 0; j < f; ++j )
+		{
+			p += bs;
+			__m256 const vj1 = _mm256_loadu_ps(p);
+			__m256 const vs = _mm256_mul_ps(_mm256_add_ps(vj,vj1),half8);
+			v = _mm256_add_ps(v,_mm256_mul_ps(vs,_mm256_set1_ps(F[j])));
+			vj = vj1;
+		}
+		
+		_mm256_storeu_ps(R + i,_mm256_mul_ps(v,s8));
+	}
+	#endif
+
+	#if defined(__SSE__)
+	__m128 const half4 = _mm_set1_ps(.5f);
+	__m128 const s4 = _mm_set1_ps(s);
+	for ( ; i + 4 <= hi; i += 4 )
+	{
+		float const * p = A + static_cast<int64_t>(i) + sub*bs;
+		__m128 vj = _mm_loadu_ps(p);
+		__m128 v = _mm_setzero_ps();
+		
+		for ( int64_t j = 0; j < f; ++j )
+		{
+			p += bs;
+			__m128 const vj1 = _mm_loadu_ps(p);
+			__m128 const vs = _mm_mul_ps(_mm_add_ps(vj,vj1),half4);
+			v = _mm_add_ps(v,_mm_mul_ps(vs,_mm_set1_ps(F[j])));
+			vj = vj1;
+		}
+		
+		_mm_storeu_ps(R + i,_mm_mul_ps(v,s4));
+	}
+	#endif
+	
+	for ( ; i < hi; ++i )
+	{
+		float const * p = A + static_cast<int64_t>(i) + sub*bs;
+		float vj = *p;
+		float v = 0;
+		
+		for ( int64_t j = 0; j < f; ++j )
+		{
+			p += bs;
+			float const vj1 = *p;
+			float const vs = (vj+vj1)*.5f;
+			v += vs * F[j];
+			vj = vj1;
+		}
+		
+		R[i] = v*s;
+	}
+}
+
+/**
+ * compute interpolating convolution of A[0,n) and store it in R[0,n). The border points
+ * are computed via a mirror accessor, the interior via interpolatingConvolveInterior.
+ **/
+static void interpolatingConvolveKernel(
+	float const * A, uint64_t const n, float const * F, int64_t const f, int64_t const bs, float const s, float * R
+)
+{
+	LiftingWaveletTransform::MirrorAccessor<float const *> const M(A,n);
+	int64_t const sub = -(f/2);
+	// first and last offset accessed for a point
+	int64_t const olow = sub*bs;
+	int64_t const ohigh = (sub+f)*bs;
+	uint64_t const lo = std::min(static_cast<uint64_t>(std::max(-olow,static_cast<int64_t>(0))),n);
+	uint64_t const hi = (static_cast<int64_t>(n) > ohigh) ? std::max(static_cast<uint64_t>(n-std::max(ohigh,static_cast<int64_t>(0))),lo) : lo;
+
+	for ( uint64_t i = 0; i < lo; ++i )
+		R[i] = interpolatingConvolveSingle(i,M,F,f,sub,bs,s);
+	if ( f )
+		interpolatingConvolveInterior(A,lo,hi,F,f,sub,bs,s,R);
+	else
+		std::fill(R+lo,R+hi,0.0f);
+	for ( uint64_t i = hi; i < n; ++i )
+		R[i] = interpolatingConvolveSingle(i,M,F,f,sub,bs,s);
+}
+
+/**
+ * scratch space for analyse, reused across scales and reference sequences
+ **/
+struct ConvolutionScratch
+{
+	// low pass
+	std::vector<float> L;
+	// output of low pass filter
+	std::vector<float> T;
+	// output of high pass filter
+	std::vector<float> H;
+};
+
 /**
  * compute convolution and store result in a different vector
  **/
@@ -198,9 +328,9 @@ struct PeakInfoLeftComparator
 	}
 };
 
-std::vector< PeakInfo  > analyse(std::deque<float> const & Q, std::string const & name, float const peakthres, uint64_t const minpeakwidth, uint64_t const maxpeakwidth)
+std::vector< PeakInfo  > analyse(std::deque<float> const & Q, std::string const & name, float const peakthres, uint64_t const minpeakwidth, uint64_t const maxpeakwidth, std::ostream & logstr, ConvolutionScratch & scratch)
 {
-	std::cerr << name << "\t" << Q.size() << std::endl;
+	logstr << name << "\t" << Q.size() << std::endl;
 
 	// biorthogonal 3.1 scaling function coefficients
 	float const bior_3_1_reconst_low [] = { 0.1767766953, 0.5303300859, 0.5303300859, 0.1767766953 };
@@ -215,7 +345,11 @@ std::vector< PeakInfo  > analyse(std::deque<float> const & Q, std::string const
 	uint64_t const n = Q.size();
 
 	// low pass
-	std::vector< float > L(Q.begin(),Q.end());
+	std::vector< float > & L = scratch.L;
+	L.assign(Q.begin(),Q.end());
+	std::vector< float > & H = scratch.H;
+	H.resize(n);
+	scratch.T.resize(n);
 	
 	std::vector < PeakInfo > peaks;
 	
@@ -231,49 +365,37 @@ std::vector< PeakInfo  > analyse(std::deque<float> const & Q, std::string const
 	
 		if ( bs >= minpeakwidth )
 		{
-			LiftingWaveletTransform::MirrorAccessor< std::vector<float>::const_iterator > const M(L.begin(),n);
-			float hpre = n ? interpolatingConvolveSingle(0,M,&bior_3_1_reconst_high[0],f,-f/2,bs,scalefactor) : 0;
-			std::deque<float> hvec;
-			hvec.push_back(hpre);
-	
+			if ( n )
+				interpolatingConvolveKernel(&L[0],n,&bior_3_1_reconst_high[0],f,bs,scalefactor,&H[0]);
+			
 			#if 0
 			std::vector<float> & fullH = fullHMap[bs];
-			fullH.push_back(hpre);
+			fullH.assign(H.begin(),H.end());
 			#endif
+			
+			// number of values dropped from the front of the high pass window
+			uint64_t dropped = 0;
 		
-			for ( int64_t i = 1; i < static_cast<int64_t>(Q.size()); ++i )
+			for ( int64_t i = 1; i < static_cast<int64_t>(n); ++i )
 			{
-				float const hnext = interpolatingConvolveSingle(i,M,&bior_3_1_reconst_high[0],f,-f/2,bs,scalefactor);
-				hvec.push_back(hnext);
-			
-				#if 0
-				fullH.push_back(hnext);
-				#endif
-			
-				int64_t const backpos = static_cast<int64_t>(hvec.size())-1;
-				int64_t const difpos = backpos - static_cast<int64_t>(bs);
+				int64_t const difpos = i - static_cast<int64_t>(dropped) - static_cast<int64_t>(bs);
 				
 				if ( 
 					difpos >= 0 
 					&&
-					hvec[difpos] > peakthres && hvec[backpos] < -peakthres
+					H[i-bs] > peakthres && H[i] < -peakthres
 				)
 				{
-					peaks.push_back(PeakInfo(bs,i-bs/2,hvec[difpos],hvec[backpos]));
-					hvec.pop_front();
+					peaks.push_back(PeakInfo(bs,i-bs/2,H[i-bs],H[i]));
+					dropped += 1;
 				}
-				
-				#if 0
-				if ( hpre > peakthres && hnext < -peakthres )
-					peaks.push_back(PeakInfo(bs,i,hpre,hnext));					
-			
-				// hpre = hnext;
-				#endif
 			}
 		}
 
 		// compute low pass on L
-		interpolatingConvolveInPlace(L.begin(),L.size(),&bior_3_1_reconst_low[0],f,bs,s);
+		if ( n )
+			interpolatingConvolveKernel(&L[0],n,&bior_3_1_reconst_low[0],f,bs,s,&scratch.T[0]);
+		L.swap(scratch.T);
 	}
 
 	std::sort(peaks.begin(),peaks.end(),PeakInfoBsComparator());
@@ -388,7 +510,7 @@ std::vector< PeakInfo  > analyse(std::deque<float> const & Q, std::string const
 			else
 				D.push_front('*');
 				
-		std::cerr << std::string(D.begin(),D.end()) << std::endl;
+		logstr << std::string(D.begin(),D.end()) << std::endl;
 
 		#if 0
 		for ( int64_t j = std::max(static_cast<int64_t>(0),i-k); j <= std::min(static_cast<int64_t>(L.size()),i+k); ++j )
@@ -499,6 +621,143 @@ void ztrim(container_type & Q, uint64_t const keep)
 	}
 }
 
+/**
+ * depth run consumer storing the depth in a vector
+ **/
+struct DepthRunFloatFill
+{
+	std::deque<float> & Q;
+	
+	DepthRunFloatFill(std::deque<float> & rQ) : Q(rQ) {}
+	
+	void operator()(uint64_t const from, uint64_t const to, int64_t const depth)
+	{
+		while ( Q.size() < to )
+			Q.push_back(0);
+		std::fill(Q.begin()+from,Q.begin()+to,static_cast<float>(depth));
+	}
+};
+
+/**
+ * compute depth for reference sequence refid via a region query, detect peaks
+ * and write the plot files. Log messages are written to logstr.
+ **/
+static void bamrefdepthpeaksRegion(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	uint64_t const refid,
+	float const peakthres,
+	uint64_t const minpeakwidth,
+	uint64_t const maxpeakwidth,
+	std::ostream & logstr,
+	ConvolutionScratch & scratch
+)
+{
+	ReferenceRegion const R(refid,0,header.getRefIDLength(refid));
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type pdec(constructReferenceRegionDecoder(arginfo,header,R));
+	libmaus::bambam::BamAlignmentDecoder & bamdec = pdec->getDecoder();
+	libmaus::bambam::BamAlignment const & algn = bamdec.getAlignment();
+	
+	std::deque<float> Q;
+	DepthRunFloatFill fill(Q);
+	DepthRunAccumulator acc;
+	uint64_t prevpos = 0;
+	
+	while ( bamdec.readAlignment() )
+		if ( algn.isMapped() && algn.getRefID() == static_cast<int64_t>(refid) )
+		{
+			if ( static_cast<uint64_t>(algn.getPos()) < prevpos )
+			{
+				libmaus::exception::LibMausException se;
+				se.getStream() << "File is not ordered by coordinate:";
+				se.getStream() << algn.formatAlignment(header) << std::endl;
+				se.finish();
+				throw se;
+			}
+			prevpos = algn.getPos();
+
+			acc.flush(algn.getPos(),fill);
+			acc.addAlignment(algn);
+		}
+	
+	acc.finish(fill);
+	
+	if ( Q.size() )
+	{
+		while ( Q.size() < R.to )
+			Q.push_back(0);
+
+		ztrim(Q,2);
+
+		std::vector< PeakInfo > const peaks = analyse(Q,header.getRefIDName(refid),peakthres,minpeakwidth,maxpeakwidth,logstr,scratch);
+		generateGPL(Q,peaks,header.getRefIDName(refid));
+	}
+}
+
+/**
+ * process reference sequences on numthreads threads using region queries. The log
+ * output of each group of numthreads reference sequences is printed in header order.
+ **/
+static void bamrefdepthpeaksParallel(
+	libmaus::util::ArgInfo const & arginfo,
+	libmaus::bambam::BamHeader const & header,
+	float const peakthres,
+	uint64_t const minpeakwidth,
+	uint64_t const maxpeakwidth,
+	uint64_t const numthreads
+)
+{
+	uint64_t const numref = header.getNumRef();
+	std::vector<std::string> logs(numthreads);
+	std::vector<ConvolutionScratch> scratch(numthreads);
+	libmaus::parallel::PosixSpinLock faillock;
+	std::string failmessage;
+
+	for ( uint64_t w = 0; w < numref; w += numthreads )
+	{
+		uint64_t const wn = std::min(numthreads,numref-w);
+		
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t i = 0; i < static_cast<int64_t>(wn); ++i )
+		{
+			try
+			{
+				std::ostringstream logstr;
+				#if defined(_OPENMP)
+				ConvolutionScratch & lscratch = scratch[omp_get_thread_num()];
+				#else
+				ConvolutionScratch & lscratch = scratch[0];
+				#endif
+				bamrefdepthpeaksRegion(arginfo,header,w+i,peakthres,minpeakwidth,maxpeakwidth,logstr,lscratch);
+				logs[i] = logstr.str();
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+				failmessage = ex.what();
+			}
+		}
+		
+		if ( failmessage.size() )
+		{
+			libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+		
+		for ( uint64_t i = 0; i < wn; ++i )
+		{
+			std::cerr << logs[i];
+			logs[i] = std::string();
+		}
+	}
+	
+	std::cerr << "done." << std::endl;
+}
+
 int bamrefdepth(libmaus::util::ArgInfo const & arginfo)
 {
 	int const verbose = arginfo.getValue<int>("verbose",getDefaultVerbose());
@@ -512,12 +771,26 @@ int bamrefdepth(libmaus::util::ArgInfo const & arginfo)
 	float const peakthres = arginfo.getValue<float>("peakthres",1.0f);
 	uint64_t const minpeakwidth = arginfo.getValueUnsignedNumeric<uint64_t>("minpeakwidth",1);
 	uint64_t const maxpeakwidth = arginfo.getValueUnsignedNumeric<uint64_t>("maxpeakwidth",1024);
+	unsigned int const threads = std::max(arginfo.getValue<unsigned int>("threads",getDefaultThreads()),1u);
+	
+	bool const regionnamesok = checkReferenceRegionNames(header);
+
+	if ( threads > 1 && ! regionnamesok )
+		std::cerr << "[W] reference sequence names contain colons, region queries are not possible, using a single thread" << std::endl;
+
+	if ( threads > 1 && regionnamesok )
+	{
+		checkReferenceRegionInput(arginfo,"bam");
+		bamrefdepthpeaksParallel(arginfo,header,peakthres,minpeakwidth,maxpeakwidth,threads);
+		return EXIT_SUCCESS;
+	}
 	
 	libmaus::bambam::BamAlignment prevalgn;
 	bool hasprev = false;
 	uint64_t c = 0;
 	
 	std::deque<float> Q;
+	ConvolutionScratch scratch;
 	libmaus::autoarray::AutoArray<libmaus::bambam::cigar_operation> cigop;
 	libmaus::autoarray::AutoArray<char> decread;
 	int64_t previd = -1;
@@ -566,7 +839,7 @@ int bamrefdepth(libmaus::util::ArgInfo const & arginfo)
 				
 			ztrim(Q,2);
 				
-			std::vector< PeakInfo > const peaks = analyse(Q,refnames[previd],peakthres,minpeakwidth,maxpeakwidth);
+			std::vector< PeakInfo > const peaks = analyse(Q,refnames[previd],peakthres,minpeakwidth,maxpeakwidth,std::cerr,scratch);
 			generateGPL(Q,peaks,header.getRefIDName(previd));
 			// std::cerr << refnames[prevalgn.getRefID()] << " size " << Q.size() << std::endl;
 			Q.resize(0);
@@ -680,7 +953,7 @@ int bamrefdepth(libmaus::util::ArgInfo const & arginfo)
 
 		ztrim(Q,2);
 
-		std::vector< PeakInfo > peaks = analyse(Q,refnames[previd],peakthres,minpeakwidth,maxpeakwidth);
+		std::vector< PeakInfo > peaks = analyse(Q,refnames[previd],peakthres,minpeakwidth,maxpeakwidth,std::cerr,scratch);
 
 		generateGPL(Q,peaks,header.getRefIDName(previd));
 
@@ -760,6 +1033,7 @@ int main(int argc, char * argv[])
 				std::vector< std::pair<std::string,std::string> > V;
 			
 				V.push_back ( std::pair<std::string,std::string> ( "verbose=<["+::biobambam::Licensing::formatNumber(getDefaultVerbose())+"]>", "print progress report" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "threads=<["+::biobambam::Licensing::formatNumber(getDefaultThreads())+"]>", "number of reference sequences processed in parallel (threads>1 requires an indexed input file given by filename)" ) );
 
 				::biobambam::Licensing::printMap(std::cerr,V);
 
@@ -23,6 +23,9 @@
 
 #include <libmaus/bambam/BamMultiAlignmentDecoderFactory.hpp>
 #include <libmaus/digest/Digests.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
 #include <libmaus/util/ArgInfo.hpp>
 
 #include <libmaus/util/I386CacheLineSize.hpp>
@@ -34,7 +37,14 @@
 #include <gmp.h>
 #endif
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 static int getDefaultVerbose() { return 0; }
+static unsigned int getDefaultThreads() { return 1; }
+static uint64_t getDefaultBatchSize() { return 16*1024*1024; }
+static uint64_t getDefaultBenchmarkRecords() { return 1024*1024; }
 static std::string getDefaultInputFormat()
 {
 	return "bam";
@@ -1163,6 +1173,76 @@ struct NullChecksums
 	};
 };
 
+/**
+ * lookup tables for the per record hot path of the checksum computation
+ **/
+struct SeqChksumTables
+{
+	// decoded base pairs for a byte of packed sequence data
+	char seqpair[256][2];
+	// reverse complemented base pairs for a byte of packed sequence data (in output order)
+	char seqpairrc[256][2];
+	// index+1 of aux tag in getDefaultAuxTags() for tag (a<<8)|b, 0 for other tags
+	uint8_t auxtagindex[256*256];
+
+	SeqChksumTables()
+	{
+		for ( unsigned int i = 0; i < 256; ++i )
+		{
+			seqpair[i][0] = ::libmaus::bambam::BamAlignmentDecoderBase::decodeSymbol(i >> 4);
+			seqpair[i][1] = ::libmaus::bambam::BamAlignmentDecoderBase::decodeSymbol(i & 0xF);
+			seqpairrc[i][0] = ::libmaus::bambam::BamAlignmentDecoderBase::decodeSymbolRC(i & 0xF);
+			seqpairrc[i][1] = ::libmaus::bambam::BamAlignmentDecoderBase::decodeSymbolRC(i >> 4);
+		}
+
+		std::fill(&auxtagindex[0],&auxtagindex[0]+sizeof(auxtagindex)/sizeof(auxtagindex[0]),0);
+		std::vector<std::string> const auxtags = getDefaultAuxTags();
+		for ( uint64_t i = 0; i < auxtags.size(); ++i )
+			auxtagindex[(static_cast<uint8_t>(auxtags[i][0]) << 8) | static_cast<uint8_t>(auxtags[i][1])] = i+1;
+	}
+	
+	/**
+	 * decode packed sequence of length len to A (reverse complemented if rc is set)
+	 **/
+	uint64_t decodeRead(uint8_t const * seq, uint64_t const len, bool const rc, ::libmaus::autoarray::AutoArray<char> & A) const
+	{
+		if ( A.size() < len )
+			A = ::libmaus::autoarray::AutoArray<char>(len,false);
+
+		uint64_t const full = len >> 1;
+		char * const out = A.begin();
+		
+		if ( rc )
+		{
+			char * p = out + len;
+			for ( uint64_t i = 0; i < full; ++i )
+			{
+				p -= 2;
+				p[0] = seqpairrc[seq[i]][0];
+				p[1] = seqpairrc[seq[i]][1];
+			}
+			if ( len & 1 )
+				out[0] = seqpairrc[seq[full]][1];
+		}
+		else
+		{
+			char * p = out;
+			for ( uint64_t i = 0; i < full; ++i )
+			{
+				p[0] = seqpair[seq[i]][0];
+				p[1] = seqpair[seq[i]][1];
+				p += 2;
+			}
+			if ( len & 1 )
+				*p = seqpair[seq[full]][0];
+		}
+		
+		return len;
+	}
+};
+
+static SeqChksumTables const seqchksumtables;
+
 /**
 * Finite field products of CRC32 checksums of primary/source sequence data
 *
@@ -1185,7 +1265,13 @@ struct OrderIndependentSeqDataChecksums {
 	::libmaus::bambam::BamAuxFilterVector const auxtagsfilter;
 	crc_container_type all;
 	crc_container_type pass;
-	OrderIndependentSeqDataChecksums() : A(), B(), auxtags(getDefaultAuxTags()), auxtagsfilter(auxtags), all(), pass() { };
+	private:
+	// start of each aux entry for auxtags in the current record
+	::libmaus::autoarray::AutoArray<uint8_t const *> paux;
+	// size of each aux entry for auxtags in the current record
+	::libmaus::autoarray::AutoArray<uint64_t> saux;
+	public:
+	OrderIndependentSeqDataChecksums() : A(), B(), auxtags(getDefaultAuxTags()), auxtagsfilter(auxtags), all(), pass(), paux(auxtags.size(),false), saux(auxtags.size(),false) { };
 	/**
 	* Combine primary sequence data from alignment record into checksum products
 	*
@@ -1214,7 +1300,9 @@ struct OrderIndependentSeqDataChecksums {
 				
 			context.pass = ! algn.isQCFail();
 			context.valid = true;
-			uint64_t const len = algn.isReverse() ? algn.decodeReadRC(A) : algn.decodeRead(A);
+			uint64_t const len = seqchksumtables.decodeRead(
+				::libmaus::bambam::BamAlignmentDecoderBase::getSeq(algn.D.begin()),algn.getLseq(),algn.isReverse(),A
+			);
 			
 			#if defined(BAM_SEQ_CHKSUM_DEBUG)
 			uint32_t const CRC32_INITIAL = crc32(0L, Z_NULL, 0);
@@ -1261,45 +1349,22 @@ struct OrderIndependentSeqDataChecksums {
 			// end of algn data block (and so of aux area)
 			uint8_t const * const auxend = algn.D.begin() + algn.blocksize;
 			
-			// start of each aux entry for auxtags
-			std::vector<uint8_t const *> paux(auxtags.size(),NULL);
-			// size of each aux entry for auxtags
-			std::vector<uint64_t> saux(auxtags.size(),0);
+			std::fill(paux.begin(),paux.end(),static_cast<uint8_t const *>(0));
 			
 			while(aux < auxend)
 			{
 				// get length of aux field in bytes
 				uint64_t const auxlen = ::libmaus::bambam::BamAlignmentDecoderBase::getAuxLength(aux);
+				// index+1 of tag in auxtags or 0 if we're not interested in it
+				uint8_t const tagindex = seqchksumtables.auxtagindex[(static_cast<unsigned int>(aux[0]) << 8) | aux[1]];
 				
-				// skip over aux tag data we're not interested in
-				if( auxtagsfilter(aux[0],aux[1]) )
+				if ( tagindex )
 				{
-					std::vector<std::string>::const_iterator it_auxtags = auxtags.begin();
-					std::vector<uint8_t const *>::iterator it_paux = paux.begin();
-					std::vector<uint64_t>::iterator it_saux = saux.begin();
-					// consider each tag in auxtag
-					while ( it_auxtags != auxtags.end())
-					{
-						// until we match the tag for the current aux data
-						if(! it_auxtags->compare(0,2,reinterpret_cast<const char *>(aux),2) )
-						{
-							*it_paux = aux;
-							*it_saux = auxlen;
-							// stop this loop
-							it_auxtags = auxtags.end();
-						}
-						else
-						{
-							++it_auxtags;
-							++it_paux;
-							++it_saux;
-						}
-					}
+					paux[tagindex-1] = aux;
+					saux[tagindex-1] = auxlen;
 				}
 				aux += auxlen;
 			}
-			std::vector<uint8_t const *>::const_iterator it_paux = paux.begin();
-			std::vector<uint64_t>::const_iterator it_saux = saux.begin();
 			
 			// copy context
 			context.ctx_flags_seq_tags.copyFrom(context.ctx_flags_seq);
@@ -1309,18 +1374,16 @@ struct OrderIndependentSeqDataChecksums {
 			#endif
 			
 			//loop over the chunks of data corresponding to the auxtags
-			while (it_paux != paux.end())
+			for ( uint64_t i = 0; i < paux.size(); ++i )
 			{
 				//if data exists push into running checksum
-				if(*it_paux)
+				if(paux[i])
 				{
-					context.ctx_flags_seq_tags.update(reinterpret_cast<uint8_t const *>(*it_paux), *it_saux);
+					context.ctx_flags_seq_tags.update(paux[i], saux[i]);
 					#if defined(BAM_SEQ_CHKSUM_DEBUG)
-					chksum_flags_seq_tags = crc32(chksum_flags_seq_tags,reinterpret_cast<const unsigned char *>(*it_paux), *it_saux);
+					chksum_flags_seq_tags = crc32(chksum_flags_seq_tags,reinterpret_cast<const unsigned char *>(paux[i]), saux[i]);
 					#endif
 				}
-				++it_paux;
-				++it_saux;
 			}
 	
 
@@ -2005,6 +2068,290 @@ namespace libmaus
 	}
 }
 
+/**
+ * batch of alignment blocks passed from the input thread to the checksum threads
+ **/
+struct BamSeqChksumBatch
+{
+	typedef BamSeqChksumBatch this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	// alignment blocks
+	std::vector<uint8_t> data;
+	// start of alignment blocks in data, the last element marks the end of the data
+	std::vector<uint64_t> offsets;
+	// package boundaries in offsets
+	std::vector<uint64_t> packages;
+
+	void reset()
+	{
+		data.resize(0);
+		offsets.resize(0);
+		packages.resize(0);
+	}
+	
+	uint64_t size() const
+	{
+		return offsets.size() ? (offsets.size()-1) : 0;
+	}
+};
+
+/**
+ * input thread for the multi-threaded checksum computation. Decodes alignments and
+ * copies them to batches split into packages of roughly packagesize bytes.
+ **/
+struct BamSeqChksumReader : public libmaus::parallel::PosixThread
+{
+	typedef BamSeqChksumReader this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	::libmaus::bambam::BamAlignmentDecoder & dec;
+	uint64_t const packagesize;
+	uint64_t const batchsize;
+
+	libmaus::autoarray::AutoArray<BamSeqChksumBatch::unique_ptr_type> batches;
+	libmaus::parallel::SynchronousQueue<BamSeqChksumBatch *> freeBatches;
+	libmaus::parallel::SynchronousQueue<BamSeqChksumBatch *> fullBatches;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	bool failed;
+	std::string failmessage;
+
+	BamSeqChksumReader(
+		::libmaus::bambam::BamAlignmentDecoder & rdec,
+		uint64_t const rpackagesize,
+		uint64_t const rbatchsize,
+		uint64_t const numbatches
+	)
+	: dec(rdec), packagesize(rpackagesize), batchsize(rbatchsize), batches(std::max(numbatches,static_cast<uint64_t>(2))), failed(false)
+	{
+		for ( uint64_t i = 0; i < batches.size(); ++i )
+		{
+			BamSeqChksumBatch::unique_ptr_type tptr(new BamSeqChksumBatch);
+			batches[i] = UNIQUE_PTR_MOVE(tptr);
+			freeBatches.enque(batches[i].get());
+		}
+	}
+	
+	void produce()
+	{
+		::libmaus::bambam::BamAlignment const & algn = dec.getAlignment();
+		bool running = true;
+		
+		while ( running )
+		{
+			BamSeqChksumBatch * batch = freeBatches.deque();
+			batch->reset();
+			std::vector<uint8_t> & D = batch->data;
+			
+			batch->offsets.push_back(0);
+			batch->packages.push_back(0);
+			
+			while ( D.size() < batchsize && (running = dec.readAlignment()) )
+			{
+				D.insert(D.end(),algn.D.begin(),algn.D.begin()+algn.blocksize);
+				batch->offsets.push_back(D.size());
+				
+				if ( D.size() - batch->offsets[batch->packages.back()] >= packagesize )
+					batch->packages.push_back(batch->offsets.size()-1);
+			}
+			
+			if ( batch->packages.back() != batch->offsets.size()-1 )
+				batch->packages.push_back(batch->offsets.size()-1);
+			
+			if ( batch->size() )
+				fullBatches.enque(batch);
+			else
+				freeBatches.enque(batch);
+		}
+	}
+	
+	void * run()
+	{
+		try
+		{
+			produce();
+		}
+		catch(std::exception const & ex)
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+			failed = true;
+			failmessage = ex.what();
+		}
+		
+		// end of stream marker
+		fullBatches.enque(0);
+		
+		return 0;
+	}
+	
+	/**
+	 * get next batch, returns null pointer at end of stream
+	 **/
+	BamSeqChksumBatch * getBatch()
+	{
+		return fullBatches.deque();
+	}
+	
+	void returnBatch(BamSeqChksumBatch * batch)
+	{
+		freeBatches.enque(batch);
+	}
+	
+	void checkFailed()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+		if ( failed )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+	}
+};
+
+/**
+ * checksum state of a single thread. As the checksums are order independent the states
+ * of all threads can be merged into the global state after the input has been processed.
+ **/
+template<typename container_type>
+struct BamSeqChksumThreadState
+{
+	typedef BamSeqChksumThreadState<container_type> this_type;
+	typedef typename libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	::libmaus::bambam::BamAlignment algn;
+	OrderIndependentSeqDataChecksums<container_type> chksums;
+	libmaus::autoarray::AutoArray< OrderIndependentSeqDataChecksums<container_type> > readgroup_chksums;
+	typename OrderIndependentSeqDataChecksums<container_type>::context_type updatecontext;
+	
+	BamSeqChksumThreadState(uint64_t const numreadgroups) : algn(), chksums(), readgroup_chksums(1 + numreadgroups,false), updatecontext()
+	{
+	
+	}
+	
+	void push(::libmaus::bambam::BamHeader const & header, uint8_t const * D, uint64_t const blocksize)
+	{
+		algn.copyFrom(D,blocksize);
+		chksums.push(algn,updatecontext);
+		readgroup_chksums[algn.getReadGroupId(header)+1].push(updatecontext);
+	}
+};
+
+/**
+ * compute checksums using numthreads threads. The alignments are decoded by an input thread
+ * and distributed to the checksum threads in packages. Each thread accumulates its own
+ * checksums, which are merged into chksums and readgroup_chksums at the end.
+ **/
+template<typename container_type>
+uint64_t bamseqchksumParallel(
+	::libmaus::bambam::BamAlignmentDecoder & dec,
+	OrderIndependentSeqDataChecksums<container_type> & chksums,
+	libmaus::autoarray::AutoArray< OrderIndependentSeqDataChecksums<container_type> > & readgroup_chksums,
+	uint64_t const numthreads,
+	uint64_t const batchsize,
+	int const verbose,
+	libmaus::timing::RealTimeClock & rtc
+)
+{
+	::libmaus::bambam::BamHeader const & header = dec.getHeader();
+	uint64_t const numreadgroups = header.getNumReadGroups();
+
+	libmaus::autoarray::AutoArray< typename BamSeqChksumThreadState<container_type>::unique_ptr_type > states(numthreads);
+	for ( uint64_t i = 0; i < numthreads; ++i )
+	{
+		typename BamSeqChksumThreadState<container_type>::unique_ptr_type tptr(new BamSeqChksumThreadState<container_type>(numreadgroups));
+		states[i] = UNIQUE_PTR_MOVE(tptr);
+	}
+
+	// use four packages per thread for load balancing
+	uint64_t const packagesize = std::max(batchsize / (4*numthreads), static_cast<uint64_t>(1));
+	BamSeqChksumReader reader(dec,packagesize,batchsize,3);
+	reader.start();
+	
+	libmaus::parallel::PosixSpinLock faillock;
+	std::string failmessage;
+	uint64_t c = 0;
+	BamSeqChksumBatch * batch = 0;
+	
+	while ( (batch = reader.getBatch()) )
+	{
+		uint64_t const numpackages = batch->packages.size()-1;
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t i = 0; i < static_cast<int64_t>(numpackages); ++i )
+		{
+			try
+			{
+				#if defined(_OPENMP)
+				BamSeqChksumThreadState<container_type> & state = *(states[omp_get_thread_num()]);
+				#else
+				BamSeqChksumThreadState<container_type> & state = *(states[0]);
+				#endif
+				uint8_t const * D = &(batch->data[0]);
+				
+				for ( uint64_t j = batch->packages[i]; j < batch->packages[i+1]; ++j )
+					state.push(header,D + batch->offsets[j],batch->offsets[j+1]-batch->offsets[j]);
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+				failmessage = ex.what();
+			}
+		}
+		
+		uint64_t const oldc = c;
+		c += batch->size();
+		reader.returnBatch(batch);
+		
+		if ( failmessage.size() )
+		{
+			// keep the input thread from blocking on a full queue
+			while ( (batch = reader.getBatch()) )
+				reader.returnBatch(batch);
+			reader.join();
+
+			::libmaus::exception::LibMausException se;
+			se.getStream() << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+		
+		if ( verbose && ((oldc >> 20) != (c >> 20)) )
+			std::cerr << "[V] " << c << " " << rtc.getElapsedSeconds() << std::endl;
+	}
+	
+	reader.join();
+	reader.checkFailed();
+
+	for ( uint64_t i = 0; i < numthreads; ++i )
+	{
+		chksums.push(states[i]->chksums);
+		for ( uint64_t j = 0; j < readgroup_chksums.size(); ++j )
+			readgroup_chksums[j].push(states[i]->readgroup_chksums[j]);
+	}
+	
+	return c;
+}
+
+/**
+ * construct the input decoder, threads sets the number of BAM decoding threads unless inputthreads is given
+ **/
+static libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type constructDecoder(::libmaus::util::ArgInfo const & arginfo)
+{
+	::libmaus::util::ArgInfo decarginfo(arginfo);
+	
+	if ( arginfo.hasArg("threads") && !arginfo.hasArg("inputthreads") )
+		decarginfo.replaceKey("inputthreads",arginfo.getUnparsedValue("threads",std::string()));
+
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type ptr(
+		libmaus::bambam::BamMultiAlignmentDecoderFactory::construct(decarginfo));
+	return UNIQUE_PTR_MOVE(ptr);
+}
+
 template<typename container_type>
 int bamseqchksumTemplate(::libmaus::util::ArgInfo const & arginfo)
 {
@@ -2024,8 +2371,7 @@ int bamseqchksumTemplate(::libmaus::util::ArgInfo const & arginfo)
 	std::string const inputformat = arginfo.getValue<std::string>("inputformat",getDefaultInputFormat());
 
 	// input decoder wrapper
-	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type decwrapper(
-		libmaus::bambam::BamMultiAlignmentDecoderFactory::construct(arginfo));
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type decwrapper(constructDecoder(arginfo));
 	::libmaus::bambam::BamAlignmentDecoder & dec = decwrapper->getDecoder();
 
 	::libmaus::bambam::BamHeader const & header = dec.getHeader();
@@ -2035,22 +2381,30 @@ int bamseqchksumTemplate(::libmaus::util::ArgInfo const & arginfo)
 	libmaus::autoarray::AutoArray< OrderIndependentSeqDataChecksums<container_type> > readgroup_chksums(1 + header.getNumReadGroups(),false);
 	typename OrderIndependentSeqDataChecksums<container_type>::context_type updatecontext;
 
+	unsigned int const threads = std::max(arginfo.getValue<unsigned int>("threads",getDefaultThreads()),1u);
+	uint64_t const batchsize = std::max(arginfo.getValueUnsignedNumeric<uint64_t>("batchsize",getDefaultBatchSize()),static_cast<uint64_t>(1));
+
 	uint64_t c = 0;
-	while ( dec.readAlignment() )
+	if ( threads > 1 )
+		c = bamseqchksumParallel<container_type>(dec,chksums,readgroup_chksums,threads,batchsize,verbose,rtc);
+	else
 	{
-		chksums.push(algn,updatecontext);
-		readgroup_chksums[algn.getReadGroupId(header)+1].push(updatecontext);
+		while ( dec.readAlignment() )
+		{
+			chksums.push(algn,updatecontext);
+			readgroup_chksums[algn.getReadGroupId(header)+1].push(updatecontext);
 		
-		if ( verbose && (++c & (1024*1024-1)) == 0 )
-		{
-			double const elapsed = rtc.getElapsedSeconds();
-			std::cerr << "[V] " << c/(1024*1024) << " " << chksums.all.get_count() << " " << algn.getName() << " " << algn.isRead1()
-			<< " " << algn.isRead2() << " " << ( algn.isReverse() ? algn.getReadRC() : algn.getRead() ) << " "
-			<< ( algn.isReverse() ? algn.getQualRC() : algn.getQual() ) << " " << std::hex << (0x0 + algn.getFlags())
-			<< std::dec << " " << chksums.all.get_b_seq() << " " << chksums.all.get_b_seq_tags() << " " 
-			<< " " << (elapsed-prevtime)
-			<< std::endl;
-			prevtime = elapsed;
+			if ( verbose && (++c & (1024*1024-1)) == 0 )
+			{
+				double const elapsed = rtc.getElapsedSeconds();
+				std::cerr << "[V] " << c/(1024*1024) << " " << chksums.all.get_count() << " " << algn.getName() << " " << algn.isRead1()
+				<< " " << algn.isRead2() << " " << ( algn.isReverse() ? algn.getReadRC() : algn.getRead() ) << " "
+				<< ( algn.isReverse() ? algn.getQualRC() : algn.getQual() ) << " " << std::hex << (0x0 + algn.getFlags())
+				<< std::dec << " " << chksums.all.get_b_seq() << " " << chksums.all.get_b_seq_tags() << " " 
+				<< " " << (elapsed-prevtime)
+				<< std::endl;
+				prevtime = elapsed;
+			}
 		}
 	}
 
@@ -2220,30 +2574,32 @@ static std::string getSupportedHashVariantsList()
 	return ostr.str();
 }
 
-int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
-{
-	std::string const hash = arginfo.getValue<std::string>("hash",getDefaultHash());
-	
+/**
+ * call F.run<container_type>() for the checksum container type matching hash
+ **/
+template<typename functor_type>
+int bamseqchksumDispatch(std::string const & hash, functor_type & F)
+{	
 	if ( hash == "crc32prod" )
 	{
-		return bamseqchksumTemplate<CRC32Products>(arginfo);
+		return F.template run<CRC32Products>();
 	}
 	else if ( hash == "crc32" )
 	{
-		return bamseqchksumTemplate<CRC32SimpleSums>(arginfo);
+		return F.template run<CRC32SimpleSums>();
 	}
 	else if ( hash == "md5" )
 	{
-		return bamseqchksumTemplate<MD5SimpleSums>(arginfo);
+		return F.template run<MD5SimpleSums>();
 	}
 	#if defined(LIBMAUS_HAVE_NETTLE)
 	else if ( hash == "sha1" )
 	{
-		return bamseqchksumTemplate<SHA1SimpleSums>(arginfo);
+		return F.template run<SHA1SimpleSums>();
 	}
 	else if ( hash == "sha224" )
 	{
-		return bamseqchksumTemplate<SHA2_224_SimpleSums>(arginfo);
+		return F.template run<SHA2_224_SimpleSums>();
 	}
 	else if ( hash == "sha256" )
 	{
@@ -2251,15 +2607,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_SimpleSums>(arginfo);
+			return F.template run<SHA2_256_sse4_SimpleSums>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_SimpleSums>(arginfo);
+			return F.template run<SHA2_256_SimpleSums>();
 	}
 	else if ( hash == "sha384" )
 	{
-		return bamseqchksumTemplate<SHA2_384_SimpleSums>(arginfo);
+		return F.template run<SHA2_384_SimpleSums>();
 	}
 	else if ( hash == "sha512" )
 	{
@@ -2267,81 +2623,81 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_SimpleSums>(arginfo);
+			return F.template run<SHA2_512_sse4_SimpleSums>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_SimpleSums>(arginfo);
+			return F.template run<SHA2_512_SimpleSums>();
 	}
 	#endif
 	else if ( hash == "crc32prime32" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct32>(arginfo);
+		return F.template run<CRC32PrimeProduct32>();
 	}
 	else if ( hash == "crc32prime64" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct64>(arginfo);
+		return F.template run<CRC32PrimeProduct64>();
 	}
 	else if ( hash == "md5prime64" )
 	{
-		return bamseqchksumTemplate<MD5PrimeProduct64>(arginfo);
+		return F.template run<MD5PrimeProduct64>();
 	}
 	else if ( hash == "crc32prime96" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct96>(arginfo);
+		return F.template run<CRC32PrimeProduct96>();
 	}
 	else if ( hash == "md5prime96" )
 	{
-		return bamseqchksumTemplate<MD5PrimeProduct96>(arginfo);
+		return F.template run<MD5PrimeProduct96>();
 	}
 	else if ( hash == "crc32prime128" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct128>(arginfo);
+		return F.template run<CRC32PrimeProduct128>();
 	}
 	else if ( hash == "md5prime128" )
 	{
-		return bamseqchksumTemplate<MD5PrimeProduct128>(arginfo);
+		return F.template run<MD5PrimeProduct128>();
 	}
 	else if ( hash == "crc32prime160" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct160>(arginfo);
+		return F.template run<CRC32PrimeProduct160>();
 	}
 	else if ( hash == "md5prime160" )
 	{
-		return bamseqchksumTemplate<MD5PrimeProduct160>(arginfo);
+		return F.template run<MD5PrimeProduct160>();
 	}
 	else if ( hash == "crc32prime192" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct192>(arginfo);
+		return F.template run<CRC32PrimeProduct192>();
 	}
 	else if ( hash == "md5prime192" )
 	{
-		return bamseqchksumTemplate<MD5PrimeProduct192>(arginfo);
+		return F.template run<MD5PrimeProduct192>();
 	}
 	else if ( hash == "crc32prime224" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct224>(arginfo);
+		return F.template run<CRC32PrimeProduct224>();
 	}
 	else if ( hash == "md5prime224" )
 	{
-		return bamseqchksumTemplate<MD5PrimeProduct224>(arginfo);
+		return F.template run<MD5PrimeProduct224>();
 	}
 	else if ( hash == "crc32prime256" )
 	{
-		return bamseqchksumTemplate<CRC32PrimeProduct256>(arginfo);
+		return F.template run<CRC32PrimeProduct256>();
 	}
 	else if ( hash == "md5prime256" )
 	{
-		return bamseqchksumTemplate<MD5PrimeProduct256>(arginfo);
+		return F.template run<MD5PrimeProduct256>();
 	}
 	#if defined(LIBMAUS_HAVE_NETTLE)
 	else if ( hash == "sha1prime64" )
 	{
-		return bamseqchksumTemplate<SHA1PrimeProduct64>(arginfo);
+		return F.template run<SHA1PrimeProduct64>();
 	}
 	else if ( hash == "sha224prime64" )
 	{
-		return bamseqchksumTemplate<SHA2_224_PrimeProduct64>(arginfo);
+		return F.template run<SHA2_224_PrimeProduct64>();
 	}
 	else if ( hash == "sha256prime64" )
 	{
@@ -2349,15 +2705,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			//std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct64>(arginfo);
+			return F.template run<SHA2_256_sse4_PrimeProduct64>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_PrimeProduct64>(arginfo);
+			return F.template run<SHA2_256_PrimeProduct64>();
 	}
 	else if ( hash == "sha384prime64" )
 	{
-		return bamseqchksumTemplate<SHA2_384_PrimeProduct64>(arginfo);
+		return F.template run<SHA2_384_PrimeProduct64>();
 	}
 	else if ( hash == "sha512prime64" )
 	{
@@ -2365,19 +2721,19 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			//std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct64>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeProduct64>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeProduct64>(arginfo);
+			return F.template run<SHA2_512_PrimeProduct64>();
 	}
 	else if ( hash == "sha1prime96" )
 	{
-		return bamseqchksumTemplate<SHA1PrimeProduct96>(arginfo);
+		return F.template run<SHA1PrimeProduct96>();
 	}
 	else if ( hash == "sha224prime96" )
 	{
-		return bamseqchksumTemplate<SHA2_224_PrimeProduct96>(arginfo);
+		return F.template run<SHA2_224_PrimeProduct96>();
 	}
 	else if ( hash == "sha256prime96" )
 	{
@@ -2385,15 +2741,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			//std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct96>(arginfo);
+			return F.template run<SHA2_256_sse4_PrimeProduct96>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_PrimeProduct96>(arginfo);
+			return F.template run<SHA2_256_PrimeProduct96>();
 	}
 	else if ( hash == "sha384prime96" )
 	{
-		return bamseqchksumTemplate<SHA2_384_PrimeProduct96>(arginfo);
+		return F.template run<SHA2_384_PrimeProduct96>();
 	}
 	else if ( hash == "sha512prime96" )
 	{
@@ -2401,19 +2757,19 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct96>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeProduct96>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeProduct96>(arginfo);
+			return F.template run<SHA2_512_PrimeProduct96>();
 	}
 	else if ( hash == "sha1prime128" )
 	{
-		return bamseqchksumTemplate<SHA1PrimeProduct128>(arginfo);
+		return F.template run<SHA1PrimeProduct128>();
 	}
 	else if ( hash == "sha224prime128" )
 	{
-		return bamseqchksumTemplate<SHA2_224_PrimeProduct128>(arginfo);
+		return F.template run<SHA2_224_PrimeProduct128>();
 	}
 	else if ( hash == "sha256prime128" )
 	{
@@ -2421,15 +2777,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct128>(arginfo);
+			return F.template run<SHA2_256_sse4_PrimeProduct128>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_PrimeProduct128>(arginfo);
+			return F.template run<SHA2_256_PrimeProduct128>();
 	}
 	else if ( hash == "sha384prime128" )
 	{
-		return bamseqchksumTemplate<SHA2_384_PrimeProduct128>(arginfo);
+		return F.template run<SHA2_384_PrimeProduct128>();
 	}
 	else if ( hash == "sha512prime128" )
 	{
@@ -2437,19 +2793,19 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct128>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeProduct128>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeProduct128>(arginfo);
+			return F.template run<SHA2_512_PrimeProduct128>();
 	}
 	else if ( hash == "sha1prime160" )
 	{
-		return bamseqchksumTemplate<SHA1PrimeProduct160>(arginfo);
+		return F.template run<SHA1PrimeProduct160>();
 	}
 	else if ( hash == "sha224prime160" )
 	{
-		return bamseqchksumTemplate<SHA2_224_PrimeProduct160>(arginfo);
+		return F.template run<SHA2_224_PrimeProduct160>();
 	}
 	else if ( hash == "sha256prime160" )
 	{
@@ -2457,15 +2813,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct160>(arginfo);
+			return F.template run<SHA2_256_sse4_PrimeProduct160>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_PrimeProduct160>(arginfo);
+			return F.template run<SHA2_256_PrimeProduct160>();
 	}
 	else if ( hash == "sha384prime160" )
 	{
-		return bamseqchksumTemplate<SHA2_384_PrimeProduct160>(arginfo);
+		return F.template run<SHA2_384_PrimeProduct160>();
 	}
 	else if ( hash == "sha512prime160" )
 	{
@@ -2473,19 +2829,19 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct160>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeProduct160>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeProduct160>(arginfo);
+			return F.template run<SHA2_512_PrimeProduct160>();
 	}
 	else if ( hash == "sha1prime192" )
 	{
-		return bamseqchksumTemplate<SHA1PrimeProduct192>(arginfo);
+		return F.template run<SHA1PrimeProduct192>();
 	}
 	else if ( hash == "sha224prime192" )
 	{
-		return bamseqchksumTemplate<SHA2_224_PrimeProduct192>(arginfo);
+		return F.template run<SHA2_224_PrimeProduct192>();
 	}
 	else if ( hash == "sha256prime192" )
 	{
@@ -2493,15 +2849,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct192>(arginfo);
+			return F.template run<SHA2_256_sse4_PrimeProduct192>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_PrimeProduct192>(arginfo);
+			return F.template run<SHA2_256_PrimeProduct192>();
 	}
 	else if ( hash == "sha384prime192" )
 	{
-		return bamseqchksumTemplate<SHA2_384_PrimeProduct192>(arginfo);
+		return F.template run<SHA2_384_PrimeProduct192>();
 	}
 	else if ( hash == "sha512prime192" )
 	{
@@ -2509,19 +2865,19 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct192>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeProduct192>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeProduct192>(arginfo);
+			return F.template run<SHA2_512_PrimeProduct192>();
 	}
 	else if ( hash == "sha1prime224" )
 	{
-		return bamseqchksumTemplate<SHA1PrimeProduct224>(arginfo);
+		return F.template run<SHA1PrimeProduct224>();
 	}
 	else if ( hash == "sha224prime224" )
 	{
-		return bamseqchksumTemplate<SHA2_224_PrimeProduct224>(arginfo);
+		return F.template run<SHA2_224_PrimeProduct224>();
 	}
 	else if ( hash == "sha256prime224" )
 	{
@@ -2529,15 +2885,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct224>(arginfo);
+			return F.template run<SHA2_256_sse4_PrimeProduct224>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_PrimeProduct224>(arginfo);
+			return F.template run<SHA2_256_PrimeProduct224>();
 	}
 	else if ( hash == "sha384prime224" )
 	{
-		return bamseqchksumTemplate<SHA2_384_PrimeProduct224>(arginfo);
+		return F.template run<SHA2_384_PrimeProduct224>();
 	}
 	else if ( hash == "sha512prime224" )
 	{
@@ -2545,19 +2901,19 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct224>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeProduct224>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeProduct224>(arginfo);
+			return F.template run<SHA2_512_PrimeProduct224>();
 	}
 	else if ( hash == "sha1prime256" )
 	{
-		return bamseqchksumTemplate<SHA1PrimeProduct256>(arginfo);
+		return F.template run<SHA1PrimeProduct256>();
 	}
 	else if ( hash == "sha224prime256" )
 	{
-		return bamseqchksumTemplate<SHA2_224_PrimeProduct256>(arginfo);
+		return F.template run<SHA2_224_PrimeProduct256>();
 	}
 	else if ( hash == "sha256prime256" )
 	{
@@ -2565,15 +2921,15 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_256" << std::endl;
-			return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct256>(arginfo);
+			return F.template run<SHA2_256_sse4_PrimeProduct256>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_256_PrimeProduct256>(arginfo);
+			return F.template run<SHA2_256_PrimeProduct256>();
 	}
 	else if ( hash == "sha384prime256" )
 	{
-		return bamseqchksumTemplate<SHA2_384_PrimeProduct256>(arginfo);
+		return F.template run<SHA2_384_PrimeProduct256>();
 	}
 	else if ( hash == "sha512prime256" )
 	{
@@ -2581,16 +2937,16 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct256>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeProduct256>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeProduct256>(arginfo);
+			return F.template run<SHA2_512_PrimeProduct256>();
 	}
 	#endif
 	else if ( hash == "null" )
 	{
-		return bamseqchksumTemplate<NullChecksums>(arginfo);
+		return F.template run<NullChecksums>();
 	}
 	#if defined(LIBMAUS_HAVE_NETTLE)
 	else if ( hash == "sha512primesums" )
@@ -2599,11 +2955,11 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeSums>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeSums>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeSums>(arginfo);
+			return F.template run<SHA2_512_PrimeSums>();
 	}
 	else if ( hash == "sha512primesums512" )
 	{
@@ -2611,85 +2967,85 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 		if ( libmaus::util::I386CacheLineSize::hasSSE41() )
 		{
 			// std::cerr << "[V] running sse4 SHA2_512" << std::endl;
-			return bamseqchksumTemplate<SHA2_512_sse4_PrimeSums512>(arginfo);
+			return F.template run<SHA2_512_sse4_PrimeSums512>();
 		}
 		else
 		#endif
-			return bamseqchksumTemplate<SHA2_512_PrimeSums512>(arginfo);
+			return F.template run<SHA2_512_PrimeSums512>();
 	}
 	#endif
 	#if (! defined(NETTLE)) && defined(LIBMAUS_USE_ASSEMBLY) && defined(LIBMAUS_HAVE_i386) && defined(LIBMAUS_HAVE_SHA2_ASSEMBLY)
 	else if ( hash == "sha256" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_SimpleSums>(arginfo);	
+		return F.template run<SHA2_256_sse4_SimpleSums>();	
 	}
 	else if ( hash == "sha512" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_SimpleSums>(arginfo);	
+		return F.template run<SHA2_512_sse4_SimpleSums>();	
 	}
 	else if ( hash == "sha256prime64" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct64>(arginfo);
+		return F.template run<SHA2_256_sse4_PrimeProduct64>();
 	}
 	else if ( hash == "sha256prime96" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct96>(arginfo);
+		return F.template run<SHA2_256_sse4_PrimeProduct96>();
 	}
 	else if ( hash == "sha256prime128" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct128>(arginfo);
+		return F.template run<SHA2_256_sse4_PrimeProduct128>();
 	}
 	else if ( hash == "sha256prime160" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct160>(arginfo);
+		return F.template run<SHA2_256_sse4_PrimeProduct160>();
 	}
 	else if ( hash == "sha256prime192" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct192>(arginfo);
+		return F.template run<SHA2_256_sse4_PrimeProduct192>();
 	}
 	else if ( hash == "sha256prime224" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct224>(arginfo);
+		return F.template run<SHA2_256_sse4_PrimeProduct224>();
 	}
 	else if ( hash == "sha256prime256" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_256_sse4_PrimeProduct256>(arginfo);
+		return F.template run<SHA2_256_sse4_PrimeProduct256>();
 	}
 	else if ( hash == "sha512prime64" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct64>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeProduct64>();
 	}
 	else if ( hash == "sha512prime96" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct96>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeProduct96>();
 	}
 	else if ( hash == "sha512prime128" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct128>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeProduct128>();
 	}
 	else if ( hash == "sha512prime160" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct160>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeProduct160>();
 	}
 	else if ( hash == "sha512prime192" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct192>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeProduct192>();
 	}
 	else if ( hash == "sha512prime224" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct224>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeProduct224>();
 	}
 	else if ( hash == "sha512prime256" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeProduct256>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeProduct256>();
 	}
 	else if ( hash == "sha512primesums" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeSums>(arginfo);	
+		return F.template run<SHA2_512_sse4_PrimeSums>();	
 	}
 	else if ( hash == "sha512primesums512" && libmaus::util::I386CacheLineSize::hasSSE41() )
 	{
-		return bamseqchksumTemplate<SHA2_512_sse4_PrimeSums512>(arginfo);
+		return F.template run<SHA2_512_sse4_PrimeSums512>();
 	}
 	#endif
 	else
@@ -2701,6 +3057,135 @@ int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
 	}
 }
 
+/**
+ * functor running the checksum computation for a container type
+ **/
+struct BamSeqChksumRun
+{
+	::libmaus::util::ArgInfo const & arginfo;
+	
+	BamSeqChksumRun(::libmaus::util::ArgInfo const & rarginfo) : arginfo(rarginfo) {}
+	
+	template<typename container_type>
+	int run()
+	{
+		return bamseqchksumTemplate<container_type>(arginfo);
+	}
+};
+
+/**
+ * compute checksums for the alignments in batch using a single thread and print the throughput
+ **/
+template<typename container_type>
+int bamseqchksumBenchmarkTemplate(std::string const & hash, ::libmaus::bambam::BamHeader const & header, BamSeqChksumBatch const & batch)
+{
+	::libmaus::bambam::BamAlignment algn;
+	OrderIndependentSeqDataChecksums<container_type> chksums;
+	libmaus::autoarray::AutoArray< OrderIndependentSeqDataChecksums<container_type> > readgroup_chksums(1 + header.getNumReadGroups(),false);
+	typename OrderIndependentSeqDataChecksums<container_type>::context_type updatecontext;
+	uint8_t const * D = batch.data.size() ? &(batch.data[0]) : 0;
+
+	libmaus::timing::RealTimeClock rtc;
+	rtc.start();
+	
+	for ( uint64_t i = 0; i < batch.size(); ++i )
+	{
+		algn.copyFrom(D + batch.offsets[i],batch.offsets[i+1]-batch.offsets[i]);
+		chksums.push(algn,updatecontext);
+		readgroup_chksums[algn.getReadGroupId(header)+1].push(updatecontext);
+	}
+	
+	double const elapsed = rtc.getElapsedSeconds();
+	
+	std::cout << hash << "\t" << batch.size() << "\t" << elapsed << "\t" 
+		<< static_cast<uint64_t>((elapsed > 0) ? (batch.size() / elapsed) : 0) << "\t"
+		<< std::hex << chksums.all.get_b_seq() << std::dec << std::endl;
+	
+	return EXIT_SUCCESS;
+}
+
+/**
+ * functor running the benchmark for a container type
+ **/
+struct BamSeqChksumBenchmarkRun
+{
+	std::string const hash;
+	::libmaus::bambam::BamHeader const & header;
+	BamSeqChksumBatch const & batch;
+	
+	BamSeqChksumBenchmarkRun(std::string const & rhash, ::libmaus::bambam::BamHeader const & rheader, BamSeqChksumBatch const & rbatch)
+	: hash(rhash), header(rheader), batch(rbatch) {}
+	
+	template<typename container_type>
+	int run()
+	{
+		return bamseqchksumBenchmarkTemplate<container_type>(hash,header,batch);
+	}
+};
+
+/**
+ * read up to benchmarkrecords alignments into memory and report the single threaded
+ * throughput in records per second for each hash variant (or the one given by the hash key)
+ **/
+int bamseqchksumBenchmark(::libmaus::util::ArgInfo const & arginfo)
+{
+	if ( isatty(STDIN_FILENO) )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "Refusing to read data from terminal, please redirect standard input to pipe or file." << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	uint64_t const benchmarkrecords = arginfo.getValueUnsignedNumeric<uint64_t>("benchmarkrecords",getDefaultBenchmarkRecords());
+
+	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type decwrapper(constructDecoder(arginfo));
+	::libmaus::bambam::BamAlignmentDecoder & dec = decwrapper->getDecoder();
+	::libmaus::bambam::BamHeader const & header = dec.getHeader();
+	::libmaus::bambam::BamAlignment const & algn = dec.getAlignment();
+
+	BamSeqChksumBatch batch;
+	batch.offsets.push_back(0);
+	while ( batch.size() < benchmarkrecords && dec.readAlignment() )
+	{
+		batch.data.insert(batch.data.end(),algn.D.begin(),algn.D.begin()+algn.blocksize);
+		batch.offsets.push_back(batch.data.size());
+	}
+	
+	std::vector<std::string> variants;
+	if ( arginfo.hasArg("hash") )
+		variants.push_back(arginfo.getUnparsedValue("hash",getDefaultHash()));
+	else
+		variants = getSupportedHashVariants();
+
+	std::cout << "###\thash\trecords\tseconds\trecords/s\tb_seq" << std::endl;
+	
+	for ( uint64_t i = 0; i < variants.size(); ++i )
+	{
+		BamSeqChksumBenchmarkRun F(variants[i],header,batch);
+		try
+		{
+			bamseqchksumDispatch(variants[i],F);
+		}
+		catch(std::exception const & ex)
+		{
+			// variant not available on this machine
+			std::cerr << "[W] skipping " << variants[i] << ": " << ex.what() << std::endl;
+		}
+	}
+	
+	return EXIT_SUCCESS;
+}
+
+int bamseqchksum(::libmaus::util::ArgInfo const & arginfo)
+{
+	if ( arginfo.getValue<int>("benchmark",0) )
+		return bamseqchksumBenchmark(arginfo);
+
+	BamSeqChksumRun F(arginfo);
+	return bamseqchksumDispatch(arginfo.getValue<std::string>("hash",getDefaultHash()),F);
+}
+
 #if defined(BIOBAMBAM_HAVE_GMP)
 template<size_t k>
 static libmaus::math::UnsignedInteger<k> convertNumber(mpz_t const & gmpnum)
@@ -2776,6 +3261,10 @@ int main(int argc, char * argv[])
 				#endif
 
 				V.push_back ( std::pair<std::string,std::string> ( std::string("hash=<[")+getDefaultHash()+"]>", "hash digest function: " + getSupportedHashVariantsList()) );
+				V.push_back ( std::pair<std::string,std::string> ( "threads=<["+::biobambam::Licensing::formatNumber(getDefaultThreads())+"]>", "number of threads used for computing checksums (and decoding input if inputformat=bam)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "batchsize=<["+::biobambam::Licensing::formatNumber(getDefaultBatchSize())+"]>", "size of alignment batches in bytes if threads>1" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "benchmark=<[0]>", "report single threaded records/s for each hash variant (or the one given by hash) instead of computing checksums" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "benchmarkrecords=<["+::biobambam::Licensing::formatNumber(getDefaultBenchmarkRecords())+"]>", "number of alignments loaded into memory for benchmark=1" ) );
 				
 				::biobambam::Licensing::printMap(std::cerr,V);
 
@@ -34,6 +34,10 @@
 #include <libmaus/bambam/BamWriter.hpp>
 #include <libmaus/bambam/ProgramHeaderLineSet.hpp>
 
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
+
 #include <libmaus/util/ArgInfo.hpp>
 #include <libmaus/util/GetObject.hpp>
 #include <libmaus/util/PutObject.hpp>
@@ -50,6 +54,8 @@ static int getDefaultIndex() { return 0; }
 #include <libmaus/bambam/ScramDecoder.hpp>
 #endif
 
+#include <biobambam/BamSortFixMatesInfo.hpp>
+#include <biobambam/BamThreadPoolSort.hpp>
 #include <biobambam/Licensing.hpp>
 
 static int getDefaultLevel() { return Z_DEFAULT_COMPRESSION; }
@@ -65,6 +71,354 @@ static int getDefaultCalMdNmRecompIndetOnly() { return 0; }
 static int getDefaultCalMdNmWarnChange() { return 0; }
 static int getDefaultAddDupMarkSupport() { return 0; }
 static int getDefaultMarkDuplicates() { return 0; }
+static int getDefaultPipeline() { return 0; }
+static uint64_t getDefaultPipelineBatchSize() { return 4096; }
+static uint64_t getDefaultPipelineBatches() { return 4; }
+static std::string getDefaultSortEngine() { return "default"; }
+
+/**
+ * batch of alignments passed from the input pipeline thread to the sorting thread
+ **/
+struct BamSortInputBatch
+{
+	typedef BamSortInputBatch this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	// alignment slots
+	libmaus::autoarray::AutoArray<libmaus::bambam::BamAlignment> A;
+	// number of slots in use
+	uint64_t fill;
+	// slot indices in the order the alignments are to be passed to the sorter
+	std::vector<uint64_t> order;
+	// slot pairs requiring mate information fixing
+	std::vector< std::pair<uint64_t,uint64_t> > pairs;
+
+	BamSortInputBatch(uint64_t const size) : A(size), fill(0) {}
+
+	void reset()
+	{
+		fill = 0;
+		order.resize(0);
+		pairs.resize(0);
+	}
+};
+
+/**
+ * input pipeline for bamsort: decoding and mate fixing run in a separate thread (the latter
+ * using up to numthreads threads per batch) while the calling thread feeds the sorter, so
+ * block sorting and spilling in the BamEntryContainer overlap with decoding the next block
+ **/
+struct BamSortInputPipeline : public libmaus::parallel::PosixThread
+{
+	typedef BamSortInputPipeline this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	libmaus::bambam::BamAlignmentDecoder & dec;
+	BamSortFixMatesInfo const & fixinfo;
+	uint64_t const numthreads;
+
+	libmaus::autoarray::AutoArray<BamSortInputBatch::unique_ptr_type> batches;
+	libmaus::parallel::SynchronousQueue<BamSortInputBatch *> freeBatches;
+	libmaus::parallel::SynchronousQueue<BamSortInputBatch *> fullBatches;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	bool failed;
+	std::string failmessage;
+
+	BamSortInputPipeline(
+		libmaus::bambam::BamAlignmentDecoder & rdec,
+		BamSortFixMatesInfo const & rfixinfo,
+		uint64_t const rnumthreads,
+		uint64_t const batchsize,
+		uint64_t const numbatches
+	)
+	: dec(rdec), fixinfo(rfixinfo), numthreads(std::max(rnumthreads,static_cast<uint64_t>(1))), batches(std::max(numbatches,static_cast<uint64_t>(2))), failed(false)
+	{
+		for ( uint64_t i = 0; i < batches.size(); ++i )
+		{
+			BamSortInputBatch::unique_ptr_type tptr(new BamSortInputBatch(std::max(batchsize,static_cast<uint64_t>(2))));
+			batches[i] = UNIQUE_PTR_MOVE(tptr);
+			freeBatches.enque(batches[i].get());
+		}
+	}
+
+	/**
+	 * process mate pairs of batch and pass it on to the sorting thread
+	 **/
+	void finishBatch(BamSortInputBatch * batch)
+	{
+		std::vector< std::pair<uint64_t,uint64_t> > const & pairs = batch->pairs;
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,256)
+		#endif
+		for ( uint64_t i = 0; i < pairs.size(); ++i )
+			fixinfo.fixPair(batch->A[pairs[i].first],batch->A[pairs[i].second]);
+
+		fullBatches.enque(batch);
+	}
+
+	void produce()
+	{
+		libmaus::bambam::BamAlignment & curalgn = dec.getAlignment();
+		BamSortInputBatch * batch = freeBatches.deque();
+		batch->reset();
+		// slot of previous unpaired primary alignment
+		int64_t prev = -1;
+		bool running = true;
+
+		while ( running )
+		{
+			while ( batch->fill < batch->A.size() && (running = dec.readAlignment()) )
+			{
+				uint64_t const cur = batch->fill++;
+				batch->A[cur].swap(curalgn);
+
+				if ( ! fixinfo.fixmates )
+				{
+					batch->order.push_back(cur);
+				}
+				else if ( batch->A[cur].isSecondary() || batch->A[cur].isSupplementary() )
+				{
+					batch->order.push_back(cur);
+				}
+				else if ( prev >= 0 )
+				{
+					// different name
+					if ( strcmp(batch->A[cur].getName(),batch->A[prev].getName()) )
+					{
+						batch->order.push_back(prev);
+						prev = cur;
+					}
+					// same name
+					else
+					{
+						batch->pairs.push_back(std::pair<uint64_t,uint64_t>(prev,cur));
+						batch->order.push_back(prev);
+						batch->order.push_back(cur);
+						prev = -1;
+					}
+				}
+				else
+				{
+					prev = cur;
+				}
+			}
+
+			if ( running )
+			{
+				BamSortInputBatch * nextbatch = freeBatches.deque();
+				nextbatch->reset();
+
+				// move unpaired alignment to the next batch
+				if ( prev >= 0 )
+				{
+					nextbatch->A[0].swap(batch->A[prev]);
+					nextbatch->fill = 1;
+					prev = 0;
+				}
+
+				finishBatch(batch);
+				batch = nextbatch;
+			}
+		}
+
+		if ( prev >= 0 )
+			batch->order.push_back(prev);
+
+		finishBatch(batch);
+	}
+
+	void * run()
+	{
+		try
+		{
+			produce();
+		}
+		catch(std::exception const & ex)
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+			failed = true;
+			failmessage = ex.what();
+		}
+
+		// end of stream marker
+		fullBatches.enque(0);
+
+		return 0;
+	}
+
+	/**
+	 * get next batch of alignments, returns null pointer at end of stream
+	 **/
+	BamSortInputBatch * getBatch()
+	{
+		return fullBatches.deque();
+	}
+
+	void returnBatch(BamSortInputBatch * batch)
+	{
+		freeBatches.enque(batch);
+	}
+
+	/**
+	 * throw exception if the input thread failed
+	 **/
+	void checkFailed()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+
+		if ( failed )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << "bamsort input pipeline failed: " << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+	}
+};
+
+/**
+ * feed alignments from decoder to sorting container, fixing mate information for name collated input
+ **/
+template<typename container_type>
+static uint64_t putAlignmentsFixMates(
+	libmaus::bambam::BamAlignmentDecoder & dec,
+	BamSortFixMatesInfo const & fixinfo,
+	container_type & BEC,
+	int const verbose
+)
+{
+	uint64_t incnt = 0;
+
+	// current alignment
+	libmaus::bambam::BamAlignment & curalgn = dec.getAlignment();
+	// previous alignment
+	libmaus::bambam::BamAlignment prevalgn;
+	// previous alignment valid
+	bool prevalgnvalid = false;
+	
+	while ( dec.readAlignment() )
+	{
+		if ( curalgn.isSecondary() || curalgn.isSupplementary() )
+		{
+			BEC.putAlignment(curalgn);
+		}
+		else if ( prevalgnvalid )
+		{
+			// different name
+			if ( strcmp(curalgn.getName(),prevalgn.getName()) )
+			{
+				BEC.putAlignment(prevalgn);
+				curalgn.swap(prevalgn);
+			}
+			// same name
+			else
+			{
+				fixinfo.fixPair(prevalgn,curalgn);
+				BEC.putAlignment(prevalgn);
+				BEC.putAlignment(curalgn);
+				prevalgnvalid = false;
+			}
+		}
+		else
+		{
+			prevalgn.swap(curalgn);
+			prevalgnvalid = true;
+		}
+		
+		if ( verbose && ( ( ++incnt & ((1ull<<20)-1) ) == 0 ) )
+			std::cerr << "[V] " << incnt << std::endl;
+	}
+	
+	if ( prevalgnvalid )
+	{
+		BEC.putAlignment(prevalgn);
+		prevalgnvalid = false;
+	}
+
+	return incnt;
+}
+
+/**
+ * feed alignments from input pipeline to sorting container
+ **/
+template<typename container_type>
+static uint64_t putAlignmentsPipelined(
+	libmaus::bambam::BamAlignmentDecoder & dec,
+	BamSortFixMatesInfo const & fixinfo,
+	container_type & BEC,
+	uint64_t const numthreads,
+	uint64_t const batchsize,
+	uint64_t const numbatches,
+	int const verbose
+)
+{
+	BamSortInputPipeline pipeline(dec,fixinfo,numthreads,batchsize,numbatches);
+	pipeline.start();
+
+	uint64_t incnt = 0;
+	BamSortInputBatch * batch = 0;
+
+	try
+	{
+		while ( (batch = pipeline.getBatch()) )
+		{
+			for ( uint64_t i = 0; i < batch->order.size(); ++i )
+				BEC.putAlignment(batch->A[batch->order[i]]);
+
+			uint64_t const previncnt = incnt;
+			incnt += batch->order.size();
+
+			if ( verbose && ((previncnt >> 20) != (incnt >> 20)) )
+				std::cerr << "[V] " << (incnt >> 20) << "M" << std::endl;
+
+			pipeline.returnBatch(batch);
+			batch = 0;
+		}
+	}
+	catch(...)
+	{
+		// hand batches back to the input thread until it reaches the end of stream marker,
+		// otherwise it may stay blocked waiting for a free batch
+		if ( batch )
+			pipeline.returnBatch(batch);
+		while ( (batch = pipeline.getBatch()) )
+			pipeline.returnBatch(batch);
+
+		pipeline.join();
+		throw;
+	}
+
+	pipeline.join();
+	pipeline.checkFailed();
+
+	return incnt;
+}
+
+/**
+ * sort using the thread pool engine shared with bamparsort
+ **/
+static int bamsortThreadPool(::libmaus::util::ArgInfo const & arginfo, bool const markduplicates)
+{
+	if ( markduplicates )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "markduplicates is not supported by sortengine=threadpool" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	::libmaus::util::ArgInfo parinfo(arginfo);
+	
+	// map bamsort arguments to their thread pool engine equivalents if the latter are not given
+	if ( (! parinfo.hasArg("numthreads")) && parinfo.hasArg("sortthreads") )
+		parinfo.replaceKey("numthreads",parinfo.getUnparsedValue("sortthreads","1"));
+	if ( (! parinfo.hasArg("tmpfileprefix")) && parinfo.hasArg("tmpfile") )
+		parinfo.replaceKey("tmpfileprefix",parinfo.getUnparsedValue("tmpfile",""));
+	
+	return bamThreadPoolSort(parinfo,"bamsort");
+}
 
 int bamsort(::libmaus::util::ArgInfo const & arginfo)
 {
@@ -94,6 +448,20 @@ int bamsort(::libmaus::util::ArgInfo const & arginfo)
 	bool const markduplicates = arginfo.getValue<int>("markduplicates",getDefaultMarkDuplicates());
 
 	std::string const inputformat = arginfo.getUnparsedValue("inputformat",getDefaultInputFormat());
+	
+	std::string const sortengine = arginfo.getUnparsedValue("sortengine",getDefaultSortEngine());
+	
+	if ( sortengine == "threadpool" )
+	{
+		return bamsortThreadPool(arginfo,markduplicates);
+	}
+	else if ( sortengine != "default" )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "unknown sort engine " << sortengine << " (supported are default and threadpool)" << std::endl;
+		se.finish();
+		throw se;
+	}
 
 	// prefix for tmp files
 	std::string const tmpfilenamebase = arginfo.getValue<std::string>("tmpfile",arginfo.getDefaultTmpFileName());
@@ -102,6 +470,9 @@ int bamsort(::libmaus::util::ArgInfo const & arginfo)
 	uint64_t blockmem = arginfo.getValue<uint64_t>("blockmb",getDefaultBlockSize())*1024*1024;
 	std::string const sortorder = arginfo.getValue<std::string>("SO","coordinate");
 	uint64_t sortthreads = arginfo.getValue<uint64_t>("sortthreads",getDefaultSortThreads());
+	bool const pipeline = arginfo.getValue<int>("pipeline",getDefaultPipeline());
+	uint64_t const pipelinebatchsize = arginfo.getValueUnsignedNumeric<uint64_t>("pipelinebatchsize",getDefaultPipelineBatchSize());
+	uint64_t const pipelinebatches = arginfo.getValueUnsignedNumeric<uint64_t>("pipelinebatches",getDefaultPipelineBatches());
 
 	// input decoder wrapper
 	libmaus::bambam::BamAlignmentDecoderWrapper::unique_ptr_type decwrapper(
@@ -189,72 +560,9 @@ int bamsort(::libmaus::util::ArgInfo const & arginfo)
 		sort_order = sort_order_queryname;
 	}
 
-	bool const havetag = arginfo.hasArg("tag");
-	std::string const tag = arginfo.getUnparsedValue("tag","no tag");
-
-	if ( havetag && (tag.size() != 2 || (!isalpha(tag[0])) || (!isalnum(tag[1])) ) )
-	{
-		::libmaus::exception::LibMausException se;
-		se.getStream() << "tag " << tag << " is invalid" << std::endl;
-		se.finish();
-		throw se;			
-	}
-	
-	// nucl tag field
-	bool const havenucltag = arginfo.hasArg("nucltag");
-	std::string const nucltag = arginfo.getUnparsedValue("nucltag","no tag");
-
-	if ( havenucltag && (nucltag.size() != 2 || (!isalpha(nucltag[0])) || (!isalnum(nucltag[1])) ) )
-	{
-		::libmaus::exception::LibMausException se;
-		se.getStream() << "nucltag " << tag << " is invalid" << std::endl;
-		se.finish();
-		throw se;			
-	}
-	
-	if ( havetag && havenucltag )
-	{
-		::libmaus::exception::LibMausException se;
-		se.getStream() << "tag and nucltag are mutually exclusive" << std::endl;
-		se.finish();
-		throw se;					
-	}
-	
-	enum tag_type_enum
-	{
-		tag_type_none,
-		tag_type_string,
-		tag_type_nucleotide
-	};
-	tag_type_enum tag_type;
-	
-	if ( havetag )
-		tag_type = tag_type_string;
-	else if ( havenucltag )
-		tag_type = tag_type_nucleotide;
-	else
-		tag_type = tag_type_none;
-
-	bool addMSMC = arginfo.getValue<int>("adddupmarksupport",getDefaultAddDupMarkSupport());
-	bool fixmates = arginfo.getValue<int>("fixmates",getDefaultFixMates());
-	
-	if ( (havetag || havenucltag) && (!addMSMC) )
-	{
-		std::cerr << "[W] tag or nucltag is enabled, forcing adddupmarksupport=1" << std::endl;
-		addMSMC = true;
-	}
-	
-	if ( markduplicates && (!addMSMC) )
-	{
-		std::cerr << "[W] markduplicates is enabled, forcing adddupmarksupport=1" << std::endl;
-		addMSMC = true;		
-	}
-	
-	if ( addMSMC && ! fixmates )
-	{
-		std::cerr << "[W] adddupmarksupport is enabled, forcing fixmates=1" << std::endl;
-		fixmates = true;
-	}
+	BamSortFixMatesInfo::unique_ptr_type const Pfixinfo(BamSortFixMatesInfo::construct(arginfo,markduplicates));
+	BamSortFixMatesInfo const & fixinfo = *Pfixinfo;
+	bool const fixmates = fixinfo.fixmates;
 
 	libmaus::bambam::BamBlockWriterBase::unique_ptr_type Uout ( libmaus::bambam::BamBlockWriterBaseFactory::construct(uphead, arginfo, Pcbs) );
 	libmaus::bambam::BamBlockWriterBase * Pout = Uout.get();
@@ -280,81 +588,10 @@ int bamsort(::libmaus::util::ArgInfo const & arginfo)
 
 			if ( verbose )
 				std::cerr << "[V] Reading alignments from source." << std::endl;
-			uint64_t incnt = 0;
 
-			// current alignment
-			libmaus::bambam::BamAlignment & curalgn = dec.getAlignment();
-			// previous alignment
-			libmaus::bambam::BamAlignment prevalgn;
-			// previous alignment valid
-			bool prevalgnvalid = false;
-			// MQ field filter
-			libmaus::bambam::BamAuxFilterVector MQfilter;
-			libmaus::bambam::BamAuxFilterVector MSfilter;
-			libmaus::bambam::BamAuxFilterVector MCfilter;
-			libmaus::bambam::BamAuxFilterVector MTfilter;
-			MQfilter.set("MQ");
-			MSfilter.set("MS");
-			MCfilter.set("MC");
-			MTfilter.set("MT");
-			
-			while ( dec.readAlignment() )
-			{
-				if ( curalgn.isSecondary() || curalgn.isSupplementary() )
-				{
-					BEC.putAlignment(curalgn);
-				}
-				else if ( prevalgnvalid )
-				{
-					// different name
-					if ( strcmp(curalgn.getName(),prevalgn.getName()) )
-					{
-						BEC.putAlignment(prevalgn);
-						curalgn.swap(prevalgn);
-					}
-					// same name
-					else
-					{
-						libmaus::bambam::BamAlignment::fixMateInformation(prevalgn,curalgn,MQfilter);
-
-						if ( addMSMC )
-						{
-							libmaus::bambam::BamAlignment::addMateBaseScore(prevalgn,curalgn,MSfilter);
-							libmaus::bambam::BamAlignment::addMateCoordinate(prevalgn,curalgn,MCfilter);
-							
-							switch ( tag_type )
-							{
-								case tag_type_string:
-									libmaus::bambam::BamAlignment::addMateTag(prevalgn,curalgn,MTfilter,tag);
-									break;
-								case tag_type_nucleotide:
-									libmaus::bambam::BamAlignment::addMateTag(prevalgn,curalgn,MTfilter,nucltag);
-									break;
-								default:
-									break;
-							}
-						}
-
-						BEC.putAlignment(prevalgn);
-						BEC.putAlignment(curalgn);
-						prevalgnvalid = false;
-					}
-				}
-				else
-				{
-					prevalgn.swap(curalgn);
-					prevalgnvalid = true;
-				}
-				
-				if ( verbose && ( ( ++incnt & ((1ull<<20)-1) ) == 0 ) )
-					std::cerr << "[V] " << incnt << std::endl;
-			}
-			
-			if ( prevalgnvalid )
-			{
-				BEC.putAlignment(prevalgn);
-				prevalgnvalid = false;
-			}
+			uint64_t const incnt =
+				pipeline ? putAlignmentsPipelined(dec,fixinfo,BEC,sortthreads,pipelinebatchsize,pipelinebatches,verbose)
+				: putAlignmentsFixMates(dec,fixinfo,BEC,verbose);
 
 			if ( verbose )
 				std::cerr << "[V] read " << incnt << " alignments" << std::endl;
@@ -369,81 +606,10 @@ int bamsort(::libmaus::util::ArgInfo const & arginfo)
 			
 			if ( verbose )
 				std::cerr << "[V] Reading alignments from source." << std::endl;
-			uint64_t incnt = 0;
-			
-			// current alignment
-			libmaus::bambam::BamAlignment & curalgn = dec.getAlignment();
-			// previous alignment
-			libmaus::bambam::BamAlignment prevalgn;
-			// previous alignment valid
-			bool prevalgnvalid = false;
-			// MQ field filter
-			libmaus::bambam::BamAuxFilterVector MQfilter;
-			libmaus::bambam::BamAuxFilterVector MSfilter;
-			libmaus::bambam::BamAuxFilterVector MCfilter;
-			libmaus::bambam::BamAuxFilterVector MTfilter;
-			MQfilter.set("MQ");
-			MSfilter.set("MS");
-			MCfilter.set("MC");
-			MTfilter.set("MT");
-			
-			while ( dec.readAlignment() )
-			{
-				if ( curalgn.isSecondary() || curalgn.isSupplementary() )
-				{
-					BEC.putAlignment(curalgn);
-				}
-				else if ( prevalgnvalid )
-				{
-					// different name
-					if ( strcmp(curalgn.getName(),prevalgn.getName()) )
-					{
-						BEC.putAlignment(prevalgn);
-						curalgn.swap(prevalgn);
-					}
-					// same name
-					else
-					{
-						libmaus::bambam::BamAlignment::fixMateInformation(prevalgn,curalgn,MQfilter);
-
-						if ( addMSMC )
-						{
-							libmaus::bambam::BamAlignment::addMateBaseScore(prevalgn,curalgn,MSfilter);
-							libmaus::bambam::BamAlignment::addMateCoordinate(prevalgn,curalgn,MCfilter);
-
-							switch ( tag_type )
-							{
-								case tag_type_string:
-									libmaus::bambam::BamAlignment::addMateTag(prevalgn,curalgn,MTfilter,tag);
-									break;
-								case tag_type_nucleotide:
-									libmaus::bambam::BamAlignment::addMateTag(prevalgn,curalgn,MTfilter,nucltag);
-									break;
-								default:
-									break;
-							}
-						}
-
-						BEC.putAlignment(prevalgn);
-						BEC.putAlignment(curalgn);
-						prevalgnvalid = false;
-					}
-				}
-				else
-				{
-					prevalgn.swap(curalgn);
-					prevalgnvalid = true;
-				}
-				
-				if ( verbose && ( ( ++incnt & ((1ull<<20)-1) ) == 0 ) )
-					std::cerr << "[V] " << incnt << std::endl;
-			}
-			
-			if ( prevalgnvalid )
-			{
-				BEC.putAlignment(prevalgn);
-				prevalgnvalid = false;
-			}
+
+			uint64_t const incnt =
+				pipeline ? putAlignmentsPipelined(dec,fixinfo,BEC,sortthreads,pipelinebatchsize,pipelinebatches,verbose)
+				: putAlignmentsFixMates(dec,fixinfo,BEC,verbose);
 			
 			if ( verbose )
 				std::cerr << "[V] read " << incnt << " alignments" << std::endl;
@@ -474,12 +640,19 @@ int bamsort(::libmaus::util::ArgInfo const & arginfo)
 				std::cerr << "[V] Reading alignments from source." << std::endl;
 			uint64_t incnt = 0;
 			
-			while ( dec.readAlignment() )
+			if ( pipeline )
 			{
-				BEC.putAlignment(dec.getAlignment());
-				incnt++;
-				if ( verbose && (incnt % (1024*1024) == 0) )
-					std::cerr << "[V] " << incnt/(1024*1024) << "M" << std::endl;
+				incnt = putAlignmentsPipelined(dec,fixinfo,BEC,sortthreads,pipelinebatchsize,pipelinebatches,verbose);
+			}
+			else
+			{
+				while ( dec.readAlignment() )
+				{
+					BEC.putAlignment(dec.getAlignment());
+					incnt++;
+					if ( verbose && (incnt % (1024*1024) == 0) )
+						std::cerr << "[V] " << incnt/(1024*1024) << "M" << std::endl;
+				}
 			}
 
 			if ( verbose )
@@ -504,12 +677,19 @@ int bamsort(::libmaus::util::ArgInfo const & arginfo)
 				std::cerr << "[V] Reading alignments from source." << std::endl;
 			uint64_t incnt = 0;
 			
-			while ( dec.readAlignment() )
+			if ( pipeline )
 			{
-				BEC.putAlignment(dec.getAlignment());
-				incnt++;
-				if ( verbose && (incnt % (1024*1024) == 0) )
-					std::cerr << "[V] " << incnt/(1024*1024) << "M" << std::endl;
+				incnt = putAlignmentsPipelined(dec,fixinfo,BEC,sortthreads,pipelinebatchsize,pipelinebatches,verbose);
+			}
+			else
+			{
+				while ( dec.readAlignment() )
+				{
+					BEC.putAlignment(dec.getAlignment());
+					incnt++;
+					if ( verbose && (incnt % (1024*1024) == 0) )
+						std::cerr << "[V] " << incnt/(1024*1024) << "M" << std::endl;
+				}
 			}
 			
 			if ( verbose )
@@ -599,6 +779,13 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "tag=<[a-zA-Z][a-zA-Z0-9]>", "aux field id for tag string extraction (adddupmarksupport=1 only)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "nucltag=<[a-zA-Z][a-zA-Z0-9]>", "aux field id for nucleotide tag extraction (adddupmarksupport=1 only)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( std::string("markduplicates=<[")+::biobambam::Licensing::formatNumber(getDefaultMarkDuplicates())+"]>", "mark duplicates (only when input name collated and output coordinate sorted, disabled by default)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("pipeline=<[")+::biobambam::Licensing::formatNumber(getDefaultPipeline())+"]>", "decode and fix mates in a separate thread while sorting (disabled by default)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("pipelinebatchsize=<[")+::biobambam::Licensing::formatNumber(getDefaultPipelineBatchSize())+"]>", "number of alignments per input batch (pipeline=1 only)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("pipelinebatches=<[")+::biobambam::Licensing::formatNumber(getDefaultPipelineBatches())+"]>", "number of input batches in flight (pipeline=1 only)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("sortthreads=<[")+::biobambam::Licensing::formatNumber(getDefaultSortThreads())+"]>", "number of threads used for sorting (and mate fixing for pipeline=1)" ) );
+
+				V.push_back ( std::pair<std::string,std::string> ( std::string("sortengine=<[")+getDefaultSortEngine()+"]>", "sorting engine (default or threadpool)" ) );
+				bamThreadPoolSortHelp(V," (sortengine=threadpool only)");
 
 				::biobambam::Licensing::printMap(std::cerr,V);
 
@@ -25,13 +25,18 @@
 #include <libmaus/bambam/BamBlockWriterBaseFactory.hpp>
 #include <libmaus/bambam/BamCat.hpp>
 #include <libmaus/bambam/BamWriter.hpp>
+#include <libmaus/util/TempFileRemovalContainer.hpp>
 
+#include <biobambam/BamWriterPool.hpp>
 #include <biobambam/Licensing.hpp>
 
 static int getDefaultLevel() { return Z_DEFAULT_COMPRESSION; }
 static int getDefaultVerbose() { return 1; }
 static uint64_t getDefaultN() { return 64*1024; }
 static std::string getDefaultFilePrefix(::libmaus::util::ArgInfo const & arginfo) { return arginfo.getDefaultTmpFileName(); }
+static uint64_t getDefaultOutputThreads() { return 1; }
+static int getDefaultMD5() { return 0; }
+static int getDefaultIndex() { return 0; }
 
 ::libmaus::bambam::BamHeader::unique_ptr_type updateHeader(
 	::libmaus::util::ArgInfo const & arginfo,
@@ -65,18 +70,26 @@ int bamsplit(libmaus::util::ArgInfo const & arginfo)
 		throw se;
 	}
 
-	int const level = libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",getDefaultLevel()));
+	// the output files are compressed by the pool using zlib
+	int const level = BamWriterPool::checkCompressionLevel(
+		libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",getDefaultLevel()))
+	);
 	int const verbose = arginfo.getValue<int>("verbose",getDefaultVerbose());
 	uint64_t const n = arginfo.getValue<int>("n",getDefaultN());
 	std::string const prefix = arginfo.getUnparsedValue("prefix",getDefaultFilePrefix(arginfo));
+	uint64_t const outputthreads = std::max(arginfo.getValueUnsignedNumeric<uint64_t>("outputthreads",getDefaultOutputThreads()),static_cast<uint64_t>(1));
+	bool const md5 = arginfo.getValue<unsigned int>("md5",getDefaultMD5());
+	bool const index = arginfo.getValue<unsigned int>("index",getDefaultIndex());
+
+	::libmaus::util::TempFileRemovalContainer::setup();
 
 	libmaus::bambam::BamDecoder bamdec(std::cin);
 	libmaus::bambam::BamAlignment const & algn = bamdec.getAlignment();
 	libmaus::bambam::BamHeader const & header = bamdec.getHeader();
 	::libmaus::bambam::BamHeader::unique_ptr_type uphead(updateHeader(arginfo,header));
 
-	libmaus::aio::CheckedOutputStream::unique_ptr_type COS;
-	libmaus::bambam::BamWriter::unique_ptr_type writer;
+	// output files are compressed and written by the pool while decoding continues
+	BamWriterPool pool(outputthreads,level,BamWriterPool::getDefaultChunkSize(),4*outputthreads,md5,index,prefix);
 	
 	uint64_t c = 0;
 	uint64_t f = 0;
@@ -84,38 +97,20 @@ int bamsplit(libmaus::util::ArgInfo const & arginfo)
 	{
 		if ( c++ % n == 0 )
 		{
-			writer.reset();
-			if ( COS )
-			{
-				COS->flush();
-				COS->close();
-			}
-			COS.reset();
-			
 			std::ostringstream fnostr;
 			fnostr << prefix << "_" << std::setw(6) << std::setfill('0') << f++ << std::setw(0) << ".bam";
 			std::string const fn = fnostr.str();
 			
-			libmaus::aio::CheckedOutputStream::unique_ptr_type tCOS(new libmaus::aio::CheckedOutputStream(fn));
-			COS = UNIQUE_PTR_MOVE(tCOS);
-			
-			libmaus::bambam::BamWriter::unique_ptr_type twriter(new libmaus::bambam::BamWriter(*COS,*uphead,level));
-			writer = UNIQUE_PTR_MOVE(twriter);
+			pool.open(fn,*uphead);
 			
 			if ( verbose )
 				std::cerr << "[V] opened file " << fn << std::endl;
 		}
 		
-		algn.serialise(writer->getStream());
+		pool.put(algn);
 	}
 	
-	writer.reset();
-	if ( COS )
-	{
-		COS->flush();
-		COS->close();
-	}
-	COS.reset();
+	pool.finish();
 
 	return EXIT_SUCCESS;
 }
@@ -153,6 +148,9 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "prefix=<["+getDefaultFilePrefix(arginfo)+"]>", "default output file prefix" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "level=<["+::biobambam::Licensing::formatNumber(getDefaultLevel())+"]>", libmaus::bambam::BamBlockWriterBaseFactory::getBamOutputLevelHelpText() ) );
 				V.push_back ( std::pair<std::string,std::string> ( "verbose=<["+::biobambam::Licensing::formatNumber(getDefaultVerbose())+"]>", "print progress report" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "outputthreads=<["+::biobambam::Licensing::formatNumber(getDefaultOutputThreads())+"]>", "output compression threads shared by all output files (default: 1)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "md5=<["+::biobambam::Licensing::formatNumber(getDefaultMD5())+"]>", "create md5 check sum file <file>.md5 for each output file (default: 0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "index=<["+::biobambam::Licensing::formatNumber(getDefaultIndex())+"]>", "create BAM index <file>.bai for each output file (default: 0)" ) );
 
 				::biobambam::Licensing::printMap(std::cerr,V);
 
@@ -19,6 +19,7 @@
 
 #include <biobambam/BamBamConfig.hpp>
 #include <biobambam/Licensing.hpp>
+#include <biobambam/PartitionedCollatingBamDecoder.hpp>
 
 #include <iomanip>
 
@@ -31,12 +32,22 @@
 #include <libmaus/bambam/BamToFastqOutputFileSet.hpp>
 #include <libmaus/bambam/CircularHashCollatingBamDecoder.hpp>
 #include <libmaus/lz/GzipOutputStream.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
 #include <libmaus/util/MemUsage.hpp>
 #include <libmaus/util/TempFileRemovalContainer.hpp>
 
 #include <libmaus/aio/LineSplittingPosixFdOutputStream.hpp>
 #include <libmaus/lz/LineSplittingGzipOutputStream.hpp>
 
+#include <cstring>
+#include <zlib.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 static std::string getDefaultInputFormat()
 {
 	return "bam";
@@ -82,6 +93,21 @@ std::string getDefaultReadGroupSuffixS(bool const gz, uint64_t const split)
 	return std::string("_s.fq") + ((gz && split) ? ".gz" : "");
 }
 
+uint64_t getDefaultColThreads()
+{
+	return 1;
+}
+
+uint64_t getDefaultOutputThreads()
+{
+	return 1;
+}
+
+uint64_t getDefaultOutputBatchSize()
+{
+	return 16*1024*1024;
+}
+
 uint64_t getDefaultSplit()
 {
 	return 0;
@@ -310,16 +336,453 @@ std::ostream & operator<<(std::ostream & out, CollateCombs const & combs)
 	return out;
 };
 
+/**
+ * compress n bytes starting at data as a complete gzip member and store the result in out.
+ * Gzip members can be concatenated, so the members produced for consecutive blocks form a valid
+ * gzip file.
+ **/
+static void bamtofastqGzipMember(char const * data, uint64_t const n, int const level, std::vector<char> & out)
+{
+	z_stream strm;
+	memset(&strm,0,sizeof(z_stream));
+	strm.zalloc = Z_NULL;
+	strm.zfree = Z_NULL;
+	strm.opaque = Z_NULL;
+
+	// window bits 15 + 16 produces a gzip header and footer
+	if ( deflateInit2(&strm,level,Z_DEFLATED,15+16,8,Z_DEFAULT_STRATEGY) != Z_OK )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "bamtofastqGzipMember: deflateInit2 failed" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	out.resize(deflateBound(&strm,n));
+
+	strm.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	strm.avail_in = n;
+	strm.next_out = reinterpret_cast<Bytef *>(&out[0]);
+	strm.avail_out = out.size();
+
+	int const r = deflate(&strm,Z_FINISH);
+
+	if ( r != Z_STREAM_END )
+	{
+		deflateEnd(&strm);
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "bamtofastqGzipMember: deflate failed" << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	out.resize(out.size() - strm.avail_out);
+	deflateEnd(&strm);
+}
+
+/**
+ * output files for the F, F2, S, O and O2 categories of the threaded output mode. Categories
+ * using the same file name (including standard output) share one output file.
+ **/
+struct BamToFastQParallelOutputFiles
+{
+	enum output_category { category_F = 0, category_F2 = 1, category_S = 2, category_O = 3, category_O2 = 4 };
+
+	std::vector<std::string> filenames;
+	libmaus::autoarray::AutoArray< ::libmaus::aio::PosixFdOutputStream::unique_ptr_type > files;
+	std::vector<std::ostream *> streams;
+	// map category to file id
+	uint64_t categorymap[5];
+
+	BamToFastQParallelOutputFiles(libmaus::util::ArgInfo const & arginfo)
+	{
+		char const * keys[] = { "F", "F2", "S", "O", "O2" };
+		std::map<std::string,uint64_t> filemap;
+
+		for ( uint64_t i = 0; i < sizeof(keys)/sizeof(keys[0]); ++i )
+		{
+			std::string const fn = arginfo.getUnparsedValue(keys[i],"-");
+
+			if ( filemap.find(fn) == filemap.end() )
+			{
+				uint64_t const id = filenames.size();
+				filemap[fn] = id;
+				filenames.push_back(fn);
+			}
+
+			categorymap[i] = filemap.find(fn)->second;
+		}
+
+		files = libmaus::autoarray::AutoArray< ::libmaus::aio::PosixFdOutputStream::unique_ptr_type >(filenames.size());
+
+		for ( uint64_t i = 0; i < filenames.size(); ++i )
+			if ( filenames[i] == "-" )
+			{
+				streams.push_back(&std::cout);
+			}
+			else
+			{
+				::libmaus::aio::PosixFdOutputStream::unique_ptr_type tptr(
+					new ::libmaus::aio::PosixFdOutputStream(filenames[i],256*1024)
+				);
+				files[i] = UNIQUE_PTR_MOVE(tptr);
+				streams.push_back(files[i].get());
+			}
+	}
+
+	uint64_t size() const
+	{
+		return filenames.size();
+	}
+};
+
+/**
+ * batch of collated alignments handed from the collating thread to the output thread. The
+ * alignment data is copied as the collator reuses its buffers.
+ **/
+struct BamToFastQOutputBatch
+{
+	typedef BamToFastQOutputBatch this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	struct Entry
+	{
+		BamToFastQParallelOutputFiles::output_category category;
+		uint64_t offa;
+		uint64_t blocksizea;
+		uint64_t offb;
+		uint64_t blocksizeb;
+	};
+
+	libmaus::autoarray::AutoArray<uint8_t> D;
+	uint64_t fill;
+	std::vector<Entry> E;
+
+	BamToFastQOutputBatch() : fill(0) {}
+
+	void reset()
+	{
+		fill = 0;
+		E.resize(0);
+	}
+
+	uint64_t push(uint8_t const * p, uint64_t const n)
+	{
+		if ( fill + n > D.size() )
+		{
+			libmaus::autoarray::AutoArray<uint8_t> N(std::max(2*D.size(),fill+n),false);
+			std::copy(D.begin(),D.begin()+fill,N.begin());
+			D = N;
+		}
+
+		uint64_t const off = fill;
+		std::copy(p,p+n,D.begin()+fill);
+		fill += n;
+		return off;
+	}
+
+	void push(
+		BamToFastQParallelOutputFiles::output_category const category,
+		uint8_t const * Da, uint64_t const blocksizea,
+		uint8_t const * Db = 0, uint64_t const blocksizeb = 0
+	)
+	{
+		Entry entry;
+		entry.category = category;
+		entry.blocksizea = blocksizea;
+		entry.offa = push(Da,blocksizea);
+		entry.blocksizeb = blocksizeb;
+		entry.offb = Db ? push(Db,blocksizeb) : 0;
+		E.push_back(entry);
+	}
+};
+
+/**
+ * output thread for outputthreads > 1. Batches are split into packages, the packages are
+ * formatted and (for gz=1) compressed as independent gzip members in parallel and the results
+ * are written in input order for each output file.
+ **/
 template<bamtofastq_conversion_type conversion_type>
+struct BamToFastQParallelOutput : public libmaus::parallel::PosixThread
+{
+	typedef BamToFastQParallelOutput<conversion_type> this_type;
+	typedef typename libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	BamToFastQParallelOutputFiles & files;
+	uint64_t const numthreads;
+	uint64_t const packagesperbatch;
+	bool const gz;
+	int const level;
+
+	libmaus::autoarray::AutoArray<BamToFastQOutputBatch::unique_ptr_type> batches;
+	libmaus::parallel::SynchronousQueue<BamToFastQOutputBatch *> freeBatches;
+	libmaus::parallel::SynchronousQueue<BamToFastQOutputBatch *> fullBatches;
+
+	// formatted and compressed data for each package and output file
+	std::vector< std::vector<char> > outdata;
+	std::vector< std::vector<char> > gzdata;
+	// number of gzip members written per file
+	std::vector<uint64_t> members;
+
+	libmaus::parallel::PosixSpinLock byteslock;
+	uint64_t bytes;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	bool failed;
+	std::string failmessage;
+
+	BamToFastQParallelOutput(
+		BamToFastQParallelOutputFiles & rfiles,
+		uint64_t const rnumthreads,
+		bool const rgz,
+		int const rlevel,
+		uint64_t const numbatches = 3
+	)
+	: files(rfiles), numthreads(rnumthreads), packagesperbatch(4*rnumthreads), gz(rgz), level(rlevel),
+	  batches(std::max(numbatches,static_cast<uint64_t>(2))), members(files.size()), bytes(0), failed(false)
+	{
+		for ( uint64_t i = 0; i < batches.size(); ++i )
+		{
+			BamToFastQOutputBatch::unique_ptr_type tptr(new BamToFastQOutputBatch);
+			batches[i] = UNIQUE_PTR_MOVE(tptr);
+			freeBatches.enque(batches[i].get());
+		}
+	}
+
+	uint64_t format(uint8_t const * D, uint64_t const blocksize, libmaus::autoarray::AutoArray<uint8_t> & T) const
+	{
+		switch ( conversion_type )
+		{
+			case bamtofastq_conversion_type_fasta:
+				return libmaus::bambam::BamAlignmentDecoderBase::putFastA(D,T);
+			case bamtofastq_conversion_type_fastq_try_oq:
+				return libmaus::bambam::BamAlignmentDecoderBase::putFastQTryOQ(D,blocksize,T);
+			case bamtofastq_conversion_type_fastq:
+			default:
+				return libmaus::bambam::BamAlignmentDecoderBase::putFastQ(D,T);
+		}
+	}
+
+	void processBatch(BamToFastQOutputBatch const & batch)
+	{
+		uint64_t const numentries = batch.E.size();
+		uint64_t const numpackages = std::min(numentries,packagesperbatch);
+		uint64_t const numfiles = files.size();
+
+		if ( outdata.size() < numpackages * numfiles )
+		{
+			outdata.resize(numpackages * numfiles);
+			gzdata.resize(numpackages * numfiles);
+		}
+
+		libmaus::parallel::PosixSpinLock faillock;
+		bool packagefailed = false;
+		std::string packagefailmessage;
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( int64_t p = 0; p < static_cast<int64_t>(numpackages); ++p )
+		{
+			try
+			{
+				uint64_t const low = (p * numentries) / numpackages;
+				uint64_t const high = ((p+1) * numentries) / numpackages;
+				std::vector<char> * const out = &outdata[p * numfiles];
+				libmaus::autoarray::AutoArray<uint8_t> T;
+
+				for ( uint64_t f = 0; f < numfiles; ++f )
+					out[f].resize(0);
+
+				for ( uint64_t i = low; i < high; ++i )
+				{
+					BamToFastQOutputBatch::Entry const & entry = batch.E[i];
+
+					if ( entry.category == BamToFastQParallelOutputFiles::category_F )
+					{
+						std::vector<char> & outa = out[files.categorymap[BamToFastQParallelOutputFiles::category_F]];
+						uint64_t const la = format(batch.D.begin() + entry.offa,entry.blocksizea,T);
+						outa.insert(outa.end(),reinterpret_cast<char const *>(T.begin()),reinterpret_cast<char const *>(T.begin())+la);
+
+						std::vector<char> & outb = out[files.categorymap[BamToFastQParallelOutputFiles::category_F2]];
+						uint64_t const lb = format(batch.D.begin() + entry.offb,entry.blocksizeb,T);
+						outb.insert(outb.end(),reinterpret_cast<char const *>(T.begin()),reinterpret_cast<char const *>(T.begin())+lb);
+					}
+					else
+					{
+						std::vector<char> & outa = out[files.categorymap[entry.category]];
+						uint64_t const la = format(batch.D.begin() + entry.offa,entry.blocksizea,T);
+						outa.insert(outa.end(),reinterpret_cast<char const *>(T.begin()),reinterpret_cast<char const *>(T.begin())+la);
+					}
+				}
+
+				if ( gz )
+					for ( uint64_t f = 0; f < numfiles; ++f )
+						if ( out[f].size() )
+							bamtofastqGzipMember(&(out[f][0]),out[f].size(),level,gzdata[p * numfiles + f]);
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus::parallel::ScopePosixSpinLock slock(faillock);
+				packagefailed = true;
+				packagefailmessage = ex.what();
+			}
+		}
+
+		if ( packagefailed )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << packagefailmessage;
+			se.finish();
+			throw se;
+		}
+
+		// write packages in order
+		uint64_t batchbytes = 0;
+		for ( uint64_t p = 0; p < numpackages; ++p )
+			for ( uint64_t f = 0; f < numfiles; ++f )
+			{
+				std::vector<char> const & plain = outdata[p * numfiles + f];
+
+				if ( plain.size() )
+				{
+					std::vector<char> const & data = gz ? gzdata[p * numfiles + f] : plain;
+					files.streams[f]->write(&data[0],data.size());
+					members[f] += 1;
+					batchbytes += plain.size();
+				}
+			}
+
+		for ( uint64_t f = 0; f < numfiles; ++f )
+			if ( ! *(files.streams[f]) )
+			{
+				::libmaus::exception::LibMausException se;
+				se.getStream() << "failed to write to " << files.filenames[f] << std::endl;
+				se.finish();
+				throw se;
+			}
+
+		libmaus::parallel::ScopePosixSpinLock slock(byteslock);
+		bytes += batchbytes;
+	}
+
+	void * run()
+	{
+		BamToFastQOutputBatch * batch = 0;
+
+		while ( (batch = fullBatches.deque()) )
+		{
+			bool const skip = checkFailedNoThrow();
+
+			if ( ! skip )
+			{
+				try
+				{
+					processBatch(*batch);
+				}
+				catch(std::exception const & ex)
+				{
+					libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+					failed = true;
+					failmessage = ex.what();
+				}
+			}
+
+			freeBatches.enque(batch);
+		}
+
+		try
+		{
+			if ( ! checkFailedNoThrow() )
+			{
+				// write an empty gzip member for files without any data
+				if ( gz )
+					for ( uint64_t f = 0; f < files.size(); ++f )
+						if ( ! members[f] )
+						{
+							std::vector<char> data;
+							bamtofastqGzipMember(0,0,level,data);
+							files.streams[f]->write(&data[0],data.size());
+						}
+
+				for ( uint64_t f = 0; f < files.size(); ++f )
+				{
+					files.streams[f]->flush();
+
+					if ( ! *(files.streams[f]) )
+					{
+						::libmaus::exception::LibMausException se;
+						se.getStream() << "failed to flush " << files.filenames[f] << std::endl;
+						se.finish();
+						throw se;
+					}
+				}
+			}
+		}
+		catch(std::exception const & ex)
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+			failed = true;
+			failmessage = ex.what();
+		}
+
+		return 0;
+	}
+
+	BamToFastQOutputBatch * getFreeBatch()
+	{
+		BamToFastQOutputBatch * batch = freeBatches.deque();
+		batch->reset();
+		return batch;
+	}
+
+	/**
+	 * pass batch to output thread, a null pointer signals the end of the stream
+	 **/
+	void putBatch(BamToFastQOutputBatch * batch)
+	{
+		fullBatches.enque(batch);
+	}
+
+	uint64_t getBytes()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(byteslock);
+		return bytes;
+	}
+
+	bool checkFailedNoThrow()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+		return failed;
+	}
+
+	/**
+	 * throw exception if the output thread failed
+	 **/
+	void checkFailed()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+
+		if ( failed )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << "bamtofastq output thread failed: " << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+	}
+};
+
+template<bamtofastq_conversion_type conversion_type, typename collator_type>
 void bamtofastqCollating(
 	libmaus::util::ArgInfo const & arginfo,
-	libmaus::bambam::CircularHashCollatingBamDecoder & CHCBD
+	collator_type & CHCBD
 )
 {
 	if ( arginfo.getValue<unsigned int>("disablevalidation",0) )
 		CHCBD.disableValidation();
 
-	libmaus::bambam::CircularHashCollatingBamDecoder::OutputBufferEntry const * ob = 0;
+	typename collator_type::OutputBufferEntry const * ob = 0;
 	
 	// number of alignments written to files
 	uint64_t cnt = 0;
@@ -424,7 +887,7 @@ void bamtofastqCollating(
 		
 		libmaus::autoarray::AutoArray< std::ostream * > AOS(numoutputfiles);
 		libmaus::autoarray::AutoArray< uint64_t > filefrags(numoutputfiles);
-		int const level = std::min(9,std::max(-1,arginfo.getValue<int>("level",Z_DEFAULT_COMPRESSION)));
+		int const level = libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",Z_DEFAULT_COMPRESSION));
 		
 		if ( split )
 		{
@@ -632,6 +1095,90 @@ void bamtofastqCollating(
 			}
 		}
 	}
+	else if ( 
+		arginfo.getValueUnsignedNumeric<uint64_t>("outputthreads",getDefaultOutputThreads()) > 1 
+		&& 
+		! arginfo.getValueUnsignedNumeric("split",getDefaultSplit()) 
+	)
+	{
+		uint64_t const outputthreads = arginfo.getValueUnsignedNumeric<uint64_t>("outputthreads",getDefaultOutputThreads());
+		uint64_t const outputbatchsize = std::max(
+			arginfo.getValueUnsignedNumeric<uint64_t>("outputbatchsize",getDefaultOutputBatchSize()),
+			static_cast<uint64_t>(1)
+		);
+		bool const gz = arginfo.getValue<int>("gz",0);
+		int const level = libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",Z_DEFAULT_COMPRESSION));
+
+		BamToFastQParallelOutputFiles files(arginfo);
+		BamToFastQParallelOutput<conversion_type> output(files,outputthreads,gz,level);
+		output.start();
+
+		try
+		{
+			BamToFastQOutputBatch * batch = output.getFreeBatch();
+		
+			while ( (ob = CHCBD.process()) )
+			{
+				uint64_t const precnt = cnt;
+			
+				if ( ob->fpair )
+				{
+					batch->push(BamToFastQParallelOutputFiles::category_F,ob->Da,ob->blocksizea,ob->Db,ob->blocksizeb);
+					combs.pairs += 1;
+					cnt += 2;
+				}
+				else if ( ob->fsingle )
+				{
+					batch->push(BamToFastQParallelOutputFiles::category_S,ob->Da,ob->blocksizea);
+					combs.single += 1;
+					cnt += 1;
+				}
+				else if ( ob->forphan1 )
+				{
+					batch->push(BamToFastQParallelOutputFiles::category_O,ob->Da,ob->blocksizea);
+					combs.orphans1 += 1;
+					cnt += 1;
+				}
+				else if ( ob->forphan2 )
+				{
+					batch->push(BamToFastQParallelOutputFiles::category_O2,ob->Da,ob->blocksizea);
+					combs.orphans2 += 1;
+					cnt += 1;
+				}
+
+				if ( batch->fill >= outputbatchsize )
+				{
+					output.putBatch(batch);
+					batch = output.getFreeBatch();
+				}
+			
+				if ( precnt >> verbshift != cnt >> verbshift )
+				{
+					bcnt = output.getBytes();
+					std::cerr 
+						<< "[V] "
+						<< (cnt >> 20) 
+						<< "\t"
+						<< (static_cast<double>(bcnt)/(1024.0*1024.0))/rtc.getElapsedSeconds() << "MB/s"
+						<< "\t" << static_cast<double>(cnt)/rtc.getElapsedSeconds() << std::endl;
+				}
+			}
+
+			output.putBatch(batch);
+		}
+		catch(...)
+		{
+			// stop the output thread before passing the error on
+			output.putBatch(0);
+			output.join();
+			throw;
+		}
+
+		// end of stream marker
+		output.putBatch(0);
+		output.join();
+		output.checkFailed();
+	}
 	else
 	{		
 		libmaus::bambam::BamToFastqOutputFileSet OFS(arginfo);
@@ -760,22 +1307,23 @@ void bamtofastqCollating(
 		std::cerr << combs;
 }
 
+template<typename collator_type>
 void bamtofastqCollating(
 	libmaus::util::ArgInfo const & arginfo,
-	libmaus::bambam::CircularHashCollatingBamDecoder & CHCBD,
+	collator_type & CHCBD,
 	bamtofastq_conversion_type const conversion_type
 )
 {
 	switch ( conversion_type )
 	{
 		case bamtofastq_conversion_type_fasta:
-			bamtofastqCollating<bamtofastq_conversion_type_fasta>(arginfo,CHCBD);
+			bamtofastqCollating<bamtofastq_conversion_type_fasta,collator_type>(arginfo,CHCBD);
 			break;
 		case bamtofastq_conversion_type_fastq:
-			bamtofastqCollating<bamtofastq_conversion_type_fastq>(arginfo,CHCBD);
+			bamtofastqCollating<bamtofastq_conversion_type_fastq,collator_type>(arginfo,CHCBD);
 			break;
 		case bamtofastq_conversion_type_fastq_try_oq:
-			bamtofastqCollating<bamtofastq_conversion_type_fastq_try_oq>(arginfo,CHCBD);
+			bamtofastqCollating<bamtofastq_conversion_type_fastq_try_oq,collator_type>(arginfo,CHCBD);
 			break;
 	}
 }
@@ -816,9 +1364,26 @@ void bamtofastqCollating(libmaus::util::ArgInfo const & arginfo)
 		)
 	);
 	libmaus::bambam::BamAlignmentDecoder & decoder = decwrapper->getDecoder();
-	// collator
-	libmaus::bambam::CircularHashCollatingBamDecoder CHCBD(decoder,tmpfilename,excludeflags,hlog,sbs);
-	bamtofastqCollating(arginfo,CHCBD,conversion_type);
+	// number of collation threads
+	uint64_t const colthreads = arginfo.getValueUnsignedNumeric<uint64_t>("colthreads",getDefaultColThreads());
+
+	// far mate distance for the partitioned collator
+	uint64_t const colfar = arginfo.getValueUnsignedNumeric<uint64_t>("colfar",PartitionedCollatingBamDecoder::getDefaultFarDistance());
+
+	if ( colthreads > 1 || colfar )
+	{
+		// partitioned collator
+		uint64_t const colmem = arginfo.getValueUnsignedNumeric<uint64_t>("colmem",PartitionedCollatingBamDecoder::getDefaultMemLimit());
+		uint64_t const colbuckets = arginfo.getValueUnsignedNumeric<uint64_t>("colbuckets",PartitionedCollatingBamDecoder::getDefaultNumBuckets());
+		PartitionedCollatingBamDecoder PCBD(decoder,tmpfilename,excludeflags,colthreads,colmem,colfar,colbuckets);
+		bamtofastqCollating(arginfo,PCBD,conversion_type);
+	}
+	else
+	{
+		// collator
+		libmaus::bambam::CircularHashCollatingBamDecoder CHCBD(decoder,tmpfilename,excludeflags,hlog,sbs);
+		bamtofastqCollating(arginfo,CHCBD,conversion_type);
+	}
 	
 	std::cout.flush();
 }
@@ -1105,9 +1670,15 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "disablevalidation=<[0]>", "disable validation of input data" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "colhlog=<[18]>", "base 2 logarithm of hash table size used for collation" ) );
 				V.push_back ( std::pair<std::string,std::string> ( std::string("colsbs=<[")+libmaus::util::NumberSerialisation::formatNumber(32ull*1024*1024,0)+"]>", "size of hash table overflow list in bytes" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("colthreads=<[")+libmaus::util::NumberSerialisation::formatNumber(getDefaultColThreads(),0)+"]>", "number of partitioned collation threads for collate=1 (1: use single threaded collation unless colfar>0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("colmem=<[")+libmaus::util::NumberSerialisation::formatNumber(PartitionedCollatingBamDecoder::getDefaultMemLimit(),0)+"]>", "memory for reads waiting for their mate in the partitioned collation (colthreads>1 or colfar>0)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("colfar=<[")+libmaus::util::NumberSerialisation::formatNumber(PartitionedCollatingBamDecoder::getDefaultFarDistance(),0)+"]>", "collate mates mapped further apart than this in coordinate buckets after reading the input (0: off, uses partitioned collation)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("colbuckets=<[")+libmaus::util::NumberSerialisation::formatNumber(PartitionedCollatingBamDecoder::getDefaultNumBuckets(),0)+"]>", "number of coordinate buckets per collation thread if colfar>0" ) );
 				V.push_back ( std::pair<std::string,std::string> ( std::string("T=<[") + arginfo.getDefaultTmpFileName() + "]>" , "temporary file name" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "gz=<[0]>", "compress output streams in gzip format (default: 0)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "level=<[-1]>", std::string("compression setting if gz=1 (") + libmaus::bambam::BamBlockWriterBaseFactory::getLevelHelpText() + std::string(")")  ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("outputthreads=<[")+libmaus::util::NumberSerialisation::formatNumber(getDefaultOutputThreads(),0)+"]>", "number of threads used for formatting and compressing output if collate=1, outputperreadgroup=0 and split=0" ) );
+				V.push_back ( std::pair<std::string,std::string> ( std::string("outputbatchsize=<[")+libmaus::util::NumberSerialisation::formatNumber(getDefaultOutputBatchSize(),0)+"]>", "size of alignment data batches in bytes if outputthreads>1" ) );
 				V.push_back ( std::pair<std::string,std::string> ( std::string("fasta=<[")+libmaus::util::NumberSerialisation::formatNumber(getDefaultFastA(),0)+"]>", "output FastA instead of FastQ" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "inputbuffersize=<["+::biobambam::Licensing::formatNumber(BamToFastQInputFileStream::getDefaultBufferSize())+"]>", "size of input buffer" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "outputperreadgroup=<["+::biobambam::Licensing::formatNumber(getDefaultOutputPerReadgroup())+"]>", "split output per read group (for collate=1 only)" ) );
@@ -184,13 +184,36 @@ class StdISOInputSource : public xercesc::InputSource
 };
 
 #include <libmaus/util/ToUpperTable.hpp>
+#include <biobambam/IndexedFastAReader.hpp>
+
+static uint64_t getDefaultRefWindowSize() { return 64*1024; }
+static uint64_t getDefaultRefCacheSize() { return 1024; }
+
+std::string stripAfterSpace(std::string const & s)
+{
+	uint64_t firstspace = s.size();
+	
+	for ( uint64_t i = 0; i < s.size(); ++i )
+		if ( isspace(s[i]) )
+		{
+			firstspace = i;
+			break;
+		}
+		
+	return s.substr(0,firstspace);
+}
 
 struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::ErrorHandler
 {
 	libmaus::util::ToUpperTable const toup;
 	
-	std::map<std::string,std::string> const & ref;
-	std::map<std::string,std::string> const & queries;
+	// reference windows and query sequences
+	FastAWindowCache & ref;
+	IndexedFastAReader & queries;
+	// sequence of the query loadedQueryName
+	std::string loadedQueryName;
+	int64_t loadedQueryId;
+	std::string querySequence;
 
 	XercesUtf8Transcoder utf8transcoder;
 	
@@ -268,8 +291,6 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 	
 	uint64_t hspId;
 
-	std::map<std::string,uint64_t> refnametoid;
-	std::map<std::string,uint64_t> queriesnametoid;
 	libmaus::bambam::BamWriter & bamwriter;
 	
 	double hitFirstScore;
@@ -300,15 +321,32 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 		return false;
 	}
 
+	/*
+	 * load the sequence of query readName if it is not the current one, returns false if the query is unknown
+	 */
+	bool loadQuery()
+	{
+		if ( loadedQueryId < 0 || readName != loadedQueryName )
+		{
+			loadedQueryName = readName;
+			loadedQueryId = queries.getSequenceId(stripAfterSpace(readName));
+			
+			if ( loadedQueryId >= 0 )
+				queries.readSequence(loadedQueryId,querySequence);
+			else
+				querySequence = std::string();
+		}
+		
+		return loadedQueryId >= 0;
+	}
+
 	BlastNDocumentHandler(
-		std::map<std::string,std::string> const & rref,
-		std::map<std::string,std::string> const & rqueries,
-		std::map<std::string,uint64_t> rrefnametoid,
-		std::map<std::string,uint64_t> rqueriesnametoid,
+		FastAWindowCache & rref,
+		IndexedFastAReader & rqueries,
 		libmaus::bambam::BamWriter & rbamwriter,
 		double const rhitFrac,
 		std::vector<libmaus::bambam::CramRange> const * rranges
-	) : ref(rref), queries(rqueries), utf8transcoder(), readNameGatheringActive(false), readName(), readNameObtained(false), 
+	) : ref(rref), queries(rqueries), loadedQueryName(), loadedQueryId(-1), querySequence(), utf8transcoder(), readNameGatheringActive(false), readName(), readNameObtained(false), 
 		hitDefObtained(false), hitDefGatheringActive(false), hitDef(),
 		hitLenObtained(false), hitLenGatheringActive(false), hitLen(),	
 		hspBitScoreObtained(false), hspBitScoreGatheringActive(false), hspBitScore(),
@@ -327,7 +365,6 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 		hspQSeqObtained(false), hspQSeqGatheringActive(false), hspQSeq(),
 		hspHSeqObtained(false), hspHSeqGatheringActive(false), hspHSeq(),
 		hspId(0),
-		refnametoid(rrefnametoid), queriesnametoid(rqueriesnametoid),
 		bamwriter(rbamwriter),
 		hitFirstScore(-1),
 		hitFrac(rhitFrac),
@@ -655,7 +692,7 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 				hspAlignLenObtained &&
 				hspQSeqObtained &&
 				hspHSeqObtained &&
-				(queries.find(readName) != queries.end());
+				loadQuery();
 
 			int64_t const thisHitScore = hspScoreObtained ?  parseNumber<int64_t>(hspScore) : -1;
 				
@@ -663,8 +700,8 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 				hitFirstScore = thisHitScore;
 
 			// reference
-			std::map<std::string,std::string>::const_iterator hita = 
-				ok ? ref.find(hitDef) : std::map<std::string,std::string>::const_iterator();
+			std::string const hitName = stripAfterSpace(hitDef);
+			int64_t const hitId = ok ? ref.reader.getSequenceId(hitName) : -1;
 			// hit coord
 			int64_t hitFrom = ok ? parseNumber<int64_t>(hspHitFrom) : -1;
 			int64_t hitTo = ok ? parseNumber<int64_t>(hspHitTo) : -1;
@@ -676,10 +713,11 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 			
 			if ( ok && 
 				(hspId == 0 || (thisHitScore >= hitFrac * hitFirstScore)) && 
-				inRange(hita->first, hitStart, hitEnd)
+				hitId >= 0 &&
+				inRange(hitName, hitStart, hitEnd)
 			)
 			{
-				// hita->first refseq
+				// hitName refseq
 
 				int64_t queryFrame = parseNumber<int64_t>(hspQueryFrame);
 				int64_t hitFrame = parseNumber<int64_t>(hspHitFrame);
@@ -694,9 +732,7 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 				int64_t queryEnd = std::max(queryFrom,queryTo)-1;
 				int64_t queryLen = queryEnd-queryStart+1;
 				int64_t queryFrontClip = queryStart;
-				std::map<std::string,std::string>::const_iterator qita = queries.find(readName);
-				assert ( qita != queries.end() );
-				int64_t queryBackClip = qita->second.size() - (queryFrontClip + queryLen);
+				int64_t queryBackClip = querySequence.size() - (queryFrontClip + queryLen);
 				
 				std::cerr 
 					<< readName << "[" << hspId << "]" << " queryFrame " << queryFrame << " hitFrame " << hitFrame 
@@ -713,13 +749,11 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 					hlen += hspHSeq[i] != '-';
 						
 				
-				if ( qita != queries.end() && hita != ref.end() )
+				if ( loadedQueryId >= 0 && hitId >= 0 )
 				{
-					std::string const & H = hita->second;
-					std::string const & Q = qita->second;
-					
-					std::string hsub = H.substr(hitStart,hitLen);
-					std::string qsub = Q.substr(queryStart,queryLen);
+					std::string hsub;
+					ref.getRange(hitId,hitStart,hitLen,hsub);
+					std::string qsub = querySequence.substr(queryStart,queryLen);
 					
 					if ( hitFrame < 0 )
 					{
@@ -824,7 +858,7 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 					if ( rc )
 						std::reverse(ops.begin(),ops.end());
 
-					std::string bamquery = qita->second;
+					std::string bamquery = querySequence;
 					if ( rc )
 						bamquery = libmaus::fastx::reverseComplementUnmapped(bamquery);
 					
@@ -852,7 +886,7 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 
 					bamwriter.encodeAlignment(
 						readName,
-						refnametoid.find(hita->first)->second,
+						hitId,
 						hitStart,
 						0, // mapq
 						(rc ? libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREVERSE : 0)
@@ -864,7 +898,7 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 						-1,
 						0,
 						bamquery,
-						std::string(qita->second.size(),255),
+						std::string(querySequence.size(),255),
 						0
 					);
 					bamwriter.putAuxNumber("AS", 'i', thisHitScore);
@@ -988,12 +1022,11 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 			#if 0
 			std::cerr << "hspQSeq " << hspQSeq << " " << hspQSeq.size() << std::endl;
 
-			std::map<std::string,std::string>::const_iterator ita = queries.find(readName);
-			if ( ita != queries.end() )
+			if ( loadQuery() )
 			{
 				std::cerr << "Found it." << std::endl;
 				uint64_t const offset = atoi(hspQueryFrom.c_str());
-				std::string const & query = ita->second;
+				std::string const & query = querySequence;
 				uint64_t j = 0;
 				
 				for ( uint64_t i = 0; i < hspQSeq.size(); ++i )
@@ -1017,12 +1050,13 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 			#if 0
 			std::cerr << "hspHSeq " << hspHSeq << " " << hspHSeq.size() << std::endl;
 
-			std::map<std::string,std::string>::const_iterator ita = ref.find(hitDef);
-			if ( ita != ref.end() )
+			int64_t const hitId = ref.reader.getSequenceId(stripAfterSpace(hitDef));
+			if ( hitId >= 0 )
 			{
 				std::cerr << "Found it." << std::endl;
 				uint64_t const offset = atoi(hspHitFrom.c_str());
-				std::string const & refseq = ita->second;
+				std::string refseq;
+				ref.getRange(hitId,0,ref.reader[hitId].length,refseq);
 				uint64_t j = 0;
 				
 				for ( uint64_t i = 0; i < hspHSeq.size(); ++i )
@@ -1074,36 +1108,6 @@ struct BlastNDocumentHandler : public xercesc::DocumentHandler, public xercesc::
 
 #include <xercesc/parsers/SAXParser.hpp>
 
-#include <libmaus/fastx/FastAReader.hpp>
-
-void loadFastAFile(std::string const & filename, std::map<std::string,std::string> & M, std::vector< std::pair<std::string,uint64_t> > & meta, std::map<std::string,uint64_t> & nametoid)
-{
-	libmaus::fastx::FastAReader fain(filename);
-	libmaus::fastx::FastAReader::pattern_type pattern;
-	
-	while ( fain.getNextPatternUnlocked(pattern) )
-	{
-		M[pattern.sid] = pattern.spattern;	
-		meta.push_back(std::pair<std::string,uint64_t>(pattern.sid,pattern.spattern.size()));
-		uint64_t const id = nametoid.size();
-		nametoid[pattern.sid] = id;
-	}
-}
-
-std::string stripAfterSpace(std::string const & s)
-{
-	uint64_t firstspace = s.size();
-	
-	for ( uint64_t i = 0; i < s.size(); ++i )
-		if ( isspace(s[i]) )
-		{
-			firstspace = i;
-			break;
-		}
-		
-	return s.substr(0,firstspace);
-}
-
 int main(int argc, char * argv[])
 {
 	int ret = EXIT_SUCCESS;
@@ -1148,20 +1152,18 @@ int main(int argc, char * argv[])
 				ranges = Pranges.get();
 			}
 			
-			std::map<std::string,std::string> ref;
-			std::vector< std::pair<std::string,uint64_t> > refmeta;
-			std::map<std::string,uint64_t> refnametoid;
-			loadFastAFile(reffn, ref, refmeta, refnametoid);
+			uint64_t const refwindowsize = arginfo.getValueUnsignedNumeric<uint64_t>("refwindowsize",getDefaultRefWindowSize());
+			uint64_t const refcachesize = arginfo.getValueUnsignedNumeric<uint64_t>("refcachesize",getDefaultRefCacheSize());
 
-			std::map<std::string,std::string> queries;
-			std::vector< std::pair<std::string,uint64_t> > queriesmeta;
-			std::map<std::string,uint64_t> queriesnametoid;
-			loadFastAFile(queriesfn, queries, queriesmeta, queriesnametoid);
+			// reference and queries are accessed via their .fai index
+			IndexedFastAReader refreader(reffn);
+			FastAWindowCache ref(refreader,refwindowsize,refcachesize);
+			IndexedFastAReader queries(queriesfn);
 
 			std::ostringstream headerostr;
 			headerostr << "@HD\tVN:1.4\tSO:unknown\n";
-			for ( uint64_t i = 0; i < refmeta.size(); ++i )
-				headerostr << "@SQ\tSN:" << stripAfterSpace(refmeta[i].first) << "\tLN:" << refmeta[i].second << std::endl;
+			for ( uint64_t i = 0; i < refreader.size(); ++i )
+				headerostr << "@SQ\tSN:" << refreader[i].name << "\tLN:" << refreader[i].length << std::endl;
 			headerostr 
 				<< "@PG"<< "\t" 
 				<< "ID:" << "blastnxmltobam" << "\t" 
@@ -1180,7 +1182,7 @@ int main(int argc, char * argv[])
 			xercesc::SAXParser saxparser;
 			saxparser.setValidationScheme(xercesc::SAXParser::Val_Never);
 			saxparser.setLoadExternalDTD(false);
-			BlastNDocumentHandler blasthandler(ref,queries,refnametoid,queriesnametoid,writer,hitfrac,ranges);
+			BlastNDocumentHandler blasthandler(ref,queries,writer,hitfrac,ranges);
 			saxparser.setDocumentHandler(&blasthandler);
 			saxparser.setErrorHandler(&blasthandler);
 			saxparser.parse(in);
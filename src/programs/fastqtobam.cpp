@@ -17,7 +17,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 **/
 #include <libmaus/fastx/StreamFastQReader.hpp>
+#include <libmaus/fastx/UCharBuffer.hpp>
+#include <libmaus/bambam/BamAlignmentEncoderBase.hpp>
 #include <libmaus/bambam/BamBlockWriterBaseFactory.hpp>
+#include <libmaus/bambam/BamSeqEncodeTable.hpp>
 #include <libmaus/bambam/BamWriter.hpp>
 #include <libmaus/bambam/BamHeaderUpdate.hpp>
 #include <libmaus/bambam/BamFlagBase.hpp>
@@ -26,11 +29,17 @@
 #include <libmaus/util/ToUpperTable.hpp>
 
 #include <libmaus/lz/BufferedGzipStream.hpp>
+#include <libmaus/lz/BgzfOutputStream.hpp>
+#include <libmaus/parallel/PosixSpinLock.hpp>
+#include <libmaus/parallel/PosixThread.hpp>
+#include <libmaus/parallel/SynchronousQueue.hpp>
 
 #include <biobambam/BamBamConfig.hpp>
+#include <biobambam/BgzfBlockCopy.hpp>
 #include <biobambam/Licensing.hpp>
 
 #include <iomanip>
+#include <cstring>
 
 #include <config.h>
 
@@ -75,6 +84,16 @@ static std::string getDefaultNameScheme()
 	return "generic";
 }
 
+static int getDefaultChunked()
+{
+	return 0;
+}
+
+static uint64_t getDefaultChunkPackageSize()
+{
+	return 1024*1024;
+}
+
 static int getLevel(libmaus::util::ArgInfo const & arginfo)
 {
 	return libmaus::bambam::BamBlockWriterBaseFactory::checkCompressionLevel(arginfo.getValue<int>("level",getDefaultLevel()));
@@ -443,6 +462,184 @@ void updateQualityHistogram(element_type const & element, int const qualityoffse
 		H [ static_cast<uint8_t>(element.quality[i]-qualityoffset) ] ++;
 }
 
+/**
+ * check and encode a single FastQ element (name schemes generic, c18s and c18pe)
+ **/
+template<typename writer_type, fastq_name_scheme_type namescheme, typename pattern_type>
+void fastqtobamEncodeSingleElement(
+	pattern_type & element,
+	writer_type & bamwr, std::string const & rgid, 
+	int const qualityoffset,
+	int const maxvalid,
+	bool const checkquality,
+	uint64_t * const H,
+	libmaus::fastx::SpaceTable const & ST,
+	FastQSeqMapTable const & toup
+)
+{
+	toup.toupper(element.spattern);
+	std::string const & name = element.sid;
+	NameInfo const NI(name,ST,namescheme);
+	
+	if ( checkquality )
+		checkFastQElement(element,qualityoffset,maxvalid);
+	if ( H )
+		updateQualityHistogram(element,qualityoffset,H);
+
+	if ( NI.ispair )
+	{
+		bamwr.encodeAlignment(
+			NI.getName(),
+			-1,
+			-1,
+			0,
+			libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED |
+			libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP |
+			libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FMUNMAP |
+			(NI.isfirst ? libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1 : libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD2),
+			std::string(),
+			-1,
+			-1,
+			0,
+			element.spattern,
+			element.quality,
+			qualityoffset
+		);
+		if ( rgid.size() )
+			bamwr.putAuxString("RG",rgid.c_str());
+		bamwr.commit();
+	}
+	else
+	{
+		bamwr.encodeAlignment(
+			NI.getName(),
+			-1,
+			-1,
+			0,
+			libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP,
+			std::string(),
+			-1,
+			-1,
+			0,
+			element.spattern,
+			element.quality,
+			qualityoffset
+		);
+		if ( rgid.size() )
+			bamwr.putAuxString("RG",rgid.c_str());
+		bamwr.commit();		
+	}
+}
+
+/**
+ * check and encode a pair of consecutive FastQ elements (name scheme pairedfiles)
+ **/
+template<typename writer_type, typename pattern_type>
+void fastqtobamEncodeElementPair(
+	pattern_type & element_1,
+	pattern_type & element_2,
+	writer_type & bamwr, std::string const & rgid, 
+	int const qualityoffset,
+	int const maxvalid,
+	bool const checkquality,
+	uint64_t * const H,
+	libmaus::fastx::SpaceTable const & ST,
+	FastQSeqMapTable const & toup
+)
+{
+	toup.toupper(element_1.spattern);
+	toup.toupper(element_2.spattern);
+
+	if ( checkquality )
+	{
+		checkFastQElement(element_1,qualityoffset,maxvalid);
+		checkFastQElement(element_2,qualityoffset,maxvalid);
+	}
+	if ( H )
+	{
+		updateQualityHistogram(element_1,qualityoffset,H);
+		updateQualityHistogram(element_2,qualityoffset,H);
+	}
+
+	// clip read names after first white space
+	uint64_t l1 = element_1.sid.size();
+	for ( uint64_t i = l1; i; )
+		if ( ST.spacetable[static_cast<uint8_t>(element_1.sid[--i])] )
+			l1 = i;
+	if ( l1 != element_1.sid.size() )
+		element_1.sid = element_1.sid.substr(0,l1);
+
+	uint64_t l2 = element_2.sid.size();
+	for ( uint64_t i = l2; i; )
+		if ( ST.spacetable[static_cast<uint8_t>(element_2.sid[--i])] )
+			l2 = i;
+	if ( l2 != element_2.sid.size() )
+		element_2.sid = element_2.sid.substr(0,l2);
+	
+	// if read names end in /1 and /2 then chop those off
+	if ( 
+		element_1.sid.size() >= 2 && element_2.sid.size() >= 2 &&
+		element_1.sid[element_1.sid.size()-2] == '/' &&
+		element_1.sid[element_1.sid.size()-1] == '1' &&
+		element_2.sid[element_2.sid.size()-2] == '/' &&
+		element_2.sid[element_2.sid.size()-1] == '2'
+	)
+	{
+		element_1.sid = element_1.sid.substr(0,element_1.sid.size()-2);
+		element_2.sid = element_2.sid.substr(0,element_2.sid.size()-2);
+	}
+	
+	if ( element_1.sid != element_2.sid )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "Pair names " << element_1.sid << " and " << element_2.sid << " are not in sync." << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	bamwr.encodeAlignment(
+		element_1.sid,
+		-1,
+		-1,
+		0,
+		libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED |
+		libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP |
+		libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FMUNMAP |
+		(true ? libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1 : libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD2),
+		std::string(),
+		-1,
+		-1,
+		0,
+		element_1.spattern,
+		element_1.quality,
+		qualityoffset
+	);
+	if ( rgid.size() )
+		bamwr.putAuxString("RG",rgid.c_str());
+	bamwr.commit();
+
+	bamwr.encodeAlignment(
+		element_2.sid,
+		-1,
+		-1,
+		0,
+		libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED |
+		libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP |
+		libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FMUNMAP |
+		(false ? libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1 : libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD2),
+		std::string(),
+		-1,
+		-1,
+		0,
+		element_2.spattern,
+		element_2.quality,
+		qualityoffset
+	);
+	if ( rgid.size() )
+		bamwr.putAuxString("RG",rgid.c_str());
+	bamwr.commit();
+}
+
 template<typename writer_type, fastq_name_scheme_type namescheme>
 void fastqtobamSingleTemplate(
 	std::istream & in, writer_type & bamwr, int const verbose, std::string const & rgid, 
@@ -469,58 +666,7 @@ void fastqtobamSingleTemplate(
 			
 			while ( fqin.getNextPatternUnlocked(element) )
 			{
-				toup.toupper(element.spattern);
-				std::string const & name = element.sid;
-				NameInfo const NI(name,ST,namescheme);
-				
-				if ( checkquality )
-					checkFastQElement(element,qualityoffset,maxvalid);
-				if ( H )
-					updateQualityHistogram(element,qualityoffset,H);
-
-				if ( NI.ispair )
-				{
-					bamwr.encodeAlignment(
-						NI.getName(),
-						-1,
-						-1,
-						0,
-						libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED |
-						libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP |
-						libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FMUNMAP |
-						(NI.isfirst ? libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1 : libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD2),
-						std::string(),
-						-1,
-						-1,
-						0,
-						element.spattern,
-						element.quality,
-						qualityoffset
-					);
-					if ( rgid.size() )
-						bamwr.putAuxString("RG",rgid.c_str());
-					bamwr.commit();
-				}
-				else
-				{
-					bamwr.encodeAlignment(
-						NI.getName(),
-						-1,
-						-1,
-						0,
-						libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP,
-						std::string(),
-						-1,
-						-1,
-						0,
-						element.spattern,
-						element.quality,
-						qualityoffset
-					);
-					if ( rgid.size() )
-						bamwr.putAuxString("RG",rgid.c_str());
-					bamwr.commit();		
-				}
+				fastqtobamEncodeSingleElement<writer_type,namescheme,pattern_type>(element,bamwr,rgid,qualityoffset,maxvalid,checkquality,H,ST,toup);
 
 				proc += 1;
 				if ( verbose && ((proc & (1024*1024-1)) == 0) )
@@ -544,97 +690,7 @@ void fastqtobamSingleTemplate(
 					throw ex;
 				}
 
-				toup.toupper(element_1.spattern);
-				toup.toupper(element_2.spattern);
-
-				if ( checkquality )
-				{
-					checkFastQElement(element_1,qualityoffset,maxvalid);
-					checkFastQElement(element_2,qualityoffset,maxvalid);
-				}
-				if ( H )
-				{
-					updateQualityHistogram(element_1,qualityoffset,H);
-					updateQualityHistogram(element_2,qualityoffset,H);
-				}
-
-				// clip read names after first white space
-				uint64_t l1 = element_1.sid.size();
-				for ( uint64_t i = l1; i; )
-					if ( ST.spacetable[static_cast<uint8_t>(element_1.sid[--i])] )
-						l1 = i;
-				if ( l1 != element_1.sid.size() )
-					element_1.sid = element_1.sid.substr(0,l1);
-
-				uint64_t l2 = element_2.sid.size();
-				for ( uint64_t i = l2; i; )
-					if ( ST.spacetable[static_cast<uint8_t>(element_2.sid[--i])] )
-						l2 = i;
-				if ( l2 != element_2.sid.size() )
-					element_2.sid = element_2.sid.substr(0,l2);
-				
-				// if read names end in /1 and /2 then chop those off
-				if ( 
-					element_1.sid.size() >= 2 && element_2.sid.size() >= 2 &&
-					element_1.sid[element_1.sid.size()-2] == '/' &&
-					element_1.sid[element_1.sid.size()-1] == '1' &&
-					element_2.sid[element_2.sid.size()-2] == '/' &&
-					element_2.sid[element_2.sid.size()-1] == '2'
-				)
-				{
-					element_1.sid = element_1.sid.substr(0,element_1.sid.size()-2);
-					element_2.sid = element_2.sid.substr(0,element_2.sid.size()-2);
-				}
-				
-				if ( element_1.sid != element_2.sid )
-				{
-					::libmaus::exception::LibMausException se;
-					se.getStream() << "Pair names " << element_1.sid << " and " << element_2.sid << " are not in sync." << std::endl;
-					se.finish();
-					throw se;
-				}
-			
-				bamwr.encodeAlignment(
-					element_1.sid,
-					-1,
-					-1,
-					0,
-					libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED |
-					libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP |
-					libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FMUNMAP |
-					(true ? libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1 : libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD2),
-					std::string(),
-					-1,
-					-1,
-					0,
-					element_1.spattern,
-					element_1.quality,
-					qualityoffset
-				);
-				if ( rgid.size() )
-					bamwr.putAuxString("RG",rgid.c_str());
-				bamwr.commit();
-
-				bamwr.encodeAlignment(
-					element_2.sid,
-					-1,
-					-1,
-					0,
-					libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FPAIRED |
-					libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FUNMAP |
-					libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FMUNMAP |
-					(false ? libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD1 : libmaus::bambam::BamFlagBase::LIBMAUS_BAMBAM_FREAD2),
-					std::string(),
-					-1,
-					-1,
-					0,
-					element_2.spattern,
-					element_2.quality,
-					qualityoffset
-				);
-				if ( rgid.size() )
-					bamwr.putAuxString("RG",rgid.c_str());
-				bamwr.commit();
+				fastqtobamEncodeElementPair<writer_type,pattern_type>(element_1,element_2,bamwr,rgid,qualityoffset,maxvalid,checkquality,H,ST,toup);
 			}
 			
 			break;
@@ -902,7 +958,582 @@ void fastqtobamPair(
 	}
 }
 
-void fastqtobam(libmaus::util::ArgInfo const & arginfo)
+/**
+ * FastQ element parsed by the chunked mode
+ **/
+struct FastQChunkPattern
+{
+	std::string sid;
+	std::string spattern;
+	std::string quality;
+};
+
+/**
+ * BAM record encoder offering the encodeAlignment/putAuxString/commit interface of the BAM writers,
+ * the encoded records (including the block size fields) are appended to data
+ **/
+struct FastQBamBufferEncoder
+{
+	typedef FastQBamBufferEncoder this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	::libmaus::fastx::UCharBuffer ubuffer;
+	::libmaus::bambam::BamSeqEncodeTable const seqtab;
+	std::vector<uint8_t> data;
+	uint64_t records;
+
+	FastQBamBufferEncoder() : ubuffer(), seqtab(), data(), records(0) {}
+
+	void reset()
+	{
+		data.resize(0);
+		records = 0;
+	}
+
+	void encodeAlignment(
+		std::string const & name,
+		int32_t const refid,
+		int32_t const pos,
+		uint32_t const mapq,
+		uint32_t const flags,
+		std::string const & cigar,
+		int32_t const nextrefid,
+		int32_t const nextpos,
+		uint32_t const tlen,
+		std::string const & seq,
+		std::string const & qual,
+		uint8_t const qualityoffset
+	)
+	{
+		ubuffer.reset();
+		::libmaus::bambam::BamAlignmentEncoderBase::encodeAlignment(
+			ubuffer,seqtab,name,refid,pos,mapq,flags,cigar,nextrefid,nextpos,tlen,seq,qual,qualityoffset
+		);
+	}
+
+	void putAuxString(std::string const & tag, std::string const & value)
+	{
+		::libmaus::bambam::BamAlignmentEncoderBase::putAuxString(ubuffer,tag,value);
+	}
+
+	void commit()
+	{
+		uint64_t const len = ubuffer.length;
+		data.push_back((len >>  0) & 0xFF);
+		data.push_back((len >>  8) & 0xFF);
+		data.push_back((len >> 16) & 0xFF);
+		data.push_back((len >> 24) & 0xFF);
+		data.insert(data.end(),ubuffer.buffer,ubuffer.buffer+len);
+		records += 1;
+	}
+};
+
+/**
+ * batch of raw FastQ data passed from the input thread to the encoding threads. The data
+ * is split into packages at record boundaries.
+ **/
+struct FastQChunkBatch
+{
+	typedef FastQChunkBatch this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	std::vector<char> data;
+	// package boundaries in data
+	std::vector<uint64_t> packages;
+
+	void reset()
+	{
+		data.resize(0);
+		packages.resize(0);
+	}
+};
+
+/**
+ * input thread for the chunked mode. Reads the (possibly gzip decompressed) input stream and
+ * splits it into batches of packages, each package containing complete units of unitrecords
+ * FastQ records. Records are delimited like getNextFastQChunkPattern does it: empty lines
+ * before a record are skipped, the record itself has four lines
+ **/
+struct FastQChunkReader : public libmaus::parallel::PosixThread
+{
+	typedef FastQChunkReader this_type;
+	typedef libmaus::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	std::istream & in;
+	uint64_t const unitrecords;
+	uint64_t const packagesize;
+	uint64_t const batchsize;
+
+	libmaus::autoarray::AutoArray<FastQChunkBatch::unique_ptr_type> batches;
+	libmaus::parallel::SynchronousQueue<FastQChunkBatch *> freeBatches;
+	libmaus::parallel::SynchronousQueue<FastQChunkBatch *> fullBatches;
+
+	libmaus::parallel::PosixSpinLock failedlock;
+	bool failed;
+	std::string failmessage;
+	bool aborted;
+
+	FastQChunkReader(
+		std::istream & rin,
+		uint64_t const runitrecords,
+		uint64_t const rpackagesize,
+		uint64_t const rpackagesperbatch,
+		uint64_t const numbatches
+	)
+	: in(rin), unitrecords(runitrecords), packagesize(rpackagesize), batchsize(rpackagesize * rpackagesperbatch), 
+	  batches(std::max(numbatches,static_cast<uint64_t>(2))), failed(false), aborted(false)
+	{
+		for ( uint64_t i = 0; i < batches.size(); ++i )
+		{
+			FastQChunkBatch::unique_ptr_type tptr(new FastQChunkBatch);
+			batches[i] = UNIQUE_PTR_MOVE(tptr);
+			freeBatches.enque(batches[i].get());
+		}
+	}
+
+	void produce()
+	{
+		// incomplete record at the end of the previous batch
+		std::vector<char> rest;
+		bool eof = false;
+
+		while ( ! eof )
+		{
+			FastQChunkBatch * batch = freeBatches.deque();
+
+			if ( isAborted() )
+			{
+				if ( batch )
+					freeBatches.enque(batch);
+				break;
+			}
+
+			batch->reset();
+			std::vector<char> & D = batch->data;
+
+			D.swap(rest);
+			rest.resize(0);
+			uint64_t const o = D.size();
+			D.resize(o + batchsize);
+			in.read(&D[o],batchsize);
+			uint64_t const got = in.gcount();
+			D.resize(o + got);
+			eof = (got < batchsize);
+
+			// split at record boundaries
+			batch->packages.push_back(0);
+			// lines of current record
+			uint64_t lines = 0;
+			// records of current unit
+			uint64_t records = 0;
+			uint64_t last = 0;
+			char const * const pa = D.size() ? &D[0] : 0;
+			char const * p = pa;
+			char const * const pe = pa + D.size();
+			char const * nl = 0;
+
+			while ( p != pe && (nl = reinterpret_cast<char const *>(memchr(p,'\n',pe-p))) )
+			{
+				bool const emptyline = (p == nl);
+				p = nl + 1;
+
+				// empty line between records
+				if ( (! lines) && emptyline )
+					continue;
+
+				if ( ++lines == 4 )
+				{
+					lines = 0;
+
+					if ( ++records == unitrecords )
+					{
+						records = 0;
+						last = p - pa;
+
+						if ( last - batch->packages.back() >= packagesize )
+							batch->packages.push_back(last);
+					}
+				}
+			}
+
+			if ( eof )
+			{
+				if ( D.size() != batch->packages.back() )
+					batch->packages.push_back(D.size());
+			}
+			else
+			{
+				if ( last != batch->packages.back() )
+					batch->packages.push_back(last);
+				rest.assign(D.begin()+last,D.end());
+				D.resize(last);
+			}
+
+			if ( batch->packages.size() > 1 )
+				fullBatches.enque(batch);
+			else
+				freeBatches.enque(batch);
+		}
+	}
+
+	void * run()
+	{
+		try
+		{
+			produce();
+		}
+		catch(std::exception const & ex)
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+			failed = true;
+			failmessage = ex.what();
+		}
+
+		// end of stream marker
+		fullBatches.enque(0);
+
+		return 0;
+	}
+
+	bool isAborted()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+		return aborted;
+	}
+
+	/**
+	 * make the input thread stop before reading the next batch
+	 **/
+	void abort()
+	{
+		{
+			libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+			aborted = true;
+		}
+		// wake up the input thread if it is waiting for a free batch
+		freeBatches.enque(0);
+	}
+
+	/**
+	 * get next batch, returns null pointer at end of stream
+	 **/
+	FastQChunkBatch * getBatch()
+	{
+		return fullBatches.deque();
+	}
+
+	void returnBatch(FastQChunkBatch * batch)
+	{
+		freeBatches.enque(batch);
+	}
+
+	/**
+	 * throw exception if the input thread failed
+	 **/
+	void checkFailed()
+	{
+		libmaus::parallel::ScopePosixSpinLock slock(failedlock);
+
+		if ( failed )
+		{
+			::libmaus::exception::LibMausException se;
+			se.getStream() << "fastqtobam input thread failed: " << failmessage << std::endl;
+			se.finish();
+			throw se;
+		}
+	}
+};
+
+/**
+ * get next line in [pa,pe) (without line terminator), returns false if there is no more data
+ **/
+static bool getFastQChunkLine(char const * & pa, char const * const pe, char const * & la, char const * & le)
+{
+	if ( pa == pe )
+		return false;
+
+	char const * nl = reinterpret_cast<char const *>(memchr(pa,'\n',pe-pa));
+	la = pa;
+	le = nl ? nl : pe;
+	pa = nl ? (nl + 1) : pe;
+
+	return true;
+}
+
+/**
+ * parse next four line FastQ record in [pa,pe), returns false if there is no more data
+ **/
+static bool getNextFastQChunkPattern(char const * & pa, char const * const pe, FastQChunkPattern & element)
+{
+	char const * la = 0;
+	char const * le = 0;
+
+	// skip empty lines between records
+	do
+	{
+		if ( ! getFastQChunkLine(pa,pe,la,le) )
+			return false;
+	} while ( la == le );
+
+	if ( *la != '@' )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "malformed FastQ input: expected @ at start of record, got " << std::string(la,le) << std::endl;
+		se.finish();
+		throw se;
+	}
+	element.sid.assign(la+1,le);
+
+	bool ok = getFastQChunkLine(pa,pe,la,le);
+	if ( ok )
+		element.spattern.assign(la,le);
+
+	ok = ok && getFastQChunkLine(pa,pe,la,le) && (la != le) && (*la == '+');
+	ok = ok && getFastQChunkLine(pa,pe,la,le);
+
+	if ( ok )
+		element.quality.assign(la,le);
+
+	if ( (! ok) || element.quality.size() != element.spattern.size() )
+	{
+		::libmaus::exception::LibMausException se;
+		se.getStream() << "malformed or incomplete FastQ record for read " << element.sid << std::endl;
+		se.finish();
+		throw se;
+	}
+
+	return true;
+}
+
+/**
+ * parse and encode the FastQ records in [pa,pe)
+ **/
+template<fastq_name_scheme_type namescheme>
+void fastqtobamChunkedPackage(
+	char const * pa, char const * const pe,
+	FastQBamBufferEncoder & enc, std::string const & rgid, 
+	int const qualityoffset,
+	int const maxvalid,
+	bool const checkquality,
+	uint64_t * const H,
+	libmaus::fastx::SpaceTable const & ST,
+	FastQSeqMapTable const & toup
+)
+{
+	FastQChunkPattern element_1;
+	FastQChunkPattern element_2;
+
+	while ( getNextFastQChunkPattern(pa,pe,element_1) )
+	{
+		if ( namescheme == fastq_name_scheme_pairedfiles )
+		{
+			if ( ! getNextFastQChunkPattern(pa,pe,element_2) )
+			{
+				libmaus::exception::LibMausException ex;
+				ex.getStream() << "number of fragments is not even" << std::endl;
+				ex.finish();
+				throw ex;
+			}
+
+			fastqtobamEncodeElementPair<FastQBamBufferEncoder,FastQChunkPattern>(element_1,element_2,enc,rgid,qualityoffset,maxvalid,checkquality,H,ST,toup);
+		}
+		else
+		{
+			fastqtobamEncodeSingleElement<FastQBamBufferEncoder,namescheme,FastQChunkPattern>(element_1,enc,rgid,qualityoffset,maxvalid,checkquality,H,ST,toup);
+		}
+	}
+}
+
+/**
+ * chunked mode: a separate thread reads the input and splits it at record boundaries,
+ * packages of records are parsed, checked, encoded and BGZF compressed by numthreads threads
+ * and written in input order. Requires four line FastQ records.
+ **/
+template<fastq_name_scheme_type namescheme>
+void fastqtobamChunkedTemplate(
+	std::istream & in, std::ostream & out,
+	::libmaus::bambam::BamHeader const & bamheader, int const level,
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * Pcbs,
+	uint64_t const numthreads,
+	int const verbose, std::string const & rgid, 
+	int const qualityoffset,
+	int const maxvalid,
+	bool const checkquality,
+	uint64_t * const H,
+	uint64_t const packagesize
+)
+{
+	libmaus::fastx::SpaceTable const ST;
+	FastQSeqMapTable const toup;
+	uint64_t const packagesperbatch = 4 * numthreads;
+	unsigned int const unitrecords = (namescheme == fastq_name_scheme_pairedfiles) ? 2 : 1;
+
+	// write bam header
+	{
+		std::ostringstream headerostr;
+		libmaus::lz::BgzfOutputStream writer(headerostr,level);
+		bamheader.serialise(writer);
+		writer.flush();
+		std::istringstream headeristr(headerostr.str());
+		bgzfBlockCopy(headeristr,out,Pcbs);
+	}
+
+	FastQChunkReader reader(in,unitrecords,std::max(packagesize,static_cast<uint64_t>(1)),packagesperbatch,3);
+	reader.start();
+
+	libmaus::autoarray::AutoArray<FastQBamBufferEncoder::unique_ptr_type> encoders;
+	std::vector<std::string> compressed;
+	libmaus::autoarray::AutoArray<uint64_t> LH;
+	libmaus::parallel::PosixSpinLock faillock;
+	std::string failmessage;
+	uint64_t proc = 0;
+	FastQChunkBatch * batch = 0;
+
+	try
+	{
+		while ( (batch = reader.getBatch()) )
+		{
+			uint64_t const numpackages = batch->packages.size()-1;
+
+			if ( encoders.size() < numpackages )
+			{
+				libmaus::autoarray::AutoArray<FastQBamBufferEncoder::unique_ptr_type> tencoders(numpackages);
+				for ( uint64_t i = 0; i < encoders.size(); ++i )
+					tencoders[i] = UNIQUE_PTR_MOVE(encoders[i]);
+				for ( uint64_t i = encoders.size(); i < numpackages; ++i )
+				{
+					FastQBamBufferEncoder::unique_ptr_type tptr(new FastQBamBufferEncoder);
+					tencoders[i] = UNIQUE_PTR_MOVE(tptr);
+				}
+				encoders = tencoders;
+			}
+			compressed.resize(numpackages);
+			if ( H && LH.size() < 256*numpackages )
+				LH = libmaus::autoarray::AutoArray<uint64_t>(256*numpackages,false);
+			if ( H )
+				std::fill(LH.begin(),LH.begin()+256*numpackages,0ull);
+
+			#if defined(_OPENMP)
+			#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+			#endif
+			for ( int64_t i = 0; i < static_cast<int64_t>(numpackages); ++i )
+			{
+				try
+				{
+					FastQBamBufferEncoder & enc = *(encoders[i]);
+					enc.reset();
+
+					fastqtobamChunkedPackage<namescheme>(
+						&(batch->data[0]) + batch->packages[i],
+						&(batch->data[0]) + batch->packages[i+1],
+						enc,rgid,qualityoffset,maxvalid,checkquality,
+						H ? (LH.begin() + 256*i) : 0,
+						ST,toup
+					);
+
+					std::ostringstream ostr;
+					libmaus::lz::BgzfOutputStream writer(ostr,level);
+					if ( enc.data.size() )
+						writer.write(reinterpret_cast<char const *>(&(enc.data[0])),enc.data.size());
+					writer.flush();
+					compressed[i] = ostr.str();
+				}
+				catch(std::exception const & ex)
+				{
+					libmaus::parallel::ScopePosixSpinLock lfaillock(faillock);
+					failmessage = ex.what();
+				}
+			}
+
+			reader.returnBatch(batch);
+			batch = 0;
+
+			if ( failmessage.size() )
+			{
+				::libmaus::exception::LibMausException se;
+				se.getStream() << failmessage;
+				se.finish();
+				throw se;
+			}
+
+			uint64_t const oldproc = proc;
+			// the callbacks get the uncompressed data from the encoders, the blocks are not decompressed again
+			for ( uint64_t i = 0; i < numpackages; ++i )
+			{
+				FastQBamBufferEncoder const & enc = *(encoders[i]);
+				std::istringstream istr(compressed[i]);
+				bgzfBlockCopy(istr,out,Pcbs,enc.data.size() ? &(enc.data[0]) : 0,enc.data.size());
+				proc += enc.records;
+			}
+
+			if ( H )
+				for ( uint64_t i = 0; i < numpackages; ++i )
+					for ( uint64_t j = 0; j < 256; ++j )
+						H[j] += LH[256*i+j];
+
+			if ( verbose && ((oldproc >> 20) != (proc >> 20)) )
+				std::cerr << "[V] " << proc << std::endl;
+		}
+	}
+	catch(...)
+	{
+		// stop the input thread, it completes the batch it is reading and then quits
+		reader.abort();
+		reader.join();
+		throw;
+	}
+
+	reader.join();
+	reader.checkFailed();
+
+	// write bam footer
+	{
+		std::ostringstream footerostr;
+		libmaus::lz::BgzfOutputStream writer(footerostr);
+		writer.flush();
+		writer.addEOFBlock();
+		std::istringstream footeristr(footerostr.str());
+		bgzfBlockCopy(footeristr,out,Pcbs);
+	}
+
+	out.flush();
+
+	if ( verbose )
+		std::cerr << "[V] " << proc << std::endl;
+}
+
+void fastqtobamChunked(
+	std::istream & in, std::ostream & out,
+	::libmaus::bambam::BamHeader const & bamheader, int const level,
+	std::vector< ::libmaus::lz::BgzfDeflateOutputCallback * > const * Pcbs,
+	uint64_t const numthreads,
+	int const verbose, std::string const & rgid, 
+	int const qualityoffset,
+	int const maxvalid,
+	bool const checkquality,
+	uint64_t * const H,
+	fastq_name_scheme_type const namescheme,
+	uint64_t const packagesize
+)
+{
+	switch ( namescheme )
+	{
+		case fastq_name_scheme_generic:
+			fastqtobamChunkedTemplate<fastq_name_scheme_generic>(in,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,packagesize);
+			break;
+		case fastq_name_scheme_casava18_single:
+			fastqtobamChunkedTemplate<fastq_name_scheme_casava18_single>(in,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,packagesize);
+			break;
+		case fastq_name_scheme_casava18_paired_end:
+			fastqtobamChunkedTemplate<fastq_name_scheme_casava18_paired_end>(in,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,packagesize);
+			break;
+		case fastq_name_scheme_pairedfiles:
+			fastqtobamChunkedTemplate<fastq_name_scheme_pairedfiles>(in,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,packagesize);
+			break;
+	}
+}
+
+void fastqtobam(libmaus::util::ArgInfo const & arginfo, std::ostream & out)
 {
 	std::vector<std::string> filenames = arginfo.getPairValues("I");
 	for ( uint64_t i = 0; i < arginfo.restargs.size(); ++i )
@@ -918,6 +1549,8 @@ void fastqtobam(libmaus::util::ArgInfo const & arginfo)
 	int const verbose = arginfo.getValue<int>("verbose",getDefaultVerbose());
 	bool const gz = arginfo.getValue<int>("gz",getDefaultGz());
 	unsigned int const threads = arginfo.getValue<unsigned int>("threads",1);
+	bool const chunked = arginfo.getValue<int>("chunked",getDefaultChunked());
+	uint64_t const packagesize = arginfo.getValueUnsignedNumeric<uint64_t>("chunksize",getDefaultChunkPackageSize());
 	int const qualityoffset = arginfo.getValue<int>("qualityoffset",getDefaultQualityOffset());
 	int const maxvalid = arginfo.getValue<int>("qualitymax",getDefaultQualityMaximum());
 	
@@ -979,11 +1612,42 @@ void fastqtobam(libmaus::util::ArgInfo const & arginfo)
 	 * end md5 callbacks
 	 */
 
-	if ( threads <= 1 )
+	if ( chunked && filenames.size() <= 1 )
+	{
+		uint64_t const numthreads = std::max(threads,1u);
+
+		if ( filenames.size() == 0 )
+		{
+			if ( gz )
+			{
+				libmaus::lz::BufferedGzipStream BGS(std::cin);
+				fastqtobamChunked(BGS,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,namescheme,packagesize);
+			}
+			else
+			{
+				fastqtobamChunked(std::cin,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,namescheme,packagesize);
+			}
+		}
+		else
+		{
+			libmaus::aio::CheckedInputStream CIS(filenames[0]);		
+			
+			if ( gz )
+			{
+				libmaus::lz::BufferedGzipStream BGS(CIS);
+				fastqtobamChunked(BGS,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,namescheme,packagesize);
+			}
+			else
+			{
+				fastqtobamChunked(CIS,out,bamheader,level,Pcbs,numthreads,verbose,rgid,qualityoffset,maxvalid,checkquality,H,namescheme,packagesize);
+			}
+		}
+	}
+	else if ( threads <= 1 )
 	{
 		::libmaus::bambam::BamWriter::unique_ptr_type bamwr(
 			new ::libmaus::bambam::BamWriter(
-				std::cout,bamheader,level,Pcbs
+				out,bamheader,level,Pcbs
 			)
 		);
 
@@ -1039,7 +1703,7 @@ void fastqtobam(libmaus::util::ArgInfo const & arginfo)
 	{
 		::libmaus::bambam::BamParallelWriter::unique_ptr_type bamwr(
 			new ::libmaus::bambam::BamParallelWriter(
-				std::cout,threads,bamheader,level,Pcbs
+				out,threads,bamheader,level,Pcbs
 			)
 		);
 
@@ -1195,6 +1859,8 @@ int main(int argc, char * argv[])
 				V.push_back ( std::pair<std::string,std::string> ( "md5filename=<filename>", "file name for md5 check sum" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "I=<[input file name]>", "input file names (standard input if unset)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "threads=<[1]>", "additional BAM encoding helper threads (default: serial encoding)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "chunked=<["+::biobambam::Licensing::formatNumber(getDefaultChunked())+"]>", "parse and encode chunks of four line FastQ records using threads threads (single input file or standard input only)" ) );
+				V.push_back ( std::pair<std::string,std::string> ( "chunksize=<["+::biobambam::Licensing::formatNumber(getDefaultChunkPackageSize())+"]>", "size of FastQ chunks in bytes for chunked=1" ) );
 
 				V.push_back ( std::pair<std::string,std::string> ( "RGID=<>", "read group id for reads (default: do not set a read group id)" ) );
 				V.push_back ( std::pair<std::string,std::string> ( "RGCN=<>", "CN field of RG header line if RGID is set (default: not present)" ) );
@@ -1225,7 +1891,7 @@ int main(int argc, char * argv[])
 			}
 		
 			
-		fastqtobam(arginfo);
+		fastqtobam(arginfo,std::cout);
 		
 		std::cerr << "[V] " << libmaus::util::MemUsage() << " wall clock time " << rtc.formatTime(rtc.getElapsedSeconds()) << std::endl;
 	}
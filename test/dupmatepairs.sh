@@ -0,0 +1,124 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/base64decode.sh
+
+# coordinate sorted pairs on two reference sequences, most templates occur one to three
+# times (duplicate pairs). 20 unpaired reads start at the position of a pair read
+function dupmatepairs
+{
+cat <<EOF | base64 ${BASE64DEC}
+H4sIBAAAAAAA/wYAQkMCAPECjZU/b9NAGMYvhQrChMMNvuUk+zJ4QFX+qmnEEEcWMhUUoUhIDB1Q
+SwUDFFV8AUcdbu/G2m/AxsTCjFC7svMxwvu8FzuuE1QnuiS+xD89z/O+72Uav2jEQohJmjRfH4y7
+O4Pm7OX46PT07PjDp7df3j2YzF41Zwfjo/dn3ebzg3Gv0+mU9nrY6w5pb4sg27TwQ/H7XnHRE3/o
+075wj4TW/SfPWg0xE3K5d03rktbxx88EH4hJQ4jAs+E8ymyQKKW01gpPqekplZL1acMbtHZCd2tp
+wDHGKAmoymlPC9oF0+hG8eOu+45pwz7TCmktUqQlEViUlAarPm1QoUmjtFH0oo3UxtDlyunttGGV
+BmnsjzWS3ZXTNwXtqMjtMd39N6f1ndMwa0VxknkhYJLjMlwJutKFtu8btO1tl7R1R0yLsyyznifP
+5ygj9FAVlHtXpj5t7ybNopyUFYJDYakoptB2XdAuC6fomsPFYlHutyywcRK2bfsc5pTrEoUK4FN9
+2rBCI1lcVRKmoQ9XOc1vrFfhivZ+5U4HPVeF8yALkyiwkXKiYFDhFV2yX6pfdRa+0d7XnNbbZdrc
+T6demCVxTN1KpVRIDqFJgOvTRhWa4dY1BhzNk6o20C4KGnpQ5bkt+61EQ/6GB19iEkhb4XRSyQ0d
+snOn1CF91yF+mrb81nRuWwbBYzoRHJhG16cNOus0jLpBfOSaj6f6tG6F5rpjOQUERY33S4lX+w1Z
+nuS5LWs69T0/DMLAiySqCJ9UCK0YqerTRmVam2g4QBSfcJq5cuX0Z6VD4HQsSk73nLbIS23a9kKb
+MAsI0uacribrdtqoSkP/S3jEEYIjU22gPWTaYvlwtBM6Q/oVGsel+QBXBu9qpe1qQ/didnt5bvmc
+2mQeSL9N/wuaD0row2EuMRs57dHWutPDRsnprsst9b25jXybJkSgwHCQcAuj3eQ67X9Oh1Wa5pkn
+gZgw8w/nmdVAAAgAAB+LCAQAAAAAAP8GAEJDAgDvApWVwWrUUBSGbzujuHTCgeZuLiR3hOAqM9B2
+Ci5MzCLOwo3gC1QEF4pPUEjIInu3CkILgt259wl8A3FZEF/BheP5z83NjJmK06HNpFPm4z/n//8b
+S0Rmqdzrw75Sdx48DvbUU0XdZ+cjpQ72lHr+6k2aLhbqId9PC2qaJokK0vxtq0nzD+41GSJPu7yG
+dsa0H6qjzVKh5TVlZV3GUWMNWfwavjAWd3p32mxA04YBmiwu2rJGftudNh/QSLMqCxpLNPyHtv3e
+7o887Vxo/EX1dd/9T2gnTlud51kcxJS1msUxRjZmNMbV1tOe9LTTXtsVf/bJ0xYnQqtKCsKqaqch
+Vg9ZPKIRH1jfzrQT50KVeRr0YG8AQpe164ScDSb1u9Sr1WrT0yScRFFLddzyznhZzlkDFJN3p80G
+NGudLJlRdOobaJv3tEpooDgHCHaKEcuN3A9p6MfP3x2t60I2zfM4CJImYz0WiWWkRRGg1NM+j7bz
+djFW6rZv1uGR0NqCwjCmaYTFw1UjLegCt027K7RV93J5e5Gm6bGnlWEcME2aKa1C1GDuuqdXPe1t
+rw2peeb31uUtaMOyadtJWWFhBjbATdig19r+S+vytqYRxoSRYGJeWvf09Xh7bwe3lPri03voJuXk
+RkWVR3WDkkrv+coFw95om/avvaUDGjw1OIqslUMOkfO0d9dou8fa3nttRy69VVEledKUTYQuoFka
+U7JITL47bb5Bq5lmnQd4k0qg/H16r6G9ZNo3T0td3pq4pTYP6mRi0XQ8DGRiOU962sV4uwvI4C/f
+hS69eVKxriSuAjlB+IxDvQg37K+nfRz/nRCclt83T8tjlzevLImM9NS60xJrMzegLdIBDXGVEwlX
+6cM6b8jWcFKk5pFPb5e3umjjsm6iInc2oq1a5IG33PBvSIPPp57WJYQxUUhBlmfoumQES3PPLrM7
+bT6gGZGDmFgnc+NZnzjaH5n5HSMACAAAH4sIBAAAAAAA/wYAQkMCAOsClZW/jtNAEMb3BHfQga2R
+zluwOmcNcoOU5BLuCgrWchHSIIF0dDRESBSgewVHLlwi8QZ3Fa8DFdDwCpQUXJiZ/WPjGF2wHSVy
+5J++mfnmc7wnXggQ9jg8EOLGnhCrd+fj8XwinuDvchRVJoMsSTRIPLWWWkmp8ASApXsy3xfi9uOn
+8b9p0x5N4qFAA7NAKY2Xp00D7XWg/cJ734WjnT5iGoLypGrKegRaKiU1ykMWUlGl3J124mmJowHS
+qFalPTfQyoFKP+O9C0+bjpk2Wq8LWNemMqhIU+9QFFUru5VeT5v0aCxLkTSJOLzw9LRngfaRafig
+uLdv/2PazFaalwkkplmUEdbGnZeWhjJ10PZ8QFuEM/3iacdzpqGoOqlrE5WAc8QCgUlULLRTeDkw
+BY20H0HbKdOsLijLHIVhz1AXUmkIOJWg7W2gXQba5U0hHmw2G6aNrUPy2qRJZZomVqzGmQ5hNNht
+WqtthdruePfOjrdoQCYBpnL/2ilcT5v1aPgwIrBeOwMq/D+0zfvaaAVoUdlwVG1L+zRAe4+0r34K
+E9u3NDJN3MCiLmmjyGw0ADQHEHHZcWp/CuToV34KbhcW6zjK0CQZkN/4o5xVtFa70yY9GpA/aAFQ
+GbM6U/g24N4zrPRD8JvLECbV+XrNRfIsbc9oWbdpd5m2cYfdrDfYt0mPxsWRTfBbkUjELjvp091T
+n1L3faUu3yCriyQzKUS0mZLKpEhyq7877eQvWhwpTpCQSBwCy86G96dASfDQ09zW51VdZUVRpSk9
+T9vJhqO+Qeu3w4Ntvx3dwlTy7j22lToUGEMQFid5Bhwk27RWG715fl85be6dVWWxo1F6c+CC9Rq1
+bnfatKeNWiW5WN4Hzt9lJ8v6U6DMO/J9c/mWQmqq1BSNcRNAb9DGU8XtFM4GtJEHzwPN9i3OiipJ
+IM0ilKMp3sge5JFuWq4GtFGu/Lza/AEMPdy9AAgAAB+LCAQAAAAAAP8GAEJDAgC5ApWVP4sUQRDF
+e5FzTXdocDop3K0DO5L9d+qBoLNMMF5qZOwhGCiCn2CbDRbByEtEI438CmLiZzEwNrtE13rV03Pr
+7MLNNQw7M7A/qt57VbM5ffl6PJ7PzKOeMcPDQRXWh/miICLnrHXWERMzkSV7YuI5vW7MjQePs555
+b2z97sWBMb//bjaRNm/RLFvCscRAOtx1px1Fmk805xgMFqocckAm2qs9tK9Cu72paZO7SlOQz6pl
+TlKNdCj9WcYld5xoHxras4Z2Lu/eoG7Q7kfdfDYalJktQw6pHDspTy52JLVRd9p8m1aFXOqBEfIj
+dQEoD4n2saE9aWhv+8Zc69W0e2OlZaMsluahmYgG5QCEH1egTWpa3ahnYUl3woMdQmPH3WnThhYi
+TWwU4SUXQpNegUy0X3toZ0L7kXQ7ip2WYVhV1dCGpXTG6oRDq0geN+k935MQOPMuJSR5am3uQ1hW
+pYOlhArVC+SFutPmLRohtqRyYcBUuUS71d+l3RTazzQLs5jeoii89VWWB7VUm+VorkAT7U5/V7fv
+8u5z0m1au5CHQR78YjlocubQKOtEdKfNdmjwkSMOYy/SdafNWzQor61ivuJGatL7tP//ZMkfzbe0
+X0A7jp2Wo3UW8uHI51ZlU5rTnDjL3WmzFs3BTdLUIcRYT1egxU5L39C0QcdRO53XPTSjtE19Iu35
+WBZcqzapSCmYL8wponKyNZOR9qVxAbP7J+Wt3iGLYr1aLW22CiITQSsHHqvD1J02adGweOvVK0mD
+s3yF2qYtmtU1hNrgKGS7mNOzPTTslYdpTusdAtDC2soj+tIjadRgKBpuNvkeTz8dbHk6PY5TXw2L
+UoZ+sCB8poDEN1Cn4aK2S2mzcYumX1Ddk1ZD57Y8vZw22ab9A3unA6EACAAAH4sIBAAAAAAA/wYA
+QkMCALQClZU/b9NQFMWTqYzY3CFenmQ/D5aQkJuENkEMPOsNpisTAwhExVapjEzIVoaOSEzM/RaI
+EbH0I/SzIDjnPT8ndYPqviqv+aP8dM+959zUUaWUFtFaK9FJokXpROmTiT/fDyaTB89fxlM8Fzz+
+doefnZ59LMvD5eQFPizqtLFtU0cVvg2ISAIcsHih70FbOVpWpybQkkRUAg5upVifBNrPnnbpaDxP
+8N5bEE/PzstyPne0TWNmualy02gUAxxQeAbVeJWMpy0GNNaj2TC0TJzqrdK7acsBjY1yKCh0pYFO
+Gnv1bHKb9mvq/zva+tjRLqoL09rG1Bk6BQhaRslQyUrH01Y3aCZzzuBRnKjmPCTQ3ve0V47G997h
+ejTtaIvOITbO8jizxnqBidAkmC7+fN/4zU897UNP43UZajvySo2NTW6rmvWwJEKEKNSoZDzNK017
+mlAddQalcNx42npQm9BlijIVDuBqS/u8h/YY1+9AOz5yNE+q2jSnZ5FVGITBYuOUCrQve2jXeJz3
+M33qaB3KbArUxe4DSZwQuof2v5yWQxoHCXVKvD3gvH4KP3rat95vrw92/eZzGuU2zzabNI3oN/Zf
+ucp8vsbTFltaA1rDETCoTITbb13qx9GWN2kRMyVeIHemS2qgXe3JwhUuCVlYHXqamCaLTFFYOILt
+4pJjbcTegzYf0BhR7zKOg/tpO9PrgdIw569hI3UOKWze5GLbNqM+BsK7BCFFcSc7vh/SmI83gdbl
+NE3jFgtuVnj3up8FSfzS3O63u2k+p1FPUz6c3CGaB4plPG09qE11Zbmkcgo7WZhObyfrD66HYQql
+VxrPirS1UdtWforMPrdv4n5rxtO80jgKNGcN6ewhfgOPp62HNLd53S+gduv8HwH8oyYACAAAH4sI
+BAAAAAAA/wYAQkMCALAClZW/jtNAEMadu4aS+KbwNivZ68KCxrlLuByiIJYLc6KjRgKBEM1JtJS2
+LJ0rGhp6HuF4i7wKSEjU/Plm1ruJHJ/wJd7dxMVP38x8M0tEl0EQzLDuY7v35Fk4C94E1L97i+09
+n1cf8nxxFjzF/yzNNnUURUloSGnSBo9SSmPHz+m05YCmtAFCaw0YQDiNmk5bHdBAERxAxCpphBYI
+7W//CYT2Ls/z9ZBmoEaTIhDBhDpjHO1kRNsNtm9O27nNW9FF87pu4qQBCBSwoAuHIbPT9n+azVvR
+ehonS5EEyiEj0DtoWw1pQHFVgQGHs6bpkHZL3hbnA5oxAmIeo+RxtIee9tlr+4j1GESr7ZHQ0jDJ
+SorTeSlhcr40c2EPiHO0l572VWj8OTmyp6VZbXEWh10UblKyLuMQidjAWD5vrwY0fvca68efXtuZ
+rUIzz+o6DTdlhRCJJF9wMVcBVb3cc+owUvbgFxep66yeVaZsMyZYA9uyTqcthzRRZNhtMLGR73Ta
+akBT3AnSC4iVm1bvHHIzQmPXPPc1tZGWSZuUcRtTx/lCMxh2huGBgjJMpy0HNPaHkhYQKDKnzXTa
+ao9GTGOrKWcSJaZztO2IQ7ZY351D1guhIWFxV1dNO4fFpAO4DoByhe9AOx3QuKTiX7KtwDZxtN8j
+kc6w/XS03PZClKZZRVRlGWg8wRkqG9tlOm09oEmUIs1IY/EQmE676GfvThvfBMaWlZSMX0e7Pjqc
+b9fHmE6zvutX6z5vDczbRm1jZ5HUU4vZ9u6sTyO0K9B++RliaSlVRVTFUcc3H7cUExkkvjuk3XbL
+nHpaJzTF3hXbktx/iNTnbetpL/x8e3C8N98urN+iMimqJmmKgm9ADDYjTiN28q6mnvYPx4wxXwAI
+AAAfiwgEAAAAAAD/BgBCQwIAJQONlc2K1EAUhWvsFtwIVigwtSlJKovgQjLT89MDLuwQJA6CoOMT
+KO4GXLlxY0JkggsFB+YFXLjShbjyQVyIjyDME/hzz62kuu30aHdn+qfo+Tj33nNuxBWhhBC/uwd9
+FI+PnmRZtiNubQgRFnFe1nGT58ZabTVejTZK8/OAfk0/Et8uCHHp5p1gQzxiGs5ejIT4wrSnWbab
+Ma1I0lkq5aysrFEGFEVQRRe+97TvSzQ83o/dO9P29pnmYSFkEc7ypQ19NHZt2jRbpLVE0wo8TSD6
+I3naem3paFjpGzp73tN2nLYwlkmjZjINjbFEIWHEtNQ0+ur7dsPTTrw2/LfXNukqdagqqjVB0DYW
+ZUgoHaxN284GNLQLNMNjoKLX17a9uUTjOjVNFPNUqHc+hXue9sD37YzOPve0fVdpkMcqiNJCSctm
+U2iZQqUE9lN4eA7to/fbhGmMSqQqqFIN33ZzxWStr/RoqVKcvSbXXKY8OL9NnXsjFTdhKdsKfTcw
+L9EsaDTUgwXfL9OQj9s9rcuCgqw4TFJJvQIPSbCALs70eAXtmGg/fnW0HaetjKO6rmTcphpj5Blo
+rTp9BwtOXabB0S97bZ1760oRqZ7NErY/z5OKRefsvNK3K7JwSMn66pPldogM0rpNVJBLVMkLBFBW
+ZzztwwraKdF+er85bTKJqzoIWiSL3Wa4fWQVbJSe9mmFQ1KivfLJ2mNaGkZRWldVI9EqrRlH/WOX
+2PVp0yUa2o7dhtm6bTKf6ZmnvfM0OPq+d4hzb5lUeZ43Uha8bTFRXpnsPf0vGtJ2t6d1ySJa7Ggw
+mmKPYJPzjpvvt/GQhuqf9bSub7KWURLNihq+oIsXieZ3Ne/b/2nTv2gNKsTNAN6AWWBfr20yHk5h
+96IQVze6KWztumSpMiqaNmpLcoRxNwSXVjRvSDvnDri55WhhT+t2B01U8z2G2uhph+NhspCP632l
+XRbaRoZBXcVNgRwoXpmcAwPv9bR2PMzCCVV6ra904rS1RR2mSRgkMawLRe4uyPvEZ+F0hTakbQRt
+fwAOh//qAAgAAB+LCAQAAAAAAP8GAEJDAgC0ApWVva7TQBCFN4II2lhTeAtWSjZFSucXLFEQy0KG
+BgGPAKK7Eq9gy4VFe2+DoKNFoqai5RVuSckj0BDmzNprXyfRNRvH+VH06cyZM5OL91G0idWTkVLB
+fJYk2WISzAxprY3RhLslbfn9c6UU/0j9uKvU/cfPgpF6o0i587R+fXvBtO1aaGWSURlkARWMIeYw
+SQuJDNnhtE2PBgAR37XVZAEmGk7b9mhktLFWniSXbmnXPRq++zlW6s6opi0fOloWZNNwElQlKKjR
+8mGWgcBjmhLaoT5O27soinbHNIYBJfVyxcYOp8UNbdHQLPvOZhn0k+vU/6Ft2dfGvWSWywgnBPJM
+Q/vjaa+9b1fs27emC7GjTZMiTcNwHlQcCaYxBAaCxZ8a2oPxcU9fjDs93bguVAEl5SLf5zP2y7qE
+cDaAtq22lnbOt02PhvyzawAiHojdcNoy7muD80YmArFD3X6ydp72xfu2Zi9//z0cpNKV861asHOT
+Yj/PWBR3EZGDRgxWm974hG/fu7OwfCS0gjgg8yCtQpRZT4IRlG613U6LezQr6WcMRkFGrPXtw/j0
+ZL1qaFEktCScpFmeF2UhKCwlXNhI1Gq79LRLT6vYt1+Nb+uV8y0MF7zesrRkRegDa8N64xu1ebsa
+H6cX2rJG284lRGTlVGYp1AAoi8QAae1w2rZDC5mGIQCO3A5Bjk9oaxOCaXt5qCutJ6vVJqvI1B3F
+3Hdm4dOZLuy9Nkdznu3zLEfGJBcsTltZdJ72udcFnI/3OglZ1QkRXSFVc/JtABG2tem9lbaObtK4
+PFmRsnyN20t6OG3Zo0Gbmyn5h0GxXtvXM75FPr2OVtEknU5zCqfYHHigD1hISN5w2qpHwyhZK5pk
+AdtO3m6nrW/S/gGWY4fiAAgAAB+LCAQAAAAAAP8GAEJDAgBZAY2TP0vDYBCHX0HBtXJDbjkI18Hx
+bat1cVDpEPs1FDfBr5BM4qqbo6s4Cw6ujq5OfhK1v7v8sSQlpGneJBfy8PzukpSUlZjIF1wIES9D
+CFvYn3dC2D0+37Nzwv5X/XAaLq+vYoyzcIKbtzRapGlOSUrCFQtYJRIsNe2toV04zWofqKVOu4lx
+eui00yJJ8iwb5xmLGlBVheyPa1muPVnS7hvaHWov8HNajE4rslGRj/cpPyPBxgpBsSPc/pNuoln6
+z4Y2adGMo0zsICRlYRpOm7ZogmRsWmal4CLzcNqsnRQYqIl6WrWx9rp9bYfw81vRJkdtWtl6BPVX
+xZi9bjbn79qtmula3yDHpRiZpYpsmOlTQ3tA7bWmzQ86SSEHL/TO3jdfh9M6buL9QlwsNgXpT/qI
+2ntDm3fcMFApG1d+FkwrONbDK28DAAAfiwgEAAAAAAD/BgBCQwIAGwADAAAAAAAAAAAA
+EOF
+}
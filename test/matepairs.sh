@@ -0,0 +1,192 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/base64decode.sh
+
+# coordinate sorted pairs on two reference sequences, about a fifth of the mates
+# are on the other sequence or at least 800 bases apart. BGZF blocks hold at most 2 KiB
+# of data, so the alignments span several blocks
+function matepairs
+{
+cat <<EOF | base64 ${BASE64DEC}
+H4sIBAAAAAAA/wYAQkMCACgDbZW9b9NAGMadpqVKGSqfPHgyOp+Hm1ASkn5EDLF1w5XSIogEbKgK
+legARRUSE8MZD8fAgFiQEBMKE6rEwsACMxNDx/4ThUpslLvchz+tnJxckp+e93mf95zEO63YcZwx
+JZ27u6Pe1UFncms0PTw8enjwZO/Z/sp4crsz2R1NHx31Ojd3R/1ut1vY68u93lDsLQjIkljyh86v
+Zfuh75yKd1uOukZiLV/fAi1n6nh671Ssr2I9ftrtDvrOuOU4EWYe4S51KUJBfun3Bja2sI9zmPij
+86OtvpOwjY05TJNonBVIBosMbNvCJlbZiVgfNGxzXcGyzE98kGCOFAZJWagCO7Swt1bZ9lKu7Npg
+Dgv9KMYEcs7y4gRT8SzspFKmUTu9uLgoKIt9jGPOQoi1HsnRL2Q9O60oM025oWG6AQqEE+gGqGhX
+uUyvVfesI4LQaakyh905zGV+QtMkZbzsvrwhC9tplaMhPbtS8Gyjp5QBNwNJlmaejkRJmoHNGmDn
+izlsfVPB0ogRApPEM5IMEBVg31r10F4WZe4bZWtzmJ9ADzBGIA5KFyop+1nxTCr7vZArG6hoQEwj
+mAIXxCiwLUDVCZBmV6Mhm/L3n+qmbgBnke+xLIUgz1cet61CSdVoyNLf62joMi2LBHYC5kAJtsqS
+hbpnM7H3XJfZXdPj5LlJlEUsRbUxz2H3GmBnYu9Yw4ZqAvyUApwRklJtlUq/Fmhg9xvKnF1ynL1F
+PehD5VnEQk4IjXgxEuZmYA8W6hNwII6gQE/AmgqtUpWFIA1qqc2VvWiArQrYJ11mX3XTixKfY0JJ
+WM5+OWcvG2B/xDhlbX0EqQmQJJ+EHuaFMVeDWVD2rgHmCtBrraynlMWQM5/DEDJU6mP51Jg1NEDG
+5ZXOmY4GCD0XwIS6nnEL6aQFhZx9b4jGsVDWNg1Q5xklOPRjwD1cOcpKg37WoExm745WpnPGIHZx
+5kYhs6OUPwws7LxB2Ruh7IvxTD2dAAM8Fs8TL6s5VoCttOsN+NwuPDcVDLoxBRl1U5p7hWqhXW3n
+p8Z/1NUXqQAIAAAfiwgEAAAAAAD/BgBCQwIAAQNtlb9rFEEUxyfJxYBgMcsUA8rB3EyxiMLlLjkv
+IOIOU+wpaGEjWlikUhGCgo0ozLDKoSj+gGApJKVYpfcf0D/BQitrsQqYOLvzZnb3dqa4vXvHffi+
+9/2+OYLcebqM0K3j4+MHO8PhaIguLyFEdKo0FUZp3reH8/LB7bNfvpnBD/EKQmsXZ8kS2kMEah8t
+7BHA1h0ssEwF8S/VgwfY2QDbrmG2ZuyzhF2YVjAsicqUwgkFiOdUHz3sXETZ9hpCV3sONt6sYMqz
+5iCKO1Zb2fkIbP8EQq9WHGy6UcGYsifDbF60NfVbMxtF2tyztefQ5nRcwUBWbkxo0uN4DbsWYDdq
+ZbZ2D2CbbmaJSXGR4ozNObjYh15LqIfdjbR5x7r568i5OVl30bBdpoOBELTfPLxSGJS9iCjbsQYc
+wcwmkwqWKokHJM0IqydVyWq5+XZBmf0her3svquiAaEtOYqJhDRkhZR42LsA+xCU/bWw6z60bmZS
+2KTJJGO5HztvdDtrBHQRVgb5GcAgtE5VIcrQhhb7i27uRWBlXJ4ADKKRS2skpSzN64hxeFeHdj/i
+ZhmXXYBBNAqVUK1NUhQQMN7Y8wD7HIGdtLUrANtwMAfKSa5D+sM61bAvkTa/WgP++ZyNHMyzZGP0
+fHGdLvW6OTuwtZcQja0tlzORC5yTIpf97gkbkPW6u3loa98BNnSLrkxGdK4KkXk1jWwE2M1eN7Rl
+6z60owmsU5aIeZYyzDlv+dmMxm5E2fYqQj8BNnYbMDAmy/RcG+bvHx7ZzYNe181yjo/BTZiZxGIg
+Ukk15eHG7m7At4gBn6yy375NN7OE4UTiBGPZ3Ey+APsRafO2hb33l6NTRpgeMEw0E41phXDMGs4t
+5qx0eAxtejcLSi1KatFtsoadWu22ed/WHvqbFq5tok0hJWXU7xAPf591NE6vttsso/FmqY7GBoSW
+UZLPKRE5b4e/9e90JqLs0Nb+AGziomGwVhRrqUyY/H9a/4H5AAgAAB+LCAQAAAAAAP8GAEJDAgDo
+AnWVv2sUQRTHN5rcVQq7rDiFrOzOglMYvNwvLmDhLVtMsJIgCHJVmoAoFrHTYiZbTGUj2FgoRP+E
+gKKdrY2dFv4VVonCObNvZnZ2d5zkktwc98n3ve/3vUsSLL8S9XMvgLPYCoLh7b1oIzgJYvl8Qz6O
+tuC1x09Ho8k4uCPvKlJlNCuzvFDvriHmD/ltYA8t7FUNU+fXZhA8Wa/XCrbYrWFpTBjiNKKRxlii
+CzvwwF5L2HUNm4xqGIBElorEUmokVk8M7FGnTHUuybuXGjab1LAahEpEcgXBpsAahi3shYXt256t
+nJ7t7tSwXDC+FGGRLRN7rEBrwDuPsm+yTKSVjaegjIWijArCM9zqPpw+bN/CVoMg+G6UjRwYlTDN
+wI4HVtlvj7LjC0Hw/K82ANykmUCc84hWSevglrJzD+yavLusy5yDMkFImgtKed4o0r+daBSDfplk
+KP+JLnMHQhulKY9QWJSF26tuz+igPwFfLzZuziEaQOJsyXBTHu66ec8D2950ojGHaJQkRigUDNmu
+Y2yRBnbfU+aZvPtoygQDDIowcLJRhx03V4O+ASout7QBOhoAQhkKnWEyw2CVHXmUXZEGnBplENqI
+FTxOaRWGWldjpQM78cAOJeynho2gTJlXQZYlTYuul66y9xZ20IL90LApuJlzwau45HGW9A72wBpl
+2zIaz/QELKZdGE7aUXM27QePsgdynN7+0QbMYJxMlbnejE2RDuzM46aKC9VummiEIWUsLhDprQwn
+Z+eD9qZVof3s7jMYJxbGAoVlyrnNajOiVpmKQVeZistdowx6FsYsWuYsLhlO3O0PIg3s6rDfsy/y
+7pNWNgNlwKpKJpLW2mgPOvEoU5tkYJRpmCAZSrOYoJakTs9m/1H2Risbg5tpwRiSw56n2H7UNb7a
+j7phP2c3Zc5OdTQmAFsWtEhjOVFV0lmO7gQcespUI3Zjvf4HssYhRwAIAAAfiwgEAAAAAAD/BgBC
+QwIA8AJ9lU9rFDEYxjNrbQXxsCFgQBycSQ45le2221rowYkDTetRvAsieKn0K8wwyODBg94ET3rT
+g+BNtFDxI4hnP4FnFWHNJG/+7G5wdie7hN0fz5v3ed6Zn5xOJpN9dCtDqCmpKiSVjcwZY7m5GNx5
+foTs9WgDoY2DI5yhF4jA3pt1hMR8Ph9gO9sG1gUYgJiH5szBTj3stYc9uYDQ6K+F7e4amAUpyluj
+xnCYl+ZgnxLKZnrvISibzgyMVGNOBcGE5rkvkpmXfv8PdlXvHQJsNvUwZWAsqg/OzZSpf4QwcrAH
+BjbstbrMTt/mzPYsTPGukbKpCtAEVea+AcMfqYfd9bBzfX9GFrZ/0zbAklRR5osXi2EHCdglvfwA
+2JbtZlUXhAqs6sIcFAvChk8HO0mUeaiXnwDb3jKwcaFoh0VdVnGJDuhg7xPKNvXyHGA71hp131dq
+XHStCFYN4hzsQwJ2rJe3AJtaZX1HGkxV2feAYh4ZKTtHi6Z1TbkN1oAGaErFa1LUbUiR62pQ9ieh
+7KNevrkyJ/bMJJdkLPuxcGnyJosasJ6twn6v6b01C9uzZzZgKC4xp8NJ+QLBwEeRDZbLHOxyA8oE
+a3iWyl2GQuITsGCNbITQlQyUTZdhzhosnJpPQKLML7rEM4jTxMKoUrjteox57i3GXBu8ss1EmYP3
+Hrt5Zs+MdKRrqGw7yWCYLY+g4Y+zhLIzvbyCbk6sz9S4E6IWhJQsmrDwzZd5mC2OIBcxDMogTmXB
+RctlPwzHPI/bGY8glVD2Sy9fXQLAtFj2ZS1aVcYwtuSz48SZDRG75yatVeZZbch5GN0Odieh7PIo
+JGDbDkdXpOCLZS5a434C9l0vT12c7DNAtgVpOMW8CA86181g2iYBuz6y9jDKIAG8qJu2w5WMVK1M
+2mfZ6gPl2kX7aZTZh3DFSdEILohcqTKK07uEspda2cjFaQ+mRtVz0usYRKJYHKd/6OvppQAIAAAf
+iwgEAAAAAAD/BgBCQwIA3QJ9lc+KE0EQxjtZWAVPM7QwIAZmug+DeIibZLPCHuxhDhO9CL6AuAdB
+EDx5E5lODnMRxD2I61ERFjwrCCvsA3hdEJ9A8CaCiCTWdHVNeiaN+dNhCvLjq6qvqnuMsU89xs7t
+z8Iee8M4PMMj+wPfq6vV6uGj4XA8ZDcgVoRa80TGshCDgYDvQJgPvmb2j589sAkcBxY2vGZghApz
+QxAINKdYw848sLtwPCZlEwOLdZ7IKKlihVoaUS1lXxvYnQZW9Bmbw28N20WY1InSqeZcCwMSRBMu
+7JsHdtrHupk0sWYZsgIdCNHUzNStfibYb0+aBRz7Ns2dPQOr8jiouKq0crLbaECvT7DDBnYejp9L
+hE13DKzMo0pynoUB1lyQshZsu7+Z5jHEPto0d0aoTCuVx3EkM0eX6MIu9DfTvNVb+2w0NTAjCjrK
+C0IJIsKbYJc8yk4g9sEq28MG8EJmGdStTKmZjWkdn132KCvhuE3KMM2GVbkNsMCmm8MGdtDA5hC7
+b5VNEaZVklRBlaiI7DBwWkCwkQf2C2Jn5DM0bZikZaRlUFtDdPwv/gv7AbEvNAFjrNkaJtwk0ScE
+G3tggy3GlhY22TUwSlIGriJKdObMYbcB9bw+sQ2ws7mIwlQtUl6lZAuqmwu757HGd4i9JmXXsQF5
+mIZFVqmEnCo8g/7Uk+YSYocEs/ssKDXkWcqou4Bc0849s1nb5ZVN01qDULFyUaSOYM86adav51v4
+a2A4AYYTyrCMB60RFy3YS0/NLgLsBY2T9dkCOBnnuLa72gh25IFdAdhb2hrYAJWGXColC+6UamOc
+jjzWeA/HkvbZtAsTLq49Ae88yv5C7AHVDCegxnAV5mnUrlnbGsceZfXCnNHaxm7mpcoDmZVl1DDw
+MmjBTjywesfdtDC7z4JM6rzkaanWdwmm6V4opx5YfWNt0yU8tFdd/g/QK7CzAAgAAB+LCAQAAAAA
+AP8GAEJDAgDsAnWVv2sUQRTH53JR6x1W2Gpxd4a4ppDL/UguYHEzjLBX2wS0Uuw88Q8Q9ZYttksR
+MWBhIwarQForwULwL7C2U6yUFELwnJ158+PuxssdezzIh+/3ve97N4+LeZRXaUpIql76SeTfFCHU
+kZ/vGwhduTXFHfQWxVC7L2sPF4vF7EmvN9pHE1krOZ7nJRMZlv/bvuGhuQb2w8IeWNizLkLv5bOF
+DXYVrM4KTOuYR4UUBMpAG3HKflrYkYUNZG0AynaHCmZZMSHamraYLin7tWKzfX3p6GcLG2oYbRSJ
+Z8KZU6qUOAP7HejZ102E/nQ0rDfWPWvbNRd5LAzGd2pg5/+xuQ02eyMFa1lRy6KuZ8R8JQZ2EVB2
+ImuvALanbSqHXOqr/UiARAv7G1D2XNZmJho7CmZZOYzQWCT+AK5215UdS9hjgI21zaxpOBYCY7E8
+x+XQpt11ZUMJ2zDKdM5iwTJalgkXBLplouvbvNZdD+2ZrL2DaOxom5IlFAsvyYLOGdhWQNnkEkI3
+NyAaezpnmsRx4lwSk1+rbDvQs9cSdA9s9mE3FSpPKmZc+tk1sL2AzUNZe2R2cwwDoDjLIo6Zo9jc
+WtjtAGxLbsC56ZkegKQwyhqeRL4k0GdtlgHYN1k7NbupB0BjLJI6m8dNuirMszkLwF5IZddhN/eH
+cM94GdeCJrHpfuqNdOrdrtVptjfuAAYA92zOiyjDlOd16k7tGqwKwLD8PL3QsKGOBqDiokr9y6h3
+3cIOA7B2wi+NMpgmb2hDo6jGaeruNRxaC3sTgAkZ2g/Qs5HuWcKKJmNlzsulbq38BpwEYDck7Bhg
+fW1Tg0RVcMsgbgwGdmphd+zZPth0Z7sPOVMgESe5d8vI6gDOAsra5b8LPYNFr8u8poxVtCKrKE/Z
+x4CyCXLKxnoAeZnRpKBRRt3RdpMwsE8BWHnZwXYHClZhVlUMY85S79QaqoF9dhvwD6xnO/cACAAA
+H4sIBAAAAAAA/wYAQkMCAAcDbZW9ixQxGMZn9fYsrBIGDBark8wdsRD2PvcOrriEKFkOC7W2ukbR
+Q/+BA2duiqkVwcpGFKxs7LSy0VoQtLEQ/Au0Ofw4k8mbTHZ2sswHgfnxvHme990kTZJkYK69hSR5
+ap4HD8bj8Vqya/ZEWQqMpeAFG9nFzION7Lu9pvDh99NJcmZnigfJ48TDtNm7cXJyYmHrKw0M0QIJ
+VBY0g+/dBW8edm7Bw24G2NIwSejAKVvZaGB1iTVFqKqK5utGnn+2sIs9sI9m7x2UueFgGSJak6qs
+CGA8iMWw5YX5Mq+YMs9CmSubDQxICqugKBAZ87DLHWV2XV90TwvbBhgXlci1pml0XMz6YH/TyLmu
+sg9G2W1QBm5WRalTVRiBo6hES4vdvBdg+wH22ewdgrLNbXdmIldSE8zVCFZ7/C3sYY+yA6Ps6z+n
+bHu9gZEqrRWnIkcswFg4Ng971ePmaxON8xCNrUkDK1SNMlRwrF1gQ3JnlL3tge0Y2BMoc+KioQnH
+KsuFVG11bC4a7wPseYARc5N/wIDVBkYlVmmlC8VnOMw5O40C2oXZICtwE0ILpEpmrD33AJ1GznUN
+sA4fAQzcrBXF2liQovakWqKHfek5s5+nzB64Od5qYDLLi1wWgojYTR9gD/vRk7N9Y8AjnzPnZoqq
+lEteUxzKawWGdvrVKdOuF4O2nSauzDLjKCtxKensabGZaBz3GLBobse/XZkT15sFJhnPKSVeGWNt
+DwRlF4bzyq5FyrbccFSUp6XEJdesDWvTm/HUWBrOK7MD8xsYAMMRSEhk0Nsz2fUwPuwZjmbvjTfA
+uZlnnOZFitMqUHpgl4bzbr40jX4HlK06N0FXrkWsi3Xc3Okp0/brXQgt9CYhlaBVjlIK8yL0UjzP
+dnuULRtln/5CaJ0yjxI5Y9H077ipemDPDOwqlLnh5plH6dqPxWBp5OZeB2bX/aSNxpqDIZljVecy
+Jd3OjKNxq3Nmdh0Ooz8UlzOCeIEIF1J6Pf8Bm5dEowAIAAAfiwgEAAAAAAD/BgBCQwIApQGF1L1O
+wzAQB3BXojAnyuApUnwZwtYPQVOJgUQdEomNRygjoA4MrEF9ACRWNgbExMAGL4DEA7CxwUMwNNi+
+sx1SUizFiSz1p79954YhhGaUjLGefOZ9xnYOSr/HblhAa59bjJ3XdX22GAz2J+xQrlUeT7I8D3gu
+fwv0yAkAGtipxeYWe5VrC/lW2BCxII6yZexFSaYdQAtayS4sdqwxNdI+vhU2HmkMoUIEeYiRKBP8
+wi47kp0QNhlqzFCFoDRgJzkb7L4D2yMsxWSemPGoqHwR64MyGOBksEeL3VnsQRbga4UFSPHMIq4g
+ITLeKIAJCQZ76ki2S8mmY6wmUTwL3bDpDPbcgQnCRrjNXMRetfSiIgDn2JfBXlqYGt/brppTxDCV
+H1S5KWazCGUjRbtpVe9dU9NSn8lIydWMJ0sPIDRNAe3W+AtTW/8gjLbpMHdirjvWMVfNRK4dmeuU
+dmL6OumvTclUI98SRk3bwuyNQnITphr5jbB0fZvg/i/g/zNTvfdOGPWZxbLGlbRn9gPiTd8jjwQA
+AB+LCAQAAAAAAP8GAEJDAgAbAAMAAAAAAAAAAAA=
+EOF
+}
+
+# reference sequences for matepairs
+function matepairsref
+{
+cat <<EOF
+>chr1
+GCTAAAGACAATTACATAACATACACGTCAGCACGAAACTTGTTGGCCCAGTGTGAATCG
+CTTAAGGGTTAAGTAAGTGTGATGCATACGCCTTTACTTGCTGTGTCCACCCCATCGGAC
+TGGCATTTTTATTACACTCAGAAACAGAACTCGGGTAATTTTGACAGGTCACGCAGAGGC
+GCGCCCTCCTGAAGTGCGTGGACACTCGCTATGAATCTCTGATTTACCCACTCTGCCAAA
+CTCCAGCGCGGTCAGTTCCATCACCCTAAGTAACCGAATAATGCGTTCGCTCTATTGACT
+ACGACGCGCTCATTCCCTTGTCGGAGAGTTATGGAACAAGGACGCTGTCTGAGACTAGAA
+GACAGATAGTGCACACGACCGGCGTCGGAGAAACTCTATTTGCCGCCTGACAAGTCAATG
+CGATCCGTAGGGGCAGCGCAGTATGCCAAGACTATAGGCACTGTCGCATCACAAACGATT
+AACTGATAAATGAGCCCTTTATGACACGGGCATATGACTGGTTTACGATAGTATGTCCAA
+CGGCGAGCTTTACATTTGCTGTGAGAGGTACAGGGATTAGTGAGAAGCCGTGCGTATCAA
+TTCGTACCTTGGGGGTCGTTACCACTCTGTTCCCACGAGCGGCATTTCTGGATGGCCAGC
+TTTTGACATTTAATTTCACCCATAAACCAGCGTAAAGCTGCAAGTGGCTCCATGAACTTA
+GCTGCTAGTGTCAGACTCGCCTCGGATCCTTACTACACTAACTTGAACGCCTAGTGGTCA
+AAGAGTACTGGTAATCGTCGGTATCTATATAAGCAGGGGAGGGGAAACATTTGTTCTCAG
+CCGGTGACTCCTAATGCTAAGACATTTCCCTTCAGGGGGGGCTCCCCCGCGATGCCATAA
+ATCTGAGCAACCAGCTGAAGCAGGCACGACAGTGCGACATTATATCACTGTGGTAGGTTA
+GCTTCATCTAATGTCCAACTAGCCGGCCAATTCGCATGATACCTCTCCATCTGACCCAAG
+ATTGTGCTTGTTCAATTCTTCTTAACGTGATAACAGAATCAAACCTGCCAGGCGGTCGTC
+GCGGACCTCGGTCGAAGTAGTGGTGCGGATCCAGGGGAACCGTTGACTCAAAAGGAGCTG
+CCGTCCACCTAACGTGAAGTTCCAAAATCCCAAACCTCTCGAGATATTTATCCAGCAAGG
+AGTGGCAACGCCCGCTGCTTTAATCGCTACCAAAACGCAAACAAAAGCATACCCAAAAGT
+ACACGGGTGAGGGAGGTGATATAGTACAGCTACGAAGTATCTGGCGCCTCAATAGGATTA
+TAGCGGTCTCTCAGGCTGCTTGCCGTCCGGCCCGGCCGCGACACTCCGGTGCAAGCTTAA
+TTCGTACGTACTTCCCATTGGATCTCGTTTATCGATTAAGCCCGATCTAGGTTCCTAGAG
+GTTAAATTGGACGTCTTCCCACTCCGTTGCTGCGTGTCTAGGCGGTTTAGCGTAAGCGAA
+CAGGACCCTGCCTCAGCTCATAAGTCCTTATTCTCTCACGTTGTGTTACGAAAGATTCAC
+TCGAGGTCGTGTGAGGGTTGGGCTAGCGGCAATTATGAAACTATCACATCACATAAGCGG
+GCTAGATATAATTTAATCTTAATCCATAAAACACTAGCTCAGCAGTTGAAAAAATGGCTA
+GGTTCCAGCTTTTGGGGAGACGTCTTTCTGAGGGTCAGCCGTGATTCCGATTCGATTAGA
+CTGGTCCCCACGGGTCCATGAGTACGAGGAAACTCGGTATCGAGCCTAAAAGTTATAAGG
+CATCTCGCCCAGGAAAGTAACGACGTATGGGTAGTTCTCCATCACCAGCTATAATGGCTA
+GCGCACTCTCGTTCCAGGGCGTAGTTACACTGAGCGTGCCATGTCAGCATGCTAGCGTAT
+CGCCCCCCAATGCCCCGCAATAGGGTAATTCGCCGACGAGTAAGCGTAGATTACACACCC
+AGGAAACGATCTAGACAGAT
+>chr2
+TGAAATCCCCTTCATTATAGGTCGTGTAGCGCTAGACAGTCACCTTTAAAGGAAGAATCA
+GAGGCAAGATCTACGTGGCAGTCTCGTGTTGACGCCTTAGCCGGTGGCGAACAGTATTGA
+CCTGGCCGATGCTAATATTCTGATTTGGGGTTGATTTGCGCTTCAGGCGCTAAAGTGGTT
+TTGAGTAACATGTCCTTTTGACGGGAGCAGGTCGCCTCAAGATAAGAGTAAACCTGCCTA
+CCAAAACTTTAAGCCGGCAGAAGCTTAACTATACCCACCGATGTGTACTCTGTTACACCG
+TCAGTGAGTGTAATGCTCTGGCTAGAGCCCACGCTTCCGGCTTCGTCCTCGTGCTCCAAG
+TACGATACCGCAAGGCAGACGCTGGTTCGCAGGTATCTGACGAGCATACTCGCTAGCCTG
+TGAAGAACAAGCGATTCGAGTTGTACTCTCAGCCCGCACGGTACGCCTTCCATCGGCCCG
+ATCCTTCAGAGTCAAGGCAGTACGTTGGCAAATTAGGATTTCGAGAGGCACAATCGGCCA
+GGTCGGCGCGGCAAATACTTTCGACCCCTTAATTCCGAATCGAATGATACCTGATGCTAG
+TTCTAAGGTGTCGGACCTACGTGCTTGACCCACGACGTCTCAATATCAATTCCTACGATC
+AGAACTGACTACAGCGGAGACGGTAGAGGAACGGCTATAATAAGCCGTCGGTAAGCTTAA
+ACTTCTTCAGGCGCACCGTGTTGGAGTGCACTACCGTGAGGCAACTAGGCCAGGGCGTGA
+GGTGCCGCCCATTTTGCACGGGGACACGGTGTATGCGGACGCACATTCGACCACAAAGCA
+CGAGACGGATTGCATAAGTTGTAAGGATGCAACCCAGGTGCGCGTAGTGGGCGATAGCCT
+AACAACCGGCCCAGCTTCGTTCGAAAATGACTTTCAGAGTCCGCGTGGTCCTGCGGAGAT
+CCGTCACGATCTCGAACACGCGACTTATGTGACCAACCTAAAGAAATCTACCCAGTAGCC
+AGCAGGAACATGGAGATGGTGTTGTTCTTTCACGTCCAAAATGTGTATTGTCTGATGGAC
+GGTGTCCAGCCGCCCTCAGTGTATCGTAGGGTAGTGTATTCCACGTCGGTGACAGACGGG
+GCGTATACCTGGATTGAGTTGGCTCCGACGAATTTTTAATTTTTCATTTCACCTAGGTTA
+ACAAATACTACGTATCTACGGCACGGAGTGGTTAGGCTTGGCCACGTTCGGCTAGAATGA
+GCTGCCTTTCCACTAACATCACTCGCCCCATACAATCGTTCACACTGCGCGGGCCCTAGT
+CGCACTCCTGTAAGACAGTGATACTGGACCTGCGAAAGCCGACGGTTCGGCAGATAACTT
+AAAATCTGAGCGCAGATGCGAACACTGAGTCCAGGCGTCCCCAAAATCCACCGATTAGAA
+CCCACAGAACCGGATCAGTTAACCCCGCCCCGAATATGAACAGTAGCTTCGGATCTTGAA
+EOF
+}
+
+# FastA index for matepairsref
+function matepairsreffai
+{
+printf "chr1\t2000\t6\t60\t61\nchr2\t1500\t2046\t60\t61\n"
+}
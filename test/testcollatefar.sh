@@ -0,0 +1,80 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+
+TMPPREFIX=testcollatefar_$$
+
+# pairs as single lines, in a canonical order (collation order may differ between collators)
+function fastqpairs
+{
+	paste - - - - - - - - | sort
+}
+
+function sampairs
+{
+	./bamtosam | grep -v '^@' | paste - - | sort
+}
+
+# runbamtofastq <label> <options>
+function runbamtofastq
+{
+	LABEL=$1
+	shift
+	matepairs | ../src/bamtofastq T=${TMPPREFIX}_tmp $* | fastqpairs > ${TMPPREFIX}_${LABEL}.fq
+
+	# copy pipe return status array
+	PIPESTAT=( ${PIPESTATUS[*]} )
+
+	if [ ${PIPESTAT[1]} -ne 0 ] ; then
+		echo "bamtofastq $* failed"
+		return 1
+	fi
+
+	return 0
+}
+
+# runbamcollate2 <label> <options>
+function runbamcollate2
+{
+	LABEL=$1
+	shift
+	matepairs | ../src/bamcollate2 collate=1 reset=0 T=${TMPPREFIX}_tmp $* | sampairs > ${TMPPREFIX}_${LABEL}.sam
+
+	# copy pipe return status array
+	PIPESTAT=( ${PIPESTATUS[*]} )
+
+	if [ ${PIPESTAT[1]} -ne 0 ] ; then
+		echo "bamcollate2 $* failed"
+		return 1
+	fi
+
+	return 0
+}
+
+function cleanup
+{
+	rm -f ${TMPPREFIX}_*
+}
+
+runbamtofastq default ; R=$? ; if [ ${R} -ne 0 ] ; then cleanup ; exit ${R} ; fi
+runbamtofastq far colfar=1 colbuckets=2 colmem=4096 ; R=$? ; if [ ${R} -ne 0 ] ; then cleanup ; exit ${R} ; fi
+runbamtofastq farthreads colfar=100 colbuckets=1 colthreads=2 ; R=$? ; if [ ${R} -ne 0 ] ; then cleanup ; exit ${R} ; fi
+
+if ! cmp ${TMPPREFIX}_default.fq ${TMPPREFIX}_far.fq ; then echo "bamtofastq colfar=1 output differs" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_default.fq ${TMPPREFIX}_farthreads.fq ; then echo "bamtofastq colfar=100 colthreads=2 output differs" ; cleanup ; exit 1 ; fi
+
+runbamcollate2 default ; R=$? ; if [ ${R} -ne 0 ] ; then cleanup ; exit ${R} ; fi
+runbamcollate2 far colfar=1 colbuckets=2 colmem=4096 ; R=$? ; if [ ${R} -ne 0 ] ; then cleanup ; exit ${R} ; fi
+runbamcollate2 threads colthreads=4 colmem=4096 ; R=$? ; if [ ${R} -ne 0 ] ; then cleanup ; exit ${R} ; fi
+runbamcollate2 farthreads colfar=100 colbuckets=1 colthreads=2 ; R=$? ; if [ ${R} -ne 0 ] ; then cleanup ; exit ${R} ; fi
+
+if ! cmp ${TMPPREFIX}_default.sam ${TMPPREFIX}_far.sam ; then echo "bamcollate2 colfar=1 output differs" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_default.sam ${TMPPREFIX}_threads.sam ; then echo "bamcollate2 colthreads=4 output differs" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_default.sam ${TMPPREFIX}_farthreads.sam ; then echo "bamcollate2 colfar=100 colthreads=2 output differs" ; cleanup ; exit 1 ; fi
+
+cleanup
+exit 0
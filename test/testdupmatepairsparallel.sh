@@ -0,0 +1,32 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/dupmatepairs.sh
+
+TMPDIR=testdupmatepairsparallel_$$
+
+function cleanup
+{
+	rm -fR ${TMPDIR}
+}
+
+mkdir -p ${TMPDIR}
+dupmatepairs > ${TMPDIR}/in.bam
+
+../src/bammarkduplicates2 I=${TMPDIR}/in.bam O=${TMPDIR}/serial.bam M=${TMPDIR}/serial.metrics tmpfile=${TMPDIR}/serial_tmp
+if [ $? -ne 0 ] ; then echo "bammarkduplicates2 failed" ; cleanup ; exit 1 ; fi
+../src/bammarkduplicates2 I=${TMPDIR}/in.bam O=${TMPDIR}/parallel.bam M=${TMPDIR}/parallel.metrics tmpfile=${TMPDIR}/parallel_tmp markthreads=4
+if [ $? -ne 0 ] ; then echo "bammarkduplicates2 markthreads=4 failed" ; cleanup ; exit 1 ; fi
+
+# pair and fragment duplicates should both be present
+./bamtosam < ${TMPDIR}/serial.bam | awk -F'\t' '/^@/ { next } int($2/1024)%2 == 1 { print int($2%2) }' | sort -u > ${TMPDIR}/dupkinds.txt
+if [ "`cat ${TMPDIR}/dupkinds.txt | tr -d '\n'`" != "01" ] ; then echo "expected duplicate pairs and fragments" ; cleanup ; exit 1 ; fi
+
+if ! ./bamcmp ${TMPDIR}/serial.bam ${TMPDIR}/parallel.bam ; then echo "bammarkduplicates2 markthreads=4 output differs" ; cleanup ; exit 1 ; fi
+if ! cmp <(grep -v '^#' ${TMPDIR}/serial.metrics) <(grep -v '^#' ${TMPDIR}/parallel.metrics) ; then echo "bammarkduplicates2 markthreads=4 metrics differ" ; cleanup ; exit 1 ; fi
+
+cleanup
+exit 0
@@ -0,0 +1,41 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/dupsingle.sh
+source ${SCRIPTDIR}/dupsinglemarked.sh
+
+function runmark2
+{
+	dupsingle | ../src/bammarkduplicates2 rewritebam=2 markthreads=2
+}
+
+function runmark1
+{
+	dupsingle | ../src/bammarkduplicates2 rewritebam=1 markthreads=2
+}
+
+function runmark2serial
+{
+	dupsingle | ../src/bammarkduplicates2 rewritebam=2
+}
+
+./bamcmp <(runmark2) <(dupsinglemarked)
+
+if [ $? -ne 0 ] ; then
+	exit 1
+fi
+
+./bamcmp <(runmark2) <(runmark2serial)
+
+if [ $? -ne 0 ] ; then
+	exit 1
+fi
+
+./bamcmp <(runmark1) <(dupsinglemarked)
+
+if [ $? -ne 0 ] ; then
+	exit 1
+fi
@@ -150,6 +150,121 @@ function runoptsgz2
 	fi
 }
 
+function runoptsgzthreads
+{
+	../src/fastqtobam $* <(precollated_fq) | ../src/bamtofastq gz=1 outputthreads=2 | zcat | cmp <(precollated_fq)
+
+	# copy pipe return status array
+	PIPESTAT=( ${PIPESTATUS[*]} )
+
+	if [ ${PIPESTAT[0]} -ne 0 ] ; then
+		echo 'fastqtobam failed'
+		return 1
+	elif [ ${PIPESTAT[1]} -ne 0 ] ; then
+		echo 'bamtofastq failed'
+		return 1
+	elif [ ${PIPESTAT[2]} -ne 0 ] ; then
+		echo 'cmp failed'
+		return 1
+	else
+		return 0
+	fi
+}
+
+# runoptscolthreads <input function> <options>
+# partitioned collation with small memory limits, so the partitions write several runs to disk.
+# The input function produces the pairs of many_fq, the order of the output pairs is not defined
+function runoptscolthreads
+{
+	INPUT=$1
+	shift
+	../src/fastqtobam $* <(${INPUT}) | ../src/bamtofastq colthreads=4 colmem=65536 | paste - - - - - - - - | sort | cmp <(many_fq | grep -v '^$' | paste - - - - - - - - | sort)
+
+	# copy pipe return status array
+	PIPESTAT=( ${PIPESTATUS[*]} )
+
+	if [ ${PIPESTAT[0]} -ne 0 ] ; then
+		echo 'fastqtobam failed'
+		return 1
+	elif [ ${PIPESTAT[1]} -ne 0 ] ; then
+		echo 'bamtofastq failed'
+		return 1
+	elif [ ${PIPESTAT[4]} -ne 0 ] ; then
+		echo 'cmp failed'
+		return 1
+	else
+		return 0
+	fi
+}
+
+# 5000 pairs with empty lines between some records
+function many_fq
+{
+	awk 'BEGIN {
+		for ( i = 0; i < 5000; ++i )
+		{
+			if ( i % 7 == 0 ) print ""
+			printf "@R%d/1\nACGTACGTAC\n+\nHGFEDCBAHG\n", i
+			if ( i % 11 == 0 ) print ""
+			printf "@R%d/2\nGTCAGTCAGT\n+\nGHGFEDCBAB\n", i
+		}
+	}'
+}
+
+# the pairs of many_fq with all first mates before all second mates
+function many_fq_far
+{
+	many_fq | grep -v '^$' | paste - - - - - - - - | cut -f 1-4 | tr '\t' '\n'
+	many_fq | grep -v '^$' | paste - - - - - - - - | cut -f 5-8 | tr '\t' '\n'
+}
+
+# chunked mode with small chunks, so the input is split into many packages for several threads
+function runoptschunkedmany
+{
+	../src/fastqtobam chunked=1 chunksize=512 threads=4 $* <(many_fq) | ../src/bamtofastq | cmp <(many_fq | grep -v '^$')
+
+	# copy pipe return status array
+	PIPESTAT=( ${PIPESTATUS[*]} )
+
+	if [ ${PIPESTAT[0]} -ne 0 ] ; then
+		echo 'fastqtobam failed'
+		return 1
+	elif [ ${PIPESTAT[1]} -ne 0 ] ; then
+		echo 'bamtofastq failed'
+		return 1
+	elif [ ${PIPESTAT[2]} -ne 0 ] ; then
+		echo 'cmp failed'
+		return 1
+	else
+		return 0
+	fi
+}
+
+# threaded output with small batches, so many batches cycle through several threads
+function runoptsgzthreadsmany
+{
+	../src/fastqtobam $* <(many_fq) | ../src/bamtofastq gz=1 outputthreads=4 outputbatchsize=4096 | zcat | cmp <(many_fq | grep -v '^$')
+
+	# copy pipe return status array
+	PIPESTAT=( ${PIPESTATUS[*]} )
+
+	if [ ${PIPESTAT[0]} -ne 0 ] ; then
+		echo 'fastqtobam failed'
+		return 1
+	elif [ ${PIPESTAT[1]} -ne 0 ] ; then
+		echo 'bamtofastq failed'
+		return 1
+	elif [ ${PIPESTAT[2]} -ne 0 ] ; then
+		echo 'zcat failed'
+		return 1
+	elif [ ${PIPESTAT[3]} -ne 0 ] ; then
+		echo 'cmp failed'
+		return 1
+	else
+		return 0
+	fi
+}
+
 
 #
 runopts ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
@@ -160,6 +275,15 @@ echo "This is expected to fail:"
 runopts namescheme=c18pe ; R=$? ; if [ ${R} -eq 0 ] ; then exit 1 ; fi
 runopts namescheme=pairedfiles ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
 
+runopts chunked=1 threads=2 ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+runopts chunked=1 threads=2 namescheme=pairedfiles ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+echo "This is expected to fail:"
+runopts chunked=1 threads=2 namescheme=c18s ; R=$? ; if [ ${R} -eq 0 ] ; then exit 1 ; fi
+runoptschunkedmany ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+runoptschunkedmany namescheme=pairedfiles ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+echo "This is expected to fail:"
+runoptschunkedmany namescheme=c18s ; R=$? ; if [ ${R} -eq 0 ] ; then exit 1 ; fi
+
 runopts2 ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
 runopts2 namescheme=generic ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
 echo "This is expected to fail:"
@@ -202,5 +326,16 @@ echo "This is expected to fail:"
 runoptsgz2 namescheme=c18pe ; R=$? ; if [ ${R} -eq 0 ] ; then exit 1 ; fi
 runoptsgz2 namescheme=pairedfiles ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
 
+# threaded output
+runoptsgzthreads ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+runoptsgzthreads namescheme=pairedfiles ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+runoptsgzthreadsmany ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+runoptsgzthreadsmany namescheme=pairedfiles ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+
+# partitioned collation
+runoptscolthreads many_fq ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+runoptscolthreads many_fq namescheme=pairedfiles ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+runoptscolthreads many_fq_far ; R=$? ; if [ ${R} -ne 0 ] ; then exit ${R} ; fi
+
 
 exit ${R}
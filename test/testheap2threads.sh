@@ -0,0 +1,41 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+source ${SCRIPTDIR}/threadruns.sh
+
+SRCDIR=`pwd`/../src
+threadrunsinit testheap2threads
+
+mkdir -p ${TMPDIR}/serial ${TMPDIR}/byref ${TMPDIR}/window
+matepairs > ${TMPDIR}/in.bam
+matepairsref > ${TMPDIR}/ref.fa
+matepairsreffai > ${TMPDIR}/ref.fa.fai
+runoutput ${TMPDIR}/in.bam.bai ${SRCDIR}/bamindex < ${TMPDIR}/in.bam || threadrunsfail
+
+# runheap2 <label> <options>, pileup goes to <label>/pileup.txt, consensus to <label>/cons_<refid>,
+# accuracy statistics to <label>/acc.txt
+function runheap2
+{
+	LABEL=$1
+	shift
+	${SRCDIR}/bamheap2 filename=${TMPDIR}/in.bam reference=${TMPDIR}/ref.fa outputprefix=${TMPDIR}/${LABEL}/cons verbose=0 $* \
+		> ${TMPDIR}/${LABEL}/pileup.txt 2> ${TMPDIR}/${LABEL}/acc.txt
+	if [ $? -ne 0 ] ; then echo "bamheap2 $* failed" ; cat ${TMPDIR}/${LABEL}/acc.txt ; return 1 ; fi
+	return 0
+}
+
+runheap2 serial || threadrunsfail
+runheap2 byref threads=3 byref=1 chunksize=500 || threadrunsfail
+runheap2 window threads=2 byref=0 windowsize=100 || threadrunsfail
+
+if [ ! -s ${TMPDIR}/serial/pileup.txt ] ; then threadrunsfail "bamheap2 produced no pileup" ; fi
+if [ ! -s ${TMPDIR}/serial/cons_chr1 ] ; then threadrunsfail "bamheap2 produced no consensus" ; fi
+compareoutput ${TMPDIR}/serial ${TMPDIR}/byref || threadrunsfail "bamheap2 threads=3 byref=1 output differs"
+compareoutput ${TMPDIR}/serial ${TMPDIR}/window || threadrunsfail "bamheap2 threads=2 byref=0 output differs"
+
+cleanup
+exit 0
@@ -0,0 +1,63 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+source ${SCRIPTDIR}/threadruns.sh
+
+threadrunsinit testindexthreads
+
+mkdir -p ${TMPDIR}/csi
+matepairs > ${TMPDIR}/in.bam
+
+runoutput ${TMPDIR}/serial.bai ../src/bamindex threads=1 < ${TMPDIR}/in.bam || threadrunsfail
+runoutput ${TMPDIR}/parallel.bai ../src/bamindex threads=4 < ${TMPDIR}/in.bam || threadrunsfail
+compareoutput ${TMPDIR}/serial.bai ${TMPDIR}/parallel.bai || threadrunsfail "bamindex threads=4 index differs from threads=1"
+
+# CSI index, the only index next to its BAM file
+cp ${TMPDIR}/in.bam ${TMPDIR}/csi/in.bam
+runoutput ${TMPDIR}/csi/in.bam.csi ../src/bamindex csi=1 threads=2 < ${TMPDIR}/csi/in.bam || threadrunsfail
+
+if [ "`gzip -dc < ${TMPDIR}/csi/in.bam.csi | head -c 4 | od -An -c | tr -d ' '`" != 'CSI001' ] ; then
+	threadrunsfail "bamindex csi=1 did not produce a CSI file"
+fi
+
+# names of the alignments overlapping region <refname> <from> <to> (1 based, inclusive)
+function samregion
+{
+	./bamtosam < ${TMPDIR}/in.bam | awk -F'\t' -v ref=$1 -v from=$2 -v to=$3 '
+		/^@/ { next }
+		$3 != ref || int($2/4)%2 == 1 { next }
+		{
+			end = $4-1
+			c = $6
+			while ( match(c,/^[0-9]+[MIDNSHP=X]/) )
+			{
+				n = substr(c,1,RLENGTH-1)+0
+				op = substr(c,RLENGTH,1)
+				c = substr(c,RLENGTH+1)
+				if ( op == "M" || op == "=" || op == "X" || op == "D" || op == "N" )
+					end += n
+			}
+			if ( $4 <= to && end >= from )
+				print $1 "\t" $2 "\t" $4
+		}'
+}
+
+# read the CSI index back through a region query (needs samtools)
+if which samtools > /dev/null 2>&1 ; then
+	for REGION in "chr1 1 300" "chr1 950 1210" "chr2 400 1500" ; do
+		set -- ${REGION}
+		samtools view ${TMPDIR}/csi/in.bam "$1:$2-$3" | cut -f 1,2,4 > ${TMPDIR}/query.txt
+		if [ ${PIPESTATUS[0]} -ne 0 ] ; then threadrunsfail "region query $1:$2-$3 on CSI index failed" ; fi
+		samregion $1 $2 $3 > ${TMPDIR}/expected.txt
+		compareoutput ${TMPDIR}/expected.txt ${TMPDIR}/query.txt || threadrunsfail "region query $1:$2-$3 on CSI index differs"
+	done
+else
+	echo "samtools not found, not reading back the CSI index"
+fi
+
+cleanup
+exit 0
@@ -0,0 +1,77 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+source ${SCRIPTDIR}/threadruns.sh
+
+threadrunsinit testlastfilter
+
+# name sorted alignments with AS tags. rnd* are random groups of up to four alignments of 50 bases
+# (some with an unmapped record), sel0 has two alignments on chr1 covering disjoint parts of
+# the read (10M40S at 101 with AS 8 and 10S40M at 501 with AS 40), sel1 has an unmapped record
+# before its mapped alignment (50M at 201)
+function lastalignments
+{
+cat <<EOF | base64 ${BASE64DEC}
+H4sIBAAAAAAA/wYAQkMCAFwGxZtPaFxFHMdn3nub3Y2txhj/tIi2JWoPUt6f3ewmVEjMHirWNCWh
+CAWNuIEiNcR0lQpCF5qToPYQFQSx4oJ4EIrGW8GCW1QQiRjEQw85xIuopLBn6/zmvRlycPk+YX72
+wcLu5rHzeTO/P9/fbyZPTj0jJ4UQk8ca5VMzE9GRSnnuxMQrry6uvL70wsuLg5NzJ8tzMxMvnlmJ
+ysdnJuIwDHd9F9N3UVV956nfKKgX3Sg2ivZDLG6odxdEen0TCFE6+tQw3R2r163sor+tLDXVj4di
+lP4ohRjudz30n6+puem9F9NfFUMZgq8+9kOoKIRr6nNFuMYYNBiHJMZoEq5CWXeOMWAwygWM0RXp
+zU3JgkFXuWgx+thFpBdjWb1WPdcYnpmNMwHCiMWmunGDMAQLBl37oYnGIlAYO2SizhelYDCOFzDG
+qBp+Ur26zmfDNxiP5ZiNhkIIJYenlM7tGrIkjg0LEfS1DYdDG5M87SOTTMS2unFIcoQr3wTul4o2
+cMt+GAcUQuCxecW3A8gOErEq0xjh3isGLmQL8puPUlhFtNX7jsfmEZ9Cx6yIlkjD1LZki5YPC4wx
+r9631c3zzjHuNLNx2EMeUhUdNfwV9XmTL6H/BWejqnPGDkuY2mtm45RAszGmh99SGGuCJXfQbNwD
+Z2NMLwbJm4ZzjPvMbHwGE3pND39ZvRrOHTbInztqHLnjNYmevq6fmiJmS7CJuzdh4K5rU6Q4MeI8
+TowYjC8CjNFSs9FmEf4lg/E8TOjjOo2Rqmryacx9cDbG9fAUNUc8No35MzLRKNTh6hJLKisZefOE
+B+RNlBaFO84XJDC64tkcCJTG2s5n4W4TL/6GixFpByWh13NvmrmjpcJgiJZTBfT0sU7glLLcZ86y
+8YgffOCYCmNeIcyy1KBWY14VGIPiwhZLtLT9ibeQuIvS8meZRdx5xjlPCyD6o4roqhsXJJuiehdJ
+mSiVubMs5Y80GCVonlWdRUlRjbhX2/ljRJUjRnwk8NM3M3N0X/IUDUYHesWYbhBRqHK/CPtMjLgJ
+MWqiJ9Pk3RFsGuJRJGUURjdrELkPVTZ7/p4DY1ukjeVV57Zxh5mNX32MMZKp7TX3cSK/g7KUPB9A
+CVPXnkGytiVvX8GnMBw/PV0femjt69oTqLYYFWxbLJ9LjEEeQJ6wzSNhCOMWzJjjOjyRqG/wFHyE
+IVG3TmFsZo2hJl94uu5jjE4Wnrp8MuY8yhlxqGuMZcmRM+41GKsoTsSRVtdbLHsb0jjsIKo54lh3
+ZiiRu5+NB2xPAnVoFAYVfBu8PYn3c2CQo9Jex6ZzEx0ytrEfdWjiRIctkrgdybblsiRBQ0Bh8OyV
+217VIyhmKAQqAjdYIqjNJyeDHBgyNU/3GPcbjK+gXVR0k2iLpfSx7dR1lF0VxmbWuevcRomjMBgE
+3tMBfnq+XcCiWYTvPYzRyE4KuO9pl02M+FqCvkRc1RInlGyNomm4IFVtsgssM2ExDubAoIQeehx7
+HYeMeT4HE/qYjhFUErvPpNY8j8DZ4MSwvcyLPsagXuYCywaU1ZwHJcZoZRjzfBh1tDUb1/T5iVmW
+XqbFuAnTWF076jWWHpafP3/UOfLHCWiSda20yTN6fPnjzxwYo5mWGBVsRziSAGPMZzs+7g8t2J7V
+T7AaG9ezQMK/x9fbXkMYScgYruyexy+oyawwmpmDBnziX/oYg8T/FZYcYm3jKOriJJH2lB0W1R0Y
+jBsoh2QYPA67J3fUTGKOxuKD6HyuGrab1RzrkmURyDPehouQHgVtSzZ1RRh/oESeJPpczWWWstiq
+qy6ME4m+h3pYq3xa8+wAxqAcMivZNqz1+YkAY5BNCI+jo2cX5WOYQyr/x4H6T+BsVLTMWWY5c5X/
+KEfC0iS4iiRuUtW2cElyNAnsydRpiDHGKGvuMhjDaAMiSc9iXmM5EmrbZ+9IjNGS6c3rfO2z9zyM
+QbYx67EeinwcZtSadtAtln0Qq6560DZqWmNusBSDe8z5mpYPet0Kg6fXbVX3jzCpp6UQCbyeYKtB
+vkT7Y8m43nygk0bu906Lb2R2QR5Q6NNYPLd4NtTaxv1/YpXM+BQOC30MQo9PPtF2Pv7h5V1jFfok
+LjW+0wOI57Nn/i6bc/nvcx6JA77r543/AcXyI/n/OQAAH4sIBAAAAAAA/wYAQkMCABsAAwAAAAAA
+AAAAAA==
+EOF
+}
+
+lastalignments > ${TMPDIR}/in.bam
+
+# selected alignments of the sel reads as name, flag, reference and position
+function selected
+{
+	./bamtosam < $1 | grep '^sel' | cut -f 1-4
+}
+
+# cluster picks both alignments of sel0 by normalised score, each alignment once; the second one
+# is marked as supplementary. Chain keeps only the better scoring alignment as the two are too
+# far apart to be linked. The unmapped record of sel1 does not hide its mapped alignment.
+printf "sel0\t256\tchr1\t501\nsel0\t2048\tchr1\t101\nsel1\t0\tchr1\t201\n" > ${TMPDIR}/expected_cluster.txt
+printf "sel0\t256\tchr1\t501\nsel1\t0\tchr1\t201\n" > ${TMPDIR}/expected_chain.txt
+
+for LINKTYPE in cluster chain ; do
+	../src/bamlastfilter linktype=${LINKTYPE} threads=1 < ${TMPDIR}/in.bam > ${TMPDIR}/serial_${LINKTYPE}.bam 2> /dev/null || threadrunsfail "bamlastfilter linktype=${LINKTYPE} failed"
+	selected ${TMPDIR}/serial_${LINKTYPE}.bam > ${TMPDIR}/selected_${LINKTYPE}.txt
+	compareoutput ${TMPDIR}/expected_${LINKTYPE}.txt ${TMPDIR}/selected_${LINKTYPE}.txt || threadrunsfail "bamlastfilter linktype=${LINKTYPE} selected unexpected alignments"
+
+	# small batches so the groups are spread over several batches and threads
+	../src/bamlastfilter linktype=${LINKTYPE} threads=4 batchsize=3 < ${TMPDIR}/in.bam > ${TMPDIR}/threads_${LINKTYPE}.bam 2> /dev/null || threadrunsfail "bamlastfilter linktype=${LINKTYPE} threads=4 failed"
+	compareoutput ${TMPDIR}/serial_${LINKTYPE}.bam ${TMPDIR}/threads_${LINKTYPE}.bam || threadrunsfail "bamlastfilter linktype=${LINKTYPE} threads=4 output differs from threads=1"
+done
+
+cleanup
+exit 0
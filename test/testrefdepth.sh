@@ -0,0 +1,92 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+
+TMPPREFIX=testrefdepth_$$
+
+function cleanup
+{
+	rm -f ${TMPPREFIX}_*
+}
+
+# single end alignments with deletions, ref skips, clipping and padding before the first match
+function leadingdeletions
+{
+cat <<EOF | base64 ${BASE64DEC}
+H4sIBAAAAAAA/wYAQkMCAOIAc3L0ZdRlYGBw8HDhDPOzMtQz4Qz2t0rOzy9KycxLLEnlcggO5Az2
+s0rOKDLk9AEqMDAw4GIEamAFYpAgwwtmBgZrBghIAWIWG08hJiDNBcT/oQAkl5NiwKAEpBcAsSAI
+yMGBOZp2RqzaDbFpdYZqzYBqZcGq1YjBGEgHALESlEYzxgZqTBbUGKCfGDgwjDFmUAXSQkDcADUC
+pt8Vqj8PST8fhn4TBhcgrYwcCMiOAAEnqEEFSP7hxDDIlEEM6hdDIE6AGiYANwUAW6aUOtYBAAAf
+iwgEAAAAAAD/BgBCQwIAGwADAAAAAAAAAAAA
+EOF
+}
+
+# depth per covered position computed from the SAM representation
+function samdepth
+{
+	./bamtosam | awk -F'\t' '
+		/^@/ { next }
+		int($2/4)%2 == 1 { next }
+		{
+			pos = $4-1
+			c = $6
+			aligned = 0
+			while ( match(c,/^[0-9]+[MIDNSHP=X]/) )
+			{
+				n = substr(c,1,RLENGTH-1)+0
+				op = substr(c,RLENGTH,1)
+				c = substr(c,RLENGTH+1)
+				if ( op == "M" || op == "=" || op == "X" )
+				{
+					for ( i = 0; i < n; ++i )
+						D[$3 "\t" (pos+i)]++
+					pos += n
+					aligned = 1
+				}
+				# deletions and ref skips before the first match do not move the start
+				else if ( (op == "D" || op == "N") && aligned )
+					pos += n
+			}
+		}
+		END { for ( k in D ) print k "\t" D[k] }' | sort -k1,1 -k2,2n
+}
+
+# expand bedGraph runs to one line per position
+function bedgraphdepth
+{
+	awk -F'\t' '{ for ( i = $2; i < $3; ++i ) print $1 "\t" i "\t" $4 }'
+}
+
+matepairs | samdepth > ${TMPPREFIX}_expected.txt
+if [ ! -s ${TMPPREFIX}_expected.txt ] ; then echo "failed to compute expected depth" ; cleanup ; exit 1 ; fi
+
+matepairs | ../src/bamrefdepth > ${TMPPREFIX}_default.txt
+if [ ${PIPESTATUS[1]} -ne 0 ] ; then echo "bamrefdepth failed" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_expected.txt ${TMPPREFIX}_default.txt ; then echo "bamrefdepth output differs from expected depth" ; cleanup ; exit 1 ; fi
+
+matepairs | ../src/bamrefdepth bedgraph=1 | bedgraphdepth > ${TMPPREFIX}_bedgraph.txt
+if [ ${PIPESTATUS[1]} -ne 0 ] ; then echo "bamrefdepth bedgraph=1 failed" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_default.txt ${TMPPREFIX}_bedgraph.txt ; then echo "bamrefdepth bedgraph=1 output differs" ; cleanup ; exit 1 ; fi
+
+matepairs | ../src/bamrefdepth gz=1 ioblocksize=7 | gzip -dc > ${TMPPREFIX}_gz.txt
+if [ ${PIPESTATUS[1]} -ne 0 ] ; then echo "bamrefdepth gz=1 failed" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_default.txt ${TMPPREFIX}_gz.txt ; then echo "bamrefdepth gz=1 output differs" ; cleanup ; exit 1 ; fi
+
+# ld0 (2D10M) and ld1 (10M) both start at position 100
+leadingdeletions | samdepth > ${TMPPREFIX}_leadingexpected.txt
+if [ "`awk -F'\t' '$2 == 100 { print $3 }' ${TMPPREFIX}_leadingexpected.txt`" != "2" ] ; then echo "unexpected depth for leading deletions" ; cleanup ; exit 1 ; fi
+
+leadingdeletions | ../src/bamrefdepth > ${TMPPREFIX}_leading.txt
+if [ ${PIPESTATUS[1]} -ne 0 ] ; then echo "bamrefdepth failed on leading deletions" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_leadingexpected.txt ${TMPPREFIX}_leading.txt ; then echo "bamrefdepth output for leading deletions differs from expected depth" ; cleanup ; exit 1 ; fi
+
+leadingdeletions | ../src/bamrefdepth bedgraph=1 | bedgraphdepth > ${TMPPREFIX}_leadingbedgraph.txt
+if [ ${PIPESTATUS[1]} -ne 0 ] ; then echo "bamrefdepth bedgraph=1 failed on leading deletions" ; cleanup ; exit 1 ; fi
+if ! cmp ${TMPPREFIX}_leading.txt ${TMPPREFIX}_leadingbedgraph.txt ; then echo "bamrefdepth bedgraph=1 output for leading deletions differs" ; cleanup ; exit 1 ; fi
+
+cleanup
+exit 0
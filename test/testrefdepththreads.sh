@@ -0,0 +1,44 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+source ${SCRIPTDIR}/threadruns.sh
+
+SRCDIR=`pwd`/../src
+threadrunsinit testrefdepththreads
+
+mkdir -p ${TMPDIR}/serial ${TMPDIR}/parallel
+matepairs > ${TMPDIR}/in.bam
+runoutput ${TMPDIR}/in.bam.bai ${SRCDIR}/bamindex < ${TMPDIR}/in.bam || threadrunsfail
+
+runoutput ${TMPDIR}/serial.txt ${SRCDIR}/bamrefdepth filename=${TMPDIR}/in.bam || threadrunsfail
+runoutput ${TMPDIR}/chunked.txt ${SRCDIR}/bamrefdepth filename=${TMPDIR}/in.bam threads=2 chunksize=500 || threadrunsfail
+runoutput ${TMPDIR}/whole.txt ${SRCDIR}/bamrefdepth filename=${TMPDIR}/in.bam threads=3 chunksize=0 || threadrunsfail
+runoutput ${TMPDIR}/bedgraphserial.txt ${SRCDIR}/bamrefdepth filename=${TMPDIR}/in.bam bedgraph=1 || threadrunsfail
+runoutput ${TMPDIR}/bedgraphparallel.txt ${SRCDIR}/bamrefdepth filename=${TMPDIR}/in.bam bedgraph=1 threads=2 chunksize=500 || threadrunsfail
+
+compareoutput ${TMPDIR}/serial.txt ${TMPDIR}/chunked.txt || threadrunsfail "bamrefdepth threads=2 chunksize=500 output differs"
+compareoutput ${TMPDIR}/serial.txt ${TMPDIR}/whole.txt || threadrunsfail "bamrefdepth threads=3 chunksize=0 output differs"
+compareoutput ${TMPDIR}/bedgraphserial.txt ${TMPDIR}/bedgraphparallel.txt || threadrunsfail "bamrefdepth bedgraph=1 threads=2 output differs"
+
+# bamrefdepthpeaks writes plot files to the current directory
+pushd ${TMPDIR}/serial
+runoutput /dev/null ${SRCDIR}/bamrefdepthpeaks filename=../in.bam 2> /dev/null
+R=$?
+popd
+if [ ${R} -ne 0 ] ; then threadrunsfail ; fi
+
+pushd ${TMPDIR}/parallel
+runoutput /dev/null ${SRCDIR}/bamrefdepthpeaks filename=../in.bam threads=2 2> /dev/null
+R=$?
+popd
+if [ ${R} -ne 0 ] ; then threadrunsfail ; fi
+
+if [ ! -s ${TMPDIR}/serial/plot_chr1.gpl ] ; then threadrunsfail "bamrefdepthpeaks produced no plot file" ; fi
+compareoutput ${TMPDIR}/serial ${TMPDIR}/parallel || threadrunsfail "bamrefdepthpeaks threads=2 output differs"
+
+cleanup
+exit 0
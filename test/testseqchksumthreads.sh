@@ -0,0 +1,19 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+source ${SCRIPTDIR}/threadruns.sh
+
+threadrunsinit testseqchksumthreads
+
+for OPTS in "" "hash=md5" ; do
+	matepairs | runoutput ${TMPDIR}/serial.txt ../src/bamseqchksum threads=1 ${OPTS} || threadrunsfail
+	matepairs | runoutput ${TMPDIR}/parallel.txt ../src/bamseqchksum threads=2 batchsize=1024 ${OPTS} || threadrunsfail
+	compareoutput ${TMPDIR}/serial.txt ${TMPDIR}/parallel.txt || threadrunsfail "bamseqchksum threads=2 ${OPTS} differs from threads=1"
+done
+
+cleanup
+exit 0
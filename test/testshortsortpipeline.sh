@@ -0,0 +1,55 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/sorttestshort.sh
+source ${SCRIPTDIR}/matepairs.sh
+
+TMPPREFIX=testshortsortpipeline_$$
+
+function cleanup
+{
+	rm -f ${TMPPREFIX}_*
+}
+
+sorttestshort | ../src/bamsort fixmates=1 pipeline=1 pipelinebatchsize=16 sortthreads=2 | ../src/bamchecksort
+
+# copy pipe return status array
+PIPESTAT=( ${PIPESTATUS[*]} )
+
+if [ ${PIPESTAT[1]} -ne 0 ] ; then
+	echo 'bamsort failed'
+	exit 1
+elif [ ${PIPESTAT[2]} -ne 0 ] ; then
+	echo 'bamchecksort failed'
+	exit 1
+fi
+
+# name collated input with pairs for fixing mate information
+matepairs | ../src/bamsort SO=queryname > ${TMPPREFIX}_in.bam
+PIPESTAT=( ${PIPESTATUS[*]} )
+if [ ${PIPESTAT[1]} -ne 0 ] ; then echo 'bamsort SO=queryname failed' ; cleanup ; exit 1 ; fi
+
+for pipeline in 0 1 ; do
+	../src/bamsort fixmates=1 adddupmarksupport=1 pipeline=${pipeline} pipelinebatchsize=16 sortthreads=2 \
+		< ${TMPPREFIX}_in.bam > ${TMPPREFIX}_out_${pipeline}.bam
+	if [ $? -ne 0 ] ; then echo "bamsort fixmates=1 pipeline=${pipeline} failed" ; cleanup ; exit 1 ; fi
+done
+
+# the mate fields MC and MS must have been added
+if [ `./bamtosam < ${TMPPREFIX}_out_1.bam | grep -c 'MC:Z:'` -eq 0 ] ; then
+	echo 'bamsort fixmates=1 pipeline=1 did not add MC fields'
+	cleanup
+	exit 1
+fi
+
+if ! cmp ${TMPPREFIX}_out_0.bam ${TMPPREFIX}_out_1.bam ; then
+	echo 'bamsort fixmates=1 pipeline=1 output differs from pipeline=0'
+	cleanup
+	exit 1
+fi
+
+cleanup
+exit 0
@@ -0,0 +1,69 @@
+#! /bin/bash
+SCRIPTDIR=`dirname "${BASH_SOURCE[0]}"`
+pushd ${SCRIPTDIR}
+SCRIPTDIR=`pwd`
+popd
+
+source ${SCRIPTDIR}/matepairs.sh
+source ${SCRIPTDIR}/threadruns.sh
+
+threadrunsinit testsplitthreads
+
+matepairs > ${TMPDIR}/in.bam
+
+# runsplit <label> <options>, output files are written to directory <label>
+function runsplit
+{
+	LABEL=$1
+	shift
+	mkdir -p ${TMPDIR}/${LABEL}
+	../src/bamsplit n=16 md5=1 index=1 verbose=0 prefix=${TMPDIR}/${LABEL}/split $* < ${TMPDIR}/in.bam
+	if [ $? -ne 0 ] ; then echo "bamsplit $* failed" ; return 1 ; fi
+	return 0
+}
+
+# runexplode <label> <options>, output files are written to directory <label>
+function runexplode
+{
+	LABEL=$1
+	shift
+	mkdir -p ${TMPDIR}/${LABEL}
+	../src/bamexplode sizethres=0 md5=1 index=1 prefix=${TMPDIR}/${LABEL}/explode tmpfile=${TMPDIR}/${LABEL}_tmp $* < ${TMPDIR}/in.bam
+	if [ $? -ne 0 ] ; then echo "bamexplode $* failed" ; return 1 ; fi
+	return 0
+}
+
+# checkmd5 <label>, checks the md5 file of each BAM file in directory <label>
+function checkmd5
+{
+	for i in ${TMPDIR}/$1/*.bam ; do
+		if [ ! -f ${i}.md5 ] || [ ! -f ${i}.bai ] ; then echo "missing md5 or index file for ${i}" ; return 1 ; fi
+		if [ "`md5sum < ${i} | cut -c 1-32`" != "`head -c 32 ${i}.md5`" ] ; then echo "md5 file of ${i} is wrong" ; return 1 ; fi
+	done
+	return 0
+}
+
+runsplit splitserial outputthreads=1 || threadrunsfail
+runsplit splitthreads outputthreads=4 || threadrunsfail
+checkmd5 splitserial || threadrunsfail
+compareoutput ${TMPDIR}/splitserial ${TMPDIR}/splitthreads || threadrunsfail "bamsplit outputthreads=4 output differs from outputthreads=1"
+
+# the shards together hold all alignments of the input
+for i in ${TMPDIR}/splitserial/*.bam ; do ./bamtosam < ${i} | grep -v '^@' ; done > ${TMPDIR}/splitserial.sam
+./bamtosam < ${TMPDIR}/in.bam | grep -v '^@' > ${TMPDIR}/in.sam
+compareoutput ${TMPDIR}/in.sam ${TMPDIR}/splitserial.sam || threadrunsfail "bamsplit shards do not contain the input alignments"
+
+runexplode explodeserial outputthreads=1 || threadrunsfail
+runexplode explodethreads outputthreads=4 || threadrunsfail
+checkmd5 explodeserial || threadrunsfail
+compareoutput ${TMPDIR}/explodeserial ${TMPDIR}/explodethreads || threadrunsfail "bamexplode outputthreads=4 output differs from outputthreads=1"
+
+# the pool compresses using zlib, other levels are rejected before any output is written
+mkdir -p ${TMPDIR}/level
+if ../src/bamsplit level=11 outputthreads=4 verbose=0 prefix=${TMPDIR}/level/split < ${TMPDIR}/in.bam 2> /dev/null ; then
+	threadrunsfail "bamsplit level=11 did not fail"
+fi
+if [ -n "`ls -A ${TMPDIR}/level`" ] ; then threadrunsfail "bamsplit level=11 created output files" ; fi
+
+cleanup
+exit 0
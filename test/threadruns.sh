@@ -0,0 +1,52 @@
+#! /bin/bash
+#
+# helpers for tests comparing the output of multi-threaded runs against a serial run
+#
+
+# threadrunsinit <name>
+# creates the temporary directory TMPDIR=<name>_<pid>
+function threadrunsinit
+{
+	TMPDIR=$1_$$
+	mkdir -p ${TMPDIR}
+}
+
+function cleanup
+{
+	rm -fR ${TMPDIR}
+}
+
+# threadrunsfail <message>
+# prints the message, removes the temporary directory and exits
+function threadrunsfail
+{
+	if [ $# -gt 0 ] ; then echo "$*" ; fi
+	cleanup
+	exit 1
+}
+
+# runoutput <output file> <command> <arguments>
+# runs the command with its standard output redirected to the output file
+function runoutput
+{
+	OUTPUT=$1
+	shift
+	"$@" > ${OUTPUT}
+	if [ $? -ne 0 ] ; then echo "$* failed" ; return 1 ; fi
+	return 0
+}
+
+# compareoutput <serial output> <threaded output>
+# checks that the serial output (a file or a directory) is not empty and
+# equal to the output of the threaded run
+function compareoutput
+{
+	if [ -d $1 ] ; then
+		if [ -z "`ls -A $1`" ] ; then echo "$1 is empty" ; return 1 ; fi
+		if ! diff -r $1 $2 ; then echo "$2 differs from $1" ; return 1 ; fi
+	else
+		if [ ! -s $1 ] ; then echo "$1 is empty" ; return 1 ; fi
+		if ! cmp $1 $2 ; then echo "$2 differs from $1" ; return 1 ; fi
+	fi
+	return 0
+}